@@ -0,0 +1,2796 @@
+#include "Benchmark.h"
+#include "ColliderGrid.h"
+#include "DistanceField.h"
+#include "DynamicObstacles.h"
+#include "Creature.h"
+#include "FlockKernel.h"
+#include "KdTree.h"
+#include "MeshBvh.h"
+#include "Octree.h"
+#include "Parallel.h"
+#include "Philox.h"
+#include "Population.h"
+#include "Simulation.h"
+#include "SimulationThread.h"
+#include "SpatialGrid.h"
+#include "TripleBuffer.h"
+#include "UpdatePolicy.h"
+
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    const float BENCH_CUBE_SIZE = 20.0f;
+
+    // main.cpp と同じ配置のコライダー
+    std::vector<SphereCollider> benchColliders()
+    {
+        return {SphereCollider(glm::vec3(5.0f, -15.0f, 0.0f), 3.0f),
+                SphereCollider(glm::vec3(-10.0f, -18.0f, 3.0f), 3.0f)};
+    }
+
+    double elapsedMs(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // count 体を speciesCount 種族に均等に割り振って生成する (seed が同じなら毎回同じ群れになる)
+    void populate(Simulation &sim, int count, int speciesCount, std::uint64_t seed = DEFAULT_RANDOM_SEED)
+    {
+        FlockState &state = sim.population();
+        state.reserve(count);
+        for (int i = 0; i < count; ++i)
+        {
+            Creature::spawn(state, BENCH_CUBE_SIZE, i % speciesCount, seed);
+        }
+        sim.finalizePopulation();
+    }
+
+    // state の群れから始める、設定がすべて既定のシミュレーション
+    Simulation simulationFrom(const FlockState &state, float cubeSize = BENCH_CUBE_SIZE)
+    {
+        Simulation sim(cubeSize);
+        sim.population() = state;
+        sim.finalizePopulation();
+        return sim;
+    }
+
+    // 1ステップあたりの平均時間 (ms)
+    double timeSteps(Simulation &sim, int steps)
+    {
+        const std::vector<SphereCollider> colliders = benchColliders();
+        sim.step(colliders); // ウォームアップ
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < steps; ++i)
+        {
+            sim.step(colliders);
+        }
+        return elapsedMs(start) / steps;
+    }
+
+    // 種族数を増やしたときの、種族ごとのグリッドと共有グリッドの比較
+    bool benchSpecies()
+    {
+        const int count = 20000;
+        const int steps = 10;
+        std::printf("[species] %d boids, shared grid vs per-species grids\n", count);
+        std::printf("  species   shared(ms)  partitioned(ms)  speedup\n");
+        for (int speciesCount : {1, 2, 4, 8, 16})
+        {
+            Simulation sim(BENCH_CUBE_SIZE);
+            populate(sim, count, speciesCount);
+
+            sim.partitionBySpecies = false;
+            double shared = timeSteps(sim, steps);
+            sim.partitionBySpecies = true;
+            double partitioned = timeSteps(sim, steps);
+
+            std::printf("  %7d   %10.2f  %15.2f  %6.2fx\n", speciesCount, shared, partitioned, shared / partitioned);
+        }
+        return true;
+    }
+
+    float maxAbsDiff(const glm::vec3 &a, const glm::vec3 &b)
+    {
+        glm::vec3 d = glm::abs(a - b);
+        return std::max(d.x, std::max(d.y, d.z));
+    }
+
+    // 命令セットごとのカーネルがスカラー版と同じ結果を返すかの確認と、カーネル単体の速度比較
+    bool benchSimd()
+    {
+        const int count = 4096;
+        const float radiusSq = FLOCK_RADIUS * FLOCK_RADIUS;
+        const float tolerance = 1e-4f;
+
+        // 2種族が混ざった、重なりを含む候補列 (区間の端数処理も確かめるため長さを変えて試す)
+        FlockState state;
+        for (int i = 0; i < count; ++i)
+        {
+            Creature::spawn(state, 6.0f, i % 2);
+        }
+        state.setPosition(7, state.position(3)); // 距離 0 の候補 (除外されるべき)
+        const NeighborArrays arrays = state.neighborArrays();
+        const FlockKernelSet &reference = scalarKernels();
+
+        bool allOk = true;
+        std::printf("[simd] kernels vs scalar reference (tolerance %.0e)\n", tolerance);
+        std::printf("  kernel    neighbors(ns/candidate)  integrate(ns/boid)  max error  result\n");
+        for (const FlockKernelSet *kernels : availableKernels())
+        {
+            // 近傍の合計
+            float worst = 0.0f;
+            int countMismatches = 0;
+            for (int q = 0; q < 256; ++q)
+            {
+                const std::size_t begin = q % 13;
+                const std::size_t end = count - (q * 7) % 29;
+                const glm::vec3 position = state.position(q);
+                const int species = state.speciesID[q];
+
+                NeighborSums expected, actual;
+                reference.accumulateNeighbors(arrays, begin, end, position, species, radiusSq, expected);
+                kernels->accumulateNeighbors(arrays, begin, end, position, species, radiusSq, actual);
+
+                if (expected.count != actual.count)
+                    countMismatches++;
+                // 合計値の大きさに対する相対誤差で比べる (加算順が違うので完全一致はしない)
+                float scale = 1.0f + std::max(glm::length(expected.separation),
+                                              std::max(glm::length(expected.alignment), glm::length(expected.cohesion)));
+                worst = std::max(worst, maxAbsDiff(expected.separation, actual.separation) / scale);
+                worst = std::max(worst, maxAbsDiff(expected.alignment, actual.alignment) / scale);
+                worst = std::max(worst, maxAbsDiff(expected.cohesion, actual.cohesion) / scale);
+            }
+
+            // 移動と反射 (箱を小さくして、多くの個体が壁に当たるようにする)
+            FlockState expectedState = state;
+            FlockState actualState = state;
+            reference.integrate(expectedState.boidArrays(), 0, count, 3.0f);
+            kernels->integrate(actualState.boidArrays(), 0, count, 3.0f);
+            for (int i = 0; i < count; ++i)
+            {
+                worst = std::max(worst, maxAbsDiff(expectedState.position(i), actualState.position(i)));
+                worst = std::max(worst, maxAbsDiff(expectedState.direction(i), actualState.direction(i)));
+            }
+
+            bool ok = countMismatches == 0 && worst < tolerance;
+            allOk = allOk && ok;
+
+            // 速度: 候補 count 個に対する近傍の合計と、count 体の移動
+            const int repeats = 2000;
+            volatile float sink = 0.0f; // 最適化で計算が消されないように
+            auto start = std::chrono::steady_clock::now();
+            for (int r = 0; r < repeats; ++r)
+            {
+                NeighborSums sums;
+                kernels->accumulateNeighbors(arrays, 0, count, state.position(r % count), state.speciesID[r % count], radiusSq, sums);
+                sink = sink + sums.separation.x;
+            }
+            double neighborNs = elapsedMs(start) * 1e6 / (double(repeats) * count);
+
+            FlockState moving = state;
+            start = std::chrono::steady_clock::now();
+            for (int r = 0; r < repeats; ++r)
+            {
+                kernels->integrate(moving.boidArrays(), 0, count, 3.0f);
+            }
+            double integrateNs = elapsedMs(start) * 1e6 / (double(repeats) * count);
+
+            std::printf("  %-8s  %23.2f  %18.2f  %9.2e  %s\n", kernels->name, neighborNs, integrateNs, worst,
+                        ok ? "OK" : (countMismatches ? "FAILED (neighbor count)" : "FAILED"));
+        }
+        return allOk;
+    }
+
+    // グリッド構築でセル順に読み出すとき、直前と違うキャッシュライン (float 16個) に移る割合
+    // 各配列のキャッシュミスの目安 (1.0 ならほぼ毎回ミス、小さいほど連続して読めている)
+    double gatherLineSwitches(const FlockState &state)
+    {
+        SpatialGrid grid(BENCH_CUBE_SIZE, FLOCK_RADIUS);
+        grid.build(state);
+        const std::vector<int> &indices = grid.getSortedIndices();
+        std::size_t switches = 0;
+        for (std::size_t k = 1; k < indices.size(); ++k)
+        {
+            if (indices[k] / 16 != indices[k - 1] / 16)
+                switches++;
+        }
+        return indices.size() > 1 ? double(switches) / (indices.size() - 1) : 0.0;
+    }
+
+    // Morton コード順の並べ替えの有無による、メモリアクセスの局所性とステップ時間の比較
+    bool benchReorder()
+    {
+        const int count = 50000;
+        const int warmup = 100;
+        const int steps = 20;
+        std::printf("[reorder] %d boids, %d steps after %d warm-up steps\n", count, steps, warmup);
+        std::printf("  mode            line switches/boid  step(ms)  reorder(ms)\n");
+        for (int interval : {0, 64, 8})
+        {
+            Simulation sim(BENCH_CUBE_SIZE);
+            sim.reorderInterval = interval;
+            populate(sim, count, 3);
+            // 初期状態は生成順 (空間的にはランダム) なので、しばらく動かしてから測る
+            const std::vector<SphereCollider> colliders = benchColliders();
+            for (int i = 0; i < warmup; ++i)
+            {
+                sim.step(colliders);
+            }
+            double switches = gatherLineSwitches(sim.state());
+            double stepMs = timeSteps(sim, steps);
+            char mode[32];
+            std::snprintf(mode, sizeof(mode), interval ? "every %d steps" : "off", interval);
+            std::printf("  %-14s  %18.3f  %8.2f  %11.2f\n", mode, switches, stepMs, sim.getLastReorderMs());
+        }
+        return true;
+    }
+
+    // グリッド構築 (カウンティングソート) の1スレッドと全スレッドの比較
+    // 並べた結果がスレッド数によらず一致することも確かめる
+    bool benchGrid()
+    {
+        const int maxThreads = parallel::threadCount();
+        const int builds = 20;
+        bool ok = true;
+        std::printf("[grid] cell-list build, 1 thread vs %d threads\n", maxThreads);
+        std::printf("  boids     1 thread(ms)  %2d threads(ms)  speedup  step build/steering(ms)\n", maxThreads);
+        for (int count : {10000, 100000, 1000000})
+        {
+            Simulation sim(BENCH_CUBE_SIZE);
+            populate(sim, count, 1);
+            const FlockState &state = sim.state();
+
+            SpatialGrid serialGrid(BENCH_CUBE_SIZE, FLOCK_RADIUS);
+            SpatialGrid parallelGrid(BENCH_CUBE_SIZE, FLOCK_RADIUS);
+
+            parallel::setThreadCount(1);
+            serialGrid.build(state); // ウォームアップ (作業用配列の確保)
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < builds; ++i)
+            {
+                serialGrid.build(state);
+            }
+            double serialMs = elapsedMs(start) / builds;
+
+            parallel::setThreadCount(maxThreads);
+            parallelGrid.build(state);
+            start = std::chrono::steady_clock::now();
+            for (int i = 0; i < builds; ++i)
+            {
+                parallelGrid.build(state);
+            }
+            double parallelMs = elapsedMs(start) / builds;
+
+            if (serialGrid.getSortedIndices() != parallelGrid.getSortedIndices())
+            {
+                std::printf("  FAIL: %d boids, parallel build differs from serial build\n", count);
+                ok = false;
+            }
+
+            std::printf("  %7d  %12.3f  %14.3f  %6.2fx", count, serialMs, parallelMs, serialMs / parallelMs);
+            // 1ステップの内訳 (100 万体の操舵は時間がかかりすぎるので省く)
+            if (count <= 100000)
+            {
+                sim.step(benchColliders());
+                const StepTimings &t = sim.getLastTimings();
+                std::printf("  %8.3f / %.3f", t.gridBuildMs, t.steeringMs);
+            }
+            std::printf("\n");
+        }
+        return ok;
+    }
+
+    // Verlet 近傍リストの skin ごとの作り直し回数と、構築コストを均した1ステップの時間
+    // 使い回しているステップの結果が、グリッドを毎回組んだ場合と一致することも確かめる
+    bool benchVerlet()
+    {
+        const int count = 20000;
+        const int warmup = 20;
+        const int steps = 100;
+        const float tolerance = 1e-4f;
+        const std::vector<SphereCollider> colliders = benchColliders();
+
+        // 近傍リストを使い回したステップと、毎回グリッドから探したステップの比較
+        Simulation withLists(BENCH_CUBE_SIZE);
+        withLists.useNeighborLists = true;
+        populate(withLists, count, 3);
+        for (int i = 0; i < warmup; ++i)
+        {
+            withLists.step(colliders);
+        }
+        Simulation withoutLists = simulationFrom(withLists.state());
+        withoutLists.useNeighborLists = false;
+        const int rebuildsBefore = withLists.getNeighborListRebuilds();
+        withLists.step(colliders);
+        withoutLists.step(colliders);
+        float worst = 0.0f;
+        for (int i = 0; i < count; ++i)
+        {
+            worst = std::max(worst, maxAbsDiff(withLists.state().position(i), withoutLists.state().position(i)));
+            worst = std::max(worst, maxAbsDiff(withLists.state().direction(i), withoutLists.state().direction(i)));
+        }
+        const bool reused = withLists.getNeighborListRebuilds() == rebuildsBefore;
+        const bool ok = worst < tolerance;
+        std::printf("[verlet] %d boids, reused list vs per-step grid: max error %.2e (%s)%s\n", count, worst,
+                    ok ? "ok" : "FAIL", reused ? "" : " [list was rebuilt on the compared step]");
+
+        std::printf("  skin   step(ms)  rebuilds/%d steps  build amortized(ms)  candidates/boid\n", steps);
+        for (float skin : {0.0f, 0.25f, 0.5f, 1.0f, 2.0f})
+        {
+            Simulation sim(BENCH_CUBE_SIZE);
+            sim.useNeighborLists = skin > 0.0f;
+            sim.neighborSkin = skin;
+            populate(sim, count, 3);
+            for (int i = 0; i < warmup; ++i)
+            {
+                sim.step(colliders);
+            }
+            const int rebuildsBefore = sim.getNeighborListRebuilds();
+            double stepMs = timeSteps(sim, steps);
+            if (skin > 0.0f)
+            {
+                std::printf("  %4.2f  %8.2f  %18d  %19.3f  %15.1f\n", skin, stepMs,
+                            sim.getNeighborListRebuilds() - rebuildsBefore, sim.getNeighborListAmortizedMs(),
+                            double(sim.getNeighborList().totalNeighbors()) / count);
+            }
+            else
+            {
+                std::printf("  off   %8.2f  %18s  %19.3f  %15s\n", stepMs, "-", sim.getLastTimings().gridBuildMs, "-");
+            }
+        }
+        return ok;
+    }
+
+    // 群れが少数の塊に集まった状態を作る (塊の中心は箱の中にランダムに置く)
+    void clusterPositions(FlockState &state, int clusterCount, float sigma)
+    {
+        std::mt19937 rng(12345);
+        std::uniform_real_distribution<float> center(-0.7f * BENCH_CUBE_SIZE, 0.7f * BENCH_CUBE_SIZE);
+        std::normal_distribution<float> offset(0.0f, sigma);
+        std::vector<glm::vec3> centers(clusterCount);
+        for (glm::vec3 &c : centers)
+        {
+            c = glm::vec3(center(rng), center(rng), center(rng));
+        }
+        for (std::size_t i = 0; i < state.size(); ++i)
+        {
+            const glm::vec3 &c = centers[rng() % clusterCount];
+            state.setPosition(i, c + glm::vec3(offset(rng), offset(rng), offset(rng)));
+        }
+    }
+
+    // 近傍探索の方法ごとの比較 (一様な分布と、少数の塊に集まった分布)
+    // どの方法でも総当たりと同じ結果になることも確かめる
+    bool benchOctree()
+    {
+        const int count = 20000;
+        const int steps = 5;
+        const float tolerance = 1e-4f;
+        const std::vector<SphereCollider> colliders = benchColliders();
+        bool allOk = true;
+        std::printf("[octree] %d boids, 3 species\n", count);
+        std::printf("  distribution  backend        step(ms)  build(ms)  max error  result\n");
+        for (int clustered = 0; clustered < 2; ++clustered)
+        {
+            Simulation base(BENCH_CUBE_SIZE);
+            populate(base, count, 3);
+            if (clustered)
+            {
+                clusterPositions(base.population(), 6, 1.5f);
+            }
+
+            // 同じ状態から総当たりで1ステップ進めた結果を基準にする
+            Simulation reference = simulationFrom(base.state());
+            reference.neighborBackend = NeighborBackend::BruteForce;
+            reference.step(colliders);
+
+            for (NeighborBackend backend : {NeighborBackend::BruteForce, NeighborBackend::Grid, NeighborBackend::Octree})
+            {
+                Simulation sim = simulationFrom(base.state());
+                sim.neighborBackend = backend;
+                sim.step(colliders);
+                float worst = 0.0f;
+                for (int i = 0; i < count; ++i)
+                {
+                    worst = std::max(worst, maxAbsDiff(sim.state().position(i), reference.state().position(i)));
+                    worst = std::max(worst, maxAbsDiff(sim.state().direction(i), reference.state().direction(i)));
+                }
+                const bool ok = worst < tolerance;
+                allOk = allOk && ok;
+
+                double buildMs = 0.0;
+                auto start = std::chrono::steady_clock::now();
+                for (int i = 0; i < steps; ++i)
+                {
+                    sim.step(colliders);
+                    buildMs += sim.getLastTimings().gridBuildMs;
+                }
+                const double stepMs = elapsedMs(start) / steps;
+                std::printf("  %-12s  %-12s  %8.2f  %9.3f  %9.2e  %s\n", clustered ? "clustered" : "uniform",
+                            neighborBackendName(backend), stepMs, buildMs / steps, worst, ok ? "ok" : "FAIL");
+            }
+
+            Octree tree(BENCH_CUBE_SIZE, FLOCK_RADIUS);
+            tree.build(base.state());
+            std::printf("  %-12s  octree: %zu nodes, %zu leaves (%.1f boids/leaf), depth %d\n",
+                        clustered ? "clustered" : "uniform", tree.nodeCount(), tree.leafCount(),
+                        double(count) / tree.leafCount(), tree.getDepth());
+        }
+        return allOk;
+    }
+
+    // k-d 木による k 近傍探索の構築・探索時間と、トポロジカルな近傍での1ステップの時間
+    // 群れが塊に集まっても1個体あたりの手間が変わらないことを、半径による近傍 (グリッド) と比べる
+    bool benchKnn()
+    {
+        const int count = 100000;
+        const int k = 7;
+        const int maxThreads = parallel::threadCount();
+        const std::vector<SphereCollider> colliders = benchColliders();
+        bool allOk = true;
+        std::printf("[knn] %d boids, 3 species, k = %d\n", count, k);
+        std::printf("  distribution  build 1T(ms)  build %dT(ms)  query(ns/boid)  step knn(ms)  step radius(ms)  result\n",
+                    maxThreads);
+        for (int clustered = 0; clustered < 2; ++clustered)
+        {
+            Simulation sim(BENCH_CUBE_SIZE);
+            populate(sim, count, 3);
+            if (clustered)
+            {
+                clusterPositions(sim.population(), 6, 1.5f);
+            }
+            const FlockState &state = sim.state();
+
+            // 構築 (Simulation と同じく種族ごとに木を組む)
+            std::vector<KdTree> trees(state.speciesCount());
+            auto buildTrees = [&]()
+            {
+                for (int species = 0; species < state.speciesCount(); ++species)
+                {
+                    trees[species].build(state, state.speciesRanges[species].begin, state.speciesRanges[species].end);
+                }
+            };
+            parallel::setThreadCount(1);
+            auto start = std::chrono::steady_clock::now();
+            buildTrees();
+            const double serialBuildMs = elapsedMs(start);
+            parallel::setThreadCount(maxThreads);
+            start = std::chrono::steady_clock::now();
+            buildTrees();
+            const double parallelBuildMs = elapsedMs(start);
+
+            // 探索 (全個体)
+            start = std::chrono::steady_clock::now();
+            std::vector<long> foundPerChunk((count + 1023) / 1024, 0);
+            parallel::forRange(count, 1024, [&](std::size_t i0, std::size_t i1)
+                               {
+                                   long chunkFound = 0;
+                                   for (int i = static_cast<int>(i0); i < static_cast<int>(i1); ++i)
+                                   {
+                                       int nearest[KdTree::MAX_K];
+                                       chunkFound += trees[state.speciesID[i]].nearest(state.position(i), state.speciesID[i], k, i, nearest);
+                                   }
+                                   foundPerChunk[i0 / 1024] = chunkFound; });
+            long found = 0;
+            for (long f : foundPerChunk)
+            {
+                found += f;
+            }
+            const double queryNs = elapsedMs(start) * 1e6 / count;
+
+            // 総当たりで求めた k 近傍との比較 (一部の個体だけ)
+            int mismatches = found == static_cast<long>(count) * k ? 0 : 1;
+            for (int q = 0; q < count; q += count / 500)
+            {
+                const int species = state.speciesID[q];
+                std::vector<std::pair<float, int>> candidates;
+                for (int j = 0; j < count; ++j)
+                {
+                    if (j == q || state.speciesID[j] != species)
+                        continue;
+                    glm::vec3 d = state.position(j) - state.position(q);
+                    candidates.push_back({glm::dot(d, d), j});
+                }
+                std::partial_sort(candidates.begin(), candidates.begin() + k, candidates.end());
+                int nearest[KdTree::MAX_K];
+                const int n = trees[species].nearest(state.position(q), species, k, q, nearest);
+                for (int j = 0; j < k; ++j)
+                {
+                    if (n != k || nearest[j] != candidates[j].second)
+                    {
+                        mismatches++;
+                        break;
+                    }
+                }
+            }
+            const bool ok = mismatches == 0;
+            allOk = allOk && ok;
+
+            // 1ステップ (種族ごとの木 / 種族ごとのグリッド)。塊の中では半径内の個体が非常に多くなる
+            sim.topologicalNeighbors = k;
+            double knnStepMs = timeSteps(sim, 2);
+            sim.topologicalNeighbors = 0;
+            double radiusStepMs = timeSteps(sim, 2);
+
+            std::printf("  %-12s  %12.2f  %12.2f  %14.1f  %12.2f  %15.2f  %s\n", clustered ? "clustered" : "uniform",
+                        serialBuildMs, parallelBuildMs, queryNs, knnStepMs, radiusStepMs, ok ? "ok" : "FAIL");
+        }
+        return allOk;
+    }
+
+    // 位置と向きがビット単位で同じか
+    bool sameBits(const FlockState &a, const FlockState &b)
+    {
+        const std::size_t bytes = a.size() * sizeof(float);
+        return a.size() == b.size() &&
+               std::memcmp(a.posX.data(), b.posX.data(), bytes) == 0 &&
+               std::memcmp(a.posY.data(), b.posY.data(), bytes) == 0 &&
+               std::memcmp(a.posZ.data(), b.posZ.data(), bytes) == 0 &&
+               std::memcmp(a.dirX.data(), b.dirX.data(), bytes) == 0 &&
+               std::memcmp(a.dirY.data(), b.dirY.data(), bytes) == 0 &&
+               std::memcmp(a.dirZ.data(), b.dirZ.data(), bytes) == 0;
+    }
+
+    // 向きの平均の長さ (1 なら全員が同じ方向を向いている)
+    float polarization(const FlockState &state)
+    {
+        glm::vec3 sum(0.0f);
+        for (std::size_t i = 0; i < state.size(); ++i)
+        {
+            sum += state.direction(i);
+        }
+        return glm::length(sum) / static_cast<float>(state.size());
+    }
+
+    // 固定小数点モードの再現性 (スレッド数・命令セットによらずビット単位で同じか) と、float 版との差・速度
+    bool benchFixed()
+    {
+        const int count = 20000;
+        const int steps = 100;
+        const int statSteps = 300;
+        const int maxThreads = parallel::threadCount();
+        const std::vector<SphereCollider> colliders = benchColliders();
+
+        Simulation base(BENCH_CUBE_SIZE);
+        populate(base, count, 3);
+        auto run = [&](Simulation &sim, int n)
+        {
+            for (int s = 0; s < n; ++s)
+            {
+                sim.step(colliders);
+            }
+        };
+        std::printf("[fixed] %d boids, 3 species, fixed point vs floating point\n", count);
+
+        // 1. スレッド数を変えても同じか
+        Simulation serial = simulationFrom(base.state());
+        serial.fixedPoint = true;
+        parallel::setThreadCount(1);
+        run(serial, steps);
+        const int threadCounts[] = {2, 4, std::max(maxThreads, 8)};
+        bool threadsOk = true;
+        for (int threads : threadCounts)
+        {
+            Simulation threaded = simulationFrom(base.state());
+            threaded.fixedPoint = true;
+            parallel::setThreadCount(threads);
+            run(threaded, steps);
+            threadsOk = threadsOk && sameBits(serial.state(), threaded.state());
+        }
+        parallel::setThreadCount(maxThreads);
+        std::printf("  %d steps, 1 vs 2/4/%d threads: %s\n", steps, threadCounts[2],
+                    threadsOk ? "bit-identical" : "DIFFERENT");
+
+        // 2. 命令セットごとのカーネルで同じか
+        bool kernelsOk = true;
+        for (const FlockKernelSet *kernels : availableKernels())
+        {
+            Simulation sim = simulationFrom(base.state());
+            sim.fixedPoint = true;
+            sim.kernels = kernels;
+            run(sim, steps);
+            const bool same = sameBits(serial.state(), sim.state());
+            kernelsOk = kernelsOk && same;
+            std::printf("  %d steps, %-8s kernels: %s\n", steps, kernels->name, same ? "bit-identical" : "DIFFERENT");
+        }
+
+        // 3. float 版との差 (1ステップ後の位置・向きのずれと、長く回したときの整列の度合い)
+        Simulation fixedSim = simulationFrom(base.state());
+        fixedSim.fixedPoint = true;
+        Simulation floatSim = simulationFrom(base.state());
+        run(fixedSim, 1);
+        run(floatSim, 1);
+        // 半径の境目にいる近傍や壁際の個体は、わずかな差で数えられるかどうかが変わり向きが大きく変わることがあるので、
+        // 最大値ではなく平均で比べる
+        float posError = 0.0f;
+        double dirErrorSum = 0.0, dirErrorMax = 0.0;
+        for (int i = 0; i < count; ++i)
+        {
+            posError = std::max(posError, maxAbsDiff(fixedSim.state().position(i), floatSim.state().position(i)));
+            const float dirError = maxAbsDiff(fixedSim.state().direction(i), floatSim.state().direction(i));
+            dirErrorSum += dirError;
+            dirErrorMax = std::max(dirErrorMax, static_cast<double>(dirError));
+        }
+        const double dirErrorMean = dirErrorSum / count;
+        run(fixedSim, statSteps - 1);
+        run(floatSim, statSteps - 1);
+        const float fixedPolarization = polarization(fixedSim.state());
+        const float floatPolarization = polarization(floatSim.state());
+        // 長く回すと個体の軌跡は分かれていくので、群れ全体の統計で比べる
+        const bool closeOk = posError < 1e-2f && dirErrorMean < 1e-3 &&
+                             std::abs(fixedPolarization - floatPolarization) < 0.1f;
+        std::printf("  1 step error: position max %.2e, direction mean %.2e (max %.2e)\n", posError, dirErrorMean,
+                    dirErrorMax);
+        std::printf("  polarization after %d steps: fixed %.3f, float %.3f\n", statSteps, fixedPolarization,
+                    floatPolarization);
+
+        // 4. 速度
+        Simulation fixedTimed = simulationFrom(base.state());
+        fixedTimed.fixedPoint = true;
+        Simulation floatTimed = simulationFrom(base.state());
+        // 交互に測って最小値を取り、片方だけが他の負荷の影響を受けないようにする
+        double fixedMs = timeSteps(fixedTimed, 2);
+        double floatMs = timeSteps(floatTimed, 2);
+        for (int round = 1; round < 10; ++round)
+        {
+            fixedMs = std::min(fixedMs, timeSteps(fixedTimed, 2));
+            floatMs = std::min(floatMs, timeSteps(floatTimed, 2));
+        }
+        std::printf("  step: fixed %.2f ms, float %.2f ms (%.2fx)\n", fixedMs, floatMs, floatMs / fixedMs);
+
+        const bool ok = threadsOk && kernelsOk && closeOk;
+        std::printf("  result: %s\n", ok ? "ok" : "FAIL");
+        return ok;
+    }
+
+    // ステップ時間と操舵 (近傍の合計・衝突・移動) の時間の平均 (ms)
+    void timeStepsDetailed(Simulation &sim, const std::vector<SphereCollider> &colliders, int steps,
+                           double &stepMs, double &steeringMs)
+    {
+        sim.step(colliders); // ウォームアップ
+        steeringMs = 0.0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < steps; ++i)
+        {
+            sim.step(colliders);
+            steeringMs += sim.getLastTimings().steeringMs;
+        }
+        stepMs = elapsedMs(start) / steps;
+        steeringMs /= steps;
+    }
+
+    // 衝突処理だけの時間 (ns/boid)。1個体ずつ分岐する汎用の版と、区間をまとめて処理するカーネルの比較
+    void timeCollisions(const FlockState &state, const std::vector<SphereCollider> &colliders,
+                        double &perBoidNs, double &kernelNs, float &maxError)
+    {
+        const int count = static_cast<int>(state.size());
+        const int repeats = 20;
+        FlockState perBoid = state;
+        FlockState batched = state;
+
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < repeats; ++r)
+        {
+            for (int i = 0; i < count; ++i)
+            {
+                glm::vec3 position = state.position(i);
+                glm::vec3 direction = state.direction(i);
+                DynamicColliders::collide(position, direction, colliders.data(), static_cast<int>(colliders.size()));
+                perBoid.setPosition(i, position);
+                perBoid.setDirection(i, direction);
+            }
+        }
+        perBoidNs = elapsedMs(start) * 1e6 / (double(repeats) * count);
+
+        const FlockKernelSet &k = activeKernels();
+        start = std::chrono::steady_clock::now();
+        for (int r = 0; r < repeats; ++r)
+        {
+            // 毎回同じ入力から処理する
+            std::copy(state.posX.begin(), state.posX.end(), batched.posX.begin());
+            std::copy(state.posY.begin(), state.posY.end(), batched.posY.begin());
+            std::copy(state.posZ.begin(), state.posZ.end(), batched.posZ.begin());
+            std::copy(state.dirX.begin(), state.dirX.end(), batched.dirX.begin());
+            std::copy(state.dirY.begin(), state.dirY.end(), batched.dirY.begin());
+            std::copy(state.dirZ.begin(), state.dirZ.end(), batched.dirZ.begin());
+            k.collide(batched.boidArrays(), 0, count, colliders.data(), static_cast<int>(colliders.size()));
+        }
+        kernelNs = elapsedMs(start) * 1e6 / (double(repeats) * count);
+
+        maxError = 0.0f;
+        for (int i = 0; i < count; ++i)
+        {
+            maxError = std::max(maxError, maxAbsDiff(perBoid.position(i), batched.position(i)));
+            maxError = std::max(maxError, maxAbsDiff(perBoid.direction(i), batched.direction(i)));
+        }
+    }
+
+    // コンパイル時に方針を固定した更新 (UpdatePolicy.h) と、実行時に分岐する汎用の更新の比較
+    bool benchPolicy()
+    {
+        const int count = 20000;
+        const int steps = 20;
+        const float tolerance = 1e-4f;
+        const BoundaryMode boundaries[] = {BoundaryMode::Reflect, BoundaryMode::Wrap, BoundaryMode::Open};
+
+        // 一部の個体が必ずコライダーの近くにいるよう、コライダーの周りにも配置する
+        std::vector<SphereCollider> fourColliders = benchColliders();
+        fourColliders.push_back(SphereCollider(glm::vec3(12.0f, 8.0f, -6.0f), 4.0f));
+        fourColliders.push_back(SphereCollider(glm::vec3(-6.0f, 10.0f, 12.0f), 2.0f));
+        const std::vector<std::vector<SphereCollider>> colliderSets = {{}, benchColliders(), fourColliders};
+
+        Simulation base(BENCH_CUBE_SIZE);
+        populate(base, count, 3);
+
+        bool allOk = true;
+        std::printf("[policy] %d boids, 3 species, generic vs compile-time specialized update (tolerance %.0e)\n",
+                    count, tolerance);
+        std::printf("  boundary  colliders  generic step(ms)  specialized step(ms)  steering speedup  max error  result\n");
+        for (BoundaryMode boundary : boundaries)
+        {
+            for (const std::vector<SphereCollider> &colliders : colliderSets)
+            {
+                Simulation generic = simulationFrom(base.state());
+                Simulation specialized = simulationFrom(base.state());
+                generic.boundary = boundary;
+                specialized.boundary = boundary;
+                generic.specializedUpdate = false;
+                specialized.specializedUpdate = true;
+
+                // 同じ状態から1ステップ進めた結果の比較 (衝突の反射で正規化の回数が違うので完全一致はしない)
+                generic.step(colliders);
+                specialized.step(colliders);
+                float worst = 0.0f;
+                for (int i = 0; i < count; ++i)
+                {
+                    worst = std::max(worst, maxAbsDiff(generic.state().position(i), specialized.state().position(i)));
+                    worst = std::max(worst, maxAbsDiff(generic.state().direction(i), specialized.state().direction(i)));
+                }
+                const bool ok = worst <= tolerance;
+                allOk = allOk && ok;
+
+                double genericMs, genericSteerMs, specializedMs, specializedSteerMs;
+                timeStepsDetailed(generic, colliders, steps, genericMs, genericSteerMs);
+                timeStepsDetailed(specialized, colliders, steps, specializedMs, specializedSteerMs);
+                std::printf("  %-8s  %9zu  %16.2f  %20.2f  %15.2fx  %9.2e  %s\n", boundaryModeName(boundary),
+                            colliders.size(), genericMs, specializedMs, genericSteerMs / specializedSteerMs, worst,
+                            ok ? "ok" : "FAIL");
+            }
+        }
+
+        // 衝突処理だけの比較 (近傍探索を含まないので、分岐の有無とベクトル化の差がそのまま出る)
+        // 全個体がどれかのコライダーの近くにいるよう、コライダーの周りに集めた配置で測る
+        std::printf("  collisions only, boids around the colliders (ns/boid, copies included in kernel time):\n");
+        std::printf("  colliders  per-boid  kernel  max error  result\n");
+        for (const std::vector<SphereCollider> &colliders : {benchColliders(), fourColliders})
+        {
+            FlockState nearby = base.state();
+            std::mt19937 rng(12345);
+            std::normal_distribution<float> offset(0.0f, 4.0f);
+            for (std::size_t i = 0; i < nearby.size(); ++i)
+            {
+                const SphereCollider &collider = colliders[i % colliders.size()];
+                nearby.setPosition(i, collider.center + glm::vec3(offset(rng), offset(rng), offset(rng)));
+            }
+            double perBoidNs, kernelNs;
+            float worst;
+            timeCollisions(nearby, colliders, perBoidNs, kernelNs, worst);
+            const bool ok = worst <= tolerance;
+            allOk = allOk && ok;
+            std::printf("  %9zu  %8.2f  %6.2f  %9.2e  %s\n", colliders.size(), perBoidNs, kernelNs, worst,
+                        ok ? "ok" : "FAIL");
+        }
+        return allOk;
+    }
+
+    // 同じ種族の半径 FLOCK_RADIUS 内にいる個体の数の平均 (群れの結合の度合い)
+    float cohesion(const FlockState &state)
+    {
+        const float radiusSq = FLOCK_RADIUS * FLOCK_RADIUS;
+        long pairs = 0;
+        for (int s = 0; s < state.speciesCount(); ++s)
+        {
+            const SpeciesRange range = state.speciesRanges[s];
+            for (std::size_t i = range.begin; i < range.end; ++i)
+            {
+                for (std::size_t j = i + 1; j < range.end; ++j)
+                {
+                    const glm::vec3 d = state.position(i) - state.position(j);
+                    if (glm::dot(d, d) < radiusSq)
+                        pairs++;
+                }
+            }
+        }
+        return 2.0f * static_cast<float>(pairs) / static_cast<float>(state.size());
+    }
+
+    // 近似の逆数を使う更新 (fastMath) の誤差と速度、長く回したときの群れの統計の比較
+    bool benchFastMath()
+    {
+        const int count = 20000;
+        const int steps = 20;
+        const float radiusSq = FLOCK_RADIUS * FLOCK_RADIUS;
+        const std::vector<SphereCollider> colliders = benchColliders();
+        bool allOk = true;
+
+        // 1. 近傍の合計: 分離の項の誤差 (合計した後の値の、項の大きさの和に対する相対誤差) とカーネル単体の速度
+        FlockState candidates;
+        for (int i = 0; i < 4096; ++i)
+        {
+            Creature::spawn(candidates, 6.0f, i % 2);
+        }
+        const NeighborArrays arrays = candidates.neighborArrays();
+        std::printf("[fastmath] approximate reciprocal square roots vs exact (bound %.0e neighbors, %.0e steering)\n",
+                    FAST_MATH_NEIGHBOR_REL_ERROR, FAST_MATH_STEER_REL_ERROR);
+        std::printf("  kernel    exact(ns/candidate)  fast(ns/candidate)  separation error  steering error  result\n");
+        for (const FlockKernelSet *kernels : availableKernels())
+        {
+            float sepError = 0.0f;
+            for (int q = 0; q < 256; ++q)
+            {
+                const glm::vec3 position = candidates.position(q);
+                const int species = candidates.speciesID[q];
+                NeighborSums exact, fast;
+                kernels->accumulateNeighbors(arrays, 0, candidates.size(), position, species, radiusSq, exact);
+                kernels->accumulateNeighborsFast(arrays, 0, candidates.size(), position, species, radiusSq, fast);
+                // 項の大きさ 1 / (d² + 0.01) の和と比べる (打ち消し合った合計と比べると、項ごとの誤差の上限と比べられない)
+                float magnitude = 0.0f;
+                for (std::size_t j = 0; j < candidates.size(); ++j)
+                {
+                    const glm::vec3 d = position - candidates.position(j);
+                    const float dSq = glm::dot(d, d);
+                    if (candidates.speciesID[j] == species && dSq < radiusSq && dSq > 0.0001f)
+                        magnitude += 1.0f / (dSq + 0.01f);
+                }
+                if (magnitude > 0.0f)
+                    sepError = std::max(sepError, maxAbsDiff(exact.separation, fast.separation) / magnitude);
+            }
+
+            // 操舵: 正規化の前の値を作り、glm::normalize で計算した向きと比べる
+            const std::size_t boids = candidates.size();
+            std::vector<float> sums[9];
+            std::vector<float> gains[3];
+            std::vector<int> counts(boids);
+            std::vector<float> outX(boids), outY(boids), outZ(boids);
+            std::vector<float> targetX(boids), targetY(boids), targetZ(boids);
+            for (std::vector<float> &v : sums)
+                v.resize(boids);
+            for (std::vector<float> &v : gains)
+                v.resize(boids);
+            for (std::size_t i = 0; i < boids; ++i)
+            {
+                NeighborSums n;
+                kernels->accumulateNeighbors(arrays, 0, boids, candidates.position(i), candidates.speciesID[i],
+                                             radiusSq, n);
+                const float values[9] = {n.separation.x, n.separation.y, n.separation.z, n.alignment.x, n.alignment.y,
+                                         n.alignment.z, n.cohesion.x, n.cohesion.y, n.cohesion.z};
+                for (int c = 0; c < 9; ++c)
+                    sums[c][i] = values[c];
+                counts[i] = n.count;
+                const SpeciesFlockGains g = ConstexprGains::get(candidates.speciesID[i]);
+                gains[0][i] = g.separation;
+                gains[1][i] = g.alignment;
+                gains[2][i] = g.cohesion;
+            }
+            const SteeringArrays steering = {sums[0].data(), sums[1].data(), sums[2].data(), sums[3].data(),
+                                             sums[4].data(), sums[5].data(), sums[6].data(), sums[7].data(),
+                                             sums[8].data(), counts.data(), gains[0].data(), gains[1].data(),
+                                             gains[2].data(), candidates.posX.data(), candidates.posY.data(),
+                                             candidates.posZ.data(), candidates.dirX.data(), candidates.dirY.data(),
+                                             candidates.dirZ.data(), candidates.maxTurn.data(), outX.data(),
+                                             outY.data(), outZ.data(), targetX.data(), targetY.data(),
+                                             targetZ.data()};
+            kernels->steerFast(steering, boids);
+            float steerError = 0.0f;
+            for (std::size_t i = 0; i < boids; ++i)
+            {
+                if (counts[i] == 0)
+                    continue;
+                const float n = static_cast<float>(counts[i]);
+                const glm::vec3 position = candidates.position(i);
+                const glm::vec3 aln = glm::normalize(glm::vec3(sums[3][i], sums[4][i], sums[5][i]) / n);
+                const glm::vec3 coh = glm::normalize(glm::vec3(sums[6][i], sums[7][i], sums[8][i]) / n - position);
+                const glm::vec3 sep = glm::vec3(sums[0][i], sums[1][i], sums[2][i]) / n;
+                const glm::vec3 steer = glm::normalize(sep * gains[0][i] + aln * gains[1][i] + coh * gains[2][i]);
+                const glm::vec3 expected =
+                    glm::normalize(glm::mix(candidates.direction(i), steer, candidates.maxTurn[i]));
+                steerError = std::max(steerError, maxAbsDiff(expected, glm::vec3(outX[i], outY[i], outZ[i])));
+            }
+
+            // 正規化は4回重なり、各成分は大きさ 1 以下なので、誤差は上限の数倍に収まるはず
+            const bool ok = sepError <= FAST_MATH_NEIGHBOR_REL_ERROR && steerError <= 4.0f * FAST_MATH_STEER_REL_ERROR;
+            allOk = allOk && ok;
+
+            auto timeKernel = [&](NeighborKernel kernel)
+            {
+                const int repeats = 64;
+                NeighborSums sink;
+                auto start = std::chrono::steady_clock::now();
+                for (int r = 0; r < repeats; ++r)
+                {
+                    kernel(arrays, 0, candidates.size(), candidates.position(r), candidates.speciesID[r], radiusSq, sink);
+                }
+                const double ns = elapsedMs(start) * 1e6 / (double(repeats) * candidates.size());
+                return sink.count > 0 ? ns : 0.0;
+            };
+            const double exactNs = timeKernel(kernels->accumulateNeighbors);
+            const double fastNs = timeKernel(kernels->accumulateNeighborsFast);
+            std::printf("  %-8s  %19.3f  %18.3f  %16.2e  %14.2e  %s\n", kernels->name, exactNs, fastNs, sepError,
+                        steerError, ok ? "ok" : "FAIL");
+        }
+
+        // 2. 1ステップの差とステップ時間
+        Simulation base(BENCH_CUBE_SIZE);
+        populate(base, count, 3);
+        Simulation exactSim = simulationFrom(base.state());
+        Simulation fastSim = simulationFrom(base.state());
+        fastSim.fastMath = true;
+        exactSim.step(colliders);
+        fastSim.step(colliders);
+        float stepError = 0.0f;
+        for (int i = 0; i < count; ++i)
+        {
+            stepError = std::max(stepError, maxAbsDiff(exactSim.state().direction(i), fastSim.state().direction(i)));
+        }
+        double exactMs, exactSteerMs, fastMs, fastSteerMs;
+        timeStepsDetailed(exactSim, colliders, steps, exactMs, exactSteerMs);
+        timeStepsDetailed(fastSim, colliders, steps, fastMs, fastSteerMs);
+        std::printf("  %d boids: 1 step direction error %.2e, step exact %.2f ms, fast %.2f ms (steering %.2fx)\n",
+                    count, stepError, exactMs, fastMs, exactSteerMs / fastSteerMs);
+
+        // 3. 長く回したときの群れの統計
+        // 軌道は正確な版どうしでも初期位置のわずかな差で数百ステップのうちに分かれ、群れの合流・分裂の時期によって
+        // 10000 ステップの平均でも実行ごとに大きくばらつく。そこで初期位置を 1e-4 ずつずらした数回の実行の平均を、
+        // 正確な版と近似の版で比べる。許容差は両者の実行ごとのばらつきから求めた標準誤差の 3 倍。
+        // 統計は最初の 1000 ステップ (群れができるまで) を除いて 100 ステップおきに取る
+        const int longCount = 1000;
+        const int longSteps = 10000;
+        const int warmup = 1000;
+        const int sampleInterval = 100;
+        const int runs = 4;
+        Simulation longBase(BENCH_CUBE_SIZE);
+        populate(longBase, longCount, 3);
+        std::vector<double> stats[2][2]; // [正確/近似][整列度/結合]
+        for (int fast = 0; fast < 2; ++fast)
+        {
+            for (int r = 0; r < runs; ++r)
+            {
+                FlockState initial = longBase.state();
+                for (int i = 0; i < longCount; ++i)
+                {
+                    initial.setPosition(i, initial.position(i) + glm::vec3(1e-4f * r));
+                }
+                Simulation sim = simulationFrom(initial);
+                sim.fastMath = fast == 1;
+                double polarizationSum = 0.0, cohesionSum = 0.0;
+                int samples = 0;
+                for (int s = 1; s <= longSteps; ++s)
+                {
+                    sim.step(colliders);
+                    if (s > warmup && s % sampleInterval == 0)
+                    {
+                        polarizationSum += polarization(sim.state());
+                        cohesionSum += cohesion(sim.state());
+                        samples++;
+                    }
+                }
+                stats[fast][0].push_back(polarizationSum / samples);
+                stats[fast][1].push_back(cohesionSum / samples);
+            }
+        }
+        auto meanOf = [](const std::vector<double> &v)
+        {
+            double sum = 0.0;
+            for (double x : v)
+                sum += x;
+            return sum / v.size();
+        };
+        auto varianceOf = [&](const std::vector<double> &v)
+        {
+            const double mean = meanOf(v);
+            double sum = 0.0;
+            for (double x : v)
+                sum += (x - mean) * (x - mean);
+            return sum / (v.size() - 1);
+        };
+        std::printf("  %d boids, %d steps x %d runs (mean of steps %d-%d):\n", longCount, longSteps, runs, warmup,
+                    longSteps);
+        std::printf("  metric                exact   fast    diff   tolerance  result\n");
+        const char *names[2] = {"polarization", "neighbors in radius"};
+        for (int m = 0; m < 2; ++m)
+        {
+            const double exactMean = meanOf(stats[0][m]);
+            const double fastMean = meanOf(stats[1][m]);
+            const double tolerance = 3.0 * std::sqrt((varianceOf(stats[0][m]) + varianceOf(stats[1][m])) / runs);
+            const double diff = std::abs(fastMean - exactMean);
+            const bool ok = diff <= tolerance;
+            allOk = allOk && ok;
+            std::printf("  %-19s  %6.3f  %6.3f  %6.3f  %9.3f  %s\n", names[m], exactMean, fastMean, diff, tolerance,
+                        ok ? "ok" : "FAIL");
+        }
+        std::printf("  result: %s\n", allOk ? "ok" : "FAIL");
+        return allOk;
+    }
+
+    // シミュレーションと描画を別スレッドで行うパイプライン (SimulationThread) の確認
+    bool benchPipeline()
+    {
+        bool allOk = true;
+
+        // 1. TripleBuffer: 書き込み側が公開し続ける間に読み出し側が読んだ値が、どれも書きかけでなく、順番も戻らないか
+        {
+            const int publishes = 200000;
+            TripleBuffer<std::vector<int>> buffer;
+            std::thread writer([&]
+                               {
+                for (int value = 1; value <= publishes; ++value)
+                {
+                    std::vector<int> &slot = buffer.back();
+                    slot.assign(256, value);
+                    buffer.publish();
+                    std::this_thread::yield(); // CPU が少なくても読み出し側と交互に動くように
+                } });
+            int torn = 0, backwards = 0, received = 0, last = 0;
+            while (last < publishes)
+            {
+                if (!buffer.acquire())
+                {
+                    std::this_thread::yield();
+                    continue;
+                }
+                const std::vector<int> &slot = buffer.front();
+                if (std::count(slot.begin(), slot.end(), slot.front()) != static_cast<long>(slot.size()))
+                    torn++;
+                if (slot.front() <= last)
+                    backwards++;
+                last = slot.front();
+                received++;
+            }
+            writer.join();
+            const bool ok = torn == 0 && backwards == 0;
+            allOk = allOk && ok;
+            std::printf("[pipeline] triple buffer: %d publishes, %d received, %d torn, %d out of order: %s\n", publishes,
+                        received, torn, backwards, ok ? "ok" : "FAIL");
+        }
+
+        const int count = 20000;
+        const std::vector<SphereCollider> colliders = benchColliders();
+        Simulation base(BENCH_CUBE_SIZE);
+        populate(base, count, 3);
+
+        // 2. 別スレッドで進めたスナップショットが、同じステップ数だけ逐次に進めた状態と一致するか
+        {
+            const int steps = 30;
+            Simulation sequential = simulationFrom(base.state());
+            Simulation threaded = simulationFrom(base.state());
+            for (int s = 0; s < steps; ++s)
+            {
+                sequential.step(colliders);
+            }
+
+            SimulationThread thread(threaded);
+            thread.start(colliders);
+            const FlockSnapshot *snapshot = &thread.latest();
+            while (snapshot->step < steps)
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+                snapshot = &thread.latest();
+            }
+            // 描画より最大 MAX_STEPS_AHEAD 先まで進むので、steps ちょうどで止まるとは限らない
+            bool same = snapshot->step == steps;
+            if (same)
+            {
+                const std::size_t bytes = count * sizeof(float);
+                const FlockState &expected = sequential.state();
+                same = std::memcmp(snapshot->posX.data(), expected.posX.data(), bytes) == 0 &&
+                       std::memcmp(snapshot->posY.data(), expected.posY.data(), bytes) == 0 &&
+                       std::memcmp(snapshot->posZ.data(), expected.posZ.data(), bytes) == 0 &&
+                       std::memcmp(snapshot->dirX.data(), expected.dirX.data(), bytes) == 0 &&
+                       std::memcmp(snapshot->dirY.data(), expected.dirY.data(), bytes) == 0 &&
+                       std::memcmp(snapshot->dirZ.data(), expected.dirZ.data(), bytes) == 0;
+            }
+            thread.stop();
+            allOk = allOk && same;
+            std::printf("  snapshot of step %ld vs %d sequential steps: %s\n", snapshot->step, steps,
+                        same ? "bit-identical" : "DIFFERENT");
+        }
+
+        // 3. 新しいステップを1つ描画するまでの時間。描画は GPU やモニタの同期を待つ時間として sleep で表す (CPU を使わない)
+        // 逐次では シミュレーション + 描画、パイプラインでは両者の遅い方に近づくはず
+        // (描画の方が速いと同じスナップショットを描き直すフレームが出るので、フレーム数ではなく描いたステップ数で割る)
+        {
+            const int frames = 60;
+            Simulation sim = simulationFrom(base.state());
+            const double stepMs = timeSteps(sim, 10);
+            std::printf("  frame time, %d boids (step %.2f ms), render simulated by sleeping:\n", count, stepMs);
+            std::printf("  ms per drawn step:\n");
+            std::printf("  render(ms)  sequential(ms)  pipelined(ms)  max(sim, render)  speedup  result\n");
+            for (double renderScale : {0.5, 1.0, 2.0})
+            {
+                const auto renderTime = std::chrono::duration<double, std::milli>(stepMs * renderScale);
+
+                auto start = std::chrono::steady_clock::now();
+                for (int f = 0; f < frames; ++f)
+                {
+                    sim.step(colliders);
+                    std::this_thread::sleep_for(renderTime);
+                }
+                const double sequentialMs = elapsedMs(start) / frames;
+
+                SimulationThread thread(sim);
+                thread.start(colliders);
+                const long firstStep = thread.latest().step;
+                start = std::chrono::steady_clock::now();
+                long drawnStep = firstStep;
+                while (drawnStep < firstStep + frames)
+                {
+                    drawnStep = thread.latest().step;
+                    std::this_thread::sleep_for(renderTime);
+                }
+                const double pipelinedMs = elapsedMs(start) / (drawnStep - firstStep);
+                thread.stop();
+
+                // 理想は max(sim, render)。スレッドの起こし直しやスナップショットの複製の分の余裕を見る
+                const double ideal = std::max(stepMs, renderTime.count());
+                const bool ok = pipelinedMs < 0.5 * (sequentialMs + ideal);
+                allOk = allOk && ok;
+                std::printf("  %10.2f  %14.2f  %13.2f  %16.2f  %6.2fx  %s\n", renderTime.count(), sequentialMs,
+                            pipelinedMs, ideal, sequentialMs / pipelinedMs, ok ? "ok" : "FAIL");
+            }
+        }
+        return allOk;
+    }
+
+    // 固定の刻みで進める SimulationThread::advance() の確認
+    // 描画のフレーム時間は実際には待たずに与え、毎フレーム、描く時刻のステップまでワーカーが進むのを待ってから描いたことにする
+    bool benchTimestep()
+    {
+        const int count = 2000;
+        const std::vector<SphereCollider> colliders = benchColliders();
+        Simulation base(BENCH_CUBE_SIZE);
+        populate(base, count, 3);
+        bool allOk = true;
+
+        // advance(frameSeconds) を呼び、描く時刻のステップ (とその次) までワーカーが進むのを待つ
+        auto advanceAndWait = [](SimulationThread &thread, double frameSeconds, long &due)
+        {
+            RenderFrame frame = thread.advance(frameSeconds);
+            due += frame.stepsDue;
+            while (frame.snapshot->step < due + 1)
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+                frame = thread.advance(0.0);
+            }
+            return frame;
+        };
+
+        // 1. 描画のフレームレートによらず、同じ時間で同じステップ数だけ進むか (30 ステップ/秒で 2 秒)
+        {
+            const double seconds = 2.0;
+            const double rate = 30.0;
+            std::printf("[timestep] %d boids, %.0f steps/s for %.0f s of frames\n", count, rate, seconds);
+            std::printf("  render(fps)  steps  dropped  result\n");
+            for (double fps : {144.0, 60.0, 20.0})
+            {
+                Simulation sim = simulationFrom(base.state());
+                SimulationThread thread(sim);
+                thread.setStepRate(rate);
+                thread.start(colliders);
+                long due = 0;
+                RenderFrame frame;
+                const int frames = static_cast<int>(std::lround(seconds * fps));
+                for (int f = 0; f < frames; ++f)
+                {
+                    frame = advanceAndWait(thread, 1.0 / fps, due);
+                }
+                thread.stop();
+                // 刻みの端数の誤差で 1 ステップずれうる
+                const long expected = std::lround(seconds * rate);
+                const bool ok = std::abs(due - expected) <= 1 && frame.droppedSteps == 0;
+                allOk = allOk && ok;
+                std::printf("  %11.0f  %5ld  %7ld  %s\n", fps, due, frame.droppedSteps, ok ? "ok" : "FAIL");
+            }
+        }
+
+        // 2. 1 秒止まったフレームの後も、溜まったステップを一度に進めようとせず、上限で捨てて描画に追いつくか
+        {
+            Simulation sim = simulationFrom(base.state());
+            SimulationThread thread(sim);
+            thread.setStepRate(60.0);
+            thread.start(colliders);
+            long due = 0;
+            advanceAndWait(thread, 1.0 / 60.0, due);
+            const long before = due;
+            RenderFrame frame = advanceAndWait(thread, 1.0, due);
+            const long hitchSteps = due - before;
+            frame = advanceAndWait(thread, 1.0 / 60.0, due);
+            thread.stop();
+            // 上限は描いているステップ (先読みの1ステップ分だけ先) から数えるので、最大 maxStepsPerFrame + 1 ステップ進む
+            const bool ok = hitchSteps <= thread.maxStepsPerFrame + 1 && frame.droppedSteps >= 60 - thread.maxStepsPerFrame - 2;
+            allOk = allOk && ok;
+            std::printf("  1 s hitch at 60 steps/s: %ld steps run, %ld dropped (cap %d ahead of the drawn step)  %s\n", hitchSteps,
+                        frame.droppedSteps, thread.maxStepsPerFrame, ok ? "ok" : "FAIL");
+        }
+
+        // 3. 30 ステップ/秒を 144 fps で描いたときの、描いた位置のフレームごとの移動量のばらつき (変動係数)
+        //    補間しなければ数フレームに1回だけ動くので大きく、補間すれば毎フレームほぼ同じ量だけ動く
+        {
+            const int frames = 288;
+            Simulation sim = simulationFrom(base.state());
+            sim.reorderInterval = 0; // 同じインデックスの個体を追うため
+            SimulationThread thread(sim);
+            thread.setStepRate(30.0);
+            thread.start(colliders);
+            long due = 0;
+            std::vector<glm::vec3> previous[2];
+            std::vector<double> moved[2]; // [補間なし/あり] フレームごとの平均の移動量
+            for (int f = 0; f < frames; ++f)
+            {
+                const RenderFrame frame = advanceAndWait(thread, 1.0 / 144.0, due);
+                for (int interpolated = 0; interpolated < 2; ++interpolated)
+                {
+                    std::vector<glm::vec3> positions(count);
+                    for (int i = 0; i < count; ++i)
+                    {
+                        glm::vec3 direction;
+                        frame.snapshot->interpolate(i, interpolated ? frame.blend : 1.0f, positions[i], direction);
+                    }
+                    if (!previous[interpolated].empty())
+                    {
+                        double sum = 0.0;
+                        int samples = 0;
+                        for (int i = 0; i < count; ++i)
+                        {
+                            const float d = glm::length(positions[i] - previous[interpolated][i]);
+                            if (d < FlockSnapshot::INTERPOLATION_MAX_JUMP) // 回り込み・押し戻しは除く
+                            {
+                                sum += d;
+                                samples++;
+                            }
+                        }
+                        moved[interpolated].push_back(sum / std::max(samples, 1));
+                    }
+                    previous[interpolated].swap(positions);
+                }
+            }
+            thread.stop();
+            double variation[2];
+            for (int k = 0; k < 2; ++k)
+            {
+                double mean = 0.0, squares = 0.0;
+                for (double m : moved[k])
+                    mean += m;
+                mean /= moved[k].size();
+                for (double m : moved[k])
+                    squares += (m - mean) * (m - mean);
+                variation[k] = std::sqrt(squares / moved[k].size()) / mean;
+            }
+            const bool ok = variation[1] < 0.2 && variation[1] < variation[0];
+            allOk = allOk && ok;
+            std::printf("  30 steps/s drawn at 144 fps, variation of per-frame motion: %.2f without interpolation, "
+                        "%.2f with  %s\n",
+                        variation[0], variation[1], ok ? "ok" : "FAIL");
+        }
+
+        // 4. 刻みを変えても、実時間 1 秒あたりに進む距離と曲がる角度が変わらないか (Simulation::setTimeScale)
+        //    曲がる割合の換算は目標の向きが変わらない間だけ正確で、壁での反射も刻みで少しずれるので、角度は距離より緩く見る
+        {
+            const double seconds = 2.0;
+            std::printf("  steps/s  distance/s  turn(rad)/s  result\n");
+            double reference[2] = {0.0, 0.0}; // 60 ステップ/秒での [距離, 角度]
+            for (double rate : {60.0, 30.0, 120.0})
+            {
+                Simulation sim = simulationFrom(base.state());
+                sim.reorderInterval = 0; // 同じインデックスの個体を追うため
+                sim.setTimeScale(static_cast<float>(60.0 / rate));
+                double distance = 0.0, turn = 0.0;
+                const int steps = static_cast<int>(std::lround(seconds * rate));
+                for (int s = 0; s < steps; ++s)
+                {
+                    const FlockState before = sim.state();
+                    sim.step(colliders);
+                    for (int i = 0; i < count; ++i)
+                    {
+                        distance += glm::length(sim.state().position(i) - before.position(i));
+                        const float cosine = glm::dot(sim.state().direction(i), before.direction(i));
+                        turn += std::acos(std::min(std::max(cosine, -1.0f), 1.0f));
+                    }
+                }
+                const double perSecond[2] = {distance / count / seconds, turn / count / seconds};
+                if (rate == 60.0)
+                {
+                    reference[0] = perSecond[0];
+                    reference[1] = perSecond[1];
+                }
+                const bool ok = std::abs(perSecond[0] / reference[0] - 1.0) < 0.02 &&
+                                std::abs(perSecond[1] / reference[1] - 1.0) < 0.05;
+                allOk = allOk && ok;
+                std::printf("  %7.0f  %10.3f  %11.3f  %s\n", rate, perSecond[0], perSecond[1], ok ? "ok" : "FAIL");
+            }
+        }
+        std::printf("  result: %s\n", allOk ? "ok" : "FAIL");
+        return allOk;
+    }
+
+    // 並列ループのバックエンド (OpenMP / std::execution / 組み込みの work-stealing プール) の比較
+    // どのバックエンドでも結果がビット単位で同じになることと、並列ループ1回の手間・探索構造の構築・1ステップの時間を比べる
+    bool benchParallel()
+    {
+        const ParallelBackend original = parallel::backend();
+        std::vector<ParallelBackend> backends;
+        for (ParallelBackend backend : {ParallelBackend::OpenMP, ParallelBackend::StdExecution, ParallelBackend::WorkStealing})
+        {
+            if (parallel::available(backend))
+                backends.push_back(backend);
+            else
+                std::printf("[parallel] %s is not available in this build\n", parallelBackendName(backend));
+        }
+        std::printf("[parallel] %d threads (std::execution chooses its own)\n", parallel::threadCount());
+        bool allOk = true;
+
+        // 1. 入れ子の invoke と forEach で区間の和を求め、どのバックエンドでも取りこぼしなく実行されるか
+        std::printf("  nested invoke/forEach sum: ");
+        for (ParallelBackend backend : backends)
+        {
+            parallel::setBackend(backend);
+            const long n = 1 << 20;
+            std::vector<long> partial(n / 1024, 0);
+            std::function<void(long, long)> sumRange = [&](long begin, long end)
+            {
+                if (end - begin > 8 * 1024)
+                {
+                    const long mid = begin + (end - begin) / 2;
+                    parallel::invoke([&]
+                                     { sumRange(begin, mid); },
+                                     [&]
+                                     { sumRange(mid, end); });
+                    return;
+                }
+                parallel::forEach(static_cast<std::size_t>((end - begin) / 1024), [&](std::size_t c)
+                                  {
+                                      const long first = begin + static_cast<long>(c) * 1024;
+                                      long sum = 0;
+                                      for (long i = first; i < first + 1024; ++i)
+                                      {
+                                          sum += i;
+                                      }
+                                      partial[first / 1024] = sum; });
+            };
+            sumRange(0, n);
+            long total = 0;
+            for (long p : partial)
+            {
+                total += p;
+            }
+            const bool ok = total == n * (n - 1) / 2;
+            allOk = allOk && ok;
+            std::printf("%s %s  ", parallelBackendName(backend), ok ? "ok" : "FAIL");
+        }
+        std::printf("\n");
+
+        // 2. バックエンドを変えても、1ステップの結果がビット単位で同じか (近傍探索の方法ごと)
+        {
+            const int count = 20000;
+            const int steps = 20;
+            const std::vector<SphereCollider> colliders = benchColliders();
+            Simulation base(BENCH_CUBE_SIZE);
+            populate(base, count, 3);
+            struct Mode
+            {
+                const char *name;
+                std::function<void(Simulation &)> configure;
+            };
+            const Mode modes[] = {
+                {"shared grid", [](Simulation &sim)
+                 { sim.partitionBySpecies = false; }},
+                {"per-species grids", [](Simulation &sim)
+                 { sim.partitionBySpecies = true; }},
+                {"neighbor lists", [](Simulation &sim)
+                 { sim.useNeighborLists = true; }},
+                {"octree", [](Simulation &sim)
+                 { sim.neighborBackend = NeighborBackend::Octree; }},
+                {"k-d tree (k = 7)", [](Simulation &sim)
+                 { sim.topologicalNeighbors = 7; }},
+                {"fixed point", [](Simulation &sim)
+                 { sim.fixedPoint = true; }},
+            };
+            std::printf("  %d boids, %d steps, compared with %s:\n", count, steps, parallelBackendName(backends.front()));
+            for (const Mode &mode : modes)
+            {
+                std::vector<Simulation> sims;
+                for (ParallelBackend backend : backends)
+                {
+                    parallel::setBackend(backend);
+                    Simulation sim = simulationFrom(base.state());
+                    mode.configure(sim);
+                    for (int s = 0; s < steps; ++s)
+                    {
+                        sim.step(colliders);
+                    }
+                    sims.push_back(std::move(sim));
+                }
+                bool same = true;
+                for (std::size_t b = 1; b < sims.size(); ++b)
+                {
+                    same = same && sameBits(sims.front().state(), sims[b].state());
+                }
+                allOk = allOk && same;
+                std::printf("    %-18s %s\n", mode.name, same ? "bit-identical" : "DIFFERENT");
+            }
+        }
+
+        // 3. 速度: 空に近い並列ループ1回 (起こして待つ手間)、グリッドと k-d 木の構築、1ステップ
+        {
+            const int count = 100000;
+            Simulation base(BENCH_CUBE_SIZE);
+            populate(base, count, 3);
+            std::printf("  %d boids, 3 species\n", count);
+            std::printf("  backend             empty loop(us)  grid build(ms)  kd build(ms)  step shared(ms)  step species(ms)\n");
+            for (ParallelBackend backend : backends)
+            {
+                parallel::setBackend(backend);
+
+                const int loops = 2000;
+                std::vector<int> touched(64, 0);
+                parallel::forEach(touched.size(), [&](std::size_t i)
+                                  { touched[i]++; }); // ウォームアップ (スレッドの起動)
+                auto start = std::chrono::steady_clock::now();
+                for (int l = 0; l < loops; ++l)
+                {
+                    parallel::forEach(touched.size(), [&](std::size_t i)
+                                      { touched[i]++; });
+                }
+                const double loopUs = elapsedMs(start) * 1000.0 / loops;
+
+                const int builds = 10;
+                SpatialGrid grid(BENCH_CUBE_SIZE, FLOCK_RADIUS);
+                grid.build(base.state());
+                start = std::chrono::steady_clock::now();
+                for (int i = 0; i < builds; ++i)
+                {
+                    grid.build(base.state());
+                }
+                const double gridMs = elapsedMs(start) / builds;
+
+                KdTree tree;
+                tree.build(base.state());
+                start = std::chrono::steady_clock::now();
+                for (int i = 0; i < builds; ++i)
+                {
+                    tree.build(base.state());
+                }
+                const double kdMs = elapsedMs(start) / builds;
+
+                double stepMs[2];
+                for (int partitioned = 0; partitioned < 2; ++partitioned)
+                {
+                    Simulation sim = simulationFrom(base.state());
+                    sim.partitionBySpecies = partitioned != 0;
+                    stepMs[partitioned] = timeSteps(sim, 5);
+                }
+                std::printf("  %-18s  %14.2f  %14.2f  %12.2f  %15.2f  %16.2f\n", parallelBackendName(backend), loopUs,
+                            gridMs, kdMs, stepMs[0], stepMs[1]);
+            }
+        }
+
+        parallel::setBackend(original);
+        return allOk;
+    }
+
+    // 操舵を数ステップおきに求め直す更新 (Simulation::steeringInterval) の確認と、間隔ごとの速さ・群れの統計の比較
+    bool benchMultirate()
+    {
+        const std::vector<SphereCollider> colliders = benchColliders();
+        const int intervals[] = {1, 2, 4, 8};
+        bool allOk = true;
+
+        // 1. 求め直さない個体の操舵の目標が前のステップのまま引き継がれているか (並べ替えをまたぐので ID で比べる)
+        //    最初のステップは目標がないので、間隔によらず全個体が求め直し、間隔 1 とビット単位で同じになるはず
+        {
+            const int count = 20000;
+            const int interval = 4;
+            const int steps = 3 * 64; // 空間順の並べ替え (reorderInterval) を何度かまたぐ
+            Simulation base(BENCH_CUBE_SIZE);
+            populate(base, count, 3);
+            struct Mode
+            {
+                const char *name;
+                std::function<void(Simulation &)> configure;
+            };
+            const Mode modes[] = {
+                {"specialized", [](Simulation &) {}},
+                {"fast math", [](Simulation &sim)
+                 { sim.fastMath = true; }},
+                {"generic", [](Simulation &sim)
+                 { sim.specializedUpdate = false; }},
+            };
+            std::printf("[multirate] %d boids, interval %d, %d steps\n", count, interval, steps);
+            std::printf("  update       order       first step  refreshed/step  stale targets  result\n");
+            for (const Mode &mode : modes)
+            {
+                for (bool staggered : {true, false})
+                {
+                    Simulation every = simulationFrom(base.state());
+                    every.staggeredSteering = staggered;
+                    Simulation sim = simulationFrom(base.state());
+                    sim.steeringInterval = interval;
+                    sim.staggeredSteering = staggered;
+                    mode.configure(every);
+                    mode.configure(sim);
+                    every.step(colliders);
+                    sim.step(colliders);
+                    const bool firstSame = sameBits(every.state(), sim.state());
+
+                    long refreshed = 0, stale = 0;
+                    std::vector<glm::vec3> previous(count);
+                    for (int s = 1; s <= steps; ++s)
+                    {
+                        for (int id = 0; id < count; ++id)
+                        {
+                            previous[id] = sim.state().steering(sim.state().indexOf(id));
+                        }
+                        sim.step(colliders);
+                        for (int id = 0; id < count; ++id)
+                        {
+                            const glm::vec3 target = sim.state().steering(sim.state().indexOf(id));
+                            const bool due = (s + (staggered ? id : 0)) % interval == 0;
+                            const bool same = std::memcmp(&target, &previous[id], sizeof(target)) == 0;
+                            if (due && !same)
+                                refreshed++;
+                            if (!due && !same)
+                                stale++;
+                        }
+                    }
+                    const bool ok = firstSame && stale == 0;
+                    allOk = allOk && ok;
+                    std::printf("  %-11s  %-10s  %-10s  %14.0f  %13ld  %s\n", mode.name,
+                                staggered ? "staggered" : "all at once", firstSame ? "same" : "DIFFERENT",
+                                static_cast<double>(refreshed) / steps, stale, ok ? "ok" : "FAIL");
+                }
+            }
+        }
+
+        // 2. 間隔ごとのステップ時間。まとめて求め直すと、求め直すステップだけが重くなる
+        {
+            const int count = 50000;
+            const int steps = 32;
+            Simulation base(BENCH_CUBE_SIZE);
+            populate(base, count, 3);
+            std::printf("  %d boids, mean of %d steps (ms):\n", count, steps);
+            std::printf("  interval  order        step  worst step  grid build  steering\n");
+            for (int interval : intervals)
+            {
+                for (bool staggered : {true, false})
+                {
+                    if (interval == 1 && !staggered)
+                        continue;
+                    Simulation sim = simulationFrom(base.state());
+                    sim.steeringInterval = interval;
+                    sim.staggeredSteering = staggered;
+                    sim.step(colliders); // ウォームアップ (全個体が求め直す)
+                    double totalMs = 0.0, worstMs = 0.0, gridMs = 0.0, steeringMs = 0.0;
+                    for (int s = 0; s < steps; ++s)
+                    {
+                        auto start = std::chrono::steady_clock::now();
+                        sim.step(colliders);
+                        const double ms = elapsedMs(start);
+                        totalMs += ms;
+                        worstMs = std::max(worstMs, ms);
+                        gridMs += sim.getLastTimings().gridBuildMs;
+                        steeringMs += sim.getLastTimings().steeringMs;
+                    }
+                    std::printf("  %8d  %-11s  %5.2f  %10.2f  %10.2f  %8.2f\n", interval,
+                                staggered ? "staggered" : "all at once", totalMs / steps, worstMs, gridMs / steps,
+                                steeringMs / steps);
+                }
+            }
+        }
+
+        // 3. 長く回したときの群れの統計 (ずらして求め直す既定の設定)。別々に生成した群れでの数回の実行の平均を比べ、
+        //    許容差は実行ごとのばらつきから求めた標準誤差の 4 倍。1つの群れの初期位置をずらしただけの実行は
+        //    互いに似た経過をたどり、ばらつきを小さく見積もってしまうので、実行ごとに群れを生成し直す
+        {
+            const int count = 1000;
+            const int longSteps = 4000;
+            const int warmup = 1000;
+            const int sampleInterval = 100;
+            const int runs = 16;
+            std::vector<FlockState> initial(runs);
+            for (int r = 0; r < runs; ++r)
+            {
+                Simulation base(BENCH_CUBE_SIZE);
+                populate(base, count, 3, static_cast<std::uint64_t>(r));
+                initial[r] = base.state();
+            }
+            std::vector<double> stats[4][2]; // [間隔][整列度/結合]
+            for (int k = 0; k < 4; ++k)
+            {
+                for (int r = 0; r < runs; ++r)
+                {
+                    Simulation sim = simulationFrom(initial[r]);
+                    sim.steeringInterval = intervals[k];
+                    double polarizationSum = 0.0, cohesionSum = 0.0;
+                    int samples = 0;
+                    for (int s = 1; s <= longSteps; ++s)
+                    {
+                        sim.step(colliders);
+                        if (s > warmup && s % sampleInterval == 0)
+                        {
+                            polarizationSum += polarization(sim.state());
+                            cohesionSum += cohesion(sim.state());
+                            samples++;
+                        }
+                    }
+                    stats[k][0].push_back(polarizationSum / samples);
+                    stats[k][1].push_back(cohesionSum / samples);
+                }
+            }
+            auto meanOf = [](const std::vector<double> &v)
+            {
+                double sum = 0.0;
+                for (double x : v)
+                    sum += x;
+                return sum / v.size();
+            };
+            auto varianceOf = [&](const std::vector<double> &v)
+            {
+                const double mean = meanOf(v);
+                double sum = 0.0;
+                for (double x : v)
+                    sum += (x - mean) * (x - mean);
+                return sum / (v.size() - 1);
+            };
+            std::printf("  %d boids, %d steps x %d runs (mean of steps %d-%d), staggered, compared with interval 1:\n",
+                        count, longSteps, runs, warmup, longSteps);
+            std::printf("  interval  polarization  tolerance  neighbors in radius  tolerance  result\n");
+            for (int k = 0; k < 4; ++k)
+            {
+                bool ok = true;
+                double tolerance[2];
+                for (int m = 0; m < 2; ++m)
+                {
+                    tolerance[m] = 4.0 * std::sqrt((varianceOf(stats[0][m]) + varianceOf(stats[k][m])) / runs);
+                    ok = ok && std::abs(meanOf(stats[k][m]) - meanOf(stats[0][m])) <= tolerance[m];
+                }
+                allOk = allOk && ok;
+                std::printf("  %8d  %12.3f  %9.3f  %19.3f  %9.3f  %s\n", intervals[k], meanOf(stats[k][0]),
+                            tolerance[0], meanOf(stats[k][1]), tolerance[1], ok ? "ok" : "FAIL");
+            }
+        }
+        std::printf("  result: %s\n", allOk ? "ok" : "FAIL");
+        return allOk;
+    }
+
+    // カメラに合わせた操舵の LOD (SteeringLod.h) の確認と、カメラの位置ごとの段階の内訳・省けた時間
+    bool benchLod()
+    {
+        const std::vector<SphereCollider> colliders = benchColliders();
+        bool allOk = true;
+        // 1. 全個体が Full になる設定なら、LOD なしとビット単位で同じか
+        {
+            const int count = 20000;
+            const int steps = 20;
+            Simulation base(BENCH_CUBE_SIZE);
+            populate(base, count, 3);
+            Simulation plain = simulationFrom(base.state());
+            Simulation allFull = simulationFrom(base.state());
+            allFull.lod.enabled = true;
+            allFull.lod.viewProjection = glm::mat4(1.0f);
+            allFull.lod.viewProjection[3][3] = 1000.0f; // 箱全体が視野に入る
+            allFull.lod.fullDistance = 1000.0f;
+            bool countsOk = true;
+            for (int s = 0; s < steps; ++s)
+            {
+                plain.step(colliders);
+                allFull.step(colliders);
+                const LodStats &stats = allFull.getLodStats();
+                // 最初のステップは操舵の目標がないので LOD を使わず、統計は 0 のまま
+                if (s > 0)
+                    countsOk = countsOk && stats.count[0] == count && stats.refreshed[0] == count && stats.skipped == 0;
+            }
+            const bool same = sameBits(plain.state(), allFull.state());
+            const bool ok = same && countsOk;
+            allOk = allOk && ok;
+            std::printf("[lod] %d boids, all boids in the full tier for %d steps: %s, tier counts %s  %s\n", count,
+                        steps, same ? "same as without LOD" : "DIFFERENT", countsOk ? "ok" : "wrong",
+                        ok ? "ok" : "FAIL");
+        }
+
+        // 2. main.cpp と同じ投影で、カメラの位置ごとの段階の内訳と時間
+        //    省けた時間は LOD なしとの操舵の時間の差 (実測) と、Simulation が毎ステップ出す見積もり (LodStats::savedMs)
+        {
+            const int count = 50000;
+            const int steps = 32;
+            Simulation base(BENCH_CUBE_SIZE);
+            populate(base, count, 3);
+            const glm::mat4 projection = glm::perspective(glm::radians(75.0f), 1200.0f / 800.0f, 0.1f, 1000.0f);
+            struct Camera
+            {
+                const char *name;
+                glm::vec3 position;
+            };
+            const Camera cameras[] = {
+                {"overview (main.cpp)", glm::vec3(0.0f, 0.0f, -60.0f)},
+                {"close-up", glm::vec3(0.0f, 0.0f, -25.0f)},
+                {"inside the box", glm::vec3(0.0f, 0.0f, -5.0f)},
+                {"far away", glm::vec3(0.0f, 0.0f, -100.0f)},
+            };
+            std::printf("  %d boids, mean of %d steps (ms):\n", count, steps);
+            std::printf("  camera                 full  reduced  minimal  step(no LOD)  step(LOD)  saved  estimated  result\n");
+            Simulation plain = simulationFrom(base.state());
+            double plainMs, plainSteerMs;
+            timeStepsDetailed(plain, colliders, steps, plainMs, plainSteerMs);
+            for (const Camera &camera : cameras)
+            {
+                Simulation sim = simulationFrom(base.state());
+                sim.lod.enabled = true;
+                sim.lod.cameraPos = camera.position;
+                sim.lod.viewProjection = projection * glm::lookAt(camera.position, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+                sim.step(colliders); // ウォームアップ (全個体が求め直す)
+                double totalMs = 0.0, steeringMs = 0.0, estimatedMs = 0.0;
+                bool countsOk = true;
+                for (int s = 0; s < steps; ++s)
+                {
+                    auto start = std::chrono::steady_clock::now();
+                    sim.step(colliders);
+                    totalMs += elapsedMs(start);
+                    steeringMs += sim.getLastTimings().steeringMs;
+                    const LodStats &stats = sim.getLodStats();
+                    estimatedMs += stats.savedMs;
+                    countsOk = countsOk && stats.count[0] + stats.count[1] + stats.count[2] == count &&
+                               stats.refreshed[0] == stats.count[0];
+                }
+                allOk = allOk && countsOk;
+                const LodStats &stats = sim.getLodStats();
+                std::printf("  %-20s  %5d  %7d  %7d  %12.2f  %9.2f  %5.2f  %9.2f  %s\n", camera.name, stats.count[0],
+                            stats.count[1], stats.count[2], plainMs, totalMs / steps, plainSteerMs - steeringMs / steps,
+                            estimatedMs / steps, countsOk ? "ok" : "FAIL");
+            }
+        }
+        std::printf("  result: %s\n", allOk ? "ok" : "FAIL");
+        return allOk;
+    }
+
+    // カウンタ方式の乱数 (Philox.h) の確認: 既知の値、スレッド数によらない生成、分布、速さ
+    bool benchRandom()
+    {
+        bool allOk = true;
+
+        // 1. Random123 の既知の値 (Philox4x32-10)
+        {
+            struct KnownAnswer
+            {
+                std::uint32_t counter[4];
+                std::uint32_t key[2];
+                std::uint32_t expected[4];
+            };
+            const KnownAnswer answers[] = {
+                {{0, 0, 0, 0}, {0, 0}, {0x6627e8d5u, 0xe169c58du, 0xbc57ac4cu, 0x9b00dbd8u}},
+                {{0xffffffffu, 0xffffffffu, 0xffffffffu, 0xffffffffu},
+                 {0xffffffffu, 0xffffffffu},
+                 {0x408f276du, 0x41c83b0eu, 0xa20bc7c6u, 0x6d5451fdu}},
+                {{0x243f6a88u, 0x85a308d3u, 0x13198a2eu, 0x03707344u},
+                 {0xa4093822u, 0x299f31d0u},
+                 {0xd16cfe09u, 0x94fdccebu, 0x5001e420u, 0x24126ea1u}},
+            };
+            bool knownOk = true;
+            for (const KnownAnswer &answer : answers)
+            {
+                std::uint32_t out[4];
+                Philox::block(answer.counter, answer.key, out);
+                knownOk = knownOk && std::memcmp(out, answer.expected, sizeof(out)) == 0;
+            }
+            allOk = allOk && knownOk;
+            std::printf("[rng] Philox4x32-10 known answers: %s\n", knownOk ? "ok" : "FAIL");
+        }
+
+        // 2. 初期配置を並列に作っても、順に spawn したものとビット単位で同じか (スレッド数・バックエンドを変えて)
+        //    さらに、その群れを進めた結果もスレッド数によらず同じか
+        {
+            const int count = 100000;
+            const int steps = 20;
+            const int maxThreads = parallel::threadCount();
+            const ParallelBackend original = parallel::backend();
+            const std::vector<SphereCollider> colliders = benchColliders();
+
+            FlockState serial;
+            serial.reserve(count);
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < count; ++i)
+            {
+                Creature::spawn(serial, BENCH_CUBE_SIZE, i % 3);
+            }
+            const double serialMs = elapsedMs(start);
+            std::printf("  %d boids, spawn one by one: %.2f ms\n", count, serialMs);
+            std::printf("  backend             threads  placement(ms)  placement  %d steps\n", steps);
+
+            Simulation reference = simulationFrom(serial);
+            parallel::setThreadCount(1);
+            for (int s = 0; s < steps; ++s)
+            {
+                reference.step(colliders);
+            }
+
+            for (ParallelBackend backend : {ParallelBackend::OpenMP, ParallelBackend::StdExecution, ParallelBackend::WorkStealing})
+            {
+                if (!parallel::available(backend))
+                    continue;
+                parallel::setBackend(backend);
+                for (int threads : {1, 2, std::max(maxThreads, 8)})
+                {
+                    parallel::setThreadCount(threads);
+                    std::vector<glm::vec3> positions(count), directions(count);
+                    start = std::chrono::steady_clock::now();
+                    parallel::forRange(count, 4096, [&](std::size_t begin, std::size_t end)
+                                       {
+                                           for (std::size_t i = begin; i < end; ++i)
+                                           {
+                                               Creature::randomPlacement(DEFAULT_RANDOM_SEED, static_cast<int>(i), BENCH_CUBE_SIZE,
+                                                                         positions[i], directions[i]);
+                                           } });
+                    const double parallelMs = elapsedMs(start);
+
+                    Simulation sim(BENCH_CUBE_SIZE);
+                    FlockState &state = sim.population();
+                    state.reserve(count);
+                    for (int i = 0; i < count; ++i)
+                    {
+                        state.add(i % 3, positions[i], directions[i], serial.speed[i], serial.maxTurn[i]);
+                    }
+                    const bool placementOk = sameBits(serial, state);
+                    sim.finalizePopulation();
+                    for (int s = 0; s < steps; ++s)
+                    {
+                        sim.step(colliders);
+                    }
+                    const bool stepsOk = sameBits(reference.state(), sim.state());
+                    allOk = allOk && placementOk && stepsOk;
+                    std::printf("  %-18s  %7d  %13.2f  %-9s  %s\n", parallelBackendName(backend), threads, parallelMs,
+                                placementOk ? "same" : "DIFFERENT", stepsOk ? "bit-identical" : "DIFFERENT");
+                }
+            }
+            parallel::setThreadCount(maxThreads);
+            parallel::setBackend(original);
+
+            // 種を変えれば別の群れになる
+            FlockState other;
+            Creature::spawn(other, BENCH_CUBE_SIZE, 0, DEFAULT_RANDOM_SEED + 1);
+            const bool seedOk = other.posX[0] != serial.posX[0] || other.posY[0] != serial.posY[0];
+            allOk = allOk && seedOk;
+            std::printf("  another seed gives another flock: %s\n", seedOk ? "ok" : "FAIL");
+        }
+
+        // 3. 一様分布の偏り (64 区間のカイ二乗。自由度 63 の 99.9% 点は約 103) と、1つ引く時間の mt19937 との比較
+        {
+            const int samples = 1 << 22;
+            const int bins = 64;
+            std::vector<long> histogram(bins, 0);
+            Philox philox(DEFAULT_RANDOM_SEED, 0, 0, RandomStream::Spawn);
+            double sum = 0.0;
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < samples; ++i)
+            {
+                const float u = philox.uniform();
+                sum += u;
+                histogram[static_cast<int>(u * bins)]++;
+            }
+            const double philoxNs = elapsedMs(start) * 1e6 / samples;
+
+            std::mt19937 mt(1);
+            std::uniform_real_distribution<float> dis(0.0f, 1.0f);
+            double mtSum = 0.0;
+            start = std::chrono::steady_clock::now();
+            for (int i = 0; i < samples; ++i)
+            {
+                mtSum += dis(mt);
+            }
+            const double mtNs = elapsedMs(start) * 1e6 / samples;
+
+            const double expected = static_cast<double>(samples) / bins;
+            double chiSquare = 0.0;
+            for (long observed : histogram)
+            {
+                chiSquare += (observed - expected) * (observed - expected) / expected;
+            }
+            const bool uniformOk = chiSquare < 103.0;
+            allOk = allOk && uniformOk;
+            // sum は最適化で消されないように出力する
+            std::printf("  uniform: chi-square %.1f over %d bins  %s (mean %.4f)\n", chiSquare, bins,
+                        uniformOk ? "ok" : "FAIL", sum / samples);
+            std::printf("  ns per float: Philox %.2f, mt19937 %.2f (mean %.4f)\n", philoxNs, mtNs, mtSum / samples);
+        }
+        std::printf("  result: %s\n", allOk ? "ok" : "FAIL");
+        return allOk;
+    }
+
+    // 群れをまとめて並列に生成する spawnPopulation の確認と、個体数ごとの起動時間
+    bool benchPopulation()
+    {
+        bool allOk = true;
+        const int maxThreads = parallel::threadCount();
+
+        // 1. Uniform のグループは、同じ順に1体ずつ spawn したものとビット単位で同じか (main.cpp の構成)
+        {
+            const std::vector<SpawnGroup> groups = {{0, 450}, {1, 30}, {2, 50}};
+            FlockState serial;
+            for (const SpawnGroup &group : groups)
+            {
+                for (int i = 0; i < group.count; ++i)
+                {
+                    Creature::spawn(serial, BENCH_CUBE_SIZE, group.speciesID);
+                }
+            }
+            FlockState bulk;
+            spawnPopulation(bulk, BENCH_CUBE_SIZE, groups, DEFAULT_RANDOM_SEED);
+            const bool same = sameBits(serial, bulk) &&
+                              std::memcmp(serial.speed.data(), bulk.speed.data(), serial.size() * sizeof(float)) == 0 &&
+                              std::memcmp(serial.speciesID.data(), bulk.speciesID.data(), serial.size() * sizeof(int)) == 0 &&
+                              std::memcmp(serial.boidID.data(), bulk.boidID.data(), serial.size() * sizeof(int)) == 0;
+            allOk = allOk && same;
+            std::printf("[population] 450/30/50 uniform, bulk vs one by one: %s\n", same ? "bit-identical" : "DIFFERENT");
+        }
+
+        // 2. 分布を混ぜた群れが、スレッド数によらず同じになり、分布の形も合っているか
+        {
+            const glm::vec3 sphereCenter(-8.0f, 4.0f, 2.0f);
+            const glm::vec3 gaussianCenter(6.0f, -5.0f, 0.0f);
+            const std::vector<SpawnGroup> groups = {
+                {0, 200000, SpawnDistribution::Uniform},
+                {1, 100000, SpawnDistribution::Sphere, sphereCenter, 6.0f},
+                {2, 100000, SpawnDistribution::Gaussian, gaussianCenter, 2.0f},
+            };
+            FlockState reference;
+            parallel::setThreadCount(1);
+            spawnPopulation(reference, BENCH_CUBE_SIZE, groups, DEFAULT_RANDOM_SEED);
+            bool threadsOk = true;
+            for (int threads : {2, std::max(maxThreads, 8)})
+            {
+                FlockState state;
+                parallel::setThreadCount(threads);
+                spawnPopulation(state, BENCH_CUBE_SIZE, groups, DEFAULT_RANDOM_SEED);
+                threadsOk = threadsOk && sameBits(reference, state);
+            }
+            parallel::setThreadCount(maxThreads);
+            allOk = allOk && threadsOk;
+            std::printf("  400000 boids (uniform/sphere/gaussian), 1 vs 2/%d threads: %s\n", std::max(maxThreads, 8),
+                        threadsOk ? "bit-identical" : "DIFFERENT");
+
+            // 球の中に収まっているか / 正規分布の平均と標準偏差
+            const SpeciesRange sphere{200000, 300000};
+            const SpeciesRange gaussian{300000, 400000};
+            float farthest = 0.0f;
+            for (std::size_t i = sphere.begin; i < sphere.end; ++i)
+            {
+                farthest = std::max(farthest, glm::length(reference.position(i) - sphereCenter));
+            }
+            double sum[3] = {}, squares[3] = {};
+            for (std::size_t i = gaussian.begin; i < gaussian.end; ++i)
+            {
+                const glm::vec3 d = reference.position(i) - gaussianCenter;
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    sum[axis] += d[axis];
+                    squares[axis] += static_cast<double>(d[axis]) * d[axis];
+                }
+            }
+            double mean[3], deviation[3];
+            bool shapeOk = farthest <= 6.0f * 1.0001f;
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                mean[axis] = sum[axis] / gaussian.count();
+                deviation[axis] = std::sqrt(squares[axis] / gaussian.count() - mean[axis] * mean[axis]);
+                shapeOk = shapeOk && std::abs(mean[axis]) < 0.05 && std::abs(deviation[axis] - 2.0) < 0.05;
+            }
+            allOk = allOk && shapeOk;
+            std::printf("  sphere: farthest %.3f (radius 6), gaussian: mean %.3f/%.3f/%.3f (0), sigma %.3f/%.3f/%.3f (2)  %s\n",
+                        farthest, mean[0], mean[1], mean[2], deviation[0], deviation[1], deviation[2], shapeOk ? "ok" : "FAIL");
+        }
+
+        // 3. 起動時間: 1体ずつ spawn する従来の方法と、まとめて確保して並列に埋める方法
+        std::printf("  boids      one by one(ms)  bulk(ms)  allocate  fill     finalize(ms)  speedup\n");
+        for (int count : {100000, 1000000, 2000000})
+        {
+            const std::vector<SpawnGroup> groups = {
+                {0, count * 450 / 530}, {1, count * 30 / 530}, {2, count - count * 450 / 530 - count * 30 / 530}};
+
+            double serialMs;
+            {
+                Simulation sim(BENCH_CUBE_SIZE);
+                auto start = std::chrono::steady_clock::now();
+                FlockState &state = sim.population();
+                state.reserve(count);
+                for (const SpawnGroup &group : groups)
+                {
+                    for (int i = 0; i < group.count; ++i)
+                    {
+                        Creature::spawn(state, BENCH_CUBE_SIZE, group.speciesID);
+                    }
+                }
+                sim.finalizePopulation();
+                serialMs = elapsedMs(start);
+            }
+            Simulation sim(BENCH_CUBE_SIZE);
+            auto start = std::chrono::steady_clock::now();
+            const PopulationTimings timings = spawnPopulation(sim.population(), BENCH_CUBE_SIZE, groups, DEFAULT_RANDOM_SEED);
+            auto finalizeStart = std::chrono::steady_clock::now();
+            sim.finalizePopulation();
+            const double finalizeMs = elapsedMs(finalizeStart);
+            const double bulkMs = elapsedMs(start);
+            std::printf("  %-9d  %14.2f  %8.2f  %8.2f  %7.2f  %12.2f  %6.2fx\n", count, serialMs, bulkMs,
+                        timings.allocateMs, timings.fillMs, finalizeMs, serialMs / bulkMs);
+        }
+        std::printf("  result: %s\n", allOk ? "ok" : "FAIL");
+        return allOk;
+    }
+
+    // 岩礁のように、広い箱の底に岩 (球のコライダー) を count 個敷き詰める
+    std::vector<SphereCollider> reefColliders(int count, float cubeSize)
+    {
+        std::vector<SphereCollider> rocks;
+        rocks.reserve(count);
+        for (int c = 0; c < count; ++c)
+        {
+            Philox random(DEFAULT_RANDOM_SEED, static_cast<std::uint32_t>(c), 0, RandomStream::Spawn);
+            const glm::vec3 center(random.uniform(-0.95f, 0.95f) * cubeSize, -cubeSize + random.uniform(0.0f, 15.0f),
+                                   random.uniform(-0.95f, 0.95f) * cubeSize);
+            rocks.emplace_back(center, random.uniform(0.5f, 3.0f));
+        }
+        return rocks;
+    }
+
+    // 多数のコライダーの衝突判定を ColliderGrid で絞り込む場合と、全コライダーを SIMD で調べる場合の比較
+    bool benchColliderGrid()
+    {
+        const float cubeSize = 200.0f;
+        const int boidCount = 20000;
+        const FlockKernelSet &k = activeKernels();
+        bool allOk = true;
+
+        // 岩の近く (底から 30 の範囲) にいる個体の位置と向き
+        FlockState boids;
+        spawnPopulation(boids, cubeSize, {{0, boidCount}}, DEFAULT_RANDOM_SEED);
+        for (int i = 0; i < boidCount; ++i)
+        {
+            Philox random(DEFAULT_RANDOM_SEED, static_cast<std::uint32_t>(i), 1, RandomStream::SpawnPosition);
+            boids.posY[i] = -cubeSize + random.uniform(0.0f, 30.0f);
+        }
+
+        std::printf("[colliders] %d boids near a reef floor (cube %.0f), one collision pass\n", boidCount, cubeSize);
+        std::printf("  colliders  build(ms)  cells     per collider  all %-6s(ms)  grid(ms)  speedup  hits   vs scalar\n", k.name);
+        for (int colliderCount : {10, 1000, 100000})
+        {
+            const std::vector<SphereCollider> rocks = reefColliders(colliderCount, cubeSize);
+            ColliderGrid grid;
+            grid.build(rocks);
+
+            FlockState all = boids;
+            FlockState indexed = boids;
+            auto start = std::chrono::steady_clock::now();
+            k.collide(all.boidArrays(), 0, all.size(), rocks.data(), colliderCount);
+            const double allMs = elapsedMs(start);
+            start = std::chrono::steady_clock::now();
+            grid.collide(indexed.boidArrays(), 0, indexed.size());
+            const double gridMs = elapsedMs(start);
+
+            // 基準実装 (FMA を使わない) と同じ式なので、ビット単位で同じになるか。
+            // 命令セットごとのカーネルとは FMA の分だけ丸めが違い、密に並んだ岩の間で何度も押し出されると差が広がる
+            FlockState reference = boids;
+            scalarKernels().collide(reference.boidArrays(), 0, reference.size(), rocks.data(), colliderCount);
+            int hits = 0;
+            for (int i = 0; i < boidCount; ++i)
+            {
+                hits += reference.position(i) != boids.position(i) ? 1 : 0;
+            }
+            const bool ok = sameBits(reference, indexed);
+            allOk = allOk && ok;
+            std::printf("  %9d  %9.2f  %8d  %12.1f  %13.2f  %8.3f  %6.1fx  %5d  %s\n", colliderCount, grid.getBuildMs(),
+                        grid.cellCount(), static_cast<double>(grid.entryCount()) / colliderCount, allMs, gridMs,
+                        allMs / gridMs, hits, ok ? "bit-identical" : "DIFFERENT");
+        }
+
+        // Simulation のステップ全体 (コライダーの数が colliderGridMinCount 未満でもグリッドを使わせて比べる)
+        std::printf("  step with %d boids spread over the cube:\n", boidCount);
+        std::printf("  colliders  all(ms)   grid(ms)  speedup\n");
+        Simulation base(cubeSize);
+        spawnPopulation(base.population(), cubeSize, {{0, boidCount / 2}, {1, boidCount / 2}}, DEFAULT_RANDOM_SEED);
+        base.finalizePopulation();
+        for (int colliderCount : {10, 1000, 100000})
+        {
+            const std::vector<SphereCollider> rocks = reefColliders(colliderCount, cubeSize);
+            double stepMs[2];
+            for (int useGrid = 0; useGrid < 2; ++useGrid)
+            {
+                Simulation sim = simulationFrom(base.state(), cubeSize);
+                sim.useColliderGrid = useGrid != 0;
+                sim.colliderGridMinCount = 0;
+                sim.step(rocks); // グリッドはここで作られる
+                const int steps = 3;
+                auto start = std::chrono::steady_clock::now();
+                for (int s = 0; s < steps; ++s)
+                {
+                    sim.step(rocks);
+                }
+                stepMs[useGrid] = elapsedMs(start) / steps;
+            }
+            std::printf("  %9d  %8.2f  %8.2f  %6.1fx\n", colliderCount, stepMs[0], stepMs[1], stepMs[0] / stepMs[1]);
+        }
+        std::printf("  result: %s\n", allOk ? "ok" : "FAIL");
+        return allOk;
+    }
+
+    // 障害物を焼き込んだ距離場 (DistanceField) の精度・焼き込みとキャッシュの時間・衝突処理の手間
+    bool benchDistanceField()
+    {
+        bool allOk = true;
+        ObstacleSet scene;
+        for (const SphereCollider &collider : benchColliders())
+        {
+            scene.spheres.push_back(SphereObstacle{collider.center, collider.radius});
+        }
+        scene.boxes.push_back(BoxObstacle{glm::vec3(0.0f, -17.0f, 0.0f), glm::vec3(8.0f, 1.0f, 8.0f)});
+        scene.meshes.push_back(TriangleMesh::sphere(glm::vec3(8.0f, 5.0f, -6.0f), 4.0f, 32, 16));
+        std::printf("[sdf] %zu spheres, %zu box, mesh of %zu triangles in a cube of %.0f\n", scene.spheres.size(),
+                    scene.boxes.size(), scene.meshes[0].triangleCount(), BENCH_CUBE_SIZE);
+
+        // 1. 表面の近く (|距離| < 8) での、焼き込んだ距離と法線の誤差 (基準は ObstacleSet::distance をその場で計算したもの)
+        std::printf("  nodes   spacing  bake(ms)  max error  mean error  mean normal error(deg)  result\n");
+        for (int resolution : {48, 64, 96})
+        {
+            DistanceField field;
+            field.bake(scene, BENCH_CUBE_SIZE, resolution);
+            double errorSum = 0.0, angleSum = 0.0;
+            float maxError = 0.0f;
+            int samples = 0;
+            for (std::uint32_t n = 0; samples < 4000; ++n)
+            {
+                Philox random(DEFAULT_RANDOM_SEED, n, 0, RandomStream::SpawnPosition);
+                const glm::vec3 p(random.uniform(-1.0f, 1.0f) * BENCH_CUBE_SIZE, random.uniform(-1.0f, 1.0f) * BENCH_CUBE_SIZE,
+                                  random.uniform(-1.0f, 1.0f) * BENCH_CUBE_SIZE);
+                const float exact = scene.distance(p);
+                if (std::abs(exact) >= 8.0f)
+                    continue;
+                glm::vec3 normal;
+                const float baked = field.sample(p, normal);
+                const float h = 1e-2f;
+                const glm::vec3 exactGradient(scene.distance(p + glm::vec3(h, 0, 0)) - scene.distance(p - glm::vec3(h, 0, 0)),
+                                              scene.distance(p + glm::vec3(0, h, 0)) - scene.distance(p - glm::vec3(0, h, 0)),
+                                              scene.distance(p + glm::vec3(0, 0, h)) - scene.distance(p - glm::vec3(0, 0, h)));
+                if (glm::length(exactGradient) < 1e-4f)
+                    continue;
+                const float cosine = glm::clamp(glm::dot(normal, glm::normalize(exactGradient)), -1.0f, 1.0f);
+                angleSum += std::acos(cosine) * 180.0 / glm::pi<double>();
+                errorSum += std::abs(baked - exact);
+                maxError = std::max(maxError, std::abs(baked - exact));
+                samples++;
+            }
+            // 三線形補間の誤差は格子の間隔程度まで (箱の角や2つの障害物の境目など、距離が折れ曲がるところで大きくなる)
+            const bool ok = maxError < field.getSpacing();
+            allOk = allOk && ok;
+            std::printf("  %3d^3  %7.3f  %8.1f  %9.3f  %10.4f  %22.2f  %s\n", resolution, field.getSpacing(),
+                        field.getBakeMs(), maxError, errorSum / samples, angleSum / samples, ok ? "ok" : "FAIL");
+        }
+
+        // 2. 障害物が多いシーンの焼き込みと、キャッシュからの読み込み
+        {
+            ObstacleSet reef = scene;
+            for (int c = 0; c < 200; ++c)
+            {
+                Philox random(DEFAULT_RANDOM_SEED, static_cast<std::uint32_t>(c), 0, RandomStream::SpawnPosition);
+                const glm::vec3 center(random.uniform(-18.0f, 18.0f), random.uniform(-20.0f, -12.0f), random.uniform(-18.0f, 18.0f));
+                if (c % 4 == 0)
+                    reef.boxes.push_back(BoxObstacle{center, glm::vec3(random.uniform(0.5f, 2.0f))});
+                else
+                    reef.spheres.push_back(SphereObstacle{center, random.uniform(0.3f, 1.5f)});
+            }
+            const char *path = "sdf_bench_cache.bin";
+            std::remove(path);
+            const int resolution = 96;
+            DistanceField baked;
+            const bool firstLoaded = baked.bakeOrLoad(reef, BENCH_CUBE_SIZE, resolution, path);
+            DistanceField loaded;
+            const bool secondLoaded = loaded.bakeOrLoad(reef, BENCH_CUBE_SIZE, resolution, path);
+            bool same = true;
+            for (int n = 0; n < 1000 && same; ++n)
+            {
+                const glm::vec3 p = glm::vec3(n % 10, (n / 10) % 10, n / 100) * 3.9f - glm::vec3(BENCH_CUBE_SIZE);
+                glm::vec3 a, b;
+                same = baked.sample(p, a) == loaded.sample(p, b) && a == b;
+            }
+            // 障害物が変われば鍵が変わり、古いキャッシュは使われない
+            ObstacleSet moved = reef;
+            moved.spheres[0].center.x += 0.5f;
+            DistanceField stale;
+            const bool staleLoaded = stale.load(path, DistanceField::cacheKey(moved, BENCH_CUBE_SIZE, resolution));
+            std::remove(path);
+            const bool ok = !firstLoaded && secondLoaded && same && !staleLoaded;
+            allOk = allOk && ok;
+            std::printf("  %zu spheres + %zu boxes + mesh, %d^3: bake %.1f ms, load from cache %.2f ms (%s), "
+                        "changed scene rebakes: %s  %s\n",
+                        reef.spheres.size(), reef.boxes.size(), resolution, baked.getBakeMs(), loaded.getBakeMs(),
+                        same ? "same field" : "DIFFERENT", staleLoaded ? "no" : "yes", ok ? "ok" : "FAIL");
+        }
+
+        // 3. 衝突処理の手間: 距離場は障害物の数によらず1回の補間、球のコライダーは数に比例する
+        {
+            const int count = 20000;
+            const FlockKernelSet &k = activeKernels();
+            DistanceField field;
+            field.bake(scene, BENCH_CUBE_SIZE, 64);
+            FlockState boids;
+            spawnPopulation(boids, BENCH_CUBE_SIZE, {{0, count}}, DEFAULT_RANDOM_SEED);
+            const int repeats = 10;
+            FlockState work = boids;
+            auto start = std::chrono::steady_clock::now();
+            for (int r = 0; r < repeats; ++r)
+            {
+                field.collide(work.boidArrays(), 0, count, COLLIDER_MARGIN);
+            }
+            const double fieldNs = elapsedMs(start) * 1e6 / (static_cast<double>(count) * repeats);
+            std::printf("  collision ns/boid: distance field %.1f (any number of shapes)", fieldNs);
+            for (int colliderCount : {2, 16, 128})
+            {
+                const std::vector<SphereCollider> rocks = reefColliders(colliderCount, BENCH_CUBE_SIZE);
+                work = boids;
+                start = std::chrono::steady_clock::now();
+                for (int r = 0; r < repeats; ++r)
+                {
+                    k.collide(work.boidArrays(), 0, count, rocks.data(), colliderCount);
+                }
+                std::printf(", %d spheres %.1f", colliderCount, elapsedMs(start) * 1e6 / (static_cast<double>(count) * repeats));
+            }
+            std::printf("\n");
+        }
+
+        // 4. 距離場を使って群れを進めても、障害物に入り込んだ個体が残らないか
+        {
+            DistanceField field;
+            field.bake(scene, BENCH_CUBE_SIZE, 64);
+            Simulation sim(BENCH_CUBE_SIZE);
+            populate(sim, 5000, 3);
+            sim.obstacleField = &field;
+            const std::vector<SphereCollider> none;
+            for (int s = 0; s < 300; ++s)
+            {
+                sim.step(none);
+            }
+            int inside = 0;
+            for (std::size_t i = 0; i < sim.state().size(); ++i)
+            {
+                inside += scene.distance(sim.state().position(i)) < 0.0f ? 1 : 0;
+            }
+            const bool ok = inside == 0;
+            allOk = allOk && ok;
+            std::printf("  5000 boids, 300 steps with the field: %d inside an obstacle  %s\n", inside, ok ? "ok" : "FAIL");
+        }
+        std::printf("  result: %s\n", allOk ? "ok" : "FAIL");
+        return allOk;
+    }
+
+    // 立方体の中に散らばる sphereCount 個の UV 球 (1つあたり 2 * sectors * sectors / 2 個の三角形)
+    std::vector<TriangleMesh> decorationMeshes(int sphereCount, int sectors, float cubeSize)
+    {
+        std::vector<TriangleMesh> meshes;
+        for (int m = 0; m < sphereCount; ++m)
+        {
+            Philox random(DEFAULT_RANDOM_SEED, static_cast<std::uint32_t>(m), 1, RandomStream::SpawnPosition);
+            const glm::vec3 center(random.uniform(-0.8f, 0.8f) * cubeSize, random.uniform(-0.8f, 0.8f) * cubeSize,
+                                   random.uniform(-0.8f, 0.8f) * cubeSize);
+            meshes.push_back(TriangleMesh::sphere(center, random.uniform(2.0f, 4.0f), sectors, sectors / 2));
+        }
+        return meshes;
+    }
+
+    // 三角形メッシュの BVH: 構築時間と木の質、光線の正しさと本数/秒、先読みの光線で避けられるか
+    bool benchMeshBvh()
+    {
+        bool allOk = true;
+        const float lookAhead = 3.0f;
+
+        // 1. 構築 (16 個の球、三角形の数を変える)
+        std::printf("[bvh] SAH BVH over %d spheres of triangles in a cube of %.0f (threads: %d)\n", 16, BENCH_CUBE_SIZE,
+                    parallel::threadCount());
+        std::printf("  triangles  nodes    build(ms)  Mtri/s  SAH cost\n");
+        for (int sectors : {32, 128, 256})
+        {
+            const std::vector<TriangleMesh> meshes = decorationMeshes(16, sectors, BENCH_CUBE_SIZE);
+            MeshBvh bvh;
+            bvh.build(meshes);
+            std::printf("  %9zu  %7d  %9.1f  %6.2f  %8.1f\n", bvh.triangleCount(), bvh.nodeCount(), bvh.getBuildMs(),
+                        bvh.triangleCount() / bvh.getBuildMs() / 1000.0, bvh.sahCost());
+        }
+
+        const std::vector<TriangleMesh> meshes = decorationMeshes(16, 64, BENCH_CUBE_SIZE);
+        MeshBvh bvh;
+        bvh.build(meshes);
+
+        // 2. 1本ずつ・まとめてたどった結果が、全三角形を調べた結果と同じか
+        {
+            std::vector<glm::vec3> v0, v1, v2;
+            for (const TriangleMesh &mesh : meshes)
+            {
+                for (std::size_t t = 0; t < mesh.triangleCount(); ++t)
+                {
+                    v0.push_back(mesh.vertex(t, 0));
+                    v1.push_back(mesh.vertex(t, 1));
+                    v2.push_back(mesh.vertex(t, 2));
+                }
+            }
+            const int rays = 2048;
+            const float length = 10.0f;
+            int mismatches = 0, hits = 0;
+            RayPacket packet;
+            for (int first = 0; first < rays; first += RayPacket::SIZE)
+            {
+                RayHit single[RayPacket::SIZE];
+                bool singleHit[RayPacket::SIZE];
+                float brute[RayPacket::SIZE];
+                for (int lane = 0; lane < RayPacket::SIZE; ++lane)
+                {
+                    Philox random(DEFAULT_RANDOM_SEED, static_cast<std::uint32_t>(first + lane), 2, RandomStream::SpawnPosition);
+                    const glm::vec3 origin(random.uniform(-1.0f, 1.0f) * BENCH_CUBE_SIZE, random.uniform(-1.0f, 1.0f) * BENCH_CUBE_SIZE,
+                                           random.uniform(-1.0f, 1.0f) * BENCH_CUBE_SIZE);
+                    const glm::vec3 direction = glm::normalize(glm::vec3(random.uniform(-1.0f, 1.0f), random.uniform(-1.0f, 1.0f),
+                                                                         random.uniform(-1.0f, 1.0f)));
+                    packet.set(lane, origin, direction, length);
+                    singleHit[lane] = bvh.intersect(origin, direction, length, single[lane]);
+                    // 総当たり (Möller-Trumbore を double で)
+                    brute[lane] = length;
+                    for (std::size_t t = 0; t < v0.size(); ++t)
+                    {
+                        const glm::vec3 e1 = v1[t] - v0[t], e2 = v2[t] - v0[t];
+                        const glm::vec3 p = glm::cross(direction, e2);
+                        const double det = glm::dot(e1, p);
+                        if (std::abs(det) < 1e-12)
+                            continue;
+                        const glm::vec3 sv = origin - v0[t];
+                        const double u = glm::dot(sv, p) / det;
+                        const glm::vec3 q = glm::cross(sv, e1);
+                        const double v = glm::dot(direction, q) / det;
+                        const double d = glm::dot(e2, q) / det;
+                        if (u >= 0.0 && v >= 0.0 && u + v <= 1.0 && d > 0.0 && d < brute[lane])
+                            brute[lane] = static_cast<float>(d);
+                    }
+                }
+                bvh.intersect(packet);
+                for (int lane = 0; lane < RayPacket::SIZE; ++lane)
+                {
+                    const float singleDistance = singleHit[lane] ? single[lane].distance : length;
+                    const bool packetHit = packet.triangle[lane] >= 0;
+                    hits += singleHit[lane] ? 1 : 0;
+                    // 1本ずつとまとめては同じ式なので同じ値、総当たりとは辺の上をかすめる光線だけ違ってよい
+                    if (packetHit != singleHit[lane] || packet.tMax[lane] != singleDistance ||
+                        std::abs(singleDistance - brute[lane]) > 1e-3f)
+                        mismatches++;
+                }
+            }
+            const bool ok = mismatches == 0;
+            allOk = allOk && ok;
+            std::printf("  %d random rays (length %.0f) against %zu triangles: %d hits, %d mismatches vs brute force  %s\n",
+                        rays, length, bvh.triangleCount(), hits, mismatches, ok ? "ok" : "FAIL");
+        }
+
+        // 3. 光線の本数/秒 (10 万体が向きに沿って lookAhead 先まで)
+        {
+            const int count = 100000;
+            const int repeats = 5;
+            FlockState boids;
+            spawnPopulation(boids, BENCH_CUBE_SIZE, {{0, count}}, DEFAULT_RANDOM_SEED);
+            FlockState sorted = boids;
+            sorted.sortBySpatialOrder(BENCH_CUBE_SIZE);
+
+            auto measureSingle = [&](const FlockState &state)
+            {
+                int hits = 0;
+                auto start = std::chrono::steady_clock::now();
+                for (int r = 0; r < repeats; ++r)
+                {
+                    for (std::size_t i = 0; i < state.size(); ++i)
+                    {
+                        RayHit hit;
+                        hits += bvh.intersect(state.position(i), state.direction(i), lookAhead, hit) ? 1 : 0;
+                    }
+                }
+                const double ms = elapsedMs(start);
+                return std::make_pair(static_cast<double>(count) * repeats / ms / 1000.0, hits / repeats);
+            };
+            auto measurePacket = [&](const FlockState &state)
+            {
+                int hits = 0;
+                RayPacket packet;
+                auto start = std::chrono::steady_clock::now();
+                for (int r = 0; r < repeats; ++r)
+                {
+                    for (std::size_t first = 0; first < state.size(); first += RayPacket::SIZE)
+                    {
+                        for (int lane = 0; lane < RayPacket::SIZE; ++lane)
+                        {
+                            if (first + lane < state.size())
+                                packet.set(lane, state.position(first + lane), state.direction(first + lane), lookAhead);
+                            else
+                                packet.disable(lane);
+                        }
+                        bvh.intersect(packet);
+                        for (int lane = 0; lane < RayPacket::SIZE; ++lane)
+                        {
+                            hits += packet.triangle[lane] >= 0 ? 1 : 0;
+                        }
+                    }
+                }
+                const double ms = elapsedMs(start);
+                return std::make_pair(static_cast<double>(count) * repeats / ms / 1000.0, hits / repeats);
+            };
+            // 群れとして動いた後 (近くの個体は向きもそろう)
+            Simulation flocked(BENCH_CUBE_SIZE);
+            populate(flocked, count, 3);
+            const std::vector<SphereCollider> none;
+            for (int s = 0; s < 128; ++s)
+            {
+                flocked.step(none);
+            }
+            const auto singleFlock = measureSingle(flocked.state());
+            const auto packetFlock = measurePacket(flocked.state());
+            const auto singleRandom = measureSingle(boids);
+            const auto packetRandom = measurePacket(boids);
+            const auto singleSorted = measureSingle(sorted);
+            const auto packetSorted = measurePacket(sorted);
+            const bool ok = singleRandom.second == packetRandom.second && singleSorted.second == packetSorted.second &&
+                            singleRandom.second == singleSorted.second && singleFlock.second == packetFlock.second;
+            allOk = allOk && ok;
+            std::printf("  %d look-ahead rays (length %.0f) against %zu triangles, %d hit, Mrays/s (1 thread):\n", count,
+                        lookAhead, bvh.triangleCount(), singleSorted.second);
+            std::printf("    spawn order:   single %.2f, packets of %d %.2f\n", singleRandom.first, RayPacket::SIZE,
+                        packetRandom.first);
+            std::printf("    spatial order: single %.2f, packets of %d %.2f\n", singleSorted.first, RayPacket::SIZE,
+                        packetSorted.first);
+            std::printf("    after 128 steps of flocking (%d hit): single %.2f, packets of %d %.2f  %s\n", singleFlock.second,
+                        singleFlock.first, RayPacket::SIZE, packetFlock.first, ok ? "ok" : "FAIL");
+        }
+
+        // 4. 先読みの光線で避けるか (大きな球のメッシュに入り込んだ個体の数)
+        {
+            const float radius = 8.0f;
+            const std::vector<TriangleMesh> boulder = {TriangleMesh::sphere(glm::vec3(0.0f), radius, 64, 32)};
+            MeshBvh boulderBvh;
+            boulderBvh.build(boulder);
+            const int count = 5000;
+            const int steps = 600;
+            int entered[2] = {0, 0};
+            for (int avoid = 0; avoid < 2; ++avoid)
+            {
+                Simulation sim(BENCH_CUBE_SIZE);
+                spawnPopulation(sim.population(), BENCH_CUBE_SIZE, {{0, count}}, DEFAULT_RANDOM_SEED);
+                // 初めから中にいる個体は外へ出しておく
+                FlockState &state = sim.population();
+                for (std::size_t i = 0; i < state.size(); ++i)
+                {
+                    const glm::vec3 p = state.position(i);
+                    if (glm::length(p) < radius + 1.0f)
+                        state.setPosition(i, glm::normalize(p + glm::vec3(1e-3f)) * (radius + 1.0f));
+                }
+                sim.finalizePopulation();
+                sim.meshObstacles = avoid ? &boulderBvh : nullptr;
+                sim.lookAheadDistance = lookAhead;
+                std::vector<char> wasInside(count, 0);
+                const std::vector<SphereCollider> none;
+                for (int s = 0; s < steps; ++s)
+                {
+                    sim.step(none);
+                    const FlockState &current = sim.state();
+                    for (std::size_t i = 0; i < current.size(); ++i)
+                    {
+                        // 内接する球 (多角形の面の内側) に入ったら入り込んだとみなす
+                        if (glm::length(current.position(i)) < radius * 0.98f && !wasInside[current.boidID[i]])
+                        {
+                            wasInside[current.boidID[i]] = 1;
+                            entered[avoid]++;
+                        }
+                    }
+                }
+            }
+            const bool ok = entered[1] == 0 && entered[0] > 0;
+            allOk = allOk && ok;
+            std::printf("  %d boids, %d steps around a mesh sphere of %zu triangles: entered without look-ahead %d, "
+                        "with look-ahead %d  %s\n",
+                        count, steps, boulderBvh.triangleCount(), entered[0], entered[1], ok ? "ok" : "FAIL");
+        }
+        std::printf("  result: %s\n", allOk ? "ok" : "FAIL");
+        return allOk;
+    }
+
+    // 動く障害物のベンチ用の置き方: 障害物 o を周回させ、内側ほど速く回して互いを追い越させる
+    glm::mat4 orbitTransform(int obstacle, int count, int frame, float cubeSize, float speed)
+    {
+        const float share = (obstacle + 0.5f) / count;
+        const float angle = speed * frame * (1.5f - share) + 6.2831853f * share;
+        const float orbit = (0.2f + 0.6f * share) * cubeSize;
+        const glm::vec3 center(orbit * std::cos(angle), 0.6f * cubeSize * std::sin(1.7f * angle + obstacle),
+                               orbit * std::sin(angle));
+        return glm::rotate(glm::translate(glm::mat4(1.0f), center), 2.0f * angle, glm::vec3(0.0f, 1.0f, 0.0f));
+    }
+
+    // 動く三角形メッシュの障害物: フレームごとの合わせ直し・作り直しの時間、木の質の崩れ方、
+    // 合わせ直した木が作り直した木と同じ答えを返すか、動く障害物を先読みで避けるか
+    bool benchDynamicObstacles()
+    {
+        bool allOk = true;
+        const int obstacles = 64;
+        const int frames = 240;
+        const float speed = 0.004f; // 外側の周回で 1フレームに 0.07 ほど (個体の倍くらい)
+        const TriangleMesh shape = TriangleMesh::sphere(glm::vec3(0.0f), 2.5f, 64, 32);
+
+        // 1. 合わせ直すだけ / SAH の見積もりが崩れたら作り直す / 毎フレーム作り直す
+        std::printf("[dynamic] %d moving spheres of %zu triangles in a cube of %.0f, %d frames (threads: %d)\n", obstacles,
+                    shape.triangleCount(), BENCH_CUBE_SIZE, frames, parallel::threadCount());
+        std::printf("  policy             transform(ms)  refit(ms)  rebuild(ms)  total(ms)  rebuilds  max SAH ratio\n");
+        struct Policy
+        {
+            const char *name;
+            bool refit;
+            float threshold;
+        };
+        const Policy policies[] = {
+            {"refit only", true, std::numeric_limits<float>::infinity()},
+            {"refit, rebuild 1.5x", true, 1.5f},
+            {"rebuild every frame", false, 1.5f},
+        };
+        double totals[3] = {0.0, 0.0, 0.0};
+        float refitOnlyRatio = 1.0f;
+        int thresholdRebuilds = 0;
+        for (int p = 0; p < 3; ++p)
+        {
+            DynamicObstacles moving;
+            moving.refitEnabled = policies[p].refit;
+            moving.rebuildThreshold = policies[p].threshold;
+            for (int o = 0; o < obstacles; ++o)
+            {
+                moving.add(shape, orbitTransform(o, obstacles, 0, BENCH_CUBE_SIZE, speed));
+            }
+            moving.update();
+            const int initialBuilds = moving.getRebuildCount();
+            double transformMs = 0.0, refitMs = 0.0, rebuildMs = 0.0;
+            float maxRatio = 1.0f;
+            for (int frame = 1; frame <= frames; ++frame)
+            {
+                for (int o = 0; o < obstacles; ++o)
+                {
+                    moving.setTransform(o, orbitTransform(o, obstacles, frame, BENCH_CUBE_SIZE, speed));
+                }
+                moving.update();
+                const ObstacleUpdateTimings &timings = moving.getLastTimings();
+                transformMs += timings.transformMs;
+                refitMs += timings.refitMs;
+                rebuildMs += timings.rebuildMs;
+                maxRatio = std::max(maxRatio, timings.sahRatio);
+            }
+            const int rebuilds = moving.getRebuildCount() - initialBuilds;
+            totals[p] = (transformMs + refitMs + rebuildMs) / frames;
+            if (p == 0)
+                refitOnlyRatio = maxRatio;
+            if (p == 1)
+                thresholdRebuilds = rebuilds;
+            std::printf("  %-19s %13.2f  %9.2f  %11.2f  %9.2f  %8d  %13.2f\n", policies[p].name, transformMs / frames,
+                        refitMs / frames, rebuildMs / frames, totals[p], rebuilds, policies[p].refit ? maxRatio : 1.0f);
+        }
+        {
+            // 作り直す回数はフレーム数より十分少なく、合わせ直すだけなら木は崩れていき、合わせ直しは作り直しより安い
+            const bool ok = thresholdRebuilds > 0 && thresholdRebuilds < frames / 4 && refitOnlyRatio > 1.5f &&
+                            totals[1] < totals[2];
+            allOk = allOk && ok;
+            std::printf("  threshold policy: %.1fx cheaper than rebuilding every frame  %s\n", totals[2] / totals[1],
+                        ok ? "ok" : "FAIL");
+        }
+
+        // 2. 合わせ直した木と、同じ配置から作り直した木で、光線の答えが同じか
+        {
+            DynamicObstacles moving;
+            moving.rebuildThreshold = std::numeric_limits<float>::infinity();
+            for (int o = 0; o < obstacles; ++o)
+            {
+                moving.add(shape, orbitTransform(o, obstacles, 0, BENCH_CUBE_SIZE, speed));
+            }
+            moving.update();
+            const int lastFrame = 120;
+            for (int frame = 1; frame <= lastFrame; ++frame)
+            {
+                for (int o = 0; o < obstacles; ++o)
+                {
+                    moving.setTransform(o, orbitTransform(o, obstacles, frame, BENCH_CUBE_SIZE, speed));
+                }
+                moving.update();
+            }
+            std::vector<TriangleMesh> placed;
+            for (int o = 0; o < obstacles; ++o)
+            {
+                TriangleMesh mesh = shape;
+                const glm::mat4 &m = moving.getTransform(o);
+                for (glm::vec3 &v : mesh.vertices)
+                {
+                    v = glm::vec3(m * glm::vec4(v, 1.0f));
+                }
+                placed.push_back(mesh);
+            }
+            MeshBvh fresh;
+            fresh.build(placed);
+            const MeshBvh &refitted = moving.getBvh();
+            const int rays = 20000;
+            const float length = 12.0f;
+            int mismatches = 0, hits = 0;
+            for (int r = 0; r < rays; ++r)
+            {
+                Philox random(DEFAULT_RANDOM_SEED, static_cast<std::uint32_t>(r), 3, RandomStream::SpawnPosition);
+                const glm::vec3 origin(random.uniform(-1.0f, 1.0f) * BENCH_CUBE_SIZE, random.uniform(-1.0f, 1.0f) * BENCH_CUBE_SIZE,
+                                       random.uniform(-1.0f, 1.0f) * BENCH_CUBE_SIZE);
+                const glm::vec3 direction = glm::normalize(glm::vec3(random.uniform(-1.0f, 1.0f), random.uniform(-1.0f, 1.0f),
+                                                                     random.uniform(-1.0f, 1.0f)));
+                RayHit a, b;
+                const bool hitA = refitted.intersect(origin, direction, length, a);
+                const bool hitB = fresh.intersect(origin, direction, length, b);
+                hits += hitA ? 1 : 0;
+                if (hitA != hitB || (hitA && std::abs(a.distance - b.distance) > 1e-4f))
+                    mismatches++;
+            }
+            const bool ok = mismatches == 0;
+            allOk = allOk && ok;
+            std::printf("  after %d refits (SAH %.1f, rebuilt %.1f): %d random rays, %d hits, %d mismatches vs a fresh build  %s\n",
+                        lastFrame, refitted.sahCost(), fresh.sahCost(), rays, hits, mismatches, ok ? "ok" : "FAIL");
+        }
+
+        // 3. 動く障害物を先読みの光線で避けるか (球に入り込んだ個体の数。後ろから追いつかれる分は避けられない)
+        {
+            const int movers = 8;
+            const float radius = 4.0f;
+            const TriangleMesh predator = TriangleMesh::sphere(glm::vec3(0.0f), radius, 48, 24);
+            const int count = 5000;
+            const int steps = 600;
+            int entered[2] = {0, 0};
+            double obstacleMs = 0.0;
+            for (int avoid = 0; avoid < 2; ++avoid)
+            {
+                DynamicObstacles moving;
+                for (int o = 0; o < movers; ++o)
+                {
+                    moving.add(predator, orbitTransform(o, movers, 0, BENCH_CUBE_SIZE, 0.002f));
+                }
+                moving.update();
+                Simulation sim(BENCH_CUBE_SIZE);
+                spawnPopulation(sim.population(), BENCH_CUBE_SIZE, {{0, count}}, DEFAULT_RANDOM_SEED);
+                sim.finalizePopulation();
+                sim.movingObstacles = avoid ? &moving : nullptr;
+                int frame = 0;
+                auto place = [&frame, movers](DynamicObstacles &obstacles)
+                {
+                    ++frame;
+                    for (int o = 0; o < movers; ++o)
+                    {
+                        obstacles.setTransform(o, orbitTransform(o, movers, frame, BENCH_CUBE_SIZE, 0.002f));
+                    }
+                };
+                sim.moveObstacles = place;
+                std::vector<int> insideSince(count, -1);
+                const std::vector<SphereCollider> none;
+                for (int s = 0; s < steps; ++s)
+                {
+                    if (!avoid)
+                    {
+                        // 避けないときも同じように動かして、入り込んだかを数える
+                        place(moving);
+                        moving.update();
+                    }
+                    sim.step(none);
+                    obstacleMs += sim.getLastTimings().obstacles.transformMs + sim.getLastTimings().obstacles.refitMs +
+                                  sim.getLastTimings().obstacles.rebuildMs;
+                    const FlockState &current = sim.state();
+                    for (std::size_t i = 0; i < current.size(); ++i)
+                    {
+                        bool inside = false;
+                        for (int o = 0; o < movers; ++o)
+                        {
+                            const glm::vec3 center(moving.getTransform(o)[3].x, moving.getTransform(o)[3].y,
+                                                   moving.getTransform(o)[3].z);
+                            inside = inside || glm::length(current.position(i) - center) < radius * 0.98f;
+                        }
+                        const int id = current.boidID[i];
+                        if (inside && insideSince[id] < 0)
+                        {
+                            insideSince[id] = s;
+                            entered[avoid]++;
+                        }
+                        else if (!inside)
+                        {
+                            insideSince[id] = -1;
+                        }
+                    }
+                }
+            }
+            const bool ok = entered[0] > 0 && entered[1] * 2 < entered[0];
+            allOk = allOk && ok;
+            std::printf("  %d boids, %d steps, %d moving spheres of %zu triangles: entered without look-ahead %d, "
+                        "with look-ahead %d (%.2f ms/step for the obstacles)  %s\n",
+                        count, steps, movers, predator.triangleCount(), entered[0], entered[1], obstacleMs / steps,
+                        ok ? "ok" : "FAIL");
+        }
+        std::printf("  result: %s\n", allOk ? "ok" : "FAIL");
+        return allOk;
+    }
+
+    struct BenchmarkEntry
+    {
+        const char *name;
+        std::function<bool()> run; // false を返したら失敗
+    };
+
+    const std::vector<BenchmarkEntry> &benchmarks()
+    {
+        static const std::vector<BenchmarkEntry> entries = {
+            {"species", benchSpecies},
+            {"simd", benchSimd},
+            {"reorder", benchReorder},
+            {"grid", benchGrid},
+            {"verlet", benchVerlet},
+            {"octree", benchOctree},
+            {"knn", benchKnn},
+            {"fixed", benchFixed},
+            {"policy", benchPolicy},
+            {"fastmath", benchFastMath},
+            {"pipeline", benchPipeline},
+            {"timestep", benchTimestep},
+            {"parallel", benchParallel},
+            {"multirate", benchMultirate},
+            {"lod", benchLod},
+            {"rng", benchRandom},
+            {"population", benchPopulation},
+            {"colliders", benchColliderGrid},
+            {"sdf", benchDistanceField},
+            {"bvh", benchMeshBvh},
+            {"dynamic", benchDynamicObstacles},
+        };
+        return entries;
+    }
+}
+
+int runBenchmarks(int argc, char **argv)
+{
+    activeKernels(); // 使われる命令セットを最初にログに出す (FLOCKING_ISA で強制できる)
+
+    bool ranAny = false;
+    bool allPassed = true;
+    for (const BenchmarkEntry &entry : benchmarks())
+    {
+        bool selected = (argc == 0);
+        for (int i = 0; i < argc; ++i)
+        {
+            if (std::strcmp(argv[i], entry.name) == 0)
+                selected = true;
+        }
+        if (selected)
+        {
+            allPassed = entry.run() && allPassed;
+            ranAny = true;
+        }
+    }
+
+    if (!ranAny)
+    {
+        std::fprintf(stderr, "Unknown benchmark. Available:");
+        for (const BenchmarkEntry &entry : benchmarks())
+        {
+            std::fprintf(stderr, " %s", entry.name);
+        }
+        std::fprintf(stderr, "\n");
+        return 1;
+    }
+    return allPassed ? 0 : 1;
+}
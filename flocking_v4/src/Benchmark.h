@@ -0,0 +1,8 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+// ウィンドウを開かずにシミュレーション部分だけを計測する (./FlockingCreatures --bench [名前...])
+// 名前を省略すると全てのベンチマークを実行する
+int runBenchmarks(int argc, char **argv);
+
+#endif
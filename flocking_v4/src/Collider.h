@@ -2,6 +2,9 @@
 #pragma once
 #include <glm/glm.hpp>
 
+// コライダーは表面からこの距離の内側に入った個体を押し出す (Creature::collide / FlockKernelSet::collide)
+const float COLLIDER_MARGIN = 5.0f;
+
 class SphereCollider
 {
 public:
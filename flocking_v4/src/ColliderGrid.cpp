@@ -0,0 +1,219 @@
+#include "ColliderGrid.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+    // 距離の二乗のふるいを一度にかける候補の数
+    const int SWEEP_WIDTH = 16;
+    // ふるいの半径を少し広げ、sqrt して比べる本来の判定で当たるものを取りこぼさないようにする
+    const float REACH_SLACK = 1.0001f;
+}
+
+void ColliderGrid::build(const std::vector<SphereCollider> &colliders)
+{
+    auto start = std::chrono::steady_clock::now();
+    source = colliders;
+    const int n = static_cast<int>(colliders.size());
+
+    // 押し出す範囲を囲む箱と、範囲の半径の平均
+    glm::vec3 lower(0.0f), upper(0.0f);
+    float reachSum = 0.0f;
+    for (int c = 0; c < n; ++c)
+    {
+        const float reach = colliders[c].radius + COLLIDER_MARGIN;
+        const glm::vec3 low = colliders[c].center - glm::vec3(reach);
+        const glm::vec3 high = colliders[c].center + glm::vec3(reach);
+        lower = c == 0 ? low : glm::min(lower, low);
+        upper = c == 0 ? high : glm::max(upper, high);
+        reachSum += reach;
+    }
+    const glm::vec3 extent = glm::max(upper - lower, glm::vec3(1e-3f));
+
+    // セルの大きさは範囲の半径の平均にする。セルが多すぎるときは、上限に収まるまで大きくする
+    cellSize = n > 0 ? reachSum / n : 1.0f;
+    const double maxCells = static_cast<double>(std::max(n, 1)) * CELLS_PER_COLLIDER;
+    auto cellsAlong = [&](float length)
+    {
+        return std::max(1, static_cast<int>(std::ceil(length / cellSize)));
+    };
+    while (static_cast<double>(cellsAlong(extent.x)) * cellsAlong(extent.y) * cellsAlong(extent.z) > maxCells)
+    {
+        cellSize *= 1.25f;
+    }
+    inverseCellSize = 1.0f / cellSize;
+    origin = lower;
+    cellsX = cellsAlong(extent.x);
+    cellsY = cellsAlong(extent.y);
+    cellsZ = cellsAlong(extent.z);
+
+    // 範囲の球と交わるセルにコライダーを登録する (1回目で数え、2回目で詰める。番号順に詰めるのでセルの中も番号順)
+    cellStart.assign(static_cast<std::size_t>(cellsX) * cellsY * cellsZ + 1, 0);
+    auto forEachCell = [&](const SphereCollider &collider, auto &&visit)
+    {
+        const float reach = collider.radius + COLLIDER_MARGIN;
+        const glm::vec3 low = (collider.center - glm::vec3(reach) - origin) * inverseCellSize;
+        const glm::vec3 high = (collider.center + glm::vec3(reach) - origin) * inverseCellSize;
+        const int x0 = std::max(static_cast<int>(low.x), 0), x1 = std::min(static_cast<int>(high.x), cellsX - 1);
+        const int y0 = std::max(static_cast<int>(low.y), 0), y1 = std::min(static_cast<int>(high.y), cellsY - 1);
+        const int z0 = std::max(static_cast<int>(low.z), 0), z1 = std::min(static_cast<int>(high.z), cellsZ - 1);
+        for (int z = z0; z <= z1; ++z)
+        {
+            for (int y = y0; y <= y1; ++y)
+            {
+                for (int x = x0; x <= x1; ++x)
+                {
+                    // セルの箱の中で球の中心に最も近い点までの距離で、箱の角にだけかかるセルを除く
+                    const glm::vec3 cellLow = origin + glm::vec3(x, y, z) * cellSize;
+                    const glm::vec3 nearest = glm::clamp(collider.center, cellLow, cellLow + glm::vec3(cellSize));
+                    const glm::vec3 d = nearest - collider.center;
+                    if (glm::dot(d, d) <= reach * reach * REACH_SLACK)
+                        visit((z * cellsY + y) * cellsX + x);
+                }
+            }
+        }
+    };
+    for (int c = 0; c < n; ++c)
+    {
+        forEachCell(colliders[c], [&](int cell)
+                    { cellStart[cell + 1]++; });
+    }
+    for (std::size_t cell = 1; cell < cellStart.size(); ++cell)
+    {
+        cellStart[cell] += cellStart[cell - 1];
+    }
+    const std::size_t entries = static_cast<std::size_t>(cellStart.back());
+    for (AlignedArray<float> *v : {&centerX, &centerY, &centerZ, &radius, &reachSq})
+    {
+        v->resize(entries);
+    }
+    colliderIndex.resize(entries);
+    std::vector<int> cursor(cellStart.begin(), cellStart.end() - 1);
+    for (int c = 0; c < n; ++c)
+    {
+        const SphereCollider &collider = colliders[c];
+        const float reach = collider.radius + COLLIDER_MARGIN;
+        forEachCell(collider, [&](int cell)
+                    {
+                        const int k = cursor[cell]++;
+                        centerX[k] = collider.center.x;
+                        centerY[k] = collider.center.y;
+                        centerZ[k] = collider.center.z;
+                        radius[k] = collider.radius;
+                        reachSq[k] = reach * reach * REACH_SLACK;
+                        colliderIndex[k] = c; });
+    }
+    buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool ColliderGrid::builtFrom(const std::vector<SphereCollider> &colliders) const
+{
+    return colliders.size() == source.size() &&
+           (colliders.empty() ||
+            std::memcmp(colliders.data(), source.data(), colliders.size() * sizeof(SphereCollider)) == 0);
+}
+
+int ColliderGrid::cellOf(const glm::vec3 &pos) const
+{
+    const glm::vec3 local = (pos - origin) * inverseCellSize;
+    // 負の値を切り捨てで 0 にしないよう、範囲は浮動小数点のまま調べる
+    if (!(local.x >= 0.0f && local.y >= 0.0f && local.z >= 0.0f && local.x < cellsX && local.y < cellsY &&
+          local.z < cellsZ))
+        return -1;
+    return (static_cast<int>(local.z) * cellsY + static_cast<int>(local.y)) * cellsX + static_cast<int>(local.x);
+}
+
+int ColliderGrid::firstCandidate(const glm::vec3 &pos, int from, int end) const
+{
+    const float *__restrict cx = centerX.data();
+    const float *__restrict cy = centerY.data();
+    const float *__restrict cz = centerZ.data();
+    const float *__restrict reach = reachSq.data();
+    for (int chunk = from; chunk < end; chunk += SWEEP_WIDTH)
+    {
+        const int chunkEnd = std::min(chunk + SWEEP_WIDTH, end);
+        // 区間の中に1つでも範囲内のものがあるかだけを、分岐なしでまとめて調べる
+        int any = 0;
+#pragma omp simd reduction(| : any)
+        for (int k = chunk; k < chunkEnd; ++k)
+        {
+            const float ox = pos.x - cx[k];
+            const float oy = pos.y - cy[k];
+            const float oz = pos.z - cz[k];
+            any |= ox * ox + oy * oy + oz * oz < reach[k] ? 1 : 0;
+        }
+        if (!any)
+            continue;
+        for (int k = chunk; k < chunkEnd; ++k)
+        {
+            const float ox = pos.x - cx[k];
+            const float oy = pos.y - cy[k];
+            const float oz = pos.z - cz[k];
+            if (ox * ox + oy * oy + oz * oz < reach[k])
+                return k;
+        }
+    }
+    return end;
+}
+
+void ColliderGrid::collide(const BoidArrays &b, std::size_t begin, std::size_t end) const
+{
+    if (cellStart.size() <= 1)
+        return;
+    for (std::size_t i = begin; i < end; ++i)
+    {
+        glm::vec3 pos(b.px[i], b.py[i], b.pz[i]);
+        glm::vec3 dir(b.dx[i], b.dy[i], b.dz[i]);
+        int done = -1; // ここまでの番号のコライダーは調べ終えた
+        bool moved = false;
+        int cell;
+        while ((cell = cellOf(pos)) >= 0)
+        {
+            const int cellEnd = cellStart[cell + 1];
+            // セルの中は番号順なので、調べ終えた番号より後ろから始める
+            int k = static_cast<int>(std::upper_bound(colliderIndex.begin() + cellStart[cell],
+                                                      colliderIndex.begin() + cellEnd, done) -
+                                     colliderIndex.begin());
+            bool hit = false;
+            while ((k = firstCandidate(pos, k, cellEnd)) < cellEnd)
+            {
+                // FlockKernelSet::collide の当たったときの式と同じ
+                const float ox = pos.x - centerX[k];
+                const float oy = pos.y - centerY[k];
+                const float oz = pos.z - centerZ[k];
+                const float dist = std::sqrt(ox * ox + oy * oy + oz * oz);
+                done = colliderIndex[k];
+                if (!(dist < radius[k] + COLLIDER_MARGIN))
+                {
+                    ++k;
+                    continue;
+                }
+                const float centered = dist == 0.0f ? 1.0f : 0.0f;
+                const float invDist = 1.0f / (dist + centered);
+                const glm::vec3 normal(ox * invDist, oy * invDist + centered, oz * invDist);
+                pos += normal * (radius[k] - dist + COLLIDER_MARGIN);
+                const float dot = dir.x * normal.x + dir.y * normal.y + dir.z * normal.z;
+                const glm::vec3 reflected = dir - 2.0f * dot * normal;
+                dir = reflected * (1.0f / std::sqrt(reflected.x * reflected.x + reflected.y * reflected.y +
+                                                    reflected.z * reflected.z));
+                hit = moved = true;
+                break;
+            }
+            // 押し出されたら、移った先のセルで残りのコライダーを調べる
+            if (!hit)
+                break;
+        }
+        if (moved)
+        {
+            b.px[i] = pos.x;
+            b.py[i] = pos.y;
+            b.pz[i] = pos.z;
+            b.dx[i] = dir.x;
+            b.dy[i] = dir.y;
+            b.dz[i] = dir.z;
+        }
+    }
+}
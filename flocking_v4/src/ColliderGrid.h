@@ -0,0 +1,60 @@
+#ifndef COLLIDER_GRID_H
+#define COLLIDER_GRID_H
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <vector>
+
+#include "Collider.h"
+#include "FlockKernel.h"
+#include "FlockState.h"
+
+// 動かないコライダーを一度だけ振り分けておく一様グリッド (衝突判定の broadphase)
+// コライダーが個体を押し出す範囲 (半径 + COLLIDER_MARGIN の球) が重なるセルすべてに、そのコライダーを登録する。
+// 個体は自分のセルに登録されたコライダーだけを、距離の二乗で SIMD でまとめてふるいにかけてから調べる。
+// セルごとの中身はコライダーの番号順で、中心・半径を SoA で連続して持つ (セルをまたいで同じコライダーを複製する)。
+//
+// 結果は全コライダーを番号順に調べる FlockKernelSet::collide と同じになる:
+// 押し出されて別のセルに移った個体は、移った先のセルで、まだ調べていない (番号の大きい) コライダーから続ける。
+// グリッドの外にいる個体は、どのコライダーにも当たらないので何もしない。
+class ColliderGrid
+{
+public:
+    // colliders からグリッドを作る (セルの大きさは押し出す範囲の半径の平均)
+    void build(const std::vector<SphereCollider> &colliders);
+    // colliders がこのグリッドを作ったときと同じか (Simulation は違っていたときだけ作り直す)
+    bool builtFrom(const std::vector<SphereCollider> &colliders) const;
+
+    // [begin, end) の個体をコライダーと衝突させる (FlockKernelSet::collide の代わり)
+    void collide(const BoidArrays &boids, std::size_t begin, std::size_t end) const;
+
+    std::size_t colliderCount() const { return source.size(); }
+    int cellCount() const { return static_cast<int>(cellStart.size()) - 1; }
+    // セルに登録した延べ数 (コライダー1つあたり平均いくつのセルに入っているかの目安)
+    std::size_t entryCount() const { return centerX.size(); }
+    float getCellSize() const { return cellSize; }
+    double getBuildMs() const { return buildMs; }
+
+    // 作れるセルの数の上限 (コライダーの数に比例させ、少数の大きなコライダーでメモリを使いすぎないようにする)
+    static const int CELLS_PER_COLLIDER = 8;
+
+private:
+    // pos を含むセルの番号 (グリッドの外なら -1)
+    int cellOf(const glm::vec3 &pos) const;
+    // セル順の配列の [from, end) で、pos が押し出す範囲に入っている最初の位置 (なければ end)
+    int firstCandidate(const glm::vec3 &pos, int from, int end) const;
+
+    std::vector<SphereCollider> source; // 作ったときのコライダー (builtFrom 用)
+    glm::vec3 origin = glm::vec3(0.0f); // グリッドの最小の角
+    float cellSize = 1.0f;
+    float inverseCellSize = 1.0f;
+    int cellsX = 0, cellsY = 0, cellsZ = 0;
+    std::vector<int> cellStart; // セル c のコライダーは [cellStart[c], cellStart[c + 1])
+
+    // セル順に並べたコライダー (SoA)。reachSq は押し出す範囲の半径の二乗を少し広げたもの (ふるい用)
+    AlignedArray<float> centerX, centerY, centerZ, radius, reachSq;
+    std::vector<int> colliderIndex;
+    double buildMs = 0.0;
+};
+
+#endif
@@ -1,190 +1,188 @@
 #define GLM_ENABLE_EXPERIMENTAL // Add this line
 
 #include "Creature.h"
+#include "KdTree.h"
+#include "NeighborList.h"
+#include "Octree.h"
+#include "Philox.h"
+#include "SpatialGrid.h"
+#include "UpdatePolicy.h"
 #include <glm/gtx/rotate_vector.hpp> // For glm::reflect
 #include <glm/gtx/norm.hpp>          // For glm::length2
 #include <glm/gtx/transform.hpp>     // For glm::mix
-#include <random>                    // より良い乱数生成
+#include <algorithm>
+#include <iterator>
+#include <limits>
 
-struct SpeciesFlockGains
+std::vector<SpeciesFlockGains> speciesParams(std::begin(DEFAULT_FLOCK_GAINS), std::end(DEFAULT_FLOCK_GAINS));
+
+const SpeciesFlockGains &Creature::flockGains(int speciesID)
 {
-    float separation;
-    float alignment;
-    float cohesion;
-};
-
-std::vector<SpeciesFlockGains> speciesParams = {
-    {270.0f, 2.0f, 10.0f}, // 種族ID 0
-    {250.0f, 4.0f, 20.0f}, // 種族ID 1
-    {100.0f, 2.0f, 10.0f}   // 種族ID 2
-};
-
-// 乱数生成器
-static std::random_device rd;
-static std::mt19937 gen(rd());
-static std::uniform_real_distribution<> dis(-1.0, 1.0); // -1.0から1.0の間の乱数
-
-Creature::Creature(float cubeSize, int speciesID) : speciesID(speciesID)
+    // パラメータが用意されていない種族 (ベンチマーク用など) は先頭から使い回す
+    return speciesParams[speciesID % speciesParams.size()];
+}
+
+void Creature::randomPlacement(std::uint64_t seed, int boidID, float cubeSize, glm::vec3 &position, glm::vec3 &direction)
 {
-    position.x = dis(gen) * cubeSize;
-    position.y = dis(gen) * cubeSize;
-    position.z = dis(gen) * cubeSize;
+    // 生成は 0 フレーム目として、個体の ID ごとに別の系列から引く
+    Philox random(seed, static_cast<std::uint32_t>(boidID), 0, RandomStream::Spawn);
+    position.x = random.uniform(-1.0f, 1.0f) * cubeSize;
+    position.y = random.uniform(-1.0f, 1.0f) * cubeSize;
+    position.z = random.uniform(-1.0f, 1.0f) * cubeSize;
 
     // 球面上のランダムな方向を生成
-    float theta = dis(gen) * glm::pi<float>(); // 0から2PI
-    float phi = std::acos(dis(gen));           // 0からPI (acosの引数を-1から1にすることで均一な分布)
+    float theta = random.uniform(-1.0f, 1.0f) * glm::pi<float>(); // -PIからPI
+    float phi = std::acos(random.uniform(-1.0f, 1.0f));           // 0からPI (acosの引数を-1から1にすることで均一な分布)
 
     direction = glm::vec3(
         std::sin(phi) * std::cos(theta),
         std::cos(phi),
         std::sin(phi) * std::sin(theta));
     direction = glm::normalize(direction);
+}
 
+float Creature::speciesSpeed(int speciesID)
+{
     switch (speciesID)
     {
     case 0:
-        speed = 0.05f;
-        break;
+        return 0.05f;
     case 1:
-        speed = 0.03f;
-        break;
+        return 0.03f;
     default:
-        speed = 0.04f;
-        break;
+        return 0.04f;
     }
-    maxTurn = 0.1f;
 }
-void Creature::update(std::vector<Creature *> &others, float cubeSize, const std::vector<SphereCollider> &colliders)
+
+Creature Creature::spawn(FlockState &state, float cubeSize, int speciesID, std::uint64_t seed)
 {
-    flock(others);
+    // ID は生成順に振られるので、次に追加する個体の ID は今の個体数
+    glm::vec3 position;
+    glm::vec3 direction;
+    randomPlacement(seed, static_cast<int>(state.size()), cubeSize, position, direction);
 
-    // コライダーによる衝突と反射の処理
-    for (const auto &collider : colliders)
-    {
-        glm::vec3 vecFromCenterToCreature = position - collider.center; // 球の中心から生物へのベクトル
-        float dist = glm::length(vecFromCenterToCreature);
+    return Creature(state, state.add(speciesID, position, direction, speciesSpeed(speciesID), DEFAULT_MAX_TURN));
+}
 
-        // Creatureがコライダーにめり込んでいる場合（radiusより距離が短い）
-        if (dist < collider.radius+5.0)
-        {
-            // 衝突面での法線ベクトルを求める
-            // distが0の場合（生物が球の中心と完全に重なっている場合）は、正規化できないため特別処理
-            glm::vec3 normal;
-            if (dist == 0.0f) {
-                normal = glm::vec3(0.0f, 1.0f, 0.0f); // 例えばY軸プラス方向を法線とする
-            } else {
-                normal = glm::normalize(vecFromCenterToCreature); // 球の中心から生物へのベクトルが法線
-            }
+void Creature::update(FlockState &next, const std::vector<SphereCollider> &colliders,
+                      const NeighborSource &source, NeighborKernel kernel, bool refreshSteering) const
+{
+    updateWith<DynamicColliders, TableGains>(next, colliders.data(), static_cast<int>(colliders.size()), source, kernel,
+                                             refreshSteering);
+}
 
-            // めり込みを解消するために位置を修正
-            // めり込み量 = 半径 - 現在の距離
-            float penetrationDepth = collider.radius - dist;
-            // 法線方向に、めり込み量+αだけ位置を押し戻す
-            position += normal * (penetrationDepth + 5.00f); // 0.01fは浮動小数点誤差対策の微小な余裕
+void Creature::collide(glm::vec3 &position, glm::vec3 &direction, const SphereCollider &collider)
+{
+    glm::vec3 vecFromCenterToCreature = position - collider.center; // 球の中心から生物へのベクトル
+    float dist = glm::length(vecFromCenterToCreature);
 
-            // 進行方向を法線で反射させる
-            reflect(normal);
-            // reflect関数内で既に正規化されているはずですが、念のため再度正規化して向きを確実に
-            direction = glm::normalize(direction);
+    // Creatureがコライダーにめり込んでいる場合（radiusより距離が短い）
+    if (dist < collider.radius+5.0)
+    {
+        // 衝突面での法線ベクトルを求める
+        // distが0の場合（生物が球の中心と完全に重なっている場合）は、正規化できないため特別処理
+        glm::vec3 normal;
+        if (dist == 0.0f) {
+            normal = glm::vec3(0.0f, 1.0f, 0.0f); // 例えばY軸プラス方向を法線とする
+        } else {
+            normal = glm::normalize(vecFromCenterToCreature); // 球の中心から生物へのベクトルが法線
         }
-    }
 
-    // 通常の移動処理
-    glm::vec3 moveVec = direction * speed;
-    position += moveVec;
+        // めり込みを解消するために位置を修正
+        // めり込み量 = 半径 - 現在の距離
+        float penetrationDepth = collider.radius - dist;
+        // 法線方向に、めり込み量+αだけ位置を押し戻す
+        position += normal * (penetrationDepth + 5.00f); // 0.01fは浮動小数点誤差対策の微小な余裕
 
-    // 境界チェックと反射 (既存のコードと同じ)
-    if (position.x > cubeSize)
-    {
-        position.x = cubeSize;
-        reflect(glm::vec3(-1, 0, 0));
-        direction = glm::normalize(direction); // 反射後も正規化
-    }
-    else if (position.x < -cubeSize)
-    {
-        position.x = -cubeSize;
-        reflect(glm::vec3(1, 0, 0));
-        direction = glm::normalize(direction); // 反射後も正規化
+        // 進行方向を法線で反射させる
+        reflect(direction, normal);
+        // reflect関数内で既に正規化されているはずですが、念のため再度正規化して向きを確実に
+        direction = glm::normalize(direction);
     }
+}
+
+NeighborSums Creature::sumNeighbors(const glm::vec3 &position, const NeighborSource &source,
+                                    NeighborKernel kernel) const
+{
+    float radius = FLOCK_RADIUS;
+    float radiusSq = radius * radius; // 距離の二乗で比較して平方根の計算を避ける
+
+    const FlockState &s = *state;
+    const int mySpecies = s.speciesID[index];
 
-    if (position.y > cubeSize)
+    // 近傍候補を連続した区間ごとにカーネルへ渡して、分離・整列・結合を合計する
+    // (自分自身は距離 0 になるのでカーネル側で除外される)
+    // k-d 木や近傍リストで見つけた個体を連続した配列に集める作業領域
+    static thread_local NeighborGather gatherBuffer;
+
+    // 打ち切る数 (打ち切らないときは、どの区間も最後まで調べるので結果は打ち切りのない版と同じ)
+    const int cap = source.neighborCap > 0 ? source.neighborCap : std::numeric_limits<int>::max();
+
+    NeighborSums sums;
+    if (source.kdTree)
     {
-        position.y = cubeSize;
-        reflect(glm::vec3(0, -1, 0));
-        direction = glm::normalize(direction); // 反射後も正規化
+        // 近い順に k 体を探し、距離によらずその全員と相互作用する
+        int nearest[KdTree::MAX_K];
+        const int count = source.kdTree->nearest(position, mySpecies, std::min(source.nearestCount, cap),
+                                                 static_cast<int>(index), nearest);
+        const NeighborArrays arrays = gatherBuffer.gather(s, nearest, count);
+        kernel(arrays, 0, count, position, mySpecies, std::numeric_limits<float>::max(), sums);
     }
-    else if (position.y < -cubeSize)
+    else if (source.lists)
     {
-        position.y = -cubeSize;
-        reflect(glm::vec3(0, 1, 0));
-        direction = glm::normalize(direction); // 反射後も正規化
+        // 近傍リストの個体を連続した配列に集めてから渡す (打ち切るときは候補の先頭 cap 体だけ)
+        const int count = std::min(source.lists->neighborCount(index), cap);
+        const NeighborArrays arrays = gatherBuffer.gather(s, source.lists->neighborsBegin(index), count);
+        kernel(arrays, 0, count, position, mySpecies, radiusSq, sums);
     }
-
-    if (position.z > cubeSize)
+    else if (source.grid)
     {
-        position.z = cubeSize;
-        reflect(glm::vec3(0, 0, -1));
-        direction = glm::normalize(direction); // 反射後も正規化
+        // 周囲 27 セルに入っている個体だけを調べる
+        const NeighborArrays arrays = source.grid->sortedArrays();
+        source.grid->forEachNeighborRange(position, [&](int begin, int end)
+                                          {
+                                              if (sums.count < cap)
+                                                  kernel(arrays, begin, end, position, mySpecies, radiusSq, sums); });
     }
-    else if (position.z < -cubeSize)
+    else if (source.octree)
     {
-        position.z = -cubeSize;
-        reflect(glm::vec3(0, 0, 1));
-        direction = glm::normalize(direction); // 反射後も正規化
+        // 半径内に境界箱がかかる葉に入っている個体だけを調べる
+        const NeighborArrays arrays = source.octree->sortedArrays();
+        source.octree->forEachNeighborRange(position, [&](int begin, int end)
+                                            {
+                                                if (sums.count < cap)
+                                                    kernel(arrays, begin, end, position, mySpecies, radiusSq, sums); });
     }
-}
-
-void Creature::flock(std::vector<Creature *> &others)
-{
-    glm::vec3 separation(0.0f);
-    glm::vec3 alignment(0.0f);
-    glm::vec3 cohesion(0.0f);
-    int count = 0;
-
-    float radius = 5.0f;
-    float radiusSq = radius * radius; // 距離の二乗で比較して平方根の計算を避ける
-
-    for (Creature *other : others)
+    else
     {
-        if (other == this)
-            continue;
-        if (other->speciesID != this->speciesID)
-            continue;
-        glm::vec3 diffVec = position - other->position;
-        float dSq = glm::dot(diffVec, diffVec); // 距離の二乗
-
-        if (dSq < radiusSq && dSq > 0.0001f)
-        {                                                          // dSqが0に近い場合を除外
-            separation += glm::normalize(diffVec) / (dSq + 0.01f); // d*d + 0.01f を dSq + 0.01f に変更
-
-            alignment += other->direction;
-            cohesion += other->position;
-            count++;
+        // 総当たり (O(N^2))。種族ごとに並べ替え済みなら自分の種族の区間だけを見ればよい
+        std::size_t begin = 0;
+        std::size_t end = s.size();
+        if (s.isSortedBySpecies())
+        {
+            begin = s.speciesRanges[mySpecies].begin;
+            end = s.speciesRanges[mySpecies].end;
+        }
+        if (source.neighborCap <= 0)
+        {
+            kernel(s.neighborArrays(), begin, end, position, mySpecies, radiusSq, sums);
+        }
+        else
+        {
+            // 打ち切るときは区切って渡し、近傍が cap 体に達したらやめる
+            const std::size_t block = 256;
+            for (std::size_t b = begin; b < end && sums.count < cap; b += block)
+            {
+                kernel(s.neighborArrays(), b, std::min(b + block, end), position, mySpecies, radiusSq, sums);
+            }
         }
     }
 
-    if (count > 0)
-    {
-        separation /= static_cast<float>(count);
-        alignment = glm::normalize(alignment / static_cast<float>(count));
-        cohesion = glm::normalize(cohesion / static_cast<float>(count) - position);
-
-        glm::vec3 steer = glm::vec3(0.0f);
-
-        const SpeciesFlockGains &params = speciesParams[speciesID];
-
-        steer += separation * params.separation;
-        steer += alignment * params.alignment;
-        steer += cohesion * params.cohesion;
-        steer = glm::normalize(steer);
-
-        // lerp (線形補間) を使用し、結果を正規化
-        direction = glm::normalize(glm::mix(direction, steer, maxTurn));
-    }
+    return sums;
 }
 
-void Creature::reflect(const glm::vec3 &normal)
+void Creature::reflect(glm::vec3 &direction, const glm::vec3 &normal)
 {
     direction = glm::reflect(direction, normal);
     direction = glm::normalize(direction);
-}
\ No newline at end of file
+}
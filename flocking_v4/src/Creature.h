@@ -3,25 +3,110 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp> // For glm::quat
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 
 #include "Collider.h"
+#include "FlockKernel.h"
+#include "FlockState.h"
+#include "Philox.h"
 
+class SpatialGrid;
+class Octree;
+class KdTree;
+class NeighborList;
+
+// 近傍探索に使う構造 (設定されているもののうち、k-d 木 → 近傍リスト → グリッド → 八分木の順に使う)
+// すべて nullptr なら全個体を総当たりで走査する (比較用)
+struct NeighborSource
+{
+    const SpatialGrid *grid = nullptr;
+    const Octree *octree = nullptr;
+    const NeighborList *lists = nullptr;
+    // k-d 木があるときは、半径によらず近い順に nearestCount 体とだけ相互作用する (トポロジカルな近傍)
+    const KdTree *kdTree = nullptr;
+    int nearestCount = 0;
+    // 0 より大きければ、近傍がこの数に達したところで探すのをやめる (SteeringLod の Minimal の段階)。
+    // 打ち切りは区間単位なので、最後の区間の分だけこの数を超えうる
+    int neighborCap = 0;
+};
+
+// 群れとして相互作用する距離 (近傍グリッドのセルサイズにも使う)
+const float FLOCK_RADIUS = 5.0f;
+// 1ステップに操舵の目標へ曲がる割合の既定値
+const float DEFAULT_MAX_TURN = 0.1f;
+
+// 種族ごとの分離・整列・結合の重み
+struct SpeciesFlockGains
+{
+    float separation;
+    float alignment;
+    float cohesion;
+};
+
+// 重みの既定値 (種族ID 0, 1, 2)。コンパイル時に決まるので、ConstexprGains (UpdatePolicy.h) では定数として埋め込まれる
+constexpr SpeciesFlockGains DEFAULT_FLOCK_GAINS[] = {
+    {270.0f, 2.0f, 10.0f},
+    {250.0f, 4.0f, 20.0f},
+    {100.0f, 2.0f, 10.0f},
+};
+constexpr int DEFAULT_FLOCK_GAIN_COUNT = sizeof(DEFAULT_FLOCK_GAINS) / sizeof(DEFAULT_FLOCK_GAINS[0]);
+
+// FlockState の1個体を指す軽量なハンドル
+// データ自体は FlockState の配列に置かれ、Creature はインデックスだけを持つ
 class Creature
 {
 public:
-    int speciesID; // 群れの種類
+    Creature(const FlockState &state, std::size_t index) : state(&state), index(index) {}
+
+    // ランダムな位置と向きを持つ個体を state に追加する (同じ種で同じ順に追加すれば、毎回同じ群れになる)
+    static Creature spawn(FlockState &state, float cubeSize, int speciesID, std::uint64_t seed = DEFAULT_RANDOM_SEED);
+    // 種と個体の ID だけから決まる初期の位置と向き (呼ぶ順番やスレッドによらない)
+    static void randomPlacement(std::uint64_t seed, int boidID, float cubeSize, glm::vec3 &position, glm::vec3 &direction);
+    // 種族ごとの速さ (1ステップに進む距離)
+    static float speciesSpeed(int speciesID);
+    // 種族ごとの重み (固定小数点版の更新でも同じ値を使う)
+    static const SpeciesFlockGains &flockGains(int speciesID);
+
+    std::size_t getIndex() const { return index; }
+    int speciesID() const { return state->speciesID[index]; }
+    glm::vec3 position() const { return state->position(index); }
+    glm::vec3 direction() const { return state->direction(index); }
+
+    // 群れの操舵とコライダーとの衝突処理を行う
+    // state (現在の状態) だけを読み、更新結果を next の同じインデックスに書き込む
+    // 移動と箱の壁での反射は、この後 FlockKernelSet::integrate でまとめて行う
+    // 近傍は source の構造を使って探す
+    // kernel は近傍の合計を求める関数 (命令セットごとの版 / スカラー版)
+    // refreshSteering が false なら近傍を探さず、前回求めた操舵の目標 (FlockState::steering) へ曲がるだけにする
+    // コライダーの数や重みを毎回実行時に調べる汎用の版 (updateWith<DynamicColliders, TableGains> と同じ)
+    void update(FlockState &next, const std::vector<SphereCollider> &colliders,
+                const NeighborSource &source, NeighborKernel kernel, bool refreshSteering = true) const;
+
+    // コライダーの扱いと重みの引き方をコンパイル時に選んだ版 (定義と方針の型は UpdatePolicy.h)
+    template <class Colliders, class Gains>
+    void updateWith(FlockState &next, const SphereCollider *colliders, int colliderCount,
+                    const NeighborSource &source, NeighborKernel kernel, bool refreshSteering = true) const;
+
+    // コライダーの表面から 5.0 以内に入っていたら押し出し、向きを反射させる
+    static void collide(glm::vec3 &position, glm::vec3 &direction, const SphereCollider &collider);
+
+    // 近傍を source の構造で探し、分離・整列・結合を合計する
+    // (操舵を区間でまとめて行う更新は、これで合計だけを集める。Simulation::fastMath を参照)
+    NeighborSums sumNeighbors(const glm::vec3 &position, const NeighborSource &source, NeighborKernel kernel) const;
 
-    glm::vec3 position;
-    glm::vec3 direction; // 進行方向
-    float speed;
-    float maxTurn;
+    // 操舵の目標 target (正規化済み、0 なら曲がらない) へ maxTurn の割合だけ direction を曲げる
+    void turnToward(const glm::vec3 &target, glm::vec3 &direction) const;
 
-    Creature(float cubeSize, int speciesID);
-void update(std::vector<Creature *> &others, float cubeSize, const std::vector<SphereCollider> &colliders);
+private:
+    // 近傍の合計から操舵の目標の向きを求める (近傍がいなければ 0)
+    template <class Gains>
+    glm::vec3 steeringTarget(const NeighborSums &sums, const glm::vec3 &position) const;
+    static void reflect(glm::vec3 &direction, const glm::vec3 &normal);
 
-    private : void flock(std::vector<Creature *> &others);
-    void reflect(const glm::vec3 &normal);
+    const FlockState *state;
+    std::size_t index;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,291 @@
+#include "DistanceField.h"
+#include "Collider.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+namespace
+{
+    const char FILE_MAGIC[8] = {'F', 'L', 'K', 'S', 'D', 'F', '\0', '\0'};
+
+    struct FileHeader
+    {
+        char magic[8];
+        std::uint32_t version;
+        std::int32_t resolution;
+        float cubeSize;
+        std::uint32_t reserved;
+        std::uint64_t key;
+    };
+
+    // FNV-1a (64 ビット)
+    struct Hasher
+    {
+        std::uint64_t value = 1469598103934665603ull;
+
+        void add(const void *data, std::size_t bytes)
+        {
+            const unsigned char *p = static_cast<const unsigned char *>(data);
+            for (std::size_t i = 0; i < bytes; ++i)
+            {
+                value = (value ^ p[i]) * 1099511628211ull;
+            }
+        }
+        template <typename T>
+        void add(const T &v) { add(&v, sizeof(T)); }
+        template <typename T>
+        void addArray(const std::vector<T> &v)
+        {
+            add(static_cast<std::uint64_t>(v.size()));
+            if (!v.empty())
+                add(v.data(), v.size() * sizeof(T));
+        }
+    };
+
+    // 箱 [lower, upper] の外の点から箱までの距離 (中なら 0)
+    float distanceToBounds(const glm::vec3 &p, const glm::vec3 &lower, const glm::vec3 &upper)
+    {
+        const glm::vec3 d = glm::max(glm::max(lower - p, p - upper), glm::vec3(0.0f));
+        return glm::length(d);
+    }
+}
+
+std::uint64_t DistanceField::cacheKey(const ObstacleSet &obstacles, float cubeSize, int resolution)
+{
+    Hasher hash;
+    hash.add(FILE_VERSION);
+    hash.add(cubeSize);
+    hash.add(resolution);
+    hash.addArray(obstacles.spheres);
+    hash.addArray(obstacles.boxes);
+    hash.add(static_cast<std::uint64_t>(obstacles.meshes.size()));
+    for (const TriangleMesh &mesh : obstacles.meshes)
+    {
+        hash.addArray(mesh.vertices);
+        hash.addArray(mesh.indices);
+    }
+    return hash.value;
+}
+
+void DistanceField::bake(const ObstacleSet &obstacles, float size, int nodesPerAxis)
+{
+    auto start = std::chrono::steady_clock::now();
+    resolution = std::max(nodesPerAxis, 2);
+    cubeSize = size;
+    spacing = 2.0f * cubeSize / (resolution - 1);
+    key = cacheKey(obstacles, cubeSize, resolution);
+    const std::size_t nodeCount = static_cast<std::size_t>(resolution) * resolution * resolution;
+    distances.assign(nodeCount, 0.0f);
+
+    // メッシュを囲む箱 (箱から遠い格子点ではメッシュの三角形を調べずに済ませる)
+    std::vector<glm::vec3> meshLower, meshUpper;
+    for (const TriangleMesh &mesh : obstacles.meshes)
+    {
+        glm::vec3 lower(std::numeric_limits<float>::max()), upper(-std::numeric_limits<float>::max());
+        for (const glm::vec3 &v : mesh.vertices)
+        {
+            lower = glm::min(lower, v);
+            upper = glm::max(upper, v);
+        }
+        meshLower.push_back(lower);
+        meshUpper.push_back(upper);
+    }
+
+    // z の1枚ずつを並列に焼く。格子点の値は ObstacleSet::distance と同じになる
+    parallel::forEach(static_cast<std::size_t>(resolution), [&](std::size_t z)
+                      {
+                          for (int y = 0; y < resolution; ++y)
+                          {
+                              for (int x = 0; x < resolution; ++x)
+                              {
+                                  const glm::vec3 p = glm::vec3(x, y, static_cast<int>(z)) * spacing - glm::vec3(cubeSize);
+                                  float best = std::numeric_limits<float>::max();
+                                  for (const SphereObstacle &sphere : obstacles.spheres)
+                                      best = std::min(best, sphere.distance(p));
+                                  for (const BoxObstacle &box : obstacles.boxes)
+                                      best = std::min(best, box.distance(p));
+                                  for (std::size_t m = 0; m < obstacles.meshes.size(); ++m)
+                                  {
+                                      // 箱の外ならメッシュの外なので、距離は箱までの距離以上で、符号は正
+                                      const float outside = distanceToBounds(p, meshLower[m], meshUpper[m]);
+                                      if (outside > 0.0f)
+                                      {
+                                          if (outside < best)
+                                              best = std::min(best, obstacles.meshes[m].unsignedDistance(p));
+                                      }
+                                      else
+                                      {
+                                          best = std::min(best, obstacles.meshes[m].distance(p));
+                                      }
+                                  }
+                                  distances[node(x, y, static_cast<int>(z))] = best;
+                              }
+                          } });
+
+    // 勾配は中央差分 (範囲の端では片側の差分)
+    gradX.assign(nodeCount, 0.0f);
+    gradY.assign(nodeCount, 0.0f);
+    gradZ.assign(nodeCount, 0.0f);
+    parallel::forEach(static_cast<std::size_t>(resolution), [&](std::size_t zs)
+                      {
+                          const int z = static_cast<int>(zs);
+                          auto difference = [&](int x, int y, int z, int dx, int dy, int dz, int coordinate)
+                          {
+                              const int lo = std::max(coordinate - 1, 0) - coordinate;
+                              const int hi = std::min(coordinate + 1, resolution - 1) - coordinate;
+                              return (distances[node(x + dx * hi, y + dy * hi, z + dz * hi)] -
+                                      distances[node(x + dx * lo, y + dy * lo, z + dz * lo)]) /
+                                     ((hi - lo) * spacing);
+                          };
+                          for (int y = 0; y < resolution; ++y)
+                          {
+                              for (int x = 0; x < resolution; ++x)
+                              {
+                                  const std::size_t n = node(x, y, z);
+                                  gradX[n] = difference(x, y, z, 1, 0, 0, x);
+                                  gradY[n] = difference(x, y, z, 0, 1, 0, y);
+                                  gradZ[n] = difference(x, y, z, 0, 0, 1, z);
+                              }
+                          } });
+    bakeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool DistanceField::bakeOrLoad(const ObstacleSet &obstacles, float size, int nodesPerAxis, const std::string &path)
+{
+    if (load(path, cacheKey(obstacles, size, std::max(nodesPerAxis, 2))))
+        return true;
+    bake(obstacles, size, nodesPerAxis);
+    save(path);
+    return false;
+}
+
+bool DistanceField::save(const std::string &path) const
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    FileHeader header{};
+    std::memcpy(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+    header.version = FILE_VERSION;
+    header.resolution = resolution;
+    header.cubeSize = cubeSize;
+    header.key = key;
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    for (const std::vector<float> *v : {&distances, &gradX, &gradY, &gradZ})
+    {
+        file.write(reinterpret_cast<const char *>(v->data()), static_cast<std::streamsize>(v->size() * sizeof(float)));
+    }
+    return static_cast<bool>(file);
+}
+
+bool DistanceField::load(const std::string &path, std::uint64_t expectedKey)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    FileHeader header{};
+    file.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (!file || std::memcmp(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0 || header.version != FILE_VERSION ||
+        header.key != expectedKey || header.resolution < 2)
+        return false;
+
+    auto start = std::chrono::steady_clock::now();
+    const std::size_t nodeCount = static_cast<std::size_t>(header.resolution) * header.resolution * header.resolution;
+    std::vector<float> loaded[4];
+    for (std::vector<float> &v : loaded)
+    {
+        v.resize(nodeCount);
+        file.read(reinterpret_cast<char *>(v.data()), static_cast<std::streamsize>(nodeCount * sizeof(float)));
+    }
+    if (!file)
+        return false; // 途中で切れたファイルは使わない (今の内容も変えない)
+
+    resolution = header.resolution;
+    cubeSize = header.cubeSize;
+    spacing = 2.0f * cubeSize / (resolution - 1);
+    key = header.key;
+    distances.swap(loaded[0]);
+    gradX.swap(loaded[1]);
+    gradY.swap(loaded[2]);
+    gradZ.swap(loaded[3]);
+    bakeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+std::size_t DistanceField::cellOf(const glm::vec3 &p, glm::vec3 &t) const
+{
+    const glm::vec3 local = glm::clamp((p + glm::vec3(cubeSize)) / spacing, glm::vec3(0.0f),
+                                       glm::vec3(static_cast<float>(resolution - 1)));
+    const int x = std::min(static_cast<int>(local.x), resolution - 2);
+    const int y = std::min(static_cast<int>(local.y), resolution - 2);
+    const int z = std::min(static_cast<int>(local.z), resolution - 2);
+    t = local - glm::vec3(x, y, z);
+    return node(x, y, z);
+}
+
+float DistanceField::distanceAt(const glm::vec3 &p) const
+{
+    glm::vec3 t;
+    const std::size_t n = cellOf(p, t);
+    const std::size_t row = resolution, slice = static_cast<std::size_t>(resolution) * resolution;
+    const float *d = distances.data() + n;
+    // x, y, z の順に線形補間する
+    const float d00 = d[0] + (d[1] - d[0]) * t.x;
+    const float d10 = d[row] + (d[row + 1] - d[row]) * t.x;
+    const float d01 = d[slice] + (d[slice + 1] - d[slice]) * t.x;
+    const float d11 = d[slice + row] + (d[slice + row + 1] - d[slice + row]) * t.x;
+    const float d0 = d00 + (d10 - d00) * t.y;
+    const float d1 = d01 + (d11 - d01) * t.y;
+    return d0 + (d1 - d0) * t.z;
+}
+
+float DistanceField::sample(const glm::vec3 &p, glm::vec3 &normal) const
+{
+    // 含むセルの角の8点から三線形補間する
+    glm::vec3 t;
+    const std::size_t base = cellOf(p, t);
+    float distance = 0.0f;
+    glm::vec3 gradient(0.0f);
+    for (int corner = 0; corner < 8; ++corner)
+    {
+        const int cx = corner & 1, cy = (corner >> 1) & 1, cz = corner >> 2;
+        const float weight = (cx ? t.x : 1.0f - t.x) * (cy ? t.y : 1.0f - t.y) * (cz ? t.z : 1.0f - t.z);
+        const std::size_t n = base + node(cx, cy, cz);
+        distance += weight * distances[n];
+        gradient += weight * glm::vec3(gradX[n], gradY[n], gradZ[n]);
+    }
+    const float length = glm::length(gradient);
+    // 勾配が消える点 (障害物の中心や、2つの障害物のちょうど中間) では上向きにする
+    normal = length > 1e-6f ? gradient / length : glm::vec3(0.0f, 1.0f, 0.0f);
+    return distance;
+}
+
+void DistanceField::collide(const BoidArrays &b, std::size_t begin, std::size_t end, float margin) const
+{
+    if (distances.empty())
+        return;
+    for (std::size_t i = begin; i < end; ++i)
+    {
+        const glm::vec3 position(b.px[i], b.py[i], b.pz[i]);
+        // ほとんどの個体は表面から遠いので、まず距離だけで判定し、近いものだけ勾配を読む
+        if (distanceAt(position) >= margin)
+            continue;
+        glm::vec3 normal;
+        const float distance = sample(position, normal);
+        // 表面から margin の位置まで押し出し、向きを法線で反射させる
+        const glm::vec3 pushed = position + normal * (margin - distance);
+        const glm::vec3 direction(b.dx[i], b.dy[i], b.dz[i]);
+        const glm::vec3 reflected = glm::normalize(direction - 2.0f * glm::dot(direction, normal) * normal);
+        b.px[i] = pushed.x;
+        b.py[i] = pushed.y;
+        b.pz[i] = pushed.z;
+        b.dx[i] = reflected.x;
+        b.dy[i] = reflected.y;
+        b.dz[i] = reflected.z;
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef DISTANCE_FIELD_H
+#define DISTANCE_FIELD_H
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "FlockKernel.h"
+#include "FlockState.h"
+#include "Obstacle.h"
+
+// 障害物 (Obstacle.h) までの符号付き距離とその勾配を、[-cubeSize, cubeSize]^3 の格子点に焼き込んだもの
+// 形の種類や数によらず、個体は1回の三線形補間で距離と法線を得るので、衝突処理に形ごとの分岐がいらない。
+// 格子の間隔より細かい形 (薄い板や細い棒) は丸められる。
+// 焼き込みは格子点ごとに並列に行い、結果はディスクに保存して次の起動から読み込める (bakeOrLoad)。
+class DistanceField
+{
+public:
+    // obstacles の距離を resolution^3 の格子点で求め、勾配を中央差分で求める
+    void bake(const ObstacleSet &obstacles, float cubeSize, int resolution);
+    // path に同じ障害物・範囲・解像度で焼いたものがあれば読み込み、なければ焼いて path に保存する
+    // 戻り値は読み込めたかどうか (焼いたときは false)
+    bool bakeOrLoad(const ObstacleSet &obstacles, float cubeSize, int resolution, const std::string &path);
+
+    bool save(const std::string &path) const;
+    // 保存したときの鍵 (cacheKey) が key と違えば読み込まずに false を返す
+    bool load(const std::string &path, std::uint64_t key);
+    // 障害物・範囲・解像度から作るキャッシュの鍵 (どれかが変われば別の値になる)
+    static std::uint64_t cacheKey(const ObstacleSet &obstacles, float cubeSize, int resolution);
+
+    bool empty() const { return distances.empty(); }
+    int getResolution() const { return resolution; }
+    float getSpacing() const { return spacing; }
+    double getBakeMs() const { return bakeMs; }
+
+    // p での距離と、距離が増える向きの単位ベクトル (障害物の外向きの法線)。範囲の外の p は範囲の端で求める
+    float sample(const glm::vec3 &p, glm::vec3 &normal) const;
+    // p での距離だけ (勾配の配列を読まないので sample より軽い)
+    float distanceAt(const glm::vec3 &p) const;
+
+    // [begin, end) の個体のうち、障害物の表面から margin 以内に入ったものを margin の位置まで押し出し、
+    // 向きを法線で反射させる (SphereCollider と同じ扱い。margin = COLLIDER_MARGIN なら球は同じ振る舞いになる)
+    void collide(const BoidArrays &boids, std::size_t begin, std::size_t end, float margin) const;
+
+    static constexpr std::uint32_t FILE_VERSION = 1;
+
+private:
+    std::size_t node(int x, int y, int z) const
+    {
+        return (static_cast<std::size_t>(z) * resolution + y) * resolution + x;
+    }
+    // p を含むセルの最小の角の節点と、セルの中での位置 (0〜1)
+    std::size_t cellOf(const glm::vec3 &p, glm::vec3 &t) const;
+
+    int resolution = 0;
+    float cubeSize = 0.0f;
+    float spacing = 1.0f; // 格子点の間隔
+    std::uint64_t key = 0;
+    std::vector<float> distances;
+    std::vector<float> gradX, gradY, gradZ; // 正規化していない中央差分
+    double bakeMs = 0.0;
+};
+
+#endif
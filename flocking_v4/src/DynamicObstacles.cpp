@@ -0,0 +1,63 @@
+#include "DynamicObstacles.h"
+#include "Parallel.h"
+
+#include <chrono>
+
+// 頂点の変換を並列に行うときの1区間の頂点数
+static const std::size_t TRANSFORM_GRAIN = 4096;
+
+int DynamicObstacles::add(const TriangleMesh &shape, const glm::mat4 &transform)
+{
+    shapes.push_back(shape);
+    placed.push_back(shape);
+    transforms.push_back(transform);
+    dirty.push_back(1);
+    structureChanged = true;
+    return static_cast<int>(shapes.size()) - 1;
+}
+
+void DynamicObstacles::setTransform(int obstacle, const glm::mat4 &transform)
+{
+    transforms[obstacle] = transform;
+    dirty[obstacle] = 1;
+}
+
+void DynamicObstacles::update()
+{
+    lastTimings = ObstacleUpdateTimings();
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t o = 0; o < shapes.size(); ++o)
+    {
+        if (!dirty[o])
+            continue;
+        dirty[o] = 0;
+        lastTimings.moved++;
+        const glm::mat4 &m = transforms[o];
+        const std::vector<glm::vec3> &from = shapes[o].vertices;
+        std::vector<glm::vec3> &to = placed[o].vertices;
+        parallel::forRange(from.size(), TRANSFORM_GRAIN, [&](std::size_t begin, std::size_t end)
+                           {
+                               for (std::size_t v = begin; v < end; ++v)
+                               {
+                                   to[v] = glm::vec3(m * glm::vec4(from[v], 1.0f));
+                               } });
+    }
+    auto transformed = std::chrono::steady_clock::now();
+    lastTimings.transformMs = std::chrono::duration<double, std::milli>(transformed - start).count();
+    if (lastTimings.moved == 0 && !structureChanged)
+        return;
+
+    if (refitEnabled && !structureChanged)
+    {
+        bvh.refit(placed);
+        lastTimings.refitMs = bvh.getRefitMs();
+        lastTimings.sahRatio = bvh.getBuildSahCost() > 0.0f ? bvh.sahCost() / bvh.getBuildSahCost() : 1.0f;
+        if (lastTimings.sahRatio <= rebuildThreshold)
+            return;
+    }
+    bvh.build(placed);
+    structureChanged = false;
+    lastTimings.rebuilt = true;
+    lastTimings.rebuildMs = bvh.getBuildMs();
+    rebuildCount++;
+}
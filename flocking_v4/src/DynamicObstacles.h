@@ -0,0 +1,58 @@
+#ifndef DYNAMIC_OBSTACLES_H
+#define DYNAMIC_OBSTACLES_H
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <vector>
+
+#include "MeshBvh.h"
+#include "Obstacle.h"
+
+// DynamicObstacles::update() 1回分の内訳
+struct ObstacleUpdateTimings
+{
+    double transformMs = 0.0; // 動いた障害物の頂点の変換
+    double refitMs = 0.0;     // BVH の箱の合わせ直し (作り直したときは 0)
+    double rebuildMs = 0.0;   // BVH の作り直し (作り直さなかったときは 0)
+    bool rebuilt = false;
+    int moved = 0;            // 変換が変わった障害物の数
+    float sahRatio = 1.0f;    // 合わせ直した後の木の SAH の見積もり / 作ったときの見積もり
+};
+
+// 毎ステップ動かせる三角形メッシュの障害物 (捕食者の模型、動く網など)
+// 障害物ごとに自分の座標系での形と、それをシーンに置く変換行列を持ち、全部まとめて1つの MeshBvh に入れる。
+// update() は変換が変わった障害物の頂点だけを変換し直し、木は作り直さずに箱だけを合わせる (MeshBvh::refit)。
+// 障害物が動き回ると木の形が今の配置に合わなくなり、箱の重なりが増えて光線が調べるノードが増えるので、
+// SAH の見積もりが作ったときの rebuildThreshold 倍を超えたら作り直す。
+class DynamicObstacles
+{
+public:
+    // 障害物を加え、その番号を返す (次の update() で木を作り直す)
+    int add(const TriangleMesh &shape, const glm::mat4 &transform);
+    void setTransform(int obstacle, const glm::mat4 &transform);
+    const glm::mat4 &getTransform(int obstacle) const { return transforms[obstacle]; }
+    const TriangleMesh &getShape(int obstacle) const { return shapes[obstacle]; }
+    std::size_t size() const { return shapes.size(); }
+
+    // 前回から変換が変わった障害物を置き直し、BVH を合わせ直す (必要なら作り直す)
+    void update();
+
+    const MeshBvh &getBvh() const { return bvh; }
+    const ObstacleUpdateTimings &getLastTimings() const { return lastTimings; }
+    int getRebuildCount() const { return rebuildCount; }
+
+    float rebuildThreshold = 1.5f;
+    bool refitEnabled = true; // false なら動くたびに作り直す (比較用)
+
+private:
+    std::vector<TriangleMesh> shapes; // 障害物の座標系での形
+    std::vector<TriangleMesh> placed; // 変換した後の形 (BVH に入れるもの)
+    std::vector<glm::mat4> transforms;
+    std::vector<char> dirty;          // 前回の update() から変換が変わったか
+    bool structureChanged = false;    // 障害物が増えたか
+    MeshBvh bvh;
+    ObstacleUpdateTimings lastTimings;
+    int rebuildCount = 0;
+};
+
+#endif
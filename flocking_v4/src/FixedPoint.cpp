@@ -0,0 +1,234 @@
+#include "FixedPoint.h"
+#include "Creature.h"
+#include "Parallel.h"
+#include "SpatialGrid.h"
+
+#include <algorithm>
+#include <cassert>
+
+using namespace fixed_point;
+
+namespace
+{
+    // 分離の重み g(d²) = 1 / (d * (d² + 0.01)) の表
+    // float 版の normalize(diff) / (d² + 0.01) は diff * g(d²) に等しい。
+    // d² を 1/2^TABLE_STEP_BITS 刻みで区切り、各区間の上端の値を小数部 SEPARATION_BITS ビットで持つ。
+    // 上端の値を使うので |diff| * g <= 1 / (d² + 0.01) <= 100 となり、積は 32 ビットに収まる。
+    const std::vector<std::int32_t> &separationTable()
+    {
+        // 倍精度の平方根・除算は IEEE 754 で正しく丸められるので、どの環境でも同じ表になる
+        static const std::vector<std::int32_t> table = []
+        {
+            std::vector<std::int32_t> t(TABLE_SIZE);
+            for (int i = 0; i < TABLE_SIZE; ++i)
+            {
+                const double d2 = std::ldexp(i + 1, -TABLE_STEP_BITS);
+                t[i] = static_cast<std::int32_t>(std::lround(std::ldexp(1.0 / (std::sqrt(d2) * (d2 + 0.01)), SEPARATION_BITS)));
+            }
+            return t;
+        }();
+        return table;
+    }
+
+    // 重みを小数部 8 ビットの整数にする
+    std::int64_t gainToFixed(float gain)
+    {
+        return std::lround(std::ldexp(gain, 8));
+    }
+}
+
+bool fixed_point::normalize(std::int64_t x, std::int64_t y, std::int64_t z, int bits, std::int32_t out[3])
+{
+    assert(bits <= 22); // 2^30 × 2^bits が quotient の範囲に収まる
+    std::int64_t m = std::max(std::max(x < 0 ? -x : x, y < 0 ? -y : y), z < 0 ? -z : z);
+    if (m == 0)
+        return false;
+    // 二乗の和が 64 ビットに収まるよう、成分を 2^shift で割って (0 方向への切り捨て) 2^30 未満に縮める。
+    // m / 2^shift < 2^30 と m >> shift < 2^30 は同じなので、m >> t >= 2^30 となる最大の t を二分探索で求める。
+    // 成分の符号やシフトの量で分岐すると呼び出しごとに予測が外れるので、回数の決まったループと条件付きの代入で書く
+    const std::int64_t limit = std::int64_t(1) << 30;
+    int shift = 0;
+    if (m >= limit)
+    {
+        int top = 0;
+        for (int step = 32; step > 0; step /= 2)
+        {
+            top += (m >> (top + step)) >= limit ? step : 0;
+        }
+        shift = top + 1;
+    }
+    // 負の値は 2^shift - 1 を足してから算術シフトすると、0 方向への切り捨てになる
+    const std::int64_t bias = (std::int64_t(1) << shift) - 1;
+    x = (x + (x < 0 ? bias : 0)) >> shift;
+    y = (y + (y < 0 ? bias : 0)) >> shift;
+    z = (z + (z < 0 ? bias : 0)) >> shift;
+    const std::int64_t len = static_cast<std::int64_t>(isqrt(static_cast<std::uint64_t>(x * x + y * y + z * z)));
+    if (len == 0)
+        return false;
+    // 成分は 2^30 未満なので、2^bits 倍しても quotient の範囲 (2^53 未満) に収まる
+    out[0] = static_cast<std::int32_t>(quotient(x * (std::int64_t(1) << bits), len));
+    out[1] = static_cast<std::int32_t>(quotient(y * (std::int64_t(1) << bits), len));
+    out[2] = static_cast<std::int32_t>(quotient(z * (std::int64_t(1) << bits), len));
+    return true;
+}
+
+// 整数への変換と、個体ごとの更新のループの区間の大きさ
+static const std::size_t CONVERT_GRAIN = 4096;
+static const std::size_t UPDATE_GRAIN = 256;
+
+void FixedPointStepper::step(const FlockState &current, FlockState &next, const SpatialGrid &grid,
+                             std::size_t begin, std::size_t end,
+                             const std::vector<SphereCollider> &colliders, float cubeSize,
+                             FixedNeighborKernel accumulateNeighbors)
+{
+    // 表の大きさと半径は FLOCK_RADIUS = 5.0 を前提にしている
+    assert(FLOCK_RADIUS == 5.0f);
+
+    // 近傍ループで連続して読めるよう、グリッドのセル順に並べた値を整数にする
+    const NeighborArrays sorted = grid.sortedArrays();
+    const int n = static_cast<int>(end - begin);
+    sortedPosX.resize(n);
+    sortedPosY.resize(n);
+    sortedPosZ.resize(n);
+    sortedDirX.resize(n);
+    sortedDirY.resize(n);
+    sortedDirZ.resize(n);
+    sortedSpecies.resize(n);
+    parallel::forRange(n, CONVERT_GRAIN, [&](std::size_t k0, std::size_t k1)
+                       {
+                           for (int k = static_cast<int>(k0); k < static_cast<int>(k1); ++k)
+                           {
+                               sortedPosX[k] = toFixed(sorted.px[k], POS_BITS);
+                               sortedPosY[k] = toFixed(sorted.py[k], POS_BITS);
+                               sortedPosZ[k] = toFixed(sorted.pz[k], POS_BITS);
+                               sortedDirX[k] = toFixed(sorted.dx[k], DIR_BITS);
+                               sortedDirY[k] = toFixed(sorted.dy[k], DIR_BITS);
+                               sortedDirZ[k] = toFixed(sorted.dz[k], DIR_BITS);
+                               sortedSpecies[k] = sorted.species[k];
+                           } });
+
+    const FixedNeighborArrays arrays = {sortedPosX.data(), sortedPosY.data(), sortedPosZ.data(),
+                                        sortedDirX.data(), sortedDirY.data(), sortedDirZ.data(),
+                                        sortedSpecies.data()};
+    const std::int32_t *table = separationTable().data();
+    const std::int32_t box = toFixed(cubeSize, POS_BITS);
+
+    // コライダーは全個体で共通なので、整数にするのはステップごとに1回にする
+    // 表面から 5.0 以内かは isqrt を使わずに二乗で比べる (floor(sqrt(v)) >= r と v >= r² は同じ)
+    struct FixedCollider
+    {
+        std::int64_t center[3];
+        std::int64_t radius;
+        std::int64_t reachSq; // (radius + 5.0)²
+    };
+    std::vector<FixedCollider> fixedColliders;
+    fixedColliders.reserve(colliders.size());
+    for (const SphereCollider &collider : colliders)
+    {
+        FixedCollider c;
+        c.center[0] = toFixed(collider.center.x, POS_BITS);
+        c.center[1] = toFixed(collider.center.y, POS_BITS);
+        c.center[2] = toFixed(collider.center.z, POS_BITS);
+        c.radius = toFixed(collider.radius, POS_BITS);
+        const std::int64_t reach = c.radius + (std::int64_t(5) << POS_BITS);
+        c.reachSq = reach * reach;
+        fixedColliders.push_back(c);
+    }
+
+    // 各個体の結果は自分の近傍だけで決まり、スレッドの分け方には左右されない
+    parallel::forRange(end - begin, UPDATE_GRAIN, [&](std::size_t i0, std::size_t i1)
+                       {
+        for (int i = static_cast<int>(begin + i0); i < static_cast<int>(begin + i1); ++i)
+        {
+            std::int32_t pos[3] = {toFixed(current.posX[i], POS_BITS), toFixed(current.posY[i], POS_BITS),
+                                   toFixed(current.posZ[i], POS_BITS)};
+            std::int32_t dir[3] = {toFixed(current.dirX[i], DIR_BITS), toFixed(current.dirY[i], DIR_BITS),
+                                   toFixed(current.dirZ[i], DIR_BITS)};
+            const int mySpecies = current.speciesID[i];
+
+            // 1. 群れの操舵
+            FixedNeighborSums sums;
+            grid.forEachNeighborRange(current.position(i), [&](int begin, int end)
+                                      { accumulateNeighbors(arrays, begin, end, pos, mySpecies, table, sums); });
+            if (sums.count > 0)
+            {
+                const SpeciesFlockGains &gains = Creature::flockGains(mySpecies);
+                // 分離は平均 (小数部 24 ビット)、整列と結合は向きだけを使う (小数部 DIR_BITS の単位ベクトル)
+                // 分離の合計は1個あたり 2^31 未満なので、近傍が 2^22 個未満なら quotient の範囲に収まる
+                const std::int64_t sep[3] = {quotient(sums.sepX, sums.count), quotient(sums.sepY, sums.count),
+                                             quotient(sums.sepZ, sums.count)};
+                std::int32_t aln[3] = {0, 0, 0};
+                std::int32_t coh[3] = {0, 0, 0};
+                normalize(sums.alnX, sums.alnY, sums.alnZ, DIR_BITS, aln);
+                normalize(-sums.cohX, -sums.cohY, -sums.cohZ, DIR_BITS, coh);
+
+                // 重み (小数部 8 ビット) を掛けて、小数部 32 ビットにそろえて足す
+                const int alignShift = DIFF_BITS + SEPARATION_BITS - DIR_BITS;
+                const std::int64_t gs = gainToFixed(gains.separation);
+                const std::int64_t ga = gainToFixed(gains.alignment) * (std::int64_t(1) << alignShift);
+                const std::int64_t gc = gainToFixed(gains.cohesion) * (std::int64_t(1) << alignShift);
+                std::int32_t steer[3];
+                if (normalize(sep[0] * gs + aln[0] * ga + coh[0] * gc,
+                              sep[1] * gs + aln[1] * ga + coh[1] * gc,
+                              sep[2] * gs + aln[2] * ga + coh[2] * gc, DIR_BITS, steer))
+                {
+                    // mix(dir, steer, maxTurn) を正規化する
+                    const std::int64_t t = toFixed(current.maxTurn[i], DIR_BITS);
+                    std::int64_t mixed[3];
+                    for (int a = 0; a < 3; ++a)
+                    {
+                        mixed[a] = dir[a] * ((std::int64_t(1) << DIR_BITS) - t) + steer[a] * t;
+                    }
+                    normalize(mixed[0], mixed[1], mixed[2], DIR_BITS, dir);
+                }
+            }
+
+            // 2. コライダーとの衝突 (float 版と同じく、表面から 5.0 以内に入ったら押し出して反射する)
+            for (const FixedCollider &collider : fixedColliders)
+            {
+                const std::int64_t v[3] = {pos[0] - collider.center[0], pos[1] - collider.center[1],
+                                           pos[2] - collider.center[2]};
+                const std::int64_t distSq = v[0] * v[0] + v[1] * v[1] + v[2] * v[2];
+                if (distSq >= collider.reachSq)
+                    continue;
+                const std::int64_t dist = static_cast<std::int64_t>(isqrt(static_cast<std::uint64_t>(distSq)));
+                const std::int64_t radius = collider.radius;
+                const std::int64_t margin = std::int64_t(5) << POS_BITS;
+
+                std::int32_t normal[3] = {0, 1 << DIR_BITS, 0};
+                normalize(v[0], v[1], v[2], DIR_BITS, normal);
+                const std::int64_t push = radius - dist + margin;
+                for (int a = 0; a < 3; ++a)
+                {
+                    pos[a] += static_cast<std::int32_t>(normal[a] * push / (std::int64_t(1) << DIR_BITS));
+                }
+                // 反射: dir - 2 (dir・n) n
+                const std::int64_t dot = std::int64_t(dir[0]) * normal[0] + std::int64_t(dir[1]) * normal[1] +
+                                         std::int64_t(dir[2]) * normal[2];
+                std::int64_t reflected[3];
+                for (int a = 0; a < 3; ++a)
+                {
+                    reflected[a] = dir[a] - 2 * dot * normal[a] / (std::int64_t(1) << (2 * DIR_BITS));
+                }
+                normalize(reflected[0], reflected[1], reflected[2], DIR_BITS, dir);
+            }
+
+            // 3. 移動と、箱の壁での反射
+            const std::int64_t speed = toFixed(current.speed[i], POS_BITS);
+            for (int a = 0; a < 3; ++a)
+            {
+                std::int64_t p = pos[a] + dir[a] * speed / (std::int64_t(1) << DIR_BITS);
+                const std::int64_t clamped = std::clamp<std::int64_t>(p, -box, box);
+                if (clamped != p)
+                    dir[a] = -dir[a];
+                pos[a] = static_cast<std::int32_t>(clamped);
+            }
+
+            next.posX[i] = toFloat(pos[0], POS_BITS);
+            next.posY[i] = toFloat(pos[1], POS_BITS);
+            next.posZ[i] = toFloat(pos[2], POS_BITS);
+            next.dirX[i] = toFloat(dir[0], DIR_BITS);
+            next.dirY[i] = toFloat(dir[1], DIR_BITS);
+            next.dirZ[i] = toFloat(dir[2], DIR_BITS);
+        } });
+}
@@ -0,0 +1,79 @@
+#ifndef FIXED_POINT_H
+#define FIXED_POINT_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Collider.h"
+#include "FlockKernel.h"
+#include "FlockState.h"
+
+class SpatialGrid;
+
+// 固定小数点 (整数) による更新
+// 浮動小数点の計算はコンパイラの最適化 (FMA への融合、演算順の入れ替え) や命令セットによって丸めが変わり、
+// 同じ初期状態からでもプラットフォームごとに結果がずれていく。
+// ここでは位置・向きを整数で表し、近傍の合計から移動までをすべて整数演算で行うので、
+// 同じ初期状態からはコンパイラ・CPU・スレッド数によらずビット単位で同じ結果になる。
+// 整数の加算は順序によらないので、近傍をどの順に足しても (グリッドの並びが違っても) 合計は変わらない。
+//
+// 各ステップの最初に FlockState (float) を整数に直し、更新結果を float に戻して書き込む。
+// 整数の値は float で正確に表せる範囲 (仮数部 24 ビット以内) に収まるので、この往復で値は変わらない。
+namespace fixed_point
+{
+    // 整数の書式 (POS_BITS など) はカーネルと共有するので FlockKernel.h にある
+
+    // 四捨五入 (0 から遠い方へ) で整数にする。倍精度では 2^bits 倍も 0.5 の加算も丸めなしで計算できる
+    inline std::int32_t toFixed(float v, int bits)
+    {
+        const double scaled = static_cast<double>(v) * static_cast<double>(std::int64_t(1) << bits);
+        return static_cast<std::int32_t>(scaled < 0.0 ? scaled - 0.5 : scaled + 0.5);
+    }
+    // 2 の累乗を掛けるだけなので ldexp と同じ値になる (ldexp はインライン展開されない関数呼び出し)
+    inline float toFloat(std::int64_t v, int bits)
+    {
+        return static_cast<float>(v) * (1.0f / static_cast<float>(std::int64_t(1) << bits));
+    }
+
+    // n / d (0 方向への切り捨て)。|n| < 2^53 なら n と d は倍精度で正確に表せ、商の丸めの誤差 (|n / d| × 2^-53 以下) は
+    // 商と隣の整数との差 (1 / |d| 以上) より小さいので、整数部は整数の除算と同じになる。64 ビットの整数の除算より速い
+    inline std::int64_t quotient(std::int64_t n, std::int64_t d)
+    {
+        return static_cast<std::int64_t>(static_cast<double>(n) / static_cast<double>(d));
+    }
+
+    // floor(sqrt(v))。倍精度の平方根 (IEEE 754 で正しく丸められる) を整数で補正するので、どの環境でも同じ値になる
+    // v < 2^62 (使うのは 2^30 未満の成分3つの二乗和) なら平方根の誤差は 2^-21 未満で、切り捨てたものは
+    // 正しい値と高々 1 しか違わないので、補正は上下に1回ずつでよい (ループにすると予測の外れる分岐になる)
+    inline std::uint64_t isqrt(std::uint64_t v)
+    {
+        std::uint64_t r = static_cast<std::uint64_t>(std::sqrt(static_cast<double>(v)));
+        r -= r * r > v;
+        r += (r + 1) * (r + 1) <= v;
+        return r;
+    }
+
+    // (x, y, z) を長さ 2^bits の整数ベクトルにして out に書く。長さ 0 なら false を返して out は変えない
+    bool normalize(std::int64_t x, std::int64_t y, std::int64_t z, int bits, std::int32_t out[3]);
+}
+
+class FixedPointStepper
+{
+public:
+    // current のインデックス [begin, end) の個体を、同じ区間で組んだ grid (FLOCK_RADIUS のセル) で
+    // 近傍探索しながら1ステップ進め、next に書く
+    // 操舵・衝突・移動・壁での反射までを行う (float 版の Creature::update + integrate に対応)
+    // 近傍の合計には accumulateNeighbors (命令セットごとのカーネル) を使う。どれを使っても結果は同じ
+    void step(const FlockState &current, FlockState &next, const SpatialGrid &grid, std::size_t begin, std::size_t end,
+              const std::vector<SphereCollider> &colliders, float cubeSize, FixedNeighborKernel accumulateNeighbors);
+
+private:
+    // グリッドのセル順に並べた、整数の位置・向き・種族
+    std::vector<std::int32_t> sortedPosX, sortedPosY, sortedPosZ;
+    std::vector<std::int32_t> sortedDirX, sortedDirY, sortedDirZ;
+    std::vector<std::int32_t> sortedSpecies;
+};
+
+#endif
@@ -0,0 +1,154 @@
+#include "FlockKernel.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+// 命令セットごとのカーネル (FlockKernelVariant.inl から生成される)
+#define DECLARE_FLOCK_KERNEL_VARIANT(variant)                                                                     \
+    namespace flock_kernels                                                                                       \
+    {                                                                                                             \
+        namespace variant                                                                                         \
+        {                                                                                                         \
+            const char *name();                                                                                   \
+            void accumulateNeighbors(const NeighborArrays &a, std::size_t begin, std::size_t end,                 \
+                                     const glm::vec3 &position, int species, float radiusSq, NeighborSums &sums); \
+            void accumulateNeighborsFast(const NeighborArrays &a, std::size_t begin, std::size_t end,             \
+                                         const glm::vec3 &position, int species, float radiusSq,                  \
+                                         NeighborSums &sums);                                                     \
+            void integrate(const BoidArrays &b, std::size_t begin, std::size_t end, float cubeSize);              \
+            void integrateWrap(const BoidArrays &b, std::size_t begin, std::size_t end, float cubeSize);          \
+            void integrateOpen(const BoidArrays &b, std::size_t begin, std::size_t end, float cubeSize);          \
+            void collide(const BoidArrays &b, std::size_t begin, std::size_t end,                                 \
+                         const SphereCollider *colliders, int colliderCount);                                     \
+            void steerFast(const SteeringArrays &s, std::size_t count);                                           \
+            void accumulateNeighborsFixed(const FixedNeighborArrays &a, int begin, int end,                       \
+                                          const std::int32_t position[3], int species,                            \
+                                          const std::int32_t *separationTable, FixedNeighborSums &sums);          \
+        }                                                                                                         \
+    }
+
+DECLARE_FLOCK_KERNEL_VARIANT(generic)
+#if defined(FLOCKING_X86_VARIANTS)
+DECLARE_FLOCK_KERNEL_VARIANT(avx2)
+DECLARE_FLOCK_KERNEL_VARIANT(avx512)
+#endif
+
+void accumulateNeighborsScalar(const NeighborArrays &a, std::size_t begin, std::size_t end,
+                               const glm::vec3 &position, int species, float radiusSq, NeighborSums &sums)
+{
+    for (std::size_t i = begin; i < end; ++i)
+    {
+        if (a.species[i] != species)
+            continue;
+        glm::vec3 otherPosition(a.px[i], a.py[i], a.pz[i]);
+        glm::vec3 diffVec = position - otherPosition;
+        float dSq = glm::dot(diffVec, diffVec); // 距離の二乗
+
+        if (dSq < radiusSq && dSq > 0.0001f)
+        { // dSqが0に近い場合を除外
+            sums.separation += glm::normalize(diffVec) / (dSq + 0.01f);
+            sums.alignment += glm::vec3(a.dx[i], a.dy[i], a.dz[i]);
+            sums.cohesion += otherPosition;
+            sums.count++;
+        }
+    }
+}
+
+const FlockKernelSet &scalarKernels()
+{
+    // 移動と反射・衝突・操舵・整数の近傍合計は元々分岐の少ない処理なので、追加フラグなしでビルドした generic 版を使う
+    static const FlockKernelSet kernels = {"scalar", accumulateNeighborsScalar, accumulateNeighborsScalar,
+                                           flock_kernels::generic::integrate,
+                                           flock_kernels::generic::integrateWrap,
+                                           flock_kernels::generic::integrateOpen,
+                                           flock_kernels::generic::collide,
+                                           flock_kernels::generic::steerFast,
+                                           flock_kernels::generic::accumulateNeighborsFixed};
+    return kernels;
+}
+
+std::vector<const FlockKernelSet *> availableKernels()
+{
+    static const FlockKernelSet generic = {flock_kernels::generic::name(),
+                                           flock_kernels::generic::accumulateNeighbors,
+                                           flock_kernels::generic::accumulateNeighborsFast,
+                                           flock_kernels::generic::integrate,
+                                           flock_kernels::generic::integrateWrap,
+                                           flock_kernels::generic::integrateOpen,
+                                           flock_kernels::generic::collide,
+                                           flock_kernels::generic::steerFast,
+                                           flock_kernels::generic::accumulateNeighborsFixed};
+    std::vector<const FlockKernelSet *> kernels;
+
+#if defined(FLOCKING_X86_VARIANTS)
+    static const FlockKernelSet avx512 = {flock_kernels::avx512::name(),
+                                          flock_kernels::avx512::accumulateNeighbors,
+                                          flock_kernels::avx512::accumulateNeighborsFast,
+                                          flock_kernels::avx512::integrate,
+                                          flock_kernels::avx512::integrateWrap,
+                                          flock_kernels::avx512::integrateOpen,
+                                          flock_kernels::avx512::collide,
+                                          flock_kernels::avx512::steerFast,
+                                          flock_kernels::avx512::accumulateNeighborsFixed};
+    static const FlockKernelSet avx2 = {flock_kernels::avx2::name(),
+                                        flock_kernels::avx2::accumulateNeighbors,
+                                        flock_kernels::avx2::accumulateNeighborsFast,
+                                        flock_kernels::avx2::integrate,
+                                        flock_kernels::avx2::integrateWrap,
+                                        flock_kernels::avx2::integrateOpen,
+                                        flock_kernels::avx2::collide,
+                                        flock_kernels::avx2::steerFast,
+                                        flock_kernels::avx2::accumulateNeighborsFixed};
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        kernels.push_back(&avx512);
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        kernels.push_back(&avx2);
+#endif
+
+    kernels.push_back(&generic);
+    kernels.push_back(&scalarKernels());
+    return kernels;
+}
+
+static const FlockKernelSet &selectKernels()
+{
+    const std::vector<const FlockKernelSet *> kernels = availableKernels();
+
+    // FLOCKING_ISA が指定されていればそれを使う (ベンチマーク用)
+    if (const char *forced = std::getenv("FLOCKING_ISA"))
+    {
+        for (const FlockKernelSet *k : kernels)
+        {
+            if (std::strcmp(k->name, forced) == 0)
+            {
+                std::cout << "Flock kernels: " << k->name << " (forced by FLOCKING_ISA)" << std::endl;
+                return *k;
+            }
+        }
+        std::cerr << "FLOCKING_ISA=" << forced << " is not available on this CPU, using auto-detection" << std::endl;
+    }
+
+    std::cout << "Flock kernels: " << kernels.front()->name << " (auto-detected)" << std::endl;
+    return *kernels.front();
+}
+
+const FlockKernelSet &activeKernels()
+{
+    static const FlockKernelSet &kernels = selectKernels();
+    return kernels;
+}
+
+IntegrateKernel integrateKernel(const FlockKernelSet &kernels, BoundaryMode boundary)
+{
+    switch (boundary)
+    {
+    case BoundaryMode::Wrap:
+        return kernels.integrateWrap;
+    case BoundaryMode::Open:
+        return kernels.integrateOpen;
+    default:
+        return kernels.integrate;
+    }
+}
@@ -0,0 +1,174 @@
+#ifndef FLOCK_KERNEL_H
+#define FLOCK_KERNEL_H
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Collider.h"
+
+// 近傍候補の配列 (Structure-of-Arrays)。カーネルは [begin, end) を連続アクセスする
+struct NeighborArrays
+{
+    const float *px;
+    const float *py;
+    const float *pz;
+    const float *dx;
+    const float *dy;
+    const float *dz;
+    const int *species;
+};
+
+// 分離・整列・結合の合計 (flock の中で正規化する前の値)
+struct NeighborSums
+{
+    glm::vec3 separation = glm::vec3(0.0f);
+    glm::vec3 alignment = glm::vec3(0.0f);
+    glm::vec3 cohesion = glm::vec3(0.0f);
+    int count = 0;
+};
+
+// 移動と境界での反射を行う個体の配列 (next バッファを指す)
+struct BoidArrays
+{
+    float *px;
+    float *py;
+    float *pz;
+    float *dx;
+    float *dy;
+    float *dz;
+    const float *speed;
+};
+
+// [begin, end) の候補のうち、同じ種族で距離の二乗が (0.0001, radiusSq) にあるものを sums に加算する
+// 自分自身は距離 0 なので自動的に除外される
+using NeighborKernel = void (*)(const NeighborArrays &arrays, std::size_t begin, std::size_t end,
+                                const glm::vec3 &position, int species, float radiusSq, NeighborSums &sums);
+
+// [begin, end) の個体を direction * speed だけ進め、[-cubeSize, cubeSize] の箱の壁で反射させる
+// (integrateWrap は反対側の壁へ回り込ませ、integrateOpen は壁で何もしない)
+using IntegrateKernel = void (*)(const BoidArrays &boids, std::size_t begin, std::size_t end, float cubeSize);
+
+// [begin, end) の個体を colliders の各球と順に衝突させる (Creature::collide と同じ処理)
+// 当たったかどうかは選択で反映するので分岐がなく、個体方向にベクトル化される
+using CollideKernel = void (*)(const BoidArrays &boids, std::size_t begin, std::size_t end,
+                               const SphereCollider *colliders, int colliderCount);
+
+// 区間の個体をまとめて操舵するときの配列。近傍の合計と重みは区間で集めたもので、
+// 位置・向きなどは区間の先頭の個体を指すようにずらして渡す (どれも [0, count) を読む)
+struct SteeringArrays
+{
+    const float *sepX, *sepY, *sepZ; // 近傍の合計 (NeighborSums を SoA にしたもの)
+    const float *alnX, *alnY, *alnZ;
+    const float *cohX, *cohY, *cohZ;
+    const int *count;
+    const float *gainSeparation, *gainAlignment, *gainCohesion; // 個体の種族の重み
+    const float *px, *py, *pz;                                  // 現在の位置
+    const float *dx, *dy, *dz;                                  // 現在の向き
+    const float *maxTurn;
+    float *outX, *outY, *outZ;          // 操舵した向き (近傍がいなければ現在の向きのまま)
+    float *targetX, *targetY, *targetZ; // 操舵の目標の向き (近傍がいなければ 0。FlockState::steering に書く)
+};
+
+// 近傍の合計から向きを決める (Creature::steer と同じ式) のを count 個体まとめて行う
+using SteerKernel = void (*)(const SteeringArrays &arrays, std::size_t count);
+
+// fastMath (Simulation::fastMath) の誤差
+// accumulateNeighborsFast は分離の 1/sqrt(d²) と 1/(d² + 0.01) を近似の逆数命令の推定値に Newton 法をかけて求める。
+// 候補1つの分離の項の相対誤差は avx512 (推定 2^-14、1回) で 1e-6、avx2 (推定 1.5 × 2^-12、1回) で 2e-6、
+// neon (推定 2^-8、2回) で 2e-6 以下。generic と scalar は近似の命令がないので正確な版と同じ。
+// steerFast の4回の正規化はビット操作の推定に Newton 法を2回かけ、長さの相対誤差は 5e-6 以下。
+// どちらも float の丸め (6e-8) より大きいので結果は正確な版とビット単位では一致せず、群れの軌道は
+// 数百ステップで離れていくが、群れの統計 (整列度・結合) は変わらない (--bench fastmath で確かめる)
+const float FAST_MATH_NEIGHBOR_REL_ERROR = 2e-6f;
+const float FAST_MATH_STEER_REL_ERROR = 5e-6f;
+
+// 箱の壁での扱い
+enum class BoundaryMode
+{
+    Reflect, // 壁で反射する
+    Wrap,    // 反対側の壁から出てくる (近傍の距離は周期的には測らない)
+    Open,    // 壁がなく、箱の外へ出ていける
+};
+
+// 固定小数点モード (FixedPoint.h) の整数の書式
+namespace fixed_point
+{
+    const int POS_BITS = 16;  // 位置・速さ: 小数部 16 ビット (箱の ±20 は ±1310720)
+    const int DIR_BITS = 14;  // 向き・旋回率: 小数部 14 ビット (単位ベクトルの成分は ±16384)
+    const int DIFF_BITS = 12; // 近傍との差: 小数部 12 ビット (距離の二乗が 32 ビットに収まるように)
+    const int DIST_SQ_BITS = 2 * DIFF_BITS;
+
+    // 差は ±6.0 で打ち切る。半径の外の個体は結果に関係せず、二乗の和も 32 ビットに収まる
+    const std::int32_t DIFF_LIMIT = 6 << DIFF_BITS;
+    // 近傍の半径 FLOCK_RADIUS (5.0) の二乗
+    const std::int32_t RADIUS_SQ = 25 << DIST_SQ_BITS;
+    // float 版と同じく、距離の二乗が 0.0001 以下の個体 (自分自身を含む) は除く
+    const std::int32_t MIN_DIST_SQ = (1 << DIST_SQ_BITS) / 10000;
+
+    // 分離の重みの表は距離の二乗を 1/2^TABLE_STEP_BITS 刻みで引き、値は小数部 SEPARATION_BITS ビット
+    const int TABLE_STEP_BITS = 8;
+    const int TABLE_SHIFT = DIST_SQ_BITS - TABLE_STEP_BITS;
+    const int TABLE_SIZE = (25 << TABLE_STEP_BITS) + 1;
+    const int SEPARATION_BITS = 12;
+}
+
+// 整数にした近傍候補の配列 (NeighborArrays の固定小数点版)
+struct FixedNeighborArrays
+{
+    const std::int32_t *px;
+    const std::int32_t *py;
+    const std::int32_t *pz;
+    const std::int32_t *dx;
+    const std::int32_t *dy;
+    const std::int32_t *dz;
+    const std::int32_t *species;
+};
+
+// 固定小数点の分離・整列・結合の合計。整数の加算なので足す順によらず同じ値になる
+struct FixedNeighborSums
+{
+    std::int64_t sepX = 0, sepY = 0, sepZ = 0; // 小数部 DIFF_BITS + SEPARATION_BITS
+    std::int64_t alnX = 0, alnY = 0, alnZ = 0; // 小数部 DIR_BITS
+    std::int64_t cohX = 0, cohY = 0, cohZ = 0; // 自分 - 相手 の合計 (小数部 DIFF_BITS)
+    int count = 0;
+};
+
+// NeighborKernel の固定小数点版。半径は RADIUS_SQ で固定、separationTable は分離の重みの表
+using FixedNeighborKernel = void (*)(const FixedNeighborArrays &arrays, int begin, int end,
+                                     const std::int32_t position[3], int species,
+                                     const std::int32_t *separationTable, FixedNeighborSums &sums);
+
+// 命令セットごとにビルドしたカーネルの組
+struct FlockKernelSet
+{
+    const char *name; // "avx512", "avx2", "neon", "generic", "scalar"
+    NeighborKernel accumulateNeighbors;
+    NeighborKernel accumulateNeighborsFast; // 近似の逆数を使う版 (fastMath)
+    IntegrateKernel integrate;
+    IntegrateKernel integrateWrap;
+    IntegrateKernel integrateOpen;
+    CollideKernel collide;
+    SteerKernel steerFast; // 正規化に近似の逆数平方根を使う (fastMath)
+    FixedNeighborKernel accumulateNeighborsFixed;
+};
+
+// 壁の扱いに合った移動のカーネル
+IntegrateKernel integrateKernel(const FlockKernelSet &kernels, BoundaryMode boundary);
+
+// 1候補ずつ処理する基準実装
+void accumulateNeighborsScalar(const NeighborArrays &arrays, std::size_t begin, std::size_t end,
+                               const glm::vec3 &position, int species, float radiusSq, NeighborSums &sums);
+
+// 基準実装の組 (比較用)
+const FlockKernelSet &scalarKernels();
+
+// この CPU で使えるカーネルの組 (速い順)
+std::vector<const FlockKernelSet *> availableKernels();
+
+// 起動時に cpuid から選んだカーネルの組
+// 環境変数 FLOCKING_ISA (avx512 / avx2 / neon / generic / scalar) で強制できる
+const FlockKernelSet &activeKernels();
+
+#endif
@@ -0,0 +1,874 @@
+// 命令セットごとにビルドされるカーネル本体
+// FlockKernel_<isa>.cpp が FLOCK_KERNEL_VARIANT (名前空間名) を定義してからインクルードする。
+//
+// 注意: このファイルは -mavx2 などのフラグ付きでコンパイルされる。ヘッダのインライン関数
+// (glm や std:: の関数) を使うと、リンク時に AVX 版の実体が他の翻訳単位にも使われてしまい、
+// 古い CPU で不正命令になる可能性がある。そのため組み込み関数と intrinsics だけで書く。
+
+#include "FlockKernel.h"
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define FLOCK_KERNEL_NEON
+#endif
+
+namespace flock_kernels
+{
+    namespace FLOCK_KERNEL_VARIANT
+    {
+        // 分離は normalize(diff) / (dSq + 0.01) を足し込む (Creature::flock の元の式と同じ)
+        static const float MIN_DIST_SQ = 0.0001f;
+        static const float SEPARATION_SOFTENING = 0.01f;
+        // 固定小数点の合計を 32 ビットで足す区間の長さ (半径内の差・向きの成分は 20480 以下で、× 2^16 個 < 2^31)
+        static const int FIXED_CHUNK = 1 << 16;
+
+        // SIMD の幅に満たない端数を1候補ずつ処理する
+        // 近傍の区間はグリッドのセルごとで短く、端数の割合が大きい。正確な版と近似の版の2か所から呼ばれると
+        // インライン展開されなくなり、呼び出しの分だけ1ステップが2倍以上遅くなるので、必ず展開させる
+        static inline __attribute__((always_inline)) void accumulateTail(const NeighborArrays &a, std::size_t begin, std::size_t end,
+                                   const glm::vec3 &position, int species, float radiusSq, NeighborSums &sums)
+        {
+            for (std::size_t i = begin; i < end; ++i)
+            {
+                if (a.species[i] != species)
+                    continue;
+                float ddx = position.x - a.px[i];
+                float ddy = position.y - a.py[i];
+                float ddz = position.z - a.pz[i];
+                float dSq = ddx * ddx + ddy * ddy + ddz * ddz;
+                if (dSq < radiusSq && dSq > MIN_DIST_SQ)
+                {
+                    float invLen = 1.0f / __builtin_sqrtf(dSq);
+                    float w = dSq + SEPARATION_SOFTENING;
+                    sums.separation.x += ddx * invLen / w;
+                    sums.separation.y += ddy * invLen / w;
+                    sums.separation.z += ddz * invLen / w;
+                    sums.alignment.x += a.dx[i];
+                    sums.alignment.y += a.dy[i];
+                    sums.alignment.z += a.dz[i];
+                    sums.cohesion.x += a.px[i];
+                    sums.cohesion.y += a.py[i];
+                    sums.cohesion.z += a.pz[i];
+                    sums.count++;
+                }
+            }
+        }
+
+#if defined(__AVX512F__)
+
+        const char *name() { return "avx512"; }
+
+        // Fast は分離の 1/sqrt(dSq) と 1/(dSq + 0.01) を近似の逆数 (推定値 + Newton 法) で求める (fastMath)
+        template <bool Fast>
+        static void accumulateNeighborsImpl(const NeighborArrays &a, std::size_t begin, std::size_t end,
+                                            const glm::vec3 &position, int species, float radiusSq, NeighborSums &sums)
+        {
+            const __m512 x = _mm512_set1_ps(position.x);
+            const __m512 y = _mm512_set1_ps(position.y);
+            const __m512 z = _mm512_set1_ps(position.z);
+            const __m512 r2 = _mm512_set1_ps(radiusSq);
+            const __m512 minD2 = _mm512_set1_ps(MIN_DIST_SQ);
+            const __m512 soft = _mm512_set1_ps(SEPARATION_SOFTENING);
+            const __m512 one = _mm512_set1_ps(1.0f);
+            const __m512 half = _mm512_set1_ps(0.5f);
+            const __m512 threeHalves = _mm512_set1_ps(1.5f);
+            const __m512 two = _mm512_set1_ps(2.0f);
+            const __m512i mySpecies = _mm512_set1_epi32(species);
+
+            __m512 sepX = _mm512_setzero_ps(), sepY = _mm512_setzero_ps(), sepZ = _mm512_setzero_ps();
+            __m512 aliX = _mm512_setzero_ps(), aliY = _mm512_setzero_ps(), aliZ = _mm512_setzero_ps();
+            __m512 cohX = _mm512_setzero_ps(), cohY = _mm512_setzero_ps(), cohZ = _mm512_setzero_ps();
+            int count = 0;
+
+            std::size_t i = begin;
+            for (; i + 16 <= end; i += 16)
+            {
+                __m512 ox = _mm512_loadu_ps(a.px + i);
+                __m512 oy = _mm512_loadu_ps(a.py + i);
+                __m512 oz = _mm512_loadu_ps(a.pz + i);
+                __m512 ddx = _mm512_sub_ps(x, ox);
+                __m512 ddy = _mm512_sub_ps(y, oy);
+                __m512 ddz = _mm512_sub_ps(z, oz);
+                __m512 dSq = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(ddx, ddx), _mm512_mul_ps(ddy, ddy)), _mm512_mul_ps(ddz, ddz));
+
+                __mmask16 mask = _mm512_cmp_ps_mask(dSq, r2, _CMP_LT_OQ) &
+                                 _mm512_cmp_ps_mask(dSq, minD2, _CMP_GT_OQ) &
+                                 _mm512_cmpeq_epi32_mask(_mm512_loadu_si512(a.species + i), mySpecies);
+                if (mask == 0)
+                    continue;
+
+                // マスクの外れたレーンは加算しない (0除算の結果も捨てられる)
+                __m512 w = _mm512_add_ps(dSq, soft);
+                if (Fast)
+                {
+                    // 推定値 (相対誤差 2^-14) に Newton 法を1回かけ、2つの逆数の積を3成分に掛ける
+                    __m512 r = _mm512_rsqrt14_ps(dSq);
+                    r = _mm512_mul_ps(r, _mm512_fnmadd_ps(_mm512_mul_ps(half, dSq), _mm512_mul_ps(r, r), threeHalves));
+                    __m512 q = _mm512_rcp14_ps(w);
+                    q = _mm512_mul_ps(q, _mm512_fnmadd_ps(w, q, two));
+                    __m512 scale = _mm512_mul_ps(r, q);
+                    sepX = _mm512_mask_add_ps(sepX, mask, sepX, _mm512_mul_ps(ddx, scale));
+                    sepY = _mm512_mask_add_ps(sepY, mask, sepY, _mm512_mul_ps(ddy, scale));
+                    sepZ = _mm512_mask_add_ps(sepZ, mask, sepZ, _mm512_mul_ps(ddz, scale));
+                }
+                else
+                {
+                    __m512 invLen = _mm512_div_ps(one, _mm512_sqrt_ps(dSq));
+                    sepX = _mm512_mask_add_ps(sepX, mask, sepX, _mm512_div_ps(_mm512_mul_ps(ddx, invLen), w));
+                    sepY = _mm512_mask_add_ps(sepY, mask, sepY, _mm512_div_ps(_mm512_mul_ps(ddy, invLen), w));
+                    sepZ = _mm512_mask_add_ps(sepZ, mask, sepZ, _mm512_div_ps(_mm512_mul_ps(ddz, invLen), w));
+                }
+                aliX = _mm512_mask_add_ps(aliX, mask, aliX, _mm512_loadu_ps(a.dx + i));
+                aliY = _mm512_mask_add_ps(aliY, mask, aliY, _mm512_loadu_ps(a.dy + i));
+                aliZ = _mm512_mask_add_ps(aliZ, mask, aliZ, _mm512_loadu_ps(a.dz + i));
+                cohX = _mm512_mask_add_ps(cohX, mask, cohX, ox);
+                cohY = _mm512_mask_add_ps(cohY, mask, cohY, oy);
+                cohZ = _mm512_mask_add_ps(cohZ, mask, cohZ, oz);
+                count += __builtin_popcount(mask);
+            }
+
+            sums.separation.x += _mm512_reduce_add_ps(sepX);
+            sums.separation.y += _mm512_reduce_add_ps(sepY);
+            sums.separation.z += _mm512_reduce_add_ps(sepZ);
+            sums.alignment.x += _mm512_reduce_add_ps(aliX);
+            sums.alignment.y += _mm512_reduce_add_ps(aliY);
+            sums.alignment.z += _mm512_reduce_add_ps(aliZ);
+            sums.cohesion.x += _mm512_reduce_add_ps(cohX);
+            sums.cohesion.y += _mm512_reduce_add_ps(cohY);
+            sums.cohesion.z += _mm512_reduce_add_ps(cohZ);
+            sums.count += count;
+
+            accumulateTail(a, i, end, position, species, radiusSq, sums);
+        }
+
+        void accumulateNeighbors(const NeighborArrays &a, std::size_t begin, std::size_t end,
+                                 const glm::vec3 &position, int species, float radiusSq, NeighborSums &sums)
+        {
+            accumulateNeighborsImpl<false>(a, begin, end, position, species, radiusSq, sums);
+        }
+
+        void accumulateNeighborsFast(const NeighborArrays &a, std::size_t begin, std::size_t end,
+                                     const glm::vec3 &position, int species, float radiusSq, NeighborSums &sums)
+        {
+            accumulateNeighborsImpl<true>(a, begin, end, position, species, radiusSq, sums);
+        }
+
+#elif defined(__AVX2__)
+
+        const char *name() { return "avx2"; }
+
+        static float horizontalSum(__m256 v)
+        {
+            __m128 lo = _mm256_castps256_ps128(v);
+            __m128 hi = _mm256_extractf128_ps(v, 1);
+            lo = _mm_add_ps(lo, hi);
+            lo = _mm_add_ps(lo, _mm_movehl_ps(lo, lo));
+            lo = _mm_add_ss(lo, _mm_shuffle_ps(lo, lo, 0x55));
+            return _mm_cvtss_f32(lo);
+        }
+
+        template <bool Fast>
+        static void accumulateNeighborsImpl(const NeighborArrays &a, std::size_t begin, std::size_t end,
+                                            const glm::vec3 &position, int species, float radiusSq, NeighborSums &sums)
+        {
+            const __m256 x = _mm256_set1_ps(position.x);
+            const __m256 y = _mm256_set1_ps(position.y);
+            const __m256 z = _mm256_set1_ps(position.z);
+            const __m256 r2 = _mm256_set1_ps(radiusSq);
+            const __m256 minD2 = _mm256_set1_ps(MIN_DIST_SQ);
+            const __m256 soft = _mm256_set1_ps(SEPARATION_SOFTENING);
+            const __m256 one = _mm256_set1_ps(1.0f);
+            const __m256 half = _mm256_set1_ps(0.5f);
+            const __m256 threeHalves = _mm256_set1_ps(1.5f);
+            const __m256 two = _mm256_set1_ps(2.0f);
+            const __m256i mySpecies = _mm256_set1_epi32(species);
+
+            __m256 sepX = _mm256_setzero_ps(), sepY = _mm256_setzero_ps(), sepZ = _mm256_setzero_ps();
+            __m256 aliX = _mm256_setzero_ps(), aliY = _mm256_setzero_ps(), aliZ = _mm256_setzero_ps();
+            __m256 cohX = _mm256_setzero_ps(), cohY = _mm256_setzero_ps(), cohZ = _mm256_setzero_ps();
+            int count = 0;
+
+            std::size_t i = begin;
+            for (; i + 8 <= end; i += 8)
+            {
+                __m256 ox = _mm256_loadu_ps(a.px + i);
+                __m256 oy = _mm256_loadu_ps(a.py + i);
+                __m256 oz = _mm256_loadu_ps(a.pz + i);
+                __m256 ddx = _mm256_sub_ps(x, ox);
+                __m256 ddy = _mm256_sub_ps(y, oy);
+                __m256 ddz = _mm256_sub_ps(z, oz);
+                __m256 dSq = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ddx, ddx), _mm256_mul_ps(ddy, ddy)), _mm256_mul_ps(ddz, ddz));
+
+                __m256i sameSpecies = _mm256_cmpeq_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(a.species + i)), mySpecies);
+                __m256 mask = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(dSq, r2, _CMP_LT_OQ), _mm256_cmp_ps(dSq, minD2, _CMP_GT_OQ)),
+                                            _mm256_castsi256_ps(sameSpecies));
+                int bits = _mm256_movemask_ps(mask);
+                if (bits == 0)
+                    continue;
+
+                // マスクの外れたレーンは 0 にしてから加算する (0除算の NaN も消える)
+                __m256 w = _mm256_add_ps(dSq, soft);
+                if (Fast)
+                {
+                    // 推定値 (相対誤差 1.5 × 2^-12) に Newton 法を1回かけ、2つの逆数の積を3成分に掛ける
+                    __m256 r = _mm256_rsqrt_ps(dSq);
+                    r = _mm256_mul_ps(r, _mm256_fnmadd_ps(_mm256_mul_ps(half, dSq), _mm256_mul_ps(r, r), threeHalves));
+                    __m256 q = _mm256_rcp_ps(w);
+                    q = _mm256_mul_ps(q, _mm256_fnmadd_ps(w, q, two));
+                    __m256 scale = _mm256_mul_ps(r, q);
+                    sepX = _mm256_add_ps(sepX, _mm256_and_ps(mask, _mm256_mul_ps(ddx, scale)));
+                    sepY = _mm256_add_ps(sepY, _mm256_and_ps(mask, _mm256_mul_ps(ddy, scale)));
+                    sepZ = _mm256_add_ps(sepZ, _mm256_and_ps(mask, _mm256_mul_ps(ddz, scale)));
+                }
+                else
+                {
+                    __m256 invLen = _mm256_div_ps(one, _mm256_sqrt_ps(dSq));
+                    sepX = _mm256_add_ps(sepX, _mm256_and_ps(mask, _mm256_div_ps(_mm256_mul_ps(ddx, invLen), w)));
+                    sepY = _mm256_add_ps(sepY, _mm256_and_ps(mask, _mm256_div_ps(_mm256_mul_ps(ddy, invLen), w)));
+                    sepZ = _mm256_add_ps(sepZ, _mm256_and_ps(mask, _mm256_div_ps(_mm256_mul_ps(ddz, invLen), w)));
+                }
+                aliX = _mm256_add_ps(aliX, _mm256_and_ps(mask, _mm256_loadu_ps(a.dx + i)));
+                aliY = _mm256_add_ps(aliY, _mm256_and_ps(mask, _mm256_loadu_ps(a.dy + i)));
+                aliZ = _mm256_add_ps(aliZ, _mm256_and_ps(mask, _mm256_loadu_ps(a.dz + i)));
+                cohX = _mm256_add_ps(cohX, _mm256_and_ps(mask, ox));
+                cohY = _mm256_add_ps(cohY, _mm256_and_ps(mask, oy));
+                cohZ = _mm256_add_ps(cohZ, _mm256_and_ps(mask, oz));
+                count += __builtin_popcount(bits);
+            }
+
+            sums.separation.x += horizontalSum(sepX);
+            sums.separation.y += horizontalSum(sepY);
+            sums.separation.z += horizontalSum(sepZ);
+            sums.alignment.x += horizontalSum(aliX);
+            sums.alignment.y += horizontalSum(aliY);
+            sums.alignment.z += horizontalSum(aliZ);
+            sums.cohesion.x += horizontalSum(cohX);
+            sums.cohesion.y += horizontalSum(cohY);
+            sums.cohesion.z += horizontalSum(cohZ);
+            sums.count += count;
+
+            accumulateTail(a, i, end, position, species, radiusSq, sums);
+        }
+
+        void accumulateNeighbors(const NeighborArrays &a, std::size_t begin, std::size_t end,
+                                 const glm::vec3 &position, int species, float radiusSq, NeighborSums &sums)
+        {
+            accumulateNeighborsImpl<false>(a, begin, end, position, species, radiusSq, sums);
+        }
+
+        void accumulateNeighborsFast(const NeighborArrays &a, std::size_t begin, std::size_t end,
+                                     const glm::vec3 &position, int species, float radiusSq, NeighborSums &sums)
+        {
+            accumulateNeighborsImpl<true>(a, begin, end, position, species, radiusSq, sums);
+        }
+
+#elif defined(FLOCK_KERNEL_NEON)
+
+        const char *name() { return "neon"; }
+
+        template <bool Fast>
+        static void accumulateNeighborsImpl(const NeighborArrays &a, std::size_t begin, std::size_t end,
+                                            const glm::vec3 &position, int species, float radiusSq, NeighborSums &sums)
+        {
+            const float32x4_t x = vdupq_n_f32(position.x);
+            const float32x4_t y = vdupq_n_f32(position.y);
+            const float32x4_t z = vdupq_n_f32(position.z);
+            const float32x4_t r2 = vdupq_n_f32(radiusSq);
+            const float32x4_t minD2 = vdupq_n_f32(MIN_DIST_SQ);
+            const float32x4_t soft = vdupq_n_f32(SEPARATION_SOFTENING);
+            const int32x4_t mySpecies = vdupq_n_s32(species);
+            const float32x4_t zero = vdupq_n_f32(0.0f);
+            const float32x4_t one = vdupq_n_f32(1.0f);
+
+            float32x4_t sepX = zero, sepY = zero, sepZ = zero;
+            float32x4_t aliX = zero, aliY = zero, aliZ = zero;
+            float32x4_t cohX = zero, cohY = zero, cohZ = zero;
+            uint32x4_t count = vdupq_n_u32(0);
+
+            std::size_t i = begin;
+            for (; i + 4 <= end; i += 4)
+            {
+                float32x4_t ox = vld1q_f32(a.px + i);
+                float32x4_t oy = vld1q_f32(a.py + i);
+                float32x4_t oz = vld1q_f32(a.pz + i);
+                float32x4_t ddx = vsubq_f32(x, ox);
+                float32x4_t ddy = vsubq_f32(y, oy);
+                float32x4_t ddz = vsubq_f32(z, oz);
+                float32x4_t dSq = vaddq_f32(vaddq_f32(vmulq_f32(ddx, ddx), vmulq_f32(ddy, ddy)), vmulq_f32(ddz, ddz));
+
+                uint32x4_t mask = vandq_u32(vandq_u32(vcltq_f32(dSq, r2), vcgtq_f32(dSq, minD2)),
+                                            vceqq_s32(vld1q_s32(a.species + i), mySpecies));
+                if (vmaxvq_u32(mask) == 0)
+                    continue;
+
+                // マスクの外れたレーンは 0 を選んでから加算する (0除算の NaN も消える)
+                float32x4_t w = vaddq_f32(dSq, soft);
+                if (Fast)
+                {
+                    // 推定値は 8 ビット程度の精度しかないので Newton 法を2回かけ、2つの逆数の積を3成分に掛ける
+                    float32x4_t r = vrsqrteq_f32(dSq);
+                    r = vmulq_f32(r, vrsqrtsq_f32(vmulq_f32(dSq, r), r));
+                    r = vmulq_f32(r, vrsqrtsq_f32(vmulq_f32(dSq, r), r));
+                    float32x4_t q = vrecpeq_f32(w);
+                    q = vmulq_f32(q, vrecpsq_f32(w, q));
+                    q = vmulq_f32(q, vrecpsq_f32(w, q));
+                    float32x4_t scale = vmulq_f32(r, q);
+                    sepX = vaddq_f32(sepX, vbslq_f32(mask, vmulq_f32(ddx, scale), zero));
+                    sepY = vaddq_f32(sepY, vbslq_f32(mask, vmulq_f32(ddy, scale), zero));
+                    sepZ = vaddq_f32(sepZ, vbslq_f32(mask, vmulq_f32(ddz, scale), zero));
+                }
+                else
+                {
+                    float32x4_t invLen = vdivq_f32(one, vsqrtq_f32(dSq));
+                    sepX = vaddq_f32(sepX, vbslq_f32(mask, vdivq_f32(vmulq_f32(ddx, invLen), w), zero));
+                    sepY = vaddq_f32(sepY, vbslq_f32(mask, vdivq_f32(vmulq_f32(ddy, invLen), w), zero));
+                    sepZ = vaddq_f32(sepZ, vbslq_f32(mask, vdivq_f32(vmulq_f32(ddz, invLen), w), zero));
+                }
+                aliX = vaddq_f32(aliX, vbslq_f32(mask, vld1q_f32(a.dx + i), zero));
+                aliY = vaddq_f32(aliY, vbslq_f32(mask, vld1q_f32(a.dy + i), zero));
+                aliZ = vaddq_f32(aliZ, vbslq_f32(mask, vld1q_f32(a.dz + i), zero));
+                cohX = vaddq_f32(cohX, vbslq_f32(mask, ox, zero));
+                cohY = vaddq_f32(cohY, vbslq_f32(mask, oy, zero));
+                cohZ = vaddq_f32(cohZ, vbslq_f32(mask, oz, zero));
+                count = vaddq_u32(count, vshrq_n_u32(mask, 31));
+            }
+
+            sums.separation.x += vaddvq_f32(sepX);
+            sums.separation.y += vaddvq_f32(sepY);
+            sums.separation.z += vaddvq_f32(sepZ);
+            sums.alignment.x += vaddvq_f32(aliX);
+            sums.alignment.y += vaddvq_f32(aliY);
+            sums.alignment.z += vaddvq_f32(aliZ);
+            sums.cohesion.x += vaddvq_f32(cohX);
+            sums.cohesion.y += vaddvq_f32(cohY);
+            sums.cohesion.z += vaddvq_f32(cohZ);
+            sums.count += static_cast<int>(vaddvq_u32(count));
+
+            accumulateTail(a, i, end, position, species, radiusSq, sums);
+        }
+
+        void accumulateNeighbors(const NeighborArrays &a, std::size_t begin, std::size_t end,
+                                 const glm::vec3 &position, int species, float radiusSq, NeighborSums &sums)
+        {
+            accumulateNeighborsImpl<false>(a, begin, end, position, species, radiusSq, sums);
+        }
+
+        void accumulateNeighborsFast(const NeighborArrays &a, std::size_t begin, std::size_t end,
+                                     const glm::vec3 &position, int species, float radiusSq, NeighborSums &sums)
+        {
+            accumulateNeighborsImpl<true>(a, begin, end, position, species, radiusSq, sums);
+        }
+
+#else
+
+        const char *name() { return "generic"; }
+
+        void accumulateNeighbors(const NeighborArrays &a, std::size_t begin, std::size_t end,
+                                 const glm::vec3 &position, int species, float radiusSq, NeighborSums &sums)
+        {
+            accumulateTail(a, begin, end, position, species, radiusSq, sums);
+        }
+
+        // 近似の逆数の命令がないので、正確な版と同じ
+        void accumulateNeighborsFast(const NeighborArrays &a, std::size_t begin, std::size_t end,
+                                     const glm::vec3 &position, int species, float radiusSq, NeighborSums &sums)
+        {
+            accumulateTail(a, begin, end, position, species, radiusSq, sums);
+        }
+
+#endif
+
+        // 固定小数点モードの近傍の合計
+        // 整数の加算は順序によらないので、どの命令セットで何レーンずつ足しても結果は同じになる。
+        // 区間の長さはセル3つ分で数十個ほどなので、SIMD の幅に満たない端数も1候補ずつにせず、
+        // 範囲外のレーンを読まないマスク付きの読み込みで最後の1組として処理する。
+#if defined(__AVX512F__)
+
+        // 16 候補ずつ整数のまま調べ、半径・種族の条件に1つも当たらない組は飛ばす (float 版と同じ)。
+        // 分離の重みの表は当たったレーンだけ gather で引き、積は 64 ビットに広げて足す
+        void accumulateNeighborsFixed(const FixedNeighborArrays &a, int begin, int end,
+                                      const std::int32_t position[3], int species,
+                                      const std::int32_t *separationTable, FixedNeighborSums &sums)
+        {
+            using namespace fixed_point;
+            const __m512i x = _mm512_set1_epi32(position[0]);
+            const __m512i y = _mm512_set1_epi32(position[1]);
+            const __m512i z = _mm512_set1_epi32(position[2]);
+            const __m512i limit = _mm512_set1_epi32(DIFF_LIMIT);
+            const __m512i radiusSq = _mm512_set1_epi32(RADIUS_SQ);
+            const __m512i minD2 = _mm512_set1_epi32(MIN_DIST_SQ);
+            const __m512i lastBucket = _mm512_set1_epi32(TABLE_SIZE - 1);
+            const __m512i mySpecies = _mm512_set1_epi32(species);
+            const __m512i zero = _mm512_setzero_si512();
+            // 位置の差を小数部 DIFF_BITS に落として DIFF_LIMIT で打ち切った値の絶対値。
+            // 0 方向への切り捨ての除算の絶対値は、絶対値を右シフトしたものに等しい。
+            // 距離の二乗には符号が要らないので、符号は当たった組でだけ withSign で戻す
+            auto magnitude = [&](__m512i v)
+            { return _mm512_min_epi32(_mm512_srli_epi32(_mm512_abs_epi32(v), POS_BITS - DIFF_BITS), limit); };
+            auto withSign = [&](__m512i m, __m512i v)
+            { return _mm512_mask_sub_epi32(m, _mm512_cmplt_epi32_mask(v, zero), zero, m); };
+            auto addWide = [](__m512i sum, __m512i v)
+            {
+                sum = _mm512_add_epi64(sum, _mm512_cvtepi32_epi64(_mm512_castsi512_si256(v)));
+                return _mm512_add_epi64(sum, _mm512_cvtepi32_epi64(_mm512_extracti64x4_epi64(v, 1)));
+            };
+
+            __m512i sepX = zero, sepY = zero, sepZ = zero; // 64 ビット × 8
+            int hits = 0;
+            for (int chunk = begin; chunk < end; chunk += FIXED_CHUNK)
+            {
+                // 整列・結合は 32 ビットのレーンで足し、FIXED_CHUNK 個ごとに 64 ビットの合計に移す
+                const int chunkEnd = end - chunk > FIXED_CHUNK ? chunk + FIXED_CHUNK : end;
+                __m512i alnX = zero, alnY = zero, alnZ = zero;
+                __m512i cohX = zero, cohY = zero, cohZ = zero;
+                int count = 0;
+                // lanes は区間に入っているレーン (最後の組だけが欠ける)。全レーンの組ではマスクの処理が消える
+                auto block = [&](int k, __mmask16 lanes) __attribute__((always_inline))
+                {
+                    const __m512i vx = _mm512_sub_epi32(x, _mm512_maskz_loadu_epi32(lanes, a.px + k));
+                    const __m512i vy = _mm512_sub_epi32(y, _mm512_maskz_loadu_epi32(lanes, a.py + k));
+                    const __m512i vz = _mm512_sub_epi32(z, _mm512_maskz_loadu_epi32(lanes, a.pz + k));
+                    const __m512i mx = magnitude(vx), my = magnitude(vy), mz = magnitude(vz);
+                    const __m512i d2 = _mm512_add_epi32(_mm512_add_epi32(_mm512_mullo_epi32(mx, mx), _mm512_mullo_epi32(my, my)),
+                                                        _mm512_mullo_epi32(mz, mz));
+                    const __mmask16 mask = lanes & _mm512_cmplt_epi32_mask(d2, radiusSq) & _mm512_cmpgt_epi32_mask(d2, minD2) &
+                                           _mm512_cmpeq_epi32_mask(_mm512_maskz_loadu_epi32(lanes, a.species + k), mySpecies);
+                    if (mask == 0)
+                        return;
+
+                    const __m512i bucket = _mm512_min_epi32(_mm512_srai_epi32(d2, TABLE_SHIFT), lastBucket);
+                    const __m512i g = _mm512_mask_i32gather_epi32(zero, mask, bucket, separationTable, 4);
+                    const __m512i ex = withSign(mx, vx), ey = withSign(my, vy), ez = withSign(mz, vz);
+                    sepX = addWide(sepX, _mm512_mullo_epi32(ex, g));
+                    sepY = addWide(sepY, _mm512_mullo_epi32(ey, g));
+                    sepZ = addWide(sepZ, _mm512_mullo_epi32(ez, g));
+                    alnX = _mm512_mask_add_epi32(alnX, mask, alnX, _mm512_maskz_loadu_epi32(mask, a.dx + k));
+                    alnY = _mm512_mask_add_epi32(alnY, mask, alnY, _mm512_maskz_loadu_epi32(mask, a.dy + k));
+                    alnZ = _mm512_mask_add_epi32(alnZ, mask, alnZ, _mm512_maskz_loadu_epi32(mask, a.dz + k));
+                    cohX = _mm512_mask_add_epi32(cohX, mask, cohX, ex);
+                    cohY = _mm512_mask_add_epi32(cohY, mask, cohY, ey);
+                    cohZ = _mm512_mask_add_epi32(cohZ, mask, cohZ, ez);
+                    count += __builtin_popcount(mask);
+                };
+                int k = chunk;
+                for (; k + 16 <= chunkEnd; k += 16)
+                {
+                    block(k, 0xFFFF);
+                }
+                if (k < chunkEnd)
+                    block(k, static_cast<__mmask16>((1u << (chunkEnd - k)) - 1));
+                // 1つも当たらなかった区間 (セルの端の行など) では横方向の合計を省く
+                if (count == 0)
+                    continue;
+                hits += count;
+                sums.alnX += _mm512_reduce_add_epi32(alnX);
+                sums.alnY += _mm512_reduce_add_epi32(alnY);
+                sums.alnZ += _mm512_reduce_add_epi32(alnZ);
+                sums.cohX += _mm512_reduce_add_epi32(cohX);
+                sums.cohY += _mm512_reduce_add_epi32(cohY);
+                sums.cohZ += _mm512_reduce_add_epi32(cohZ);
+                sums.count += count;
+            }
+            if (hits == 0)
+                return;
+            sums.sepX += _mm512_reduce_add_epi64(sepX);
+            sums.sepY += _mm512_reduce_add_epi64(sepY);
+            sums.sepZ += _mm512_reduce_add_epi64(sepZ);
+        }
+
+#elif defined(__AVX2__)
+
+        static std::int64_t horizontalSum64(__m256i v)
+        {
+            const __m128i s = _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+            return _mm_cvtsi128_si64(s) + _mm_extract_epi64(s, 1);
+        }
+
+        static std::int32_t horizontalSum32(__m256i v)
+        {
+            __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+            s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4E));
+            s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xB1));
+            return _mm_cvtsi128_si32(s);
+        }
+
+        // AVX-512 版と同じく 8 候補ずつ、差の絶対値で調べて条件に1つも当たらない組は飛ばす。
+        // マスクはレーンごとの全ビット 1 / 0 で、当たらないレーンの値は AND で 0 にしてから足す
+        void accumulateNeighborsFixed(const FixedNeighborArrays &a, int begin, int end,
+                                      const std::int32_t position[3], int species,
+                                      const std::int32_t *separationTable, FixedNeighborSums &sums)
+        {
+            using namespace fixed_point;
+            const __m256i x = _mm256_set1_epi32(position[0]);
+            const __m256i y = _mm256_set1_epi32(position[1]);
+            const __m256i z = _mm256_set1_epi32(position[2]);
+            const __m256i limit = _mm256_set1_epi32(DIFF_LIMIT);
+            const __m256i radiusSq = _mm256_set1_epi32(RADIUS_SQ);
+            const __m256i minD2 = _mm256_set1_epi32(MIN_DIST_SQ);
+            const __m256i lastBucket = _mm256_set1_epi32(TABLE_SIZE - 1);
+            const __m256i mySpecies = _mm256_set1_epi32(species);
+            const __m256i laneIndex = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+            const __m256i zero = _mm256_setzero_si256();
+            auto magnitude = [&](__m256i v)
+            { return _mm256_min_epi32(_mm256_srli_epi32(_mm256_abs_epi32(v), POS_BITS - DIFF_BITS), limit); };
+            auto load = [](const std::int32_t *p, __m256i lanes)
+            { return _mm256_maskload_epi32(reinterpret_cast<const int *>(p), lanes); };
+            auto addWide = [](__m256i sum, __m256i v)
+            {
+                sum = _mm256_add_epi64(sum, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(v)));
+                return _mm256_add_epi64(sum, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(v, 1)));
+            };
+
+            __m256i sepX = zero, sepY = zero, sepZ = zero; // 64 ビット × 4
+            bool hit = false;
+            for (int chunk = begin; chunk < end; chunk += FIXED_CHUNK)
+            {
+                const int chunkEnd = end - chunk > FIXED_CHUNK ? chunk + FIXED_CHUNK : end;
+                __m256i alnX = zero, alnY = zero, alnZ = zero;
+                __m256i cohX = zero, cohY = zero, cohZ = zero;
+                __m256i count = zero; // 当たったレーンで -1 ずつ
+                for (int k = chunk; k < chunkEnd; k += 8)
+                {
+                    const __m256i lanes = _mm256_cmpgt_epi32(_mm256_set1_epi32(chunkEnd - k), laneIndex);
+                    const __m256i vx = _mm256_sub_epi32(x, load(a.px + k, lanes));
+                    const __m256i vy = _mm256_sub_epi32(y, load(a.py + k, lanes));
+                    const __m256i vz = _mm256_sub_epi32(z, load(a.pz + k, lanes));
+                    const __m256i mx = magnitude(vx), my = magnitude(vy), mz = magnitude(vz);
+                    const __m256i d2 = _mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(mx, mx), _mm256_mullo_epi32(my, my)),
+                                                        _mm256_mullo_epi32(mz, mz));
+                    const __m256i in = _mm256_and_si256(
+                        _mm256_and_si256(lanes, _mm256_cmpeq_epi32(load(a.species + k, lanes), mySpecies)),
+                        _mm256_and_si256(_mm256_cmpgt_epi32(radiusSq, d2), _mm256_cmpgt_epi32(d2, minD2)));
+                    if (_mm256_testz_si256(in, in))
+                        continue;
+
+                    const __m256i bucket = _mm256_min_epi32(_mm256_srai_epi32(d2, TABLE_SHIFT), lastBucket);
+                    const __m256i g = _mm256_mask_i32gather_epi32(zero, separationTable, bucket, in, 4);
+                    // 符号を戻す (v が 0 のレーンは絶対値も 0)
+                    const __m256i ex = _mm256_sign_epi32(mx, vx), ey = _mm256_sign_epi32(my, vy), ez = _mm256_sign_epi32(mz, vz);
+                    sepX = addWide(sepX, _mm256_mullo_epi32(ex, g));
+                    sepY = addWide(sepY, _mm256_mullo_epi32(ey, g));
+                    sepZ = addWide(sepZ, _mm256_mullo_epi32(ez, g));
+                    alnX = _mm256_add_epi32(alnX, load(a.dx + k, in));
+                    alnY = _mm256_add_epi32(alnY, load(a.dy + k, in));
+                    alnZ = _mm256_add_epi32(alnZ, load(a.dz + k, in));
+                    cohX = _mm256_add_epi32(cohX, _mm256_and_si256(ex, in));
+                    cohY = _mm256_add_epi32(cohY, _mm256_and_si256(ey, in));
+                    cohZ = _mm256_add_epi32(cohZ, _mm256_and_si256(ez, in));
+                    count = _mm256_add_epi32(count, in);
+                }
+                if (_mm256_testz_si256(count, count))
+                    continue;
+                hit = true;
+                sums.alnX += horizontalSum32(alnX);
+                sums.alnY += horizontalSum32(alnY);
+                sums.alnZ += horizontalSum32(alnZ);
+                sums.cohX += horizontalSum32(cohX);
+                sums.cohY += horizontalSum32(cohY);
+                sums.cohZ += horizontalSum32(cohZ);
+                sums.count -= horizontalSum32(count);
+            }
+            if (!hit)
+                return;
+            sums.sepX += horizontalSum64(sepX);
+            sums.sepY += horizontalSum64(sepY);
+            sums.sepZ += horizontalSum64(sepZ);
+        }
+
+#else
+
+        // 命令セットを問わない版 (generic、NEON、scalar)
+        // 分岐のない整数演算だけで書いてあるので、各命令セットの幅で自動ベクトル化される。
+        // 整数の加算は順序によらないので、どの命令セットで何レーンずつ足しても結果は同じになる。
+        void accumulateNeighborsFixed(const FixedNeighborArrays &a, int begin, int end,
+                                      const std::int32_t position[3], int species,
+                                      const std::int32_t *separationTable, FixedNeighborSums &sums)
+        {
+            using namespace fixed_point;
+            const std::int32_t *__restrict px = a.px;
+            const std::int32_t *__restrict py = a.py;
+            const std::int32_t *__restrict pz = a.pz;
+            const std::int32_t *__restrict dx = a.dx;
+            const std::int32_t *__restrict dy = a.dy;
+            const std::int32_t *__restrict dz = a.dz;
+            const std::int32_t *__restrict sp = a.species;
+            const std::int32_t *__restrict table = separationTable;
+            const std::int32_t x = position[0];
+            const std::int32_t y = position[1];
+            const std::int32_t z = position[2];
+
+            // 分離の積は 1 個でも 32 ビット近くになるので 64 ビットで足す。
+            // 整列・結合・個数は FIXED_CHUNK 個ずつなら 32 ビットで足しても溢れないので、区切って 64 ビットの合計に移す
+            // (64 ビットのレーンは 32 ビットの半分の幅しかないので、こちらの方が速い)
+            std::int64_t sepX = 0, sepY = 0, sepZ = 0;
+            for (int chunk = begin; chunk < end; chunk += FIXED_CHUNK)
+            {
+                const int chunkEnd = end - chunk > FIXED_CHUNK ? chunk + FIXED_CHUNK : end;
+                std::int32_t alnX = 0, alnY = 0, alnZ = 0;
+                std::int32_t cohX = 0, cohY = 0, cohZ = 0;
+                std::int32_t count = 0;
+                // 近傍の区間は数十個と短いことが多い。16 レーンにすると端数処理の比重が大きくなるので 8 レーンにする
+#pragma omp simd simdlen(8) reduction(+ : sepX, sepY, sepZ, alnX, alnY, alnZ, cohX, cohY, cohZ, count)
+                for (int k = chunk; k < chunkEnd; ++k)
+                {
+                    // 位置の差を小数部 DIFF_BITS に落とす (除算は 0 方向への切り捨てで、右シフトと違い符号の扱いが規格で決まっている)
+                    std::int32_t ex = (x - px[k]) / (1 << (POS_BITS - DIFF_BITS));
+                    std::int32_t ey = (y - py[k]) / (1 << (POS_BITS - DIFF_BITS));
+                    std::int32_t ez = (z - pz[k]) / (1 << (POS_BITS - DIFF_BITS));
+                    ex = ex > DIFF_LIMIT ? DIFF_LIMIT : ex;
+                    ey = ey > DIFF_LIMIT ? DIFF_LIMIT : ey;
+                    ez = ez > DIFF_LIMIT ? DIFF_LIMIT : ez;
+                    ex = ex < -DIFF_LIMIT ? -DIFF_LIMIT : ex;
+                    ey = ey < -DIFF_LIMIT ? -DIFF_LIMIT : ey;
+                    ez = ez < -DIFF_LIMIT ? -DIFF_LIMIT : ez;
+                    std::int32_t d2 = ex * ex + ey * ey + ez * ez;
+                    // 条件はマスク (全ビット 1 か 0) にして AND で選ぶ。条件付きの読み込みにするとベクトル化されないので、表は常に引く
+                    std::int32_t in = -((d2 < RADIUS_SQ) & (d2 > MIN_DIST_SQ) & (sp[k] == species));
+                    std::int32_t bucket = d2 >> TABLE_SHIFT;
+                    bucket = bucket > TABLE_SIZE - 1 ? TABLE_SIZE - 1 : bucket;
+                    std::int32_t g = table[bucket] & in;
+                    sepX += ex * g;
+                    sepY += ey * g;
+                    sepZ += ez * g;
+                    alnX += dx[k] & in;
+                    alnY += dy[k] & in;
+                    alnZ += dz[k] & in;
+                    cohX += ex & in;
+                    cohY += ey & in;
+                    cohZ += ez & in;
+                    count -= in;
+                }
+                sums.alnX += alnX;
+                sums.alnY += alnY;
+                sums.alnZ += alnZ;
+                sums.cohX += cohX;
+                sums.cohY += cohY;
+                sums.cohZ += cohZ;
+                sums.count += count;
+            }
+            sums.sepX += sepX;
+            sums.sepY += sepY;
+            sums.sepZ += sepZ;
+        }
+
+#endif
+
+        // 移動と、箱の壁での扱い (Mode ごとに別の関数として実体化される)
+        // 分岐を選択に置き換えてあるので、各命令セットの幅で自動ベクトル化される。
+        // 壁の法線での反射はその軸の成分の符号を反転するのと同じ。
+        template <BoundaryMode Mode>
+        static void integrateBoundary(const BoidArrays &b, std::size_t begin, std::size_t end, float cubeSize)
+        {
+            float *__restrict px = b.px;
+            float *__restrict py = b.py;
+            float *__restrict pz = b.pz;
+            float *__restrict dx = b.dx;
+            float *__restrict dy = b.dy;
+            float *__restrict dz = b.dz;
+            const float *__restrict speed = b.speed;
+
+            if (Mode == BoundaryMode::Open)
+            {
+#pragma omp simd
+                for (std::size_t i = begin; i < end; ++i)
+                {
+                    px[i] += dx[i] * speed[i];
+                    py[i] += dy[i] * speed[i];
+                    pz[i] += dz[i] * speed[i];
+                }
+                return;
+            }
+
+            if (Mode == BoundaryMode::Wrap)
+            {
+                // 1ステップの移動は箱の大きさよりずっと小さいので、1回ずらせば箱に戻る
+                const float span = 2.0f * cubeSize;
+#pragma omp simd
+                for (std::size_t i = begin; i < end; ++i)
+                {
+                    float x = px[i] + dx[i] * speed[i];
+                    float y = py[i] + dy[i] * speed[i];
+                    float z = pz[i] + dz[i] * speed[i];
+                    x = x > cubeSize ? x - span : x;
+                    y = y > cubeSize ? y - span : y;
+                    z = z > cubeSize ? z - span : z;
+                    x = x < -cubeSize ? x + span : x;
+                    y = y < -cubeSize ? y + span : y;
+                    z = z < -cubeSize ? z + span : z;
+                    px[i] = x;
+                    py[i] = y;
+                    pz[i] = z;
+                }
+                return;
+            }
+
+#pragma omp simd
+            for (std::size_t i = begin; i < end; ++i)
+            {
+                float x = px[i] + dx[i] * speed[i];
+                float y = py[i] + dy[i] * speed[i];
+                float z = pz[i] + dz[i] * speed[i];
+
+                // 箱の中に収める。収める前後で値が変わった軸は壁に当たっている
+                // (短絡評価や入れ子の三項演算子は分岐になりベクトル化を妨げるので、単純な選択だけで書く)
+                float cx = x > cubeSize ? cubeSize : x;
+                float cy = y > cubeSize ? cubeSize : y;
+                float cz = z > cubeSize ? cubeSize : z;
+                cx = cx < -cubeSize ? -cubeSize : cx;
+                cy = cy < -cubeSize ? -cubeSize : cy;
+                cz = cz < -cubeSize ? -cubeSize : cz;
+                px[i] = cx;
+                py[i] = cy;
+                pz[i] = cz;
+
+                // 壁に当たった軸の成分の符号を反転する
+                float flipX = cx != x ? -1.0f : 1.0f;
+                float flipY = cy != y ? -1.0f : 1.0f;
+                float flipZ = cz != z ? -1.0f : 1.0f;
+                float rx = dx[i] * flipX;
+                float ry = dy[i] * flipY;
+                float rz = dz[i] * flipZ;
+
+                // 正規化し直して誤差の蓄積を防ぐ
+                // (元の実装は反射したときだけ正規化していたが、条件を付けるとベクトル化されないので全個体で行う)
+                float invLen = 1.0f / __builtin_sqrtf(rx * rx + ry * ry + rz * rz);
+                dx[i] = rx * invLen;
+                dy[i] = ry * invLen;
+                dz[i] = rz * invLen;
+            }
+        }
+
+        // 球のコライダーとの衝突
+        // コライダーを外側、個体を内側のループにして、個体方向にベクトル化する (個体ごとに見ると元と同じ順で処理される)。
+        // 当たっていない個体には 0 / 1 の重みを掛けて、位置も向きも変わらないようにする
+        void collide(const BoidArrays &b, std::size_t begin, std::size_t end,
+                     const SphereCollider *colliders, int colliderCount)
+        {
+            float *__restrict px = b.px;
+            float *__restrict py = b.py;
+            float *__restrict pz = b.pz;
+            float *__restrict dx = b.dx;
+            float *__restrict dy = b.dy;
+            float *__restrict dz = b.dz;
+
+            for (int c = 0; c < colliderCount; ++c)
+            {
+                const float cx = colliders[c].center.x;
+                const float cy = colliders[c].center.y;
+                const float cz = colliders[c].center.z;
+                const float radius = colliders[c].radius;
+#pragma omp simd
+                for (std::size_t i = begin; i < end; ++i)
+                {
+                    float ox = px[i] - cx;
+                    float oy = py[i] - cy;
+                    float oz = pz[i] - cz;
+                    float dist = __builtin_sqrtf(ox * ox + oy * oy + oz * oz);
+                    float hit = dist < radius + 5.0f ? 1.0f : 0.0f;
+
+                    // 中心と重なっているときは Y 軸プラス方向を法線にする
+                    float centered = dist == 0.0f ? 1.0f : 0.0f;
+                    float invDist = 1.0f / (dist + centered);
+                    float nx = ox * invDist;
+                    float ny = oy * invDist + centered;
+                    float nz = oz * invDist;
+
+                    // 表面から 5.0 の位置まで押し出す
+                    float push = (radius - dist + 5.0f) * hit;
+                    px[i] += nx * push;
+                    py[i] += ny * push;
+                    pz[i] += nz * push;
+
+                    // 法線で反射して正規化する
+                    float dot = dx[i] * nx + dy[i] * ny + dz[i] * nz;
+                    float rx = dx[i] - 2.0f * dot * nx;
+                    float ry = dy[i] - 2.0f * dot * ny;
+                    float rz = dz[i] - 2.0f * dot * nz;
+                    float invLen = 1.0f / __builtin_sqrtf(rx * rx + ry * ry + rz * rz);
+                    float keep = 1.0f - hit;
+                    dx[i] = rx * invLen * hit + dx[i] * keep;
+                    dy[i] = ry * invLen * hit + dy[i] * keep;
+                    dz[i] = rz * invLen * hit + dz[i] * keep;
+                }
+            }
+        }
+
+        // 1/sqrt(v) の近似。float のビット列を整数として扱って推定値を作り、Newton 法を2回かける
+        // (推定値の相対誤差は 3.5e-2 以下、1回で 1.8e-3、2回で 5e-6 以下)。
+        // 整数演算と乗算だけなので、どの命令セットでもベクトル化される。v = 0 でも有限の値になる
+        static float rsqrtApprox(float v)
+        {
+            std::int32_t bits;
+            __builtin_memcpy(&bits, &v, sizeof(bits));
+            bits = 0x5f375a86 - (bits >> 1);
+            float r;
+            __builtin_memcpy(&r, &bits, sizeof(r));
+            const float halfV = 0.5f * v;
+            r = r * (1.5f - halfV * r * r);
+            r = r * (1.5f - halfV * r * r);
+            return r;
+        }
+
+        // 近傍の合計からの操舵を区間の全個体まとめて行う。個体ごとに4回ある正規化を rsqrtApprox で行い、
+        // 近傍のいない個体も同じ式で計算してから選択で捨てるので、分岐がなく個体方向にベクトル化される
+        void steerFast(const SteeringArrays &s, std::size_t count)
+        {
+#pragma omp simd
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                const float n = static_cast<float>(s.count[i]);
+                const float invN = 1.0f / (n > 0.0f ? n : 1.0f);
+
+                // 整列は合計の向きだけを使うので、平均にせずそのまま正規化する
+                const float alnScale = rsqrtApprox(s.alnX[i] * s.alnX[i] + s.alnY[i] * s.alnY[i] + s.alnZ[i] * s.alnZ[i]);
+                const float cx = s.cohX[i] * invN - s.px[i];
+                const float cy = s.cohY[i] * invN - s.py[i];
+                const float cz = s.cohZ[i] * invN - s.pz[i];
+                const float cohScale = rsqrtApprox(cx * cx + cy * cy + cz * cz);
+
+                const float gs = s.gainSeparation[i] * invN;
+                const float ga = s.gainAlignment[i] * alnScale;
+                const float gc = s.gainCohesion[i] * cohScale;
+                float sx = s.sepX[i] * gs + s.alnX[i] * ga + cx * gc;
+                float sy = s.sepY[i] * gs + s.alnY[i] * ga + cy * gc;
+                float sz = s.sepZ[i] * gs + s.alnZ[i] * ga + cz * gc;
+                const float steerScale = rsqrtApprox(sx * sx + sy * sy + sz * sz);
+                sx *= steerScale;
+                sy *= steerScale;
+                sz *= steerScale;
+
+                // mix(direction, steer, maxTurn) を正規化する
+                const float t = s.maxTurn[i];
+                const float mx = s.dx[i] * (1.0f - t) + sx * t;
+                const float my = s.dy[i] * (1.0f - t) + sy * t;
+                const float mz = s.dz[i] * (1.0f - t) + sz * t;
+                const float mixScale = rsqrtApprox(mx * mx + my * my + mz * mz);
+
+                const bool any = n > 0.0f;
+                s.targetX[i] = any ? sx : 0.0f;
+                s.targetY[i] = any ? sy : 0.0f;
+                s.targetZ[i] = any ? sz : 0.0f;
+                s.outX[i] = any ? mx * mixScale : s.dx[i];
+                s.outY[i] = any ? my * mixScale : s.dy[i];
+                s.outZ[i] = any ? mz * mixScale : s.dz[i];
+            }
+        }
+
+        void integrate(const BoidArrays &b, std::size_t begin, std::size_t end, float cubeSize)
+        {
+            integrateBoundary<BoundaryMode::Reflect>(b, begin, end, cubeSize);
+        }
+
+        void integrateWrap(const BoidArrays &b, std::size_t begin, std::size_t end, float cubeSize)
+        {
+            integrateBoundary<BoundaryMode::Wrap>(b, begin, end, cubeSize);
+        }
+
+        void integrateOpen(const BoidArrays &b, std::size_t begin, std::size_t end, float cubeSize)
+        {
+            integrateBoundary<BoundaryMode::Open>(b, begin, end, cubeSize);
+        }
+    }
+}
@@ -0,0 +1,3 @@
+// FlockKernelVariant.inl を avx2 用のフラグでビルドする (CMakeLists.txt を参照)
+#define FLOCK_KERNEL_VARIANT avx2
+#include "FlockKernelVariant.inl"
@@ -0,0 +1,3 @@
+// FlockKernelVariant.inl を avx512 用のフラグでビルドする (CMakeLists.txt を参照)
+#define FLOCK_KERNEL_VARIANT avx512
+#include "FlockKernelVariant.inl"
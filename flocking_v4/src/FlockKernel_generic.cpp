@@ -0,0 +1,4 @@
+// FlockKernelVariant.inl を追加のフラグなしでビルドする
+// (x86-64 ではスカラー、aarch64 では NEON 版になる)
+#define FLOCK_KERNEL_VARIANT generic
+#include "FlockKernelVariant.inl"
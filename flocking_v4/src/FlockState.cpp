@@ -0,0 +1,213 @@
+#include "FlockState.h"
+#include "SpaceFillingCurve.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+
+void FlockState::reserve(std::size_t n)
+{
+    posX.reserve(n);
+    posY.reserve(n);
+    posZ.reserve(n);
+    dirX.reserve(n);
+    dirY.reserve(n);
+    dirZ.reserve(n);
+    speed.reserve(n);
+    maxTurn.reserve(n);
+    speciesID.reserve(n);
+    boidID.reserve(n);
+    steerX.reserve(n);
+    steerY.reserve(n);
+    steerZ.reserve(n);
+    indexOfID.reserve(n);
+}
+
+void FlockState::clear()
+{
+    posX.clear();
+    posY.clear();
+    posZ.clear();
+    dirX.clear();
+    dirY.clear();
+    dirZ.clear();
+    speed.clear();
+    maxTurn.clear();
+    speciesID.clear();
+    boidID.clear();
+    steerX.clear();
+    steerY.clear();
+    steerZ.clear();
+    indexOfID.clear();
+    speciesRanges.clear();
+}
+
+std::size_t FlockState::add(int species, const glm::vec3 &position, const glm::vec3 &direction, float s, float turn)
+{
+    posX.push_back(position.x);
+    posY.push_back(position.y);
+    posZ.push_back(position.z);
+    dirX.push_back(direction.x);
+    dirY.push_back(direction.y);
+    dirZ.push_back(direction.z);
+    speed.push_back(s);
+    maxTurn.push_back(turn);
+    speciesID.push_back(species);
+    boidID.push_back(static_cast<int>(indexOfID.size()));
+    steerX.push_back(0.0f);
+    steerY.push_back(0.0f);
+    steerZ.push_back(0.0f);
+    indexOfID.push_back(static_cast<int>(size() - 1));
+    speciesRanges.clear(); // 並びが崩れるので sortBySpecies() をやり直す必要がある
+    return size() - 1;
+}
+
+std::size_t FlockState::grow(std::size_t count)
+{
+    const std::size_t first = size();
+    const std::size_t n = first + count;
+    for (AlignedArray<float> *v : {&posX, &posY, &posZ, &dirX, &dirY, &dirZ, &speed, &maxTurn, &steerX, &steerY, &steerZ})
+    {
+        v->resize(n);
+    }
+    speciesID.resize(n);
+    boidID.resize(n);
+    for (std::size_t i = first; i < n; ++i)
+    {
+        boidID[i] = static_cast<int>(indexOfID.size());
+        indexOfID.push_back(static_cast<int>(i));
+    }
+    speciesRanges.clear();
+    return first;
+}
+
+void FlockState::sortBySpecies()
+{
+    const std::size_t n = size();
+    int maxSpecies = -1;
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        maxSpecies = std::max(maxSpecies, speciesID[i]);
+    }
+
+    // 種族ごとの個体数を数え、累積和で各種族の開始位置を決める (カウンティングソート)
+    std::vector<SpeciesRange> ranges(maxSpecies + 1);
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        ranges[speciesID[i]].end++;
+    }
+    std::size_t offset = 0;
+    for (SpeciesRange &r : ranges)
+    {
+        r.begin = offset;
+        offset += r.end;
+        r.end = offset;
+    }
+
+    std::vector<std::size_t> order(n);
+    std::vector<std::size_t> cursor(ranges.size());
+    for (std::size_t s = 0; s < ranges.size(); ++s)
+    {
+        cursor[s] = ranges[s].begin;
+    }
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        order[cursor[speciesID[i]]++] = i;
+    }
+
+    // 種族ごとにまとめて生成した群れはすでに並んでいるので、並べ替えを省く
+    bool sorted = true;
+    for (std::size_t i = 0; i < n && sorted; ++i)
+    {
+        sorted = order[i] == i;
+    }
+    if (!sorted)
+        applyPermutation(order);
+    speciesRanges = ranges;
+}
+
+template <typename T>
+static void permute(AlignedArray<T> &values, const std::vector<std::size_t> &order)
+{
+    AlignedArray<T> sorted(order.size());
+    for (std::size_t i = 0; i < order.size(); ++i)
+    {
+        sorted[i] = values[order[i]];
+    }
+    values.swap(sorted);
+}
+
+void FlockState::applyPermutation(const std::vector<std::size_t> &order)
+{
+    permute(posX, order);
+    permute(posY, order);
+    permute(posZ, order);
+    permute(dirX, order);
+    permute(dirY, order);
+    permute(dirZ, order);
+    permute(speed, order);
+    permute(maxTurn, order);
+    permute(speciesID, order);
+    permute(boidID, order);
+    permute(steerX, order);
+    permute(steerY, order);
+    permute(steerZ, order);
+
+    for (std::size_t i = 0; i < boidID.size(); ++i)
+    {
+        indexOfID[boidID[i]] = static_cast<int>(i);
+    }
+}
+
+long FlockState::sortBySpatialOrder(float cubeSize)
+{
+    const std::size_t n = size();
+    std::vector<SpeciesRange> ranges = speciesRanges;
+    if (ranges.empty())
+    {
+        ranges.push_back(SpeciesRange{0, n});
+    }
+
+    // (Morton コード, 元のインデックス) の組を区間ごとに並べ替える
+    std::vector<std::pair<std::uint32_t, std::size_t>> keys(n);
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        keys[i] = std::make_pair(mortonCode(position(i), cubeSize), i);
+    }
+
+    // 前回の並べ替えから数フレームしか経っていなければほぼ整列済みなので、挿入ソートがほぼ O(n) で済む。
+    // 移動回数が多すぎる (初回など) ときは途中でやめて通常のソートに切り替える
+    const long moveBudget = static_cast<long>(8 * n);
+    long moves = 0;
+    for (const SpeciesRange &r : ranges)
+    {
+        for (std::size_t i = r.begin + 1; i < r.end && moves <= moveBudget; ++i)
+        {
+            std::pair<std::uint32_t, std::size_t> key = keys[i];
+            std::size_t j = i;
+            while (j > r.begin && keys[j - 1] > key)
+            {
+                keys[j] = keys[j - 1];
+                --j;
+                ++moves;
+            }
+            keys[j] = key;
+        }
+    }
+    const bool fullSort = moves > moveBudget;
+    if (fullSort)
+    {
+        for (const SpeciesRange &r : ranges)
+        {
+            std::sort(keys.begin() + r.begin, keys.begin() + r.end);
+        }
+    }
+
+    std::vector<std::size_t> order(n);
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        order[i] = keys[i].second;
+    }
+    applyPermutation(order);
+    return fullSort ? -1 : moves;
+}
@@ -0,0 +1,164 @@
+#ifndef FLOCK_STATE_H
+#define FLOCK_STATE_H
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+#include "FlockKernel.h"
+
+// キャッシュライン (64バイト) 境界に揃えて確保するアロケータ
+template <typename T, std::size_t Alignment = 64>
+struct AlignedAllocator
+{
+    using value_type = T;
+
+    template <typename U>
+    struct rebind
+    {
+        using other = AlignedAllocator<U, Alignment>;
+    };
+
+    AlignedAllocator() = default;
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment> &) {}
+
+    T *allocate(std::size_t n)
+    {
+        return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+    }
+    void deallocate(T *p, std::size_t)
+    {
+        ::operator delete(p, std::align_val_t(Alignment));
+    }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U, Alignment> &) const { return true; }
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U, Alignment> &) const { return false; }
+};
+
+template <typename T>
+using AlignedArray = std::vector<T, AlignedAllocator<T>>;
+
+// 同じ種族の個体が並んでいる区間 [begin, end)
+struct SpeciesRange
+{
+    std::size_t begin = 0;
+    std::size_t end = 0;
+
+    std::size_t count() const { return end - begin; }
+};
+
+// 群れ全体の状態を Structure-of-Arrays で保持する
+// 近傍ループは位置と向きしか読まないので、成分ごとに連続した配列にしておくと
+// キャッシュラインを無駄なく使える (ポインタを辿る必要もない)
+class FlockState
+{
+public:
+    AlignedArray<float> posX, posY, posZ;
+    AlignedArray<float> dirX, dirY, dirZ; // 進行方向 (正規化済み)
+    AlignedArray<float> speed;
+    AlignedArray<float> maxTurn;
+    AlignedArray<int> speciesID; // 群れの種類
+    AlignedArray<int> boidID;    // 生成順に振った ID。並べ替えても個体と一緒に移動する
+    // 最後に近傍から求めた操舵の目標の向き (正規化済み。近傍がいなかったときは 0)
+    // 操舵を数ステップおきにするとき (Simulation::steeringInterval)、間のステップはこの向きへ曲がる
+    AlignedArray<float> steerX, steerY, steerZ;
+
+    // sortBySpecies() 後に有効。speciesRanges[種族ID] がその種族の区間
+    std::vector<SpeciesRange> speciesRanges;
+
+    std::size_t size() const { return posX.size(); }
+    void reserve(std::size_t n);
+    void clear();
+
+    // 個体を追加し、そのインデックスを返す
+    std::size_t add(int species, const glm::vec3 &position, const glm::vec3 &direction, float speed, float maxTurn);
+    // 末尾に count 体をまとめて確保し、生成順の ID を振って、追加した区間の先頭のインデックスを返す
+    // 位置・向き・速さ・種族は 0 のままなので、呼び出し側が埋める (spawnPopulation を参照)
+    std::size_t grow(std::size_t count);
+
+    glm::vec3 position(std::size_t i) const { return glm::vec3(posX[i], posY[i], posZ[i]); }
+    glm::vec3 direction(std::size_t i) const { return glm::vec3(dirX[i], dirY[i], dirZ[i]); }
+    void setPosition(std::size_t i, const glm::vec3 &p)
+    {
+        posX[i] = p.x;
+        posY[i] = p.y;
+        posZ[i] = p.z;
+    }
+    void setDirection(std::size_t i, const glm::vec3 &d)
+    {
+        dirX[i] = d.x;
+        dirY[i] = d.y;
+        dirZ[i] = d.z;
+    }
+    glm::vec3 steering(std::size_t i) const { return glm::vec3(steerX[i], steerY[i], steerZ[i]); }
+    void setSteering(std::size_t i, const glm::vec3 &s)
+    {
+        steerX[i] = s.x;
+        steerY[i] = s.y;
+        steerZ[i] = s.z;
+    }
+
+    // カーネルに渡す配列の先頭ポインタ
+    NeighborArrays neighborArrays() const
+    {
+        return NeighborArrays{posX.data(), posY.data(), posZ.data(),
+                              dirX.data(), dirY.data(), dirZ.data(), speciesID.data()};
+    }
+    BoidArrays boidArrays()
+    {
+        return BoidArrays{posX.data(), posY.data(), posZ.data(),
+                          dirX.data(), dirY.data(), dirZ.data(), speed.data()};
+    }
+
+    // 種族ごとに個体が連続するよう並べ替え (安定)、speciesRanges を作る
+    void sortBySpecies();
+    bool isSortedBySpecies() const { return !speciesRanges.empty(); }
+    int speciesCount() const { return static_cast<int>(speciesRanges.size()); }
+
+    // 種族の区間の中で、位置の Morton コード順に並べ替える (空間的に近い個体をメモリ上でも近くに置く)
+    // 前回の並べ替えからあまり動いていなければ挿入ソートで済ませる。
+    // 戻り値は挿入ソートでの要素の移動回数 (全体をソートし直した場合は -1)
+    long sortBySpatialOrder(float cubeSize);
+
+    // 全配列を並べ替える。並べ替え後の i 番目には元の order[i] 番目が入る
+    void applyPermutation(const std::vector<std::size_t> &order);
+
+    // ID から現在のインデックスを引く (描画や記録で同じ個体を追い続けるため)
+    std::size_t indexOf(int id) const { return static_cast<std::size_t>(indexOfID[id]); }
+
+    // 1個体あたりのメモリ量 (バイト)
+    static constexpr std::size_t bytesPerBoid()
+    {
+        return 11 * sizeof(float) + 3 * sizeof(int);
+    }
+
+private:
+    std::vector<int> indexOfID; // boidID -> 現在のインデックス
+};
+
+// シミュレーション用のダブルバッファ (ピンポンバッファ)
+// 1ステップの間、current は読み取り専用、next は書き込み専用として使い、
+// ステップの最後に swap() で入れ替える。
+// 他スレッドが書き換え中の位置を flock で読んでしまう競合が起きなくなる。
+class FlockBuffers
+{
+public:
+    FlockState &current() { return buffers[front]; }
+    const FlockState &current() const { return buffers[front]; }
+    FlockState &next() { return buffers[1 - front]; }
+
+    void swap() { front = 1 - front; }
+
+    // current の内容を next にも複製する (個体の追加など、current を直接書き換えた後に呼ぶ)
+    void syncNext() { buffers[1 - front] = buffers[front]; }
+
+private:
+    FlockState buffers[2];
+    int front = 0;
+};
+
+#endif
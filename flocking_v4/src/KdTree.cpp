@@ -0,0 +1,157 @@
+#include "KdTree.h"
+#include "Parallel.h"
+
+#include <algorithm>
+
+// これより小さい部分木は、並列に分けずに同じスレッドで続けて組む
+static const int PARALLEL_SUBTREE_MIN = 8192;
+
+void KdTree::build(const FlockState &state)
+{
+    build(state, 0, state.size());
+}
+
+void KdTree::build(const FlockState &state, std::size_t begin, std::size_t end)
+{
+    const int first = static_cast<int>(begin);
+    const int n = static_cast<int>(end - begin);
+    points.resize(n);
+    for (int i = 0; i < n; ++i)
+    {
+        const int k = first + i;
+        points[i] = Point{state.posX[k], state.posY[k], state.posZ[k], k};
+    }
+
+    // 中央値で半分ずつに分けるので、木の高さは個体数だけで決まる
+    int height = 0;
+    for (int size = n; size > LEAF_SIZE; size = (size + 1) / 2)
+    {
+        height++;
+    }
+    nodes.assign((std::size_t(2) << height) - 1, Node{0, 0, -1, 0.0f});
+    if (n == 0)
+    {
+        species.clear();
+        return;
+    }
+
+    buildNode(0, 0, n);
+
+    species.resize(n);
+    for (int i = 0; i < n; ++i)
+    {
+        species[i] = state.speciesID[points[i].index];
+    }
+}
+
+void KdTree::buildNode(int index, int begin, int end)
+{
+    Node &node = nodes[index];
+    node.begin = begin;
+    node.end = end;
+    node.axis = -1;
+    if (end - begin <= LEAF_SIZE)
+        return;
+
+    // 境界箱の一番長い軸で分ける
+    glm::vec3 lo(points[begin].x, points[begin].y, points[begin].z);
+    glm::vec3 hi = lo;
+    for (int i = begin + 1; i < end; ++i)
+    {
+        const glm::vec3 p(points[i].x, points[i].y, points[i].z);
+        lo = glm::min(lo, p);
+        hi = glm::max(hi, p);
+    }
+    const glm::vec3 extent = hi - lo;
+    const int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+    auto coord = [axis](const Point &p)
+    { return axis == 0 ? p.x : (axis == 1 ? p.y : p.z); };
+
+    const int mid = (begin + end) / 2;
+    std::nth_element(points.begin() + begin, points.begin() + mid, points.begin() + end,
+                     [&](const Point &a, const Point &b)
+                     { return coord(a) < coord(b); });
+    node.axis = axis;
+    node.split = coord(points[mid]);
+
+    // 左右の部分木は points の別々の区間しか触らないので、並列に組める
+    if (mid - begin >= PARALLEL_SUBTREE_MIN)
+    {
+        parallel::invoke([&]
+                         { buildNode(2 * index + 1, begin, mid); },
+                         [&]
+                         { buildNode(2 * index + 2, mid, end); });
+        return;
+    }
+    buildNode(2 * index + 1, begin, mid);
+    buildNode(2 * index + 2, mid, end);
+}
+
+int KdTree::nearest(const glm::vec3 &pos, int wantedSpecies, int k, int exclude, int *outIndices) const
+{
+    k = std::min(k, MAX_K);
+    if (nodes.empty() || points.empty() || k <= 0)
+        return 0;
+
+    // 見つけた個体を距離の近い順に持つ (k が小さいので、挿入ソートで十分速い)
+    float bestDistSq[MAX_K];
+    int bestIndex[MAX_K];
+    int found = 0;
+
+    struct Entry
+    {
+        int node;
+        float minDistSq; // この部分木までの距離の二乗の下限
+    };
+    Entry stack[64];
+    int top = 0;
+    stack[top++] = Entry{0, 0.0f};
+    while (top > 0)
+    {
+        const Entry entry = stack[--top];
+        if (found == k && entry.minDistSq >= bestDistSq[k - 1])
+            continue;
+
+        const Node &node = nodes[entry.node];
+        if (node.axis < 0)
+        {
+            for (int i = node.begin; i < node.end; ++i)
+            {
+                const Point &p = points[i];
+                if (species[i] != wantedSpecies || p.index == exclude)
+                    continue;
+                const float dx = p.x - pos.x;
+                const float dy = p.y - pos.y;
+                const float dz = p.z - pos.z;
+                const float d2 = dx * dx + dy * dy + dz * dz;
+                if (found == k && d2 >= bestDistSq[k - 1])
+                    continue;
+
+                // 距離順を保ったまま挿入する (いっぱいなら一番遠いものを押し出す)
+                int slot = found < k ? found++ : k - 1;
+                while (slot > 0 && bestDistSq[slot - 1] > d2)
+                {
+                    bestDistSq[slot] = bestDistSq[slot - 1];
+                    bestIndex[slot] = bestIndex[slot - 1];
+                    --slot;
+                }
+                bestDistSq[slot] = d2;
+                bestIndex[slot] = p.index;
+            }
+            continue;
+        }
+
+        // pos のある側を先に調べ、反対側は分割面までの距離が k 番目より近いときだけ調べる
+        const float q = node.axis == 0 ? pos.x : (node.axis == 1 ? pos.y : pos.z);
+        const float diff = q - node.split;
+        const int nearChild = diff < 0.0f ? 2 * entry.node + 1 : 2 * entry.node + 2;
+        const int farChild = diff < 0.0f ? 2 * entry.node + 2 : 2 * entry.node + 1;
+        const float farDistSq = std::max(entry.minDistSq, diff * diff);
+        if (found < k || farDistSq < bestDistSq[k - 1])
+            stack[top++] = Entry{farChild, farDistSq};
+        stack[top++] = Entry{nearChild, entry.minDistSq};
+    }
+
+    std::copy(bestIndex, bestIndex + found, outIndices);
+    return found;
+}
@@ -0,0 +1,53 @@
+#ifndef KD_TREE_H
+#define KD_TREE_H
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <vector>
+
+#include "FlockState.h"
+
+// k 近傍探索用の k-d 木
+// 各ノードで境界箱の一番長い軸の中央値で2つに分ける (平衡木)。
+// 子は配列上の位置 2i+1, 2i+2 に置くのでポインタを持たず、大きな部分木の構築は parallel::invoke で並列に行う。
+// 探索は見つけた k 個を距離順に保つ有界ヒープで行い、k 番目より遠い部分木は調べない。
+// 手間は O(log N + k) 程度で、周りがどれだけ密集していても変わらない。
+class KdTree
+{
+public:
+    // state の位置から木を作り直す
+    void build(const FlockState &state);
+    // インデックス [begin, end) の個体だけで木を作る (種族ごとの木用)
+    void build(const FlockState &state, std::size_t begin, std::size_t end);
+
+    // pos に近い順に最大 k 個の、species の個体を探す (exclude の個体は除く)
+    // 見つかった個体の state 上のインデックスを outIndices に近い順に書き、個数を返す
+    int nearest(const glm::vec3 &pos, int species, int k, int exclude, int *outIndices) const;
+
+    std::size_t size() const { return points.size(); }
+
+    static constexpr int LEAF_SIZE = 8;
+    static constexpr int MAX_K = 32; // 一度に探せる最大の個数
+
+private:
+    struct Point
+    {
+        float x, y, z;
+        int index; // state 上のインデックス
+    };
+    struct Node
+    {
+        int begin, end; // points 上の区間
+        int axis;       // 分割する軸 (0, 1, 2)。-1 なら葉
+        float split;    // 分割する座標 (左の子は split 以下、右の子は split 以上)
+    };
+
+    // [begin, end) の点から nodes[index] を作り、必要なら子を作る
+    void buildNode(int index, int begin, int end);
+
+    std::vector<Point> points;  // 木の順に並べた点
+    std::vector<int> species;   // points と同じ順の種族
+    std::vector<Node> nodes;
+};
+
+#endif
@@ -0,0 +1,605 @@
+#include "MeshBvh.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+// これより小さい部分木は、並列に分けずに同じスレッドで続けて組む
+static const int PARALLEL_SUBTREE_MIN = 4096;
+// refit() と SAH の見積もりで、並列ループの1区間が受け持つ三角形・ノードの数
+static const std::size_t REFIT_GRAIN = 2048;
+
+// SAH の見積もりで使う、ノードを1つ調べる手間と三角形を1つ調べる手間の比
+static const float TRAVERSAL_COST = 1.0f;
+static const float INTERSECT_COST = 1.0f;
+
+namespace
+{
+    const float INFINITE_DISTANCE = std::numeric_limits<float>::infinity();
+
+    // 箱の表面積の半分 (SAH では比しか使わない)
+    float halfArea(const glm::vec3 &lo, const glm::vec3 &hi)
+    {
+        const glm::vec3 e = hi - lo;
+        return e.x * e.y + e.y * e.z + e.z * e.x;
+    }
+
+    // 0 に近い成分を符号付きの小さな値に置き換えた逆数 (箱との交差で 0 * 無限大 の NaN を作らないため)
+    float safeInverse(float d)
+    {
+        const float tiny = 1e-12f;
+        return 1.0f / (std::abs(d) > tiny ? d : std::copysign(tiny, d));
+    }
+
+    // 光線が箱 [lo, hi] の中を通る区間と [0, tMax] が重なるか (slab 法)。重なれば入る距離を tNear に書く
+    // 1本ずつたどるときとまとめてたどるときで同じ式を使い、結果をそろえる
+    inline bool hitBox(float loX, float loY, float loZ, float hiX, float hiY, float hiZ, float ox, float oy, float oz,
+                       float invX, float invY, float invZ, float tMax, float &tNear)
+    {
+        const float x1 = (loX - ox) * invX, x2 = (hiX - ox) * invX;
+        const float y1 = (loY - oy) * invY, y2 = (hiY - oy) * invY;
+        const float z1 = (loZ - oz) * invZ, z2 = (hiZ - oz) * invZ;
+        tNear = std::max(std::max(std::min(x1, x2), std::min(y1, y2)), std::max(std::min(z1, z2), 0.0f));
+        const float tFar = std::min(std::min(std::max(x1, x2), std::max(y1, y2)), std::min(std::max(z1, z2), tMax));
+        return tNear <= tFar;
+    }
+
+    // Möller-Trumbore の光線と三角形の交差。(0, tMax) で当たれば距離を t に書く
+    inline bool hitTriangle(const glm::vec3 &v0, const glm::vec3 &e1, const glm::vec3 &e2, float ox, float oy, float oz,
+                            float dx, float dy, float dz, float tMax, float &t)
+    {
+        const float px = dy * e2.z - dz * e2.y, py = dz * e2.x - dx * e2.z, pz = dx * e2.y - dy * e2.x;
+        const float det = e1.x * px + e1.y * py + e1.z * pz;
+        const float inv = 1.0f / det;
+        const float sx = ox - v0.x, sy = oy - v0.y, sz = oz - v0.z;
+        const float u = (sx * px + sy * py + sz * pz) * inv;
+        const float qx = sy * e1.z - sz * e1.y, qy = sz * e1.x - sx * e1.z, qz = sx * e1.y - sy * e1.x;
+        const float v = (dx * qx + dy * qy + dz * qz) * inv;
+        t = (e2.x * qx + e2.y * qy + e2.z * qz) * inv;
+        // 分岐にしないよう & でつなぐ (まとめて調べるときにレーン方向へベクトル化される)
+        return (std::abs(det) > 1e-12f) & (u >= 0.0f) & (v >= 0.0f) & (u + v <= 1.0f) & (t > 0.0f) & (t < tMax);
+    }
+}
+
+void RayPacket::set(int lane, const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance)
+{
+    ox[lane] = origin.x;
+    oy[lane] = origin.y;
+    oz[lane] = origin.z;
+    dx[lane] = direction.x;
+    dy[lane] = direction.y;
+    dz[lane] = direction.z;
+    invX[lane] = safeInverse(direction.x);
+    invY[lane] = safeInverse(direction.y);
+    invZ[lane] = safeInverse(direction.z);
+    tMax[lane] = maxDistance;
+    triangle[lane] = -1;
+}
+
+void RayPacket::disable(int lane)
+{
+    set(lane, glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f), -1.0f);
+}
+
+void MeshBvh::build(const std::vector<TriangleMesh> &meshes)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::vector<Triangle> source;
+    std::vector<TriangleSource> sourceIndex;
+    for (std::size_t m = 0; m < meshes.size(); ++m)
+    {
+        const TriangleMesh &mesh = meshes[m];
+        for (std::size_t t = 0; t < mesh.triangleCount(); ++t)
+        {
+            const glm::vec3 &a = mesh.vertex(t, 0), &b = mesh.vertex(t, 1), &c = mesh.vertex(t, 2);
+            source.push_back(Triangle{a, b - a, c - a});
+            sourceIndex.push_back(TriangleSource{static_cast<int>(m), static_cast<int>(t)});
+        }
+    }
+    const int n = static_cast<int>(source.size());
+    references.resize(n);
+    for (int t = 0; t < n; ++t)
+    {
+        const Triangle &tri = source[t];
+        const glm::vec3 b = tri.v0 + tri.edge1, c = tri.v0 + tri.edge2;
+        references[t] = BuildReference{glm::min(tri.v0, glm::min(b, c)), t, glm::max(tri.v0, glm::max(b, c))};
+    }
+
+    nodes.clear();
+    triangles.clear();
+    sources.clear();
+    levelNodes.clear();
+    levelStart.assign(1, 0);
+    if (n > 0)
+    {
+        // 葉に三角形が1つ以上あれば、ノードは 2n - 1 個を超えない
+        nodes.resize(2 * static_cast<std::size_t>(n) - 1);
+        nodes[0].leftFirst = 0;
+        nodes[0].count = n;
+        std::atomic<int> nodesUsed(1);
+        subdivide(0, 0, nodesUsed);
+        nodes.resize(nodesUsed.load());
+
+        triangles.resize(n);
+        sources.resize(n);
+        for (int i = 0; i < n; ++i)
+        {
+            triangles[i] = source[references[i].triangle];
+            sources[i] = sourceIndex[references[i].triangle];
+        }
+
+        // 深さごとのノード (refit で子から親へ順に箱を求める)
+        levelNodes.push_back(0);
+        for (std::size_t begin = 0; begin < levelNodes.size();)
+        {
+            const std::size_t end = levelNodes.size();
+            levelStart.push_back(end);
+            for (std::size_t k = begin; k < end; ++k)
+            {
+                const Node &node = nodes[levelNodes[k]];
+                if (node.count == 0)
+                {
+                    levelNodes.push_back(node.leftFirst);
+                    levelNodes.push_back(node.leftFirst + 1);
+                }
+            }
+            begin = end;
+        }
+    }
+    currentSahCost = buildSahCost = computeSahCost();
+    buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void MeshBvh::subdivide(int index, int depth, std::atomic<int> &nodesUsed)
+{
+    Node &node = nodes[index];
+    const int first = node.leftFirst;
+    const int count = node.count;
+    glm::vec3 lo(INFINITE_DISTANCE), hi(-INFINITE_DISTANCE);
+    glm::vec3 centroidLo(INFINITE_DISTANCE), centroidHi(-INFINITE_DISTANCE);
+    // 三角形の代表点は箱の中心 (の2倍。ビンの位置の比しか使わないので半分にしない)
+    for (int i = first; i < first + count; ++i)
+    {
+        const BuildReference &r = references[i];
+        for (int c = 0; c < 3; ++c)
+        {
+            lo[c] = std::min(lo[c], r.lo[c]);
+            hi[c] = std::max(hi[c], r.hi[c]);
+            const float center = r.lo[c] + r.hi[c];
+            centroidLo[c] = std::min(centroidLo[c], center);
+            centroidHi[c] = std::max(centroidHi[c], center);
+        }
+    }
+    node.boundsMin = lo;
+    node.boundsMax = hi;
+    if (count <= 1 || depth >= MAX_DEPTH)
+        return;
+
+    // 軸ごとに重心を SAH_BINS 個のビンに分け、ビンの境目で分けたときの見積もりが最も小さいものを選ぶ
+    // (3軸のビンは三角形を1回なめる間にまとめて埋める)
+    struct Bin
+    {
+        float lo[3], hi[3];
+        int count;
+    };
+    Bin bins[3][SAH_BINS];
+    float scale[3];
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        const float extent = centroidHi[axis] - centroidLo[axis];
+        scale[axis] = extent > 0.0f ? SAH_BINS / extent : 0.0f;
+        for (Bin &bin : bins[axis])
+        {
+            bin.lo[0] = bin.lo[1] = bin.lo[2] = INFINITE_DISTANCE;
+            bin.hi[0] = bin.hi[1] = bin.hi[2] = -INFINITE_DISTANCE;
+            bin.count = 0;
+        }
+    }
+    for (int i = first; i < first + count; ++i)
+    {
+        const BuildReference &r = references[i];
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            const float center = r.lo[axis] + r.hi[axis];
+            const int b = std::min(static_cast<int>((center - centroidLo[axis]) * scale[axis]), SAH_BINS - 1);
+            Bin &bin = bins[axis][b];
+            bin.count++;
+            for (int c = 0; c < 3; ++c)
+            {
+                bin.lo[c] = std::min(bin.lo[c], r.lo[c]);
+                bin.hi[c] = std::max(bin.hi[c], r.hi[c]);
+            }
+        }
+    }
+    float bestCost = INFINITE_DISTANCE;
+    int bestAxis = -1, bestSplit = 0;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        if (scale[axis] == 0.0f)
+            continue;
+        // 境目 s (ビン s - 1 と s の間) より左の三角形の数と箱の面積。右は逆向きに足しながら見積もる
+        float leftArea[SAH_BINS];
+        int leftCount[SAH_BINS];
+        Bin acc = {{INFINITE_DISTANCE, INFINITE_DISTANCE, INFINITE_DISTANCE},
+                   {-INFINITE_DISTANCE, -INFINITE_DISTANCE, -INFINITE_DISTANCE}, 0};
+        auto grow = [](Bin &into, const Bin &bin)
+        {
+            into.count += bin.count;
+            for (int c = 0; c < 3; ++c)
+            {
+                into.lo[c] = std::min(into.lo[c], bin.lo[c]);
+                into.hi[c] = std::max(into.hi[c], bin.hi[c]);
+            }
+        };
+        auto area = [](const Bin &bin)
+        {
+            return bin.count > 0 ? halfArea(glm::vec3(bin.lo[0], bin.lo[1], bin.lo[2]), glm::vec3(bin.hi[0], bin.hi[1], bin.hi[2]))
+                                 : 0.0f;
+        };
+        for (int s = 1; s < SAH_BINS; ++s)
+        {
+            grow(acc, bins[axis][s - 1]);
+            leftCount[s] = acc.count;
+            leftArea[s] = area(acc);
+        }
+        acc = Bin{{INFINITE_DISTANCE, INFINITE_DISTANCE, INFINITE_DISTANCE},
+                  {-INFINITE_DISTANCE, -INFINITE_DISTANCE, -INFINITE_DISTANCE}, 0};
+        for (int s = SAH_BINS - 1; s >= 1; --s)
+        {
+            grow(acc, bins[axis][s]);
+            if (leftCount[s] == 0 || acc.count == 0)
+                continue;
+            const float cost = leftCount[s] * leftArea[s] + acc.count * area(acc);
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = s;
+            }
+        }
+    }
+    // 分けない (葉にする) 方が安ければ分けない
+    const float area = halfArea(lo, hi);
+    if (bestAxis < 0 || TRAVERSAL_COST * area + INTERSECT_COST * bestCost >= INTERSECT_COST * count * area)
+        return;
+
+    const float axisLo = centroidLo[bestAxis], axisScale = scale[bestAxis];
+    const auto middle = std::partition(references.begin() + first, references.begin() + first + count,
+                                       [&](const BuildReference &r)
+                                       {
+                                           const float center = r.lo[bestAxis] + r.hi[bestAxis];
+                                           return std::min(static_cast<int>((center - axisLo) * axisScale), SAH_BINS - 1) < bestSplit;
+                                       });
+    const int leftCount = static_cast<int>(middle - references.begin()) - first;
+
+    const int left = nodesUsed.fetch_add(2);
+    nodes[left].leftFirst = first;
+    nodes[left].count = leftCount;
+    nodes[left + 1].leftFirst = first + leftCount;
+    nodes[left + 1].count = count - leftCount;
+    node.leftFirst = left;
+    node.count = 0;
+
+    // 左右の部分木は references の別々の区間と別々のノードしか触らないので、並列に組める
+    if (count >= PARALLEL_SUBTREE_MIN)
+    {
+        parallel::invoke([&]
+                         { subdivide(left, depth + 1, nodesUsed); },
+                         [&]
+                         { subdivide(left + 1, depth + 1, nodesUsed); });
+        return;
+    }
+    subdivide(left, depth + 1, nodesUsed);
+    subdivide(left + 1, depth + 1, nodesUsed);
+}
+
+void MeshBvh::refit(const std::vector<TriangleMesh> &meshes)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::size_t total = 0;
+    for (const TriangleMesh &mesh : meshes)
+    {
+        total += mesh.triangleCount();
+    }
+    if (total != triangles.size() || nodes.empty())
+    {
+        build(meshes);
+        refitMs = 0.0;
+        return;
+    }
+
+    parallel::forRange(triangles.size(), REFIT_GRAIN, [&](std::size_t begin, std::size_t end)
+                       {
+                           for (std::size_t i = begin; i < end; ++i)
+                           {
+                               const TriangleMesh &mesh = meshes[sources[i].mesh];
+                               const int t = sources[i].triangle;
+                               const glm::vec3 &a = mesh.vertex(t, 0), &b = mesh.vertex(t, 1), &c = mesh.vertex(t, 2);
+                               triangles[i] = Triangle{a, b - a, c - a};
+                           } });
+
+    // 子の箱は親より1段深いので、深い段から順に求めれば、どの段でも子の箱はもう新しくなっている
+    // 同じ段のノードは互いに触らないので、段の中は並列に求められる
+    const int levels = static_cast<int>(levelStart.size()) - 1;
+    for (int level = levels - 1; level >= 0; --level)
+    {
+        const std::size_t first = levelStart[level];
+        parallel::forRange(levelStart[level + 1] - first, REFIT_GRAIN, [&](std::size_t begin, std::size_t end)
+                           {
+                               for (std::size_t k = first + begin; k < first + end; ++k)
+                               {
+                                   Node &node = nodes[levelNodes[k]];
+                                   glm::vec3 lo(INFINITE_DISTANCE), hi(-INFINITE_DISTANCE);
+                                   if (node.count > 0)
+                                   {
+                                       for (int t = node.leftFirst; t < node.leftFirst + node.count; ++t)
+                                       {
+                                           const Triangle &tri = triangles[t];
+                                           const glm::vec3 b = tri.v0 + tri.edge1, c = tri.v0 + tri.edge2;
+                                           lo = glm::min(lo, glm::min(tri.v0, glm::min(b, c)));
+                                           hi = glm::max(hi, glm::max(tri.v0, glm::max(b, c)));
+                                       }
+                                   }
+                                   else
+                                   {
+                                       const Node &left = nodes[node.leftFirst], &right = nodes[node.leftFirst + 1];
+                                       lo = glm::min(left.boundsMin, right.boundsMin);
+                                       hi = glm::max(left.boundsMax, right.boundsMax);
+                                   }
+                                   node.boundsMin = lo;
+                                   node.boundsMax = hi;
+                               } });
+    }
+    currentSahCost = computeSahCost();
+    refitMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+float MeshBvh::computeSahCost() const
+{
+    if (nodes.empty())
+        return 0.0f;
+    const float rootArea = halfArea(nodes[0].boundsMin, nodes[0].boundsMax);
+    if (rootArea <= 0.0f)
+        return 0.0f;
+    // 区間ごとに足してから区間の順に合計する (スレッド数によらず同じ値になる)
+    std::vector<double> partial((nodes.size() + REFIT_GRAIN - 1) / REFIT_GRAIN, 0.0);
+    parallel::forRange(nodes.size(), REFIT_GRAIN, [&](std::size_t begin, std::size_t end)
+                       {
+                           double sum = 0.0;
+                           for (std::size_t i = begin; i < end; ++i)
+                           {
+                               const Node &node = nodes[i];
+                               sum += halfArea(node.boundsMin, node.boundsMax) *
+                                      (node.count > 0 ? INTERSECT_COST * node.count : TRAVERSAL_COST);
+                           }
+                           partial[begin / REFIT_GRAIN] = sum; });
+    double cost = 0.0;
+    for (double sum : partial)
+    {
+        cost += sum;
+    }
+    return static_cast<float>(cost / rootArea);
+}
+
+glm::vec3 MeshBvh::normal(int triangle) const
+{
+    const Triangle &tri = triangles[triangle];
+    return glm::normalize(glm::cross(tri.edge1, tri.edge2));
+}
+
+bool MeshBvh::intersect(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, RayHit &hit) const
+{
+    if (nodes.empty())
+        return false;
+    const glm::vec3 inverse(safeInverse(direction.x), safeInverse(direction.y), safeInverse(direction.z));
+    const Node &root = nodes[0];
+    float tNear;
+    if (!hitBox(root.boundsMin.x, root.boundsMin.y, root.boundsMin.z, root.boundsMax.x, root.boundsMax.y, root.boundsMax.z,
+                origin.x, origin.y, origin.z, inverse.x, inverse.y, inverse.z, maxDistance, tNear))
+        return false;
+    float tMax = maxDistance;
+    int best = -1;
+    traverseSingle(0, origin, direction, inverse, tMax, best);
+    if (best < 0)
+        return false;
+    hit.distance = tMax;
+    hit.triangle = best;
+    return true;
+}
+
+void MeshBvh::traverseSingle(int root, const glm::vec3 &origin, const glm::vec3 &direction, const glm::vec3 &inverse,
+                             float &tMax, int &best) const
+{
+    auto boxDistance = [&](const Node &node, float &tNear)
+    {
+        return hitBox(node.boundsMin.x, node.boundsMin.y, node.boundsMin.z, node.boundsMax.x, node.boundsMax.y,
+                      node.boundsMax.z, origin.x, origin.y, origin.z, inverse.x, inverse.y, inverse.z, tMax, tNear);
+    };
+    // 近い方の子から調べ、遠い方は入る距離と一緒に積んでおく (その間に当たった面より遠ければ調べない)
+    int stack[MAX_DEPTH + 1];
+    float stackDistance[MAX_DEPTH + 1];
+    int size = 0;
+    int index = root;
+    while (true)
+    {
+        const Node &node = nodes[index];
+        if (node.count > 0)
+        {
+            for (int t = node.leftFirst; t < node.leftFirst + node.count; ++t)
+            {
+                const Triangle &tri = triangles[t];
+                float distance;
+                if (hitTriangle(tri.v0, tri.edge1, tri.edge2, origin.x, origin.y, origin.z, direction.x, direction.y,
+                                direction.z, tMax, distance))
+                {
+                    tMax = distance;
+                    best = t;
+                }
+            }
+        }
+        else
+        {
+            int nearChild = node.leftFirst, farChild = node.leftFirst + 1;
+            float nearDistance, farDistance;
+            const bool nearHit = boxDistance(nodes[nearChild], nearDistance);
+            const bool farHit = boxDistance(nodes[farChild], farDistance);
+            if (nearHit && farHit)
+            {
+                if (farDistance < nearDistance)
+                {
+                    std::swap(nearChild, farChild);
+                    std::swap(nearDistance, farDistance);
+                }
+                stack[size] = farChild;
+                stackDistance[size++] = farDistance;
+                index = nearChild;
+                continue;
+            }
+            if (nearHit || farHit)
+            {
+                index = nearHit ? nearChild : farChild;
+                continue;
+            }
+        }
+        while (size > 0 && stackDistance[size - 1] > tMax)
+        {
+            size--;
+        }
+        if (size == 0)
+            break;
+        index = stack[--size];
+    }
+}
+
+void MeshBvh::intersect(RayPacket &packet) const
+{
+    if (nodes.empty())
+        return;
+    // 光線はどれも短いので、全レーンの線分を囲む箱と重ならないノードは、レーンごとに調べる前に1回の比較で除く
+    glm::vec3 packetMin(INFINITE_DISTANCE), packetMax(-INFINITE_DISTANCE);
+    for (int lane = 0; lane < RayPacket::SIZE; ++lane)
+    {
+        if (packet.tMax[lane] < 0.0f)
+            continue;
+        const glm::vec3 origin(packet.ox[lane], packet.oy[lane], packet.oz[lane]);
+        const glm::vec3 tip = origin + glm::vec3(packet.dx[lane], packet.dy[lane], packet.dz[lane]) * packet.tMax[lane];
+        packetMin = glm::min(packetMin, glm::min(origin, tip));
+        packetMax = glm::max(packetMax, glm::max(origin, tip));
+    }
+    // 上の方の大きなノードは全レーンでまとめて調べ (箱との交差はレーン方向に SIMD)、
+    // 通るレーンが PACKET_MIN_LANES 本より少なくなったノードから先は、通るレーンだけ1本ずつたどる
+    // (Benthin et al., "Combining Single and Packet-Ray Tracing for Arbitrary Ray Distributions", 2012)。
+    // 深いところの小さな箱は個体の間隔より小さく、1本しか通らないことが多いので、まとめても無駄が増えるだけになる
+    int stack[MAX_DEPTH + 2];
+    int size = 0;
+    stack[size++] = 0;
+    while (size > 0)
+    {
+        const int index = stack[--size];
+        const Node &node = nodes[index];
+        if (node.boundsMin.x > packetMax.x || node.boundsMin.y > packetMax.y || node.boundsMin.z > packetMax.z ||
+            node.boundsMax.x < packetMin.x || node.boundsMax.y < packetMin.y || node.boundsMax.z < packetMin.z)
+            continue;
+        alignas(64) int active[RayPacket::SIZE];
+        int activeCount = 0;
+#pragma omp simd reduction(+ : activeCount)
+        for (int lane = 0; lane < RayPacket::SIZE; ++lane)
+        {
+            float tNear;
+            active[lane] = hitBox(node.boundsMin.x, node.boundsMin.y, node.boundsMin.z, node.boundsMax.x,
+                                  node.boundsMax.y, node.boundsMax.z, packet.ox[lane], packet.oy[lane], packet.oz[lane],
+                                  packet.invX[lane], packet.invY[lane], packet.invZ[lane], packet.tMax[lane], tNear)
+                               ? 1
+                               : 0;
+            activeCount += active[lane];
+        }
+        if (activeCount == 0)
+            continue;
+        if (activeCount < PACKET_MIN_LANES)
+        {
+            for (int lane = 0; lane < RayPacket::SIZE; ++lane)
+            {
+                if (!active[lane])
+                    continue;
+                traverseSingle(index, glm::vec3(packet.ox[lane], packet.oy[lane], packet.oz[lane]),
+                               glm::vec3(packet.dx[lane], packet.dy[lane], packet.dz[lane]),
+                               glm::vec3(packet.invX[lane], packet.invY[lane], packet.invZ[lane]), packet.tMax[lane],
+                               packet.triangle[lane]);
+            }
+            continue;
+        }
+        if (node.count > 0)
+        {
+            for (int t = node.leftFirst; t < node.leftFirst + node.count; ++t)
+            {
+                const Triangle tri = triangles[t];
+#pragma omp simd
+                for (int lane = 0; lane < RayPacket::SIZE; ++lane)
+                {
+                    float distance;
+                    const bool hit = hitTriangle(tri.v0, tri.edge1, tri.edge2, packet.ox[lane], packet.oy[lane],
+                                                 packet.oz[lane], packet.dx[lane], packet.dy[lane], packet.dz[lane],
+                                                 packet.tMax[lane], distance);
+                    packet.tMax[lane] = hit ? distance : packet.tMax[lane];
+                    packet.triangle[lane] = hit ? t : packet.triangle[lane];
+                }
+            }
+            continue;
+        }
+        // 子は通るレーンのうち最初のものの向きから見て近い方を先に調べる
+        int lead = 0;
+        while (!active[lead])
+        {
+            lead++;
+        }
+        const Node &left = nodes[node.leftFirst], &right = nodes[node.leftFirst + 1];
+        const glm::vec3 toRight = (right.boundsMin + right.boundsMax) - (left.boundsMin + left.boundsMax);
+        const bool leftNear = toRight.x * packet.dx[lead] + toRight.y * packet.dy[lead] + toRight.z * packet.dz[lead] >= 0.0f;
+        stack[size++] = leftNear ? node.leftFirst + 1 : node.leftFirst;
+        stack[size++] = leftNear ? node.leftFirst : node.leftFirst + 1;
+    }
+}
+
+void MeshBvh::avoid(const BoidArrays &b, std::size_t begin, std::size_t end, float lookAhead) const
+{
+    if (nodes.empty() || lookAhead <= 0.0f)
+        return;
+    RayPacket packet;
+    for (std::size_t first = begin; first < end; first += RayPacket::SIZE)
+    {
+        const int lanes = static_cast<int>(std::min<std::size_t>(RayPacket::SIZE, end - first));
+        for (int lane = 0; lane < RayPacket::SIZE; ++lane)
+        {
+            if (lane < lanes)
+            {
+                const std::size_t i = first + lane;
+                packet.set(lane, glm::vec3(b.px[i], b.py[i], b.pz[i]), glm::vec3(b.dx[i], b.dy[i], b.dz[i]), lookAhead);
+            }
+            else
+            {
+                packet.disable(lane);
+            }
+        }
+        intersect(packet);
+
+        for (int lane = 0; lane < lanes; ++lane)
+        {
+            if (packet.triangle[lane] < 0)
+                continue;
+            const std::size_t i = first + lane;
+            const glm::vec3 direction(b.dx[i], b.dy[i], b.dz[i]);
+            // 面の法線を、光線が来た側 (個体のいる側) に向ける
+            glm::vec3 away = normal(packet.triangle[lane]);
+            if (glm::dot(away, direction) > 0.0f)
+                away = -away;
+            // 面までの残りが短いほど強く曲げる。触れる位置では AVOID_GAIN > 1 なので必ず面から離れる向きになる
+            const float urgency = 1.0f - packet.tMax[lane] / lookAhead;
+            const glm::vec3 steered = glm::normalize(direction + away * (AVOID_GAIN * urgency));
+            b.dx[i] = steered.x;
+            b.dy[i] = steered.y;
+            b.dz[i] = steered.z;
+        }
+    }
+}
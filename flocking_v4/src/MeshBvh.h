@@ -0,0 +1,131 @@
+#ifndef MESH_BVH_H
+#define MESH_BVH_H
+
+#include <glm/glm.hpp>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+#include "FlockKernel.h"
+#include "Obstacle.h"
+
+// まとめて調べる光線の組 (SoA)。同じ BVH のノードを全レーンで一緒にたどり、三角形との交差も全レーンまとめて SIMD で調べる
+struct RayPacket
+{
+    static const int SIZE = 16;
+
+    alignas(64) float ox[SIZE], oy[SIZE], oz[SIZE];       // 始点
+    alignas(64) float dx[SIZE], dy[SIZE], dz[SIZE];       // 向き (単位ベクトル)
+    alignas(64) float invX[SIZE], invY[SIZE], invZ[SIZE]; // 向きの逆数 (箱との交差用)
+    alignas(64) float tMax[SIZE];                         // 入力は光線の長さ、出力は最も近い交点までの距離
+    alignas(64) int triangle[SIZE];                       // 当たった三角形 (MeshBvh の番号。当たらなければ -1)
+
+    void set(int lane, const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance);
+    // 使わないレーン (どの箱にも当たらない)
+    void disable(int lane);
+};
+
+// 光線が当たった三角形
+struct RayHit
+{
+    float distance = 0.0f;
+    int triangle = -1;
+};
+
+// 三角形メッシュの障害物を入れる BVH (bounding volume hierarchy)
+// 各ノードで三角形の重心を軸ごとに SAH_BINS 個のビンに分け、SAH (表面積ヒューリスティック) の見積もりが
+// 最も小さい分け方を選ぶ (Wald, "On fast Construction of SAH-based Bounding Volume Hierarchies", 2007)。
+// 分けない方が安いときはそこで葉にする。ノードは配列に並べ、子の組は親より後ろに置く
+// (大きな部分木は parallel::invoke で並列に組む)。
+//
+// 個体は向きに沿って lookAhead 先までの光線を飛ばし、当たった面から離れる向きに曲がる (avoid)。
+// 押し出しのコライダーと違い、めり込む前に避ける。近くの個体は空間順に並んでいるので、
+// 並び順に RayPacket::SIZE 本ずつまとめてたどると、同じノードを読む光線が多くなる。
+class MeshBvh
+{
+public:
+    // meshes のすべての三角形から木を作る
+    void build(const std::vector<TriangleMesh> &meshes);
+    // build() と同じ形で頂点の位置だけが変わった meshes に合わせて、三角形とノードの箱を求め直す (木の形は変えない)。
+    // 箱は深い段から根へ向かって、段ごとに並列に求める。三角形の数が変わっていたら build() する
+    void refit(const std::vector<TriangleMesh> &meshes);
+
+    bool empty() const { return nodes.empty(); }
+    std::size_t triangleCount() const { return triangles.size(); }
+    int nodeCount() const { return static_cast<int>(nodes.size()); }
+    double getBuildMs() const { return buildMs; }
+    double getRefitMs() const { return refitMs; }
+    // 木の SAH の見積もり (根の箱に当たった光線1本あたりの、ノードを調べる回数と三角形を調べる回数の期待値の和)。
+    // build() と refit() のたびに求め直す。refit() で三角形が動くと箱の重なりが増え、作り直した木より大きくなる
+    float sahCost() const { return currentSahCost; }
+    // 直前の build() の直後の sahCost()
+    float getBuildSahCost() const { return buildSahCost; }
+
+    // origin から direction (単位ベクトル) に maxDistance までの光線が最初に当たる三角形 (両面とも当たる)
+    bool intersect(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, RayHit &hit) const;
+    // packet の全レーンについて intersect と同じことをする
+    void intersect(RayPacket &packet) const;
+    // 三角形 triangle の単位法線 (cross(v1 - v0, v2 - v0) の向き)
+    glm::vec3 normal(int triangle) const;
+
+    // [begin, end) の個体について、向きに沿って lookAhead 先までに面があれば、面から離れる向きに曲げる。
+    // 近いほど強く曲げ (面に触れる位置では必ず離れる向きになる)、個体の maxTurn の制限は受けない
+    void avoid(const BoidArrays &boids, std::size_t begin, std::size_t end, float lookAhead) const;
+
+    static const int SAH_BINS = 16;
+    // まとめてたどるノードを通るレーンがこれより少なくなったら、そこから先は1本ずつたどる
+    static const int PACKET_MIN_LANES = 8;
+    static const int MAX_DEPTH = 64; // これより深くは分けない (たどるときのスタックの大きさ)
+
+    // 面に触れる位置で、向きに足す法線の倍率
+    static constexpr float AVOID_GAIN = 2.0f;
+
+private:
+    struct Node
+    {
+        glm::vec3 boundsMin;
+        int leftFirst; // 葉なら最初の三角形、そうでなければ左の子 (右の子は leftFirst + 1)
+        glm::vec3 boundsMax;
+        int count;     // 葉の三角形の数 (0 なら内部ノード)
+    };
+    // 交差判定に使う形の三角形
+    struct Triangle
+    {
+        glm::vec3 v0, edge1, edge2;
+    };
+    // 木の順の三角形が、build() に渡したどのメッシュのどの三角形か (refit 用)
+    struct TriangleSource
+    {
+        int mesh;
+        int triangle;
+    };
+
+    // nodes[index] の箱を求め、分けた方が安ければ子の組を nodes[nodesUsed] から取って再帰的に分ける
+    void subdivide(int index, int depth, std::atomic<int> &nodesUsed);
+    float computeSahCost() const;
+    // nodes[root] の部分木を1本の光線でたどり、tMax より近くで当たれば tMax と best を書き換える
+    void traverseSingle(int root, const glm::vec3 &origin, const glm::vec3 &direction, const glm::vec3 &inverse,
+                        float &tMax, int &best) const;
+
+    std::vector<Node> nodes;
+    std::vector<Triangle> triangles; // 木の順
+    std::vector<TriangleSource> sources; // triangles と同じ順
+    // 根からの深さごとのノードの番号 (深さ d のノードは levelNodes の [levelStart[d], levelStart[d + 1]))
+    std::vector<int> levelNodes;
+    std::vector<std::size_t> levelStart;
+    // 構築中だけ使う三角形の箱と元の番号。ノードの区間ごとに並べ替えていき、最後は木の順になる
+    // (分けるたびに読む箱を連続させておくため、番号の配列から別の配列をひかない)
+    struct BuildReference
+    {
+        glm::vec3 lo;
+        int triangle;
+        glm::vec3 hi;
+    };
+    std::vector<BuildReference> references;
+    double buildMs = 0.0;
+    double refitMs = 0.0;
+    float currentSahCost = 0.0f;
+    float buildSahCost = 0.0f;
+};
+
+#endif
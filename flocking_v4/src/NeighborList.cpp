@@ -0,0 +1,148 @@
+#include "NeighborList.h"
+#include "Parallel.h"
+#include "SpatialGrid.h"
+
+#include <algorithm>
+
+// 移動量の確認は軽いので大きな区間で、候補の列挙は個体ごとの手間がばらつくので小さな区間で分ける
+static const long MOVE_CHECK_GRAIN = 16384;
+static const std::size_t BUILD_GRAIN = 256;
+
+bool NeighborList::needsRebuild(const FlockState &state, float skin) const
+{
+    const long n = static_cast<long>(state.size());
+    if (!valid || skin != builtSkin || static_cast<long>(refPosX.size()) != n)
+        return true;
+
+    // どの個体も skin/2 以内しか動いていなければ、2個体の距離は最大でも skin しか縮まない
+    const float *__restrict px = state.posX.data();
+    const float *__restrict py = state.posY.data();
+    const float *__restrict pz = state.posZ.data();
+    const float *__restrict rx = refPosX.data();
+    const float *__restrict ry = refPosY.data();
+    const float *__restrict rz = refPosZ.data();
+    // 区間ごとの最大値を並べてから最大を取る (区間の切れ目は固定なので、結果はスレッド数によらない)
+    const long chunkCount = (n + MOVE_CHECK_GRAIN - 1) / MOVE_CHECK_GRAIN;
+    std::vector<float> chunkMax(chunkCount, 0.0f);
+    parallel::forRange(n, MOVE_CHECK_GRAIN, [&](std::size_t begin, std::size_t end)
+                       {
+                           float maxMoveSq = 0.0f;
+                           const long i0 = static_cast<long>(begin);
+                           const long i1 = static_cast<long>(end);
+#pragma omp simd reduction(max : maxMoveSq)
+                           for (long i = i0; i < i1; ++i)
+                           {
+                               float x = px[i] - rx[i];
+                               float y = py[i] - ry[i];
+                               float z = pz[i] - rz[i];
+                               float d2 = x * x + y * y + z * z;
+                               maxMoveSq = d2 > maxMoveSq ? d2 : maxMoveSq;
+                           }
+                           chunkMax[begin / MOVE_CHECK_GRAIN] = maxMoveSq; });
+    const float maxMoveSq = chunkMax.empty() ? 0.0f : *std::max_element(chunkMax.begin(), chunkMax.end());
+    const float halfSkin = 0.5f * skin;
+    return maxMoveSq > halfSkin * halfSkin;
+}
+
+void NeighborList::build(const FlockState &state, const GridLookup &gridOf, float radius, float skin)
+{
+    const long n = static_cast<long>(state.size());
+    const float cutoff = radius + skin;
+    const float cutoffSq = cutoff * cutoff;
+
+    // 自分自身も距離 0 の候補として入るが、カーネル側で除外される
+    // 1. 個体ごとの候補数を数える (分岐のない合計なのでベクトル化される)
+    neighborStart.resize(n + 1);
+    neighborStart[0] = 0;
+    parallel::forRange(n, BUILD_GRAIN, [&](std::size_t i0, std::size_t i1)
+                       {
+        for (long i = static_cast<long>(i0); i < static_cast<long>(i1); ++i)
+        {
+            const int mySpecies = state.speciesID[i];
+            const SpatialGrid &grid = gridOf(mySpecies);
+            const NeighborArrays a = grid.sortedArrays();
+            const glm::vec3 p = state.position(i);
+            int count = 0;
+            grid.forEachNeighborRange(p, [&](int begin, int end)
+                                      {
+                                          for (int k = begin; k < end; ++k)
+                                          {
+                                              float x = a.px[k] - p.x;
+                                              float y = a.py[k] - p.y;
+                                              float z = a.pz[k] - p.z;
+                                              count += (x * x + y * y + z * z < cutoffSq) & (a.species[k] == mySpecies);
+                                          }
+                                      });
+            neighborStart[i + 1] = count;
+        } });
+
+    // 2. 累積和で個体ごとの開始位置を求める
+    for (long i = 0; i < n; ++i)
+    {
+        neighborStart[i + 1] += neighborStart[i];
+    }
+
+    // 3. 候補のインデックスを書き込み、構築時の位置を覚えておく
+    //    条件に関わらず書き込んで、満たしたときだけ書き込み位置を進める (分岐なしの詰め込み)。
+    //    最後の1つぶんはみ出すので、いったん区間ごとの作業領域に書いてから移す
+    neighborIndex.resize(neighborStart[n]);
+    refPosX.assign(state.posX.begin(), state.posX.end());
+    refPosY.assign(state.posY.begin(), state.posY.end());
+    refPosZ.assign(state.posZ.begin(), state.posZ.end());
+    parallel::forRange(n, BUILD_GRAIN, [&](std::size_t i0, std::size_t i1)
+                       {
+        std::vector<int> scratch;
+        for (long i = static_cast<long>(i0); i < static_cast<long>(i1); ++i)
+        {
+            const int mySpecies = state.speciesID[i];
+            const SpatialGrid &grid = gridOf(mySpecies);
+            const NeighborArrays a = grid.sortedArrays();
+            const int *sortedIndices = grid.getSortedIndices().data();
+            const glm::vec3 p = state.position(i);
+            const int count = neighborStart[i + 1] - neighborStart[i];
+            scratch.resize(count + 1);
+            int *out = scratch.data();
+            int m = 0;
+            grid.forEachNeighborRange(p, [&](int begin, int end)
+                                      {
+                                          for (int k = begin; k < end; ++k)
+                                          {
+                                              float x = a.px[k] - p.x;
+                                              float y = a.py[k] - p.y;
+                                              float z = a.pz[k] - p.z;
+                                              out[m] = sortedIndices[k];
+                                              m += (x * x + y * y + z * z < cutoffSq) & (a.species[k] == mySpecies);
+                                          }
+                                      });
+            std::copy(out, out + count, neighborIndex.begin() + neighborStart[i]);
+        } });
+
+    builtSkin = skin;
+    valid = true;
+}
+
+NeighborArrays NeighborGather::gather(const FlockState &state, const int *indices, int count)
+{
+    if (static_cast<int>(px.size()) < count)
+    {
+        px.resize(count);
+        py.resize(count);
+        pz.resize(count);
+        dx.resize(count);
+        dy.resize(count);
+        dz.resize(count);
+        species.resize(count);
+    }
+    for (int k = 0; k < count; ++k)
+    {
+        const int src = indices[k];
+        px[k] = state.posX[src];
+        py[k] = state.posY[src];
+        pz[k] = state.posZ[src];
+        dx[k] = state.dirX[src];
+        dy[k] = state.dirY[src];
+        dz[k] = state.dirZ[src];
+        species[k] = state.speciesID[src];
+    }
+    return NeighborArrays{px.data(), py.data(), pz.data(), dx.data(), dy.data(), dz.data(), species.data()};
+}
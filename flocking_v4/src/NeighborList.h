@@ -0,0 +1,59 @@
+#ifndef NEIGHBOR_LIST_H
+#define NEIGHBOR_LIST_H
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#include "FlockKernel.h"
+#include "FlockState.h"
+
+class SpatialGrid;
+
+// Verlet 近傍リスト
+// 相互作用半径に余裕 (skin) を足した距離以内にいる同じ種族の個体を、個体ごとに覚えておく。
+// 1フレームで動く距離 (speed = 0.03〜0.05) は半径 5.0 に比べてとても小さいので、
+// どの個体も構築時の位置から skin/2 以上動いていなければ、半径内の近傍はすべてリストに含まれている。
+// その間はグリッドの構築も 27 セルの走査もせず、リストだけを調べればよい。
+class NeighborList
+{
+public:
+    // species の個体の近傍候補を探すグリッド
+    using GridLookup = std::function<const SpatialGrid &(int species)>;
+
+    // 作り直しが必要か (未構築、個体数や skin が変わった、または skin/2 より大きく動いた個体がいる)
+    bool needsRebuild(const FlockState &state, float skin) const;
+    // 並べ替えなどで個体のインデックスが変わったときに呼ぶ
+    void invalidate() { valid = false; }
+
+    // state の全個体について、半径 radius + skin 以内にいる同じ種族の個体を集める
+    void build(const FlockState &state, const GridLookup &gridOf, float radius, float skin);
+
+    // 個体 i の近傍候補 (state 全体でのインデックス)
+    const int *neighborsBegin(std::size_t i) const { return neighborIndex.data() + neighborStart[i]; }
+    int neighborCount(std::size_t i) const { return neighborStart[i + 1] - neighborStart[i]; }
+
+    // 全個体の近傍候補の合計数 (リストの大きさの目安)
+    std::size_t totalNeighbors() const { return neighborIndex.size(); }
+
+private:
+    bool valid = false;
+    float builtSkin = 0.0f;
+    std::vector<int> neighborStart; // 個体ごとの開始位置 (要素数 = 個体数 + 1)
+    std::vector<int> neighborIndex; // 近傍候補のインデックスを個体順に並べたもの
+    AlignedArray<float> refPosX, refPosY, refPosZ; // 構築時の位置
+};
+
+// 近傍リストの個体をカーネルに渡せるよう、位置・向き・種族を連続した配列に集める作業領域
+// スレッドごとに1つずつ持つ
+class NeighborGather
+{
+public:
+    NeighborArrays gather(const FlockState &state, const int *indices, int count);
+
+private:
+    AlignedArray<float> px, py, pz, dx, dy, dz;
+    AlignedArray<int> species;
+};
+
+#endif
@@ -0,0 +1,182 @@
+#include "Obstacle.h"
+
+#include <glm/gtc/constants.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+namespace
+{
+    // 三角形 abc 上で p に最も近い点 (Ericson, "Real-Time Collision Detection" 5.1.5)
+    glm::vec3 closestPointOnTriangle(const glm::vec3 &p, const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c)
+    {
+        const glm::vec3 ab = b - a;
+        const glm::vec3 ac = c - a;
+        const glm::vec3 ap = p - a;
+        const float d1 = glm::dot(ab, ap);
+        const float d2 = glm::dot(ac, ap);
+        if (d1 <= 0.0f && d2 <= 0.0f)
+            return a;
+
+        const glm::vec3 bp = p - b;
+        const float d3 = glm::dot(ab, bp);
+        const float d4 = glm::dot(ac, bp);
+        if (d3 >= 0.0f && d4 <= d3)
+            return b;
+
+        const float vc = d1 * d4 - d3 * d2;
+        if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+            return a + ab * (d1 / (d1 - d3));
+
+        const glm::vec3 cp = p - c;
+        const float d5 = glm::dot(ab, cp);
+        const float d6 = glm::dot(ac, cp);
+        if (d6 >= 0.0f && d5 <= d6)
+            return c;
+
+        const float vb = d5 * d2 - d1 * d6;
+        if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+            return a + ac * (d2 / (d2 - d6));
+
+        const float va = d3 * d6 - d5 * d4;
+        if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+            return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+        const float denom = 1.0f / (va + vb + vc);
+        return a + ab * (vb * denom) + ac * (vc * denom);
+    }
+}
+
+float TriangleMesh::unsignedDistance(const glm::vec3 &p) const
+{
+    float bestSq = std::numeric_limits<float>::max();
+    for (std::size_t t = 0; t < triangleCount(); ++t)
+    {
+        const glm::vec3 d = p - closestPointOnTriangle(p, vertex(t, 0), vertex(t, 1), vertex(t, 2));
+        bestSq = std::min(bestSq, glm::dot(d, d));
+    }
+    return std::sqrt(bestSq);
+}
+
+float TriangleMesh::windingNumber(const glm::vec3 &p) const
+{
+    // 各三角形が p に張る立体角の和 / 4π (Van Oosterom & Strackee の式)
+    double solidAngle = 0.0;
+    for (std::size_t t = 0; t < triangleCount(); ++t)
+    {
+        const glm::vec3 a = vertex(t, 0) - p;
+        const glm::vec3 b = vertex(t, 1) - p;
+        const glm::vec3 c = vertex(t, 2) - p;
+        const float la = glm::length(a), lb = glm::length(b), lc = glm::length(c);
+        const float numerator = glm::dot(a, glm::cross(b, c));
+        const float denominator = la * lb * lc + glm::dot(a, b) * lc + glm::dot(b, c) * la + glm::dot(c, a) * lb;
+        solidAngle += 2.0 * std::atan2(numerator, denominator);
+    }
+    return static_cast<float>(solidAngle / (4.0 * glm::pi<double>()));
+}
+
+float TriangleMesh::distance(const glm::vec3 &p) const
+{
+    // 三角形の向きが内向きでも外向きでも同じになるよう、巻き数の絶対値で内外を決める
+    const float d = unsignedDistance(p);
+    return std::abs(windingNumber(p)) > 0.5f ? -d : d;
+}
+
+bool TriangleMesh::loadObj(const std::string &path)
+{
+    std::ifstream file(path);
+    if (!file)
+        return false;
+    std::vector<glm::vec3> objVertices;
+    std::vector<unsigned int> objIndices;
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::istringstream in(line);
+        std::string tag;
+        in >> tag;
+        if (tag == "v")
+        {
+            glm::vec3 v;
+            in >> v.x >> v.y >> v.z;
+            objVertices.push_back(v);
+        }
+        else if (tag == "f")
+        {
+            // "i", "i/t", "i//n", "i/t/n" のどれでも先頭の頂点番号だけを使う (負の番号は末尾から数える)
+            std::vector<unsigned int> face;
+            std::string corner;
+            while (in >> corner)
+            {
+                const long k = std::strtol(corner.c_str(), nullptr, 10);
+                const long resolved = k < 0 ? static_cast<long>(objVertices.size()) + k : k - 1;
+                if (resolved < 0 || resolved >= static_cast<long>(objVertices.size()))
+                    return false;
+                face.push_back(static_cast<unsigned int>(resolved));
+            }
+            for (std::size_t c = 2; c < face.size(); ++c)
+            {
+                objIndices.insert(objIndices.end(), {face[0], face[c - 1], face[c]});
+            }
+        }
+    }
+    if (objIndices.empty())
+        return false;
+    vertices = std::move(objVertices);
+    indices = std::move(objIndices);
+    return true;
+}
+
+void TriangleMesh::transform(float scale, const glm::vec3 &offset)
+{
+    for (glm::vec3 &v : vertices)
+    {
+        v = v * scale + offset;
+    }
+}
+
+TriangleMesh TriangleMesh::sphere(const glm::vec3 &center, float radius, int sectors, int stacks)
+{
+    TriangleMesh mesh;
+    for (int i = 0; i <= stacks; ++i)
+    {
+        const float phi = glm::pi<float>() * i / stacks;
+        for (int j = 0; j < sectors; ++j)
+        {
+            const float theta = 2.0f * glm::pi<float>() * j / sectors;
+            mesh.vertices.push_back(center + radius * glm::vec3(std::sin(phi) * std::cos(theta), std::cos(phi),
+                                                                std::sin(phi) * std::sin(theta)));
+        }
+    }
+    for (int i = 0; i < stacks; ++i)
+    {
+        for (int j = 0; j < sectors; ++j)
+        {
+            const unsigned int a = i * sectors + j, b = i * sectors + (j + 1) % sectors;
+            const unsigned int c = a + sectors, d = b + sectors;
+            mesh.indices.insert(mesh.indices.end(), {a, c, b, b, c, d});
+        }
+    }
+    return mesh;
+}
+
+float ObstacleSet::distance(const glm::vec3 &p) const
+{
+    float best = std::numeric_limits<float>::max();
+    for (const SphereObstacle &sphere : spheres)
+    {
+        best = std::min(best, sphere.distance(p));
+    }
+    for (const BoxObstacle &box : boxes)
+    {
+        best = std::min(best, box.distance(p));
+    }
+    for (const TriangleMesh &mesh : meshes)
+    {
+        best = std::min(best, mesh.distance(p));
+    }
+    return best;
+}
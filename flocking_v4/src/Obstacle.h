@@ -0,0 +1,71 @@
+#ifndef OBSTACLE_H
+#define OBSTACLE_H
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// 距離場 (DistanceField) に焼き込む障害物の形
+// どれも符号付き距離 (外側で正、内側で負) を返し、障害物全体の距離はその最小値 (和集合) になる
+
+struct SphereObstacle
+{
+    glm::vec3 center;
+    float radius;
+
+    float distance(const glm::vec3 &p) const { return glm::length(p - center) - radius; }
+};
+
+// 軸に沿った直方体
+struct BoxObstacle
+{
+    glm::vec3 center;
+    glm::vec3 halfExtent;
+
+    float distance(const glm::vec3 &p) const
+    {
+        const glm::vec3 q = glm::abs(p - center) - halfExtent;
+        return glm::length(glm::max(q, glm::vec3(0.0f))) + glm::min(glm::max(q.x, glm::max(q.y, q.z)), 0.0f);
+    }
+};
+
+// 三角形メッシュ (indices の3つずつが1つの三角形)
+// 閉じていて向きのそろったメッシュを想定する。内外は一般化ワインディング数で決めるので、小さな穴があってもよい
+struct TriangleMesh
+{
+    std::vector<glm::vec3> vertices;
+    std::vector<unsigned int> indices;
+
+    std::size_t triangleCount() const { return indices.size() / 3; }
+    // 三角形 t の頂点
+    const glm::vec3 &vertex(std::size_t t, int corner) const { return vertices[indices[3 * t + corner]]; }
+
+    float distance(const glm::vec3 &p) const;
+    // p から最も近い三角形上の点までの距離 (符号なし)
+    float unsignedDistance(const glm::vec3 &p) const;
+    // p を囲む回数 (内側なら 1、外側なら 0 に近い)
+    float windingNumber(const glm::vec3 &p) const;
+
+    // Wavefront OBJ の頂点 (v) と面 (f) を読み込む (多角形の面は扇形に三角形に分ける。法線や UV は読み飛ばす)
+    // 読めなかったら false を返し、mesh は変えない
+    bool loadObj(const std::string &path);
+    // 全頂点に scale を掛けてから offset だけずらす
+    void transform(float scale, const glm::vec3 &offset);
+    // 中心 center、半径 radius の球を、経度 sectors × 緯度 stacks の三角形で近似した閉じたメッシュ (外向き)
+    static TriangleMesh sphere(const glm::vec3 &center, float radius, int sectors, int stacks);
+};
+
+// シーンの障害物の一式 (DistanceField::bake に渡す)
+struct ObstacleSet
+{
+    std::vector<SphereObstacle> spheres;
+    std::vector<BoxObstacle> boxes;
+    std::vector<TriangleMesh> meshes;
+
+    bool empty() const { return spheres.empty() && boxes.empty() && meshes.empty(); }
+    // p から障害物までの符号付き距離 (障害物がなければ非常に大きな値)
+    float distance(const glm::vec3 &p) const;
+};
+
+#endif
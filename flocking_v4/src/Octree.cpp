@@ -0,0 +1,157 @@
+#include "Octree.h"
+#include "Parallel.h"
+#include "SpaceFillingCurve.h"
+
+#include <algorithm>
+
+Octree::Octree(float cubeSize, float searchRadius)
+    : cubeSize(cubeSize), searchRadiusSq(searchRadius * searchRadius), minLeafExtent(2.0f * searchRadius)
+{
+}
+
+// Morton コードの計算とコピーのループの区間の大きさ
+static const std::size_t BUILD_GRAIN = 4096;
+
+void Octree::build(const FlockState &state)
+{
+    build(state, 0, state.size());
+}
+
+void Octree::build(const FlockState &state, std::size_t begin, std::size_t end)
+{
+    const int first = static_cast<int>(begin);
+    const int n = static_cast<int>(end - begin);
+
+    // 1. Morton コードを求める
+    keys.resize(n);
+    keysScratch.resize(n);
+    parallel::forRange(n, BUILD_GRAIN, [&](std::size_t i0, std::size_t i1)
+                       {
+                           for (int i = static_cast<int>(i0); i < static_cast<int>(i1); ++i)
+                           {
+                               const std::uint32_t code = mortonCode(state.position(first + i), cubeSize);
+                               keys[i] = (static_cast<std::uint64_t>(code) << 32) | static_cast<std::uint32_t>(i);
+                           } });
+
+    // 2. コード (30 ビット) を 10 ビットずつ 3 回の基数ソートで並べる
+    //    安定なソートなので、同じコードの個体は元の並び順のまま
+    for (int shift = 32; shift < 62; shift += 10)
+    {
+        std::vector<int> bucketStart(1024 + 1, 0);
+        for (int i = 0; i < n; ++i)
+        {
+            bucketStart[((keys[i] >> shift) & 0x3ff) + 1]++;
+        }
+        for (int b = 0; b < 1024; ++b)
+        {
+            bucketStart[b + 1] += bucketStart[b];
+        }
+        for (int i = 0; i < n; ++i)
+        {
+            keysScratch[bucketStart[(keys[i] >> shift) & 0x3ff]++] = keys[i];
+        }
+        keys.swap(keysScratch);
+    }
+
+    // 3. 近傍ループで連続アクセスできるよう、位置・向き・種族も Morton 順にコピーする
+    sortedCodes.resize(n);
+    sortedIndices.resize(n);
+    sortedPosX.resize(n);
+    sortedPosY.resize(n);
+    sortedPosZ.resize(n);
+    sortedDirX.resize(n);
+    sortedDirY.resize(n);
+    sortedDirZ.resize(n);
+    sortedSpecies.resize(n);
+    parallel::forRange(n, BUILD_GRAIN, [&](std::size_t k0, std::size_t k1)
+                       {
+                           for (int k = static_cast<int>(k0); k < static_cast<int>(k1); ++k)
+                           {
+                               const int src = first + static_cast<int>(keys[k] & 0xffffffffu);
+                               sortedCodes[k] = static_cast<std::uint32_t>(keys[k] >> 32);
+                               sortedIndices[k] = src;
+                               sortedPosX[k] = state.posX[src];
+                               sortedPosY[k] = state.posY[src];
+                               sortedPosZ[k] = state.posZ[src];
+                               sortedDirX[k] = state.dirX[src];
+                               sortedDirY[k] = state.dirY[src];
+                               sortedDirZ[k] = state.dirZ[src];
+                               sortedSpecies[k] = state.speciesID[src];
+                           } });
+
+    // 4. 根から順に分割してノードを作る
+    nodes.clear();
+    leaves = 0;
+    depth = 0;
+    if (n == 0)
+        return;
+    nodes.emplace_back();
+    buildNode(0, 0, n, 0);
+}
+
+void Octree::buildNode(int index, int begin, int end, int level)
+{
+    // 中の個体にぴったり合わせた境界箱
+    glm::vec3 lo(sortedPosX[begin], sortedPosY[begin], sortedPosZ[begin]);
+    glm::vec3 hi = lo;
+    for (int k = begin + 1; k < end; ++k)
+    {
+        const glm::vec3 p(sortedPosX[k], sortedPosY[k], sortedPosZ[k]);
+        lo = glm::min(lo, p);
+        hi = glm::max(hi, p);
+    }
+    const glm::vec3 extent = hi - lo;
+
+    Node node;
+    node.minX = lo.x;
+    node.minY = lo.y;
+    node.minZ = lo.z;
+    node.maxX = hi.x;
+    node.maxY = hi.y;
+    node.maxZ = hi.z;
+    node.begin = begin;
+    node.end = end;
+    depth = std::max(depth, level);
+
+    const bool smallEnough = end - begin <= LEAF_SIZE ||
+                             std::max(extent.x, std::max(extent.y, extent.z)) <= minLeafExtent;
+    if (smallEnough || level == MAX_DEPTH)
+    {
+        nodes[index] = node;
+        leaves++;
+        return;
+    }
+
+    // Morton コードの上から level 番目の 3 ビットで 8 つの子に分ける (空の子は作らない)
+    const int shift = 3 * (MAX_DEPTH - 1 - level);
+    int childBegin[9];
+    childBegin[0] = begin;
+    for (std::uint32_t octant = 1; octant < 8; ++octant)
+    {
+        childBegin[octant] = static_cast<int>(
+            std::partition_point(sortedCodes.begin() + childBegin[octant - 1], sortedCodes.begin() + end,
+                                 [&](std::uint32_t code)
+                                 { return ((code >> shift) & 7u) < octant; }) -
+            sortedCodes.begin());
+    }
+    childBegin[8] = end;
+
+    node.firstChild = static_cast<int>(nodes.size());
+    for (int octant = 0; octant < 8; ++octant)
+    {
+        if (childBegin[octant] < childBegin[octant + 1])
+            node.childCount++;
+    }
+    nodes[index] = node;
+    nodes.resize(nodes.size() + node.childCount);
+
+    // 子ノードは nodes の再確保で動くので、インデックスで指す
+    int child = node.firstChild;
+    for (int octant = 0; octant < 8; ++octant)
+    {
+        if (childBegin[octant] < childBegin[octant + 1])
+        {
+            buildNode(child++, childBegin[octant], childBegin[octant + 1], level + 1);
+        }
+    }
+}
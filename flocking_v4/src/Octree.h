@@ -0,0 +1,121 @@
+#ifndef OCTREE_H
+#define OCTREE_H
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "FlockKernel.h"
+#include "FlockState.h"
+
+// 八分木による近傍探索
+// 個体を Morton コード順に並べると、八分木の各ノードに入る個体は並べた配列上の連続した区間になる。
+// ノードは中の個体にぴったり合わせた境界箱を持つので、群れが少数の塊に集まって
+// 箱の大部分が空いているときでも、空の領域にメモリも探索時間も使わない。
+// 葉の大きさは密度に合わせて決める: 個体数が LEAF_SIZE 以下になるか、境界箱の一辺が探索半径の
+// 2倍 (探索する球の直径) 以下になったら、それ以上分けても候補がほとんど減らないので分割をやめる。
+// 密集した塊では個体の多い葉、まばらな所では個体の少ない葉になる。
+class Octree
+{
+public:
+    Octree(float cubeSize, float searchRadius);
+
+    // state の位置から木を作り直す
+    void build(const FlockState &state);
+    // インデックス [begin, end) の個体だけで木を作る (種族ごとの木用)
+    void build(const FlockState &state, std::size_t begin, std::size_t end);
+
+    // pos から探索半径以内に境界箱がかかる葉を、セル順に並べた配列 (sortedArrays()) 上の区間 [begin, end) として visit に渡す
+    // 配列上で隣り合う葉はまとめて1つの区間にする
+    template <typename RangeVisitor>
+    void forEachNeighborRange(const glm::vec3 &pos, RangeVisitor &&visit) const
+    {
+        if (nodes.empty())
+            return;
+
+        int stack[MAX_DEPTH * 8 + 8];
+        int top = 0;
+        stack[top++] = 0;
+        int pendingBegin = 0;
+        int pendingEnd = 0;
+        while (top > 0)
+        {
+            const Node &node = nodes[stack[--top]];
+            // 境界箱までの距離の二乗
+            float dx = glm::max(glm::max(node.minX - pos.x, pos.x - node.maxX), 0.0f);
+            float dy = glm::max(glm::max(node.minY - pos.y, pos.y - node.maxY), 0.0f);
+            float dz = glm::max(glm::max(node.minZ - pos.z, pos.z - node.maxZ), 0.0f);
+            if (dx * dx + dy * dy + dz * dz >= searchRadiusSq)
+                continue;
+
+            if (node.childCount == 0)
+            {
+                if (node.begin != pendingEnd)
+                {
+                    if (pendingBegin < pendingEnd)
+                        visit(pendingBegin, pendingEnd);
+                    pendingBegin = node.begin;
+                }
+                pendingEnd = node.end;
+                continue;
+            }
+            // 配列の順 (Morton 順) に取り出せるよう、逆順に積む
+            for (int c = node.childCount - 1; c >= 0; --c)
+            {
+                stack[top++] = node.firstChild + c;
+            }
+        }
+        if (pendingBegin < pendingEnd)
+            visit(pendingBegin, pendingEnd);
+    }
+
+    // Morton 順に並べた位置・向き・種族 (forEachNeighborRange の区間はこの配列上の位置)
+    NeighborArrays sortedArrays() const
+    {
+        return NeighborArrays{sortedPosX.data(), sortedPosY.data(), sortedPosZ.data(),
+                              sortedDirX.data(), sortedDirY.data(), sortedDirZ.data(),
+                              sortedSpecies.data()};
+    }
+
+    // Morton 順に並べた個体のインデックス
+    const std::vector<int> &getSortedIndices() const { return sortedIndices; }
+
+    std::size_t nodeCount() const { return nodes.size(); }
+    std::size_t leafCount() const { return leaves; }
+    int getDepth() const { return depth; }
+
+    static const int LEAF_SIZE = 64;
+    static const int MAX_DEPTH = 10; // Morton コードは各軸 10 ビット
+
+private:
+    struct Node
+    {
+        float minX, minY, minZ;
+        float maxX, maxY, maxZ;
+        int begin, end;     // 並べた配列上の区間
+        int firstChild = 0; // 子ノードは nodes 上に連続して置く
+        int childCount = 0; // 0 なら葉
+    };
+
+    // [begin, end) を受け持つノードを nodes[index] に作り、必要なら子を作る
+    void buildNode(int index, int begin, int end, int level);
+
+    float cubeSize;
+    float searchRadiusSq;
+    float minLeafExtent;
+
+    std::vector<Node> nodes;
+    std::size_t leaves = 0;
+    int depth = 0;
+
+    std::vector<std::uint64_t> keys, keysScratch; // (Morton コード << 32) | 区間内の番号
+    std::vector<std::uint32_t> sortedCodes;
+    std::vector<int> sortedIndices;
+
+    AlignedArray<float> sortedPosX, sortedPosY, sortedPosZ;
+    AlignedArray<float> sortedDirX, sortedDirY, sortedDirZ;
+    AlignedArray<int> sortedSpecies;
+};
+
+#endif
@@ -0,0 +1,401 @@
+#include "Parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+#if defined(FLOCKING_HAVE_STD_EXECUTION)
+#include <execution>
+#endif
+
+const char *parallelBackendName(ParallelBackend backend)
+{
+    switch (backend)
+    {
+    case ParallelBackend::OpenMP:
+        return "OpenMP";
+    case ParallelBackend::StdExecution:
+        return "std::execution";
+    case ParallelBackend::WorkStealing:
+        return "work-stealing pool";
+    }
+    return "unknown";
+}
+
+namespace
+{
+    // 組み込みのスレッドプール
+    // スレッドごとにタスクのキューを持ち、持ち主は後ろから (最後に積んだものから)、
+    // 手の空いたスレッドはほかのキューの前から横取りして実行する。
+    // run() を呼んだスレッドも、自分の仕事が終わるまでキューのタスクを実行して待つので、
+    // タスクの中から run() を入れ子に呼んでも (木の再帰的な構築など) スレッドが足りなくなることはない。
+    class WorkStealingPool
+    {
+    public:
+        // threads は呼び出し側のスレッドを含む数 (threads - 1 本のワーカーを起動する)
+        explicit WorkStealingPool(int threads);
+        ~WorkStealingPool();
+        WorkStealingPool(const WorkStealingPool &) = delete;
+        WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+        int size() const { return static_cast<int>(workers.size()) + 1; }
+        // body(i) を i = 0 .. count-1 について実行し、すべて終わってから戻る
+        void run(std::size_t count, const std::function<void(std::size_t)> &body);
+
+    private:
+        struct Job
+        {
+            const std::function<void(std::size_t)> *body;
+            std::atomic<std::size_t> remaining;
+        };
+        struct Task
+        {
+            Job *job;
+            std::size_t index;
+        };
+        // キューは横取りのときしか競合しないので、短いロックで守る
+        struct alignas(64) Queue
+        {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+        // このスレッドが積む・先に取るキュー (プールの外のスレッドは共用のキューを使う)
+        int ownQueue() const;
+        bool take(int self, Task &task);
+        static void execute(const Task &task);
+        void workerLoop(int self);
+
+        std::vector<std::unique_ptr<Queue>> queues; // ワーカーごとに1つ + プールの外のスレッド用に1つ
+        std::vector<std::thread> workers;
+        std::atomic<long> queued{0}; // キューに積まれているタスクの数 (ワーカーを寝かせるかの判断用)
+        std::mutex sleepMutex;
+        std::condition_variable wake;
+        bool stopping = false;
+    };
+
+    thread_local const WorkStealingPool *currentPool = nullptr;
+    thread_local int currentWorker = -1;
+
+    WorkStealingPool::WorkStealingPool(int threads)
+    {
+        const int workerCount = std::max(threads, 1) - 1;
+        for (int i = 0; i <= workerCount; ++i)
+        {
+            queues.push_back(std::make_unique<Queue>());
+        }
+        for (int i = 0; i < workerCount; ++i)
+        {
+            workers.emplace_back(&WorkStealingPool::workerLoop, this, i);
+        }
+    }
+
+    WorkStealingPool::~WorkStealingPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread &worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    int WorkStealingPool::ownQueue() const
+    {
+        return currentPool == this ? currentWorker : static_cast<int>(workers.size());
+    }
+
+    void WorkStealingPool::run(std::size_t count, const std::function<void(std::size_t)> &body)
+    {
+        if (count == 0)
+            return;
+        if (count == 1 || workers.empty())
+        {
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                body(i);
+            }
+            return;
+        }
+
+        Job job;
+        job.body = &body;
+        job.remaining.store(count, std::memory_order_relaxed);
+        const int self = ownQueue();
+        {
+            // 持ち主は後ろから取るので、逆順に積んで 0 から順に実行されるようにする
+            Queue &queue = *queues[self];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            for (std::size_t i = count; i-- > 0;)
+            {
+                queue.tasks.push_back(Task{&job, i});
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            queued.fetch_add(static_cast<long>(count), std::memory_order_relaxed);
+        }
+        wake.notify_all();
+
+        // 自分の仕事が終わるまで、自分のキュー・ほかのキューのタスクを実行して待つ
+        while (job.remaining.load(std::memory_order_acquire) > 0)
+        {
+            Task task;
+            if (take(self, task))
+                execute(task);
+            else
+                std::this_thread::yield();
+        }
+    }
+
+    bool WorkStealingPool::take(int self, Task &task)
+    {
+        if (queued.load(std::memory_order_relaxed) <= 0)
+            return false;
+        {
+            Queue &own = *queues[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty())
+            {
+                task = own.tasks.back();
+                own.tasks.pop_back();
+                queued.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        // 自分のキューが空なら、隣から順にほかのキューの前 (古い方) から取る
+        const int queueCount = static_cast<int>(queues.size());
+        for (int k = 1; k < queueCount; ++k)
+        {
+            Queue &victim = *queues[(self + k) % queueCount];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty())
+            {
+                task = victim.tasks.front();
+                victim.tasks.pop_front();
+                queued.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void WorkStealingPool::execute(const Task &task)
+    {
+        (*task.job->body)(task.index);
+        // release: 結果の書き込みを、run() で待っているスレッドに見えるようにする
+        // (これより後に job を触ってはいけない。待っているスレッドが job を破棄しうる)
+        task.job->remaining.fetch_sub(1, std::memory_order_release);
+    }
+
+    void WorkStealingPool::workerLoop(int self)
+    {
+        currentPool = this;
+        currentWorker = self;
+        while (true)
+        {
+            Task task;
+            if (take(self, task))
+            {
+                execute(task);
+                continue;
+            }
+            // 並列ループは1ステップの中で何度も続くので、すぐには寝ずに少しだけ次の仕事を待つ
+            for (int spin = 0; spin < 64 && queued.load(std::memory_order_relaxed) <= 0; ++spin)
+            {
+                std::this_thread::yield();
+            }
+            if (queued.load(std::memory_order_relaxed) > 0)
+                continue;
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wake.wait(lock, [&]
+                      { return stopping || queued.load(std::memory_order_relaxed) > 0; });
+            if (stopping)
+                return;
+        }
+    }
+
+    int initialThreadCount()
+    {
+#if defined(_OPENMP)
+        return omp_get_max_threads();
+#else
+        return std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+#endif
+    }
+
+    // ほかの翻訳単位の静的な初期化から呼ばれても使えるよう、定数で初期化できる値だけを持つ
+#if defined(_OPENMP)
+    std::atomic<ParallelBackend> currentBackend{ParallelBackend::OpenMP};
+#else
+    std::atomic<ParallelBackend> currentBackend{ParallelBackend::WorkStealing};
+#endif
+    std::atomic<int> currentThreadCount{0}; // 0 なら initialThreadCount()
+
+    std::mutex poolMutex;
+    std::unique_ptr<WorkStealingPool> workStealingPool;
+
+    WorkStealingPool &pool()
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        const int threads = parallel::threadCount();
+        if (!workStealingPool || workStealingPool->size() != threads)
+            workStealingPool = std::make_unique<WorkStealingPool>(threads);
+        return *workStealingPool;
+    }
+
+#if defined(FLOCKING_HAVE_STD_EXECUTION)
+    void forEachStd(std::size_t count, const std::function<void(std::size_t)> &body)
+    {
+        std::vector<std::size_t> indices(count);
+        std::iota(indices.begin(), indices.end(), std::size_t(0));
+        std::for_each(std::execution::par, indices.begin(), indices.end(), [&](std::size_t i)
+                      { body(i); });
+    }
+#endif
+}
+
+bool parallel::available(ParallelBackend backend)
+{
+    switch (backend)
+    {
+    case ParallelBackend::OpenMP:
+#if defined(_OPENMP)
+        return true;
+#else
+        return false;
+#endif
+    case ParallelBackend::StdExecution:
+#if defined(FLOCKING_HAVE_STD_EXECUTION)
+        return true;
+#else
+        return false;
+#endif
+    case ParallelBackend::WorkStealing:
+        return true;
+    }
+    return false;
+}
+
+ParallelBackend parallel::defaultBackend()
+{
+    return available(ParallelBackend::OpenMP) ? ParallelBackend::OpenMP : ParallelBackend::WorkStealing;
+}
+
+void parallel::setBackend(ParallelBackend backend)
+{
+    currentBackend = available(backend) ? backend : defaultBackend();
+}
+
+ParallelBackend parallel::backend()
+{
+    return currentBackend;
+}
+
+void parallel::setThreadCount(int threads)
+{
+    currentThreadCount = std::max(threads, 1);
+}
+
+int parallel::threadCount()
+{
+    const int threads = currentThreadCount;
+    return threads > 0 ? threads : initialThreadCount();
+}
+
+void parallel::forEach(std::size_t count, const std::function<void(std::size_t)> &body)
+{
+    if (count == 0)
+        return;
+    if (count == 1)
+    {
+        body(0);
+        return;
+    }
+    switch (currentBackend.load())
+    {
+    case ParallelBackend::OpenMP:
+#if defined(_OPENMP)
+    {
+        // すでに並列領域の中 (入れ子) なら、OpenMP の既定どおり1スレッドで実行される
+        const long n = static_cast<long>(count);
+#pragma omp parallel for schedule(dynamic, 1) num_threads(threadCount())
+        for (long i = 0; i < n; ++i)
+        {
+            body(static_cast<std::size_t>(i));
+        }
+        return;
+    }
+#else
+        break;
+#endif
+    case ParallelBackend::StdExecution:
+#if defined(FLOCKING_HAVE_STD_EXECUTION)
+        forEachStd(count, body);
+        return;
+#else
+        break;
+#endif
+    case ParallelBackend::WorkStealing:
+        break;
+    }
+    pool().run(count, body);
+}
+
+void parallel::forRange(std::size_t count, std::size_t grain, const std::function<void(std::size_t, std::size_t)> &body)
+{
+    grain = std::max<std::size_t>(grain, 1);
+    const std::size_t chunkCount = (count + grain - 1) / grain;
+    if (chunkCount <= 1)
+    {
+        if (count > 0)
+            body(0, count);
+        return;
+    }
+    forEach(chunkCount, [&](std::size_t chunk)
+            {
+                const std::size_t begin = chunk * grain;
+                body(begin, std::min(begin + grain, count)); });
+}
+
+void parallel::invoke(const std::function<void()> &a, const std::function<void()> &b)
+{
+#if defined(_OPENMP)
+    if (currentBackend.load() == ParallelBackend::OpenMP)
+    {
+        // 入れ子の parallel for は1スレッドになってしまうので、タスクで分ける
+        auto both = [&]
+        {
+#pragma omp task default(shared)
+            a();
+            b();
+#pragma omp taskwait
+        };
+        if (omp_in_parallel())
+        {
+            both();
+        }
+        else
+        {
+#pragma omp parallel num_threads(threadCount())
+#pragma omp single
+            both();
+        }
+        return;
+    }
+#endif
+    forEach(2, [&](std::size_t i)
+            { i == 0 ? a() : b(); });
+}
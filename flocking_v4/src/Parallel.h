@@ -0,0 +1,50 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <cstddef>
+#include <functional>
+
+// 並列ループをどの仕組みで実行するか
+// 更新・グリッドの構築・描画の準備などの並列ループは、すべて parallel:: の関数を通して実行する。
+// OpenMP はビルドに OpenMP があるとき、StdExecution は並列アルゴリズムが使えるとき (libstdc++ なら TBB) だけ使える。
+// WorkStealing は標準ライブラリのスレッドだけで動くので、どの環境でも使える。
+enum class ParallelBackend
+{
+    OpenMP,       // #pragma omp parallel for / task
+    StdExecution, // std::for_each(std::execution::par, ...)
+    WorkStealing, // 組み込みのスレッドプール (スレッドごとのキューと、空いたスレッドによる横取り)
+};
+
+const char *parallelBackendName(ParallelBackend backend);
+
+namespace parallel
+{
+    // このビルドで使えるか
+    bool available(ParallelBackend backend);
+    // 使えるもののうち既定のもの (OpenMP があれば OpenMP、なければ WorkStealing)
+    ParallelBackend defaultBackend();
+
+    // 以降の並列ループが使うバックエンド (プロセス全体で1つ。使えないものを渡すと defaultBackend() になる)
+    // 実行中の並列ループは、始めたときのバックエンドのまま最後まで実行される
+    void setBackend(ParallelBackend backend);
+    ParallelBackend backend();
+
+    // 並列ループに使うスレッド数 (呼び出したスレッドも含む)
+    // StdExecution は実装がスレッド数を決めるので、この値は使われない。
+    // WorkStealing のスレッドは次の並列ループで作り直すので、どのスレッドでも並列ループを実行していないときに変える
+    void setThreadCount(int threads);
+    int threadCount();
+
+    // body(i) を i = 0 .. count-1 について並列に呼び、すべて終わってから戻る
+    // 呼ぶ順番やスレッドの割り当ては決まっていないので、結果は i ごとに独立でなければならない
+    void forEach(std::size_t count, const std::function<void(std::size_t)> &body);
+
+    // 0 .. count-1 を grain 個ずつの区間に分け、各区間について body(begin, end) を並列に呼ぶ
+    // 区間の切れ目は grain だけで決まり、スレッド数やバックエンドによらない (区間ごとの途中結果を持つときに使える)
+    void forRange(std::size_t count, std::size_t grain, const std::function<void(std::size_t, std::size_t)> &body);
+
+    // a() と b() を並列に実行する。入れ子にしてよい (木を再帰的に組むときなど)
+    void invoke(const std::function<void()> &a, const std::function<void()> &b);
+}
+
+#endif
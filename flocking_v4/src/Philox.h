@@ -0,0 +1,83 @@
+#ifndef PHILOX_H
+#define PHILOX_H
+
+#include <cstdint>
+
+// 乱数の種を指定しなかったときの値 (ベンチマークはこの値で毎回同じ群れを作る)
+constexpr std::uint64_t DEFAULT_RANDOM_SEED = 0x5eed2024f10c4ull;
+
+// 乱数を何に使うか (同じ個体・同じフレームでも、用途ごとに別の系列になる)
+enum class RandomStream : std::uint32_t
+{
+    Spawn = 0,         // 生成時の位置と向き
+    SpawnPosition = 1, // 一様でない分布で生成するときの位置 (SpawnDistribution)
+};
+
+// カウンタ方式の乱数 Philox4x32-10 (Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3", SC'11)
+// 状態を順に進める mt19937 と違い、(種, 個体の ID, フレーム, 用途) からその場で値を計算するので、
+// どのスレッドでどの順番に引いても、同じ種なら同じ値になる (スレッド数やバックエンドによらない)。
+// 生成器は小さい値なので、使う場所でその都度作る。共有しないのでロックもいらない。
+class Philox
+{
+public:
+    // counter = {boidID, frame, stream, ブロック番号}, key = 種の下位・上位 32 ビット
+    Philox(std::uint64_t seed, std::uint32_t boidID, std::uint32_t frame, RandomStream stream)
+        : key{static_cast<std::uint32_t>(seed), static_cast<std::uint32_t>(seed >> 32)},
+          counter{boidID, frame, static_cast<std::uint32_t>(stream), 0}
+    {
+    }
+
+    // 次の 32 ビットの乱数 (1ブロックで4つ作り、使い切ったら次のブロックを計算する)
+    std::uint32_t next()
+    {
+        if (used == 4)
+        {
+            block(counter, key, buffer);
+            counter[3]++;
+            used = 0;
+        }
+        return buffer[used++];
+    }
+
+    // [0, 1) の一様な乱数 (上位 24 ビットを使うので、float で表せる値だけになり 1 にはならない)
+    float uniform() { return static_cast<float>(next() >> 8) * (1.0f / 16777216.0f); }
+    // [lo, hi) の一様な乱数
+    float uniform(float lo, float hi) { return lo + (hi - lo) * uniform(); }
+
+    // Philox4x32-10 の1ブロック (counter と key から4つの値を作る)
+    static void block(const std::uint32_t counter[4], const std::uint32_t key[2], std::uint32_t out[4])
+    {
+        std::uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+        std::uint32_t k0 = key[0], k1 = key[1];
+        for (int round = 0; round < 10; ++round)
+        {
+            const std::uint64_t p0 = static_cast<std::uint64_t>(MULTIPLIER_0) * c0;
+            const std::uint64_t p1 = static_cast<std::uint64_t>(MULTIPLIER_1) * c2;
+            const std::uint32_t hi0 = static_cast<std::uint32_t>(p0 >> 32), lo0 = static_cast<std::uint32_t>(p0);
+            const std::uint32_t hi1 = static_cast<std::uint32_t>(p1 >> 32), lo1 = static_cast<std::uint32_t>(p1);
+            c0 = hi1 ^ c1 ^ k0;
+            c1 = lo1;
+            c2 = hi0 ^ c3 ^ k1;
+            c3 = lo0;
+            k0 += WEYL_0;
+            k1 += WEYL_1;
+        }
+        out[0] = c0;
+        out[1] = c1;
+        out[2] = c2;
+        out[3] = c3;
+    }
+
+private:
+    static constexpr std::uint32_t MULTIPLIER_0 = 0xD2511F53u;
+    static constexpr std::uint32_t MULTIPLIER_1 = 0xCD9E8D57u;
+    static constexpr std::uint32_t WEYL_0 = 0x9E3779B9u;
+    static constexpr std::uint32_t WEYL_1 = 0xBB67AE85u;
+
+    std::uint32_t key[2];
+    std::uint32_t counter[4];
+    std::uint32_t buffer[4] = {};
+    int used = 4;
+};
+
+#endif
@@ -0,0 +1,95 @@
+#include "Population.h"
+#include "Creature.h"
+#include "Parallel.h"
+#include "Philox.h"
+
+#include <glm/gtc/constants.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+const char *spawnDistributionName(SpawnDistribution distribution)
+{
+    switch (distribution)
+    {
+    case SpawnDistribution::Uniform:
+        return "uniform";
+    case SpawnDistribution::Sphere:
+        return "sphere";
+    case SpawnDistribution::Gaussian:
+        return "gaussian";
+    }
+    return "unknown";
+}
+
+namespace
+{
+    // 並列に埋める単位
+    const std::size_t FILL_GRAIN = 4096;
+
+    // Uniform 以外の分布の位置 (向きとは別の系列から引く)
+    glm::vec3 distributedPosition(const SpawnGroup &group, std::uint64_t seed, int boidID)
+    {
+        Philox random(seed, static_cast<std::uint32_t>(boidID), 0, RandomStream::SpawnPosition);
+        if (group.distribution == SpawnDistribution::Sphere)
+        {
+            // 球面上の一様な向きに、体積が一様になるよう半径を立方根で取る
+            const float z = random.uniform(-1.0f, 1.0f);
+            const float theta = random.uniform(-1.0f, 1.0f) * glm::pi<float>();
+            const float r = group.extent * std::cbrt(random.uniform());
+            const float s = std::sqrt(std::max(1.0f - z * z, 0.0f));
+            return group.center + r * glm::vec3(s * std::cos(theta), z, s * std::sin(theta));
+        }
+        // Box-Muller 法で正規分布の値を3つ作る (log(0) を避けるため 1 - u を使う)
+        glm::vec3 offset;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            const float u = 1.0f - random.uniform();
+            const float v = random.uniform();
+            offset[axis] = std::sqrt(-2.0f * std::log(u)) * std::cos(2.0f * glm::pi<float>() * v);
+        }
+        return group.center + group.extent * offset;
+    }
+}
+
+PopulationTimings spawnPopulation(FlockState &state, float cubeSize, const std::vector<SpawnGroup> &groups,
+                                  std::uint64_t seed)
+{
+    PopulationTimings timings;
+    auto start = std::chrono::steady_clock::now();
+
+    // グループごとの開始位置 (groupBegin[g] .. groupBegin[g + 1] がグループ g の区間)
+    std::vector<std::size_t> groupBegin(groups.size() + 1, 0);
+    for (std::size_t g = 0; g < groups.size(); ++g)
+    {
+        groupBegin[g + 1] = groupBegin[g] + static_cast<std::size_t>(std::max(groups[g].count, 0));
+    }
+    const std::size_t total = groupBegin.back();
+    const std::size_t first = state.grow(total);
+    auto filled = std::chrono::steady_clock::now();
+    timings.allocateMs = std::chrono::duration<double, std::milli>(filled - start).count();
+
+    parallel::forRange(total, FILL_GRAIN, [&](std::size_t begin, std::size_t end)
+                       {
+                           std::size_t g = std::upper_bound(groupBegin.begin(), groupBegin.end(), begin) - groupBegin.begin() - 1;
+                           for (std::size_t k = begin; k < end; ++k)
+                           {
+                               while (k >= groupBegin[g + 1])
+                                   g++;
+                               const SpawnGroup &group = groups[g];
+                               const std::size_t i = first + k;
+                               const int id = state.boidID[i];
+                               glm::vec3 position;
+                               glm::vec3 direction;
+                               Creature::randomPlacement(seed, id, cubeSize, position, direction);
+                               if (group.distribution != SpawnDistribution::Uniform)
+                                   position = glm::clamp(distributedPosition(group, seed, id), glm::vec3(-cubeSize), glm::vec3(cubeSize));
+                               state.setPosition(i, position);
+                               state.setDirection(i, direction);
+                               state.speed[i] = Creature::speciesSpeed(group.speciesID);
+                               state.maxTurn[i] = DEFAULT_MAX_TURN;
+                               state.speciesID[i] = group.speciesID;
+                           } });
+    timings.fillMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - filled).count();
+    return timings;
+}
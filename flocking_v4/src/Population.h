@@ -0,0 +1,45 @@
+#ifndef POPULATION_H
+#define POPULATION_H
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "FlockState.h"
+
+// 初期配置の位置の分布 (向きはどれも球面上で一様)
+enum class SpawnDistribution
+{
+    Uniform,  // 箱全体に一様 (Creature::spawn と同じ)
+    Sphere,   // center を中心とする半径 extent の球の中に一様
+    Gaussian, // center を中心とする標準偏差 extent の正規分布
+};
+
+const char *spawnDistributionName(SpawnDistribution distribution);
+
+// ある種族を何体、どう配置するか
+struct SpawnGroup
+{
+    int speciesID = 0;
+    int count = 0;
+    SpawnDistribution distribution = SpawnDistribution::Uniform;
+    glm::vec3 center = glm::vec3(0.0f);
+    float extent = 1.0f;
+};
+
+// spawnPopulation の所要時間 (起動時のログ用)
+struct PopulationTimings
+{
+    double allocateMs = 0.0; // 配列をまとめて確保する時間
+    double fillMs = 0.0;     // 位置・向きなどを並列に埋める時間
+};
+
+// groups の個体を state の末尾にまとめて追加する (groups の順に、ID も連番で振る)
+// 配列は一度に確保し、各個体の値は parallel::forRange で並列に埋める。
+// 乱数は (seed, 個体の ID) から引くので、スレッド数によらず同じ群れになり、
+// Uniform のグループは同じ順に Creature::spawn したものとビット単位で一致する。
+// 箱の外に出る位置は箱の中に収める。この後 Simulation::finalizePopulation() を呼ぶこと
+PopulationTimings spawnPopulation(FlockState &state, float cubeSize, const std::vector<SpawnGroup> &groups,
+                                  std::uint64_t seed);
+
+#endif
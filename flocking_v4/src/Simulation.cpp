@@ -0,0 +1,560 @@
+#include "Simulation.h"
+#include "Creature.h"
+#include "Parallel.h"
+#include "UpdatePolicy.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+const char *neighborBackendName(NeighborBackend backend)
+{
+    switch (backend)
+    {
+    case NeighborBackend::BruteForce:
+        return "brute force";
+    case NeighborBackend::Grid:
+        return "spatial grid";
+    case NeighborBackend::Octree:
+        return "octree";
+    }
+    return "unknown";
+}
+
+const char *boundaryModeName(BoundaryMode boundary)
+{
+    switch (boundary)
+    {
+    case BoundaryMode::Reflect:
+        return "reflect";
+    case BoundaryMode::Wrap:
+        return "wrap";
+    case BoundaryMode::Open:
+        return "open";
+    }
+    return "unknown";
+}
+
+const char *lodTierName(LodTier tier)
+{
+    switch (tier)
+    {
+    case LodTier::Full:
+        return "full";
+    case LodTier::Reduced:
+        return "reduced";
+    case LodTier::Minimal:
+        return "minimal";
+    }
+    return "unknown";
+}
+
+Simulation::Simulation(float cubeSize)
+    : cubeSize(cubeSize), sharedGrid(cubeSize, FLOCK_RADIUS), sharedOctree(cubeSize, FLOCK_RADIUS)
+{
+}
+
+void Simulation::finalizePopulation()
+{
+    flock.current().sortBySpecies();
+    flock.syncNext();
+    speciesGrids.assign(flock.current().speciesCount(), SpatialGrid(cubeSize, FLOCK_RADIUS));
+    speciesOctrees.assign(flock.current().speciesCount(), Octree(cubeSize, FLOCK_RADIUS));
+    speciesKdTrees.assign(flock.current().speciesCount(), KdTree());
+    neighborList.invalidate();
+    steeringCached = false;
+}
+
+void Simulation::setTimeScale(float scale)
+{
+    const float ratio = scale / timeScale;
+    timeScale = scale;
+    FlockState &state = flock.current();
+    for (std::size_t i = 0; i < state.size(); ++i)
+    {
+        state.speed[i] *= ratio;
+        // 目標の向きとの差は1ステップごとに (1 - maxTurn) 倍になるので、ratio ステップ分で同じだけ縮むようにする
+        // (maxTurn が小さければ ratio 倍とほぼ同じで、1 を超えて目標を通り過ぎることがない)
+        state.maxTurn[i] = 1.0f - std::pow(1.0f - state.maxTurn[i], ratio);
+    }
+    flock.syncNext();
+}
+
+// 並列処理の単位。この個数ごとに操舵をまとめて行い、続けて移動・反射をベクトル化して行う
+static const std::size_t CHUNK_SIZE = 256;
+
+void Simulation::step(const std::vector<SphereCollider> &colliders)
+{
+    const FlockKernelSet &k = kernels ? *kernels : activeKernels();
+    const bool perSpecies = partitionBySpecies && flock.current().isSortedBySpecies();
+
+    // 操舵の目標をまだ持っていないとき (最初のステップ、固定小数点の更新の直後) は全個体の操舵を求め直す
+    const bool refreshAll = !steeringCached || fixedPoint;
+    activeSteeringInterval = refreshAll ? 1 : std::max(steeringInterval, 1);
+    lodActive = lod.enabled && !refreshAll;
+    // ずらさずに間引くときは、どの個体も近傍を探さないステップがあるので、近傍探索の構造も組まない
+    // (LOD を使うときは近くの個体が毎ステップ探す)
+    const bool searchNeeded = activeSteeringInterval == 1 || staggeredSteering || lodActive ||
+                              steeringStep % activeSteeringInterval == 0;
+
+    // 近傍リストを使い回せるステップでは、グリッドも組み直さない
+    listsInUse = useNeighborLists && neighborBackend == NeighborBackend::Grid && topologicalNeighbors <= 0 && !fixedPoint;
+    const bool rebuildList = searchNeeded && listsInUse && neighborList.needsRebuild(flock.current(), neighborSkin);
+
+    // 動く障害物はこのステップの位置に置いてから、全個体の更新で読む
+    lastTimings.obstacles = ObstacleUpdateTimings();
+    if (movingObstacles)
+    {
+        if (moveObstacles)
+            moveObstacles(*movingObstacles);
+        movingObstacles->update();
+        lastTimings.obstacles = movingObstacles->getLastTimings();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    collidersIndexed = useColliderGrid && !fixedPoint && static_cast<int>(colliders.size()) >= colliderGridMinCount;
+    if (collidersIndexed && !colliderGrid.builtFrom(colliders))
+    {
+        colliderGrid.build(colliders);
+    }
+    if (searchNeeded && (!listsInUse || rebuildList))
+    {
+        buildNeighborSearch(perSpecies);
+    }
+    auto gridBuilt = std::chrono::steady_clock::now();
+    if (rebuildList)
+    {
+        buildNeighborList(perSpecies);
+        neighborListRebuilds++;
+    }
+    lodStats = LodStats();
+    if (lodActive)
+    {
+        classifyLod();
+    }
+    auto built = std::chrono::steady_clock::now();
+    // グリッドで衝突判定をするときは、区間の版はコライダーなしのものを使う
+    rangeStepper = selectRangeStepper(collidersIndexed ? 0 : static_cast<int>(colliders.size()));
+    if (fixedPoint)
+    {
+        stepFixedPoint(perSpecies, colliders, k);
+    }
+    else if (perSpecies)
+    {
+        stepPerSpecies(colliders, k);
+    }
+    else
+    {
+        stepSharedGrid(colliders, k);
+    }
+    auto stepped = std::chrono::steady_clock::now();
+    lastTimings.gridBuildMs = std::chrono::duration<double, std::milli>(gridBuilt - start).count();
+    lastTimings.neighborListMs = std::chrono::duration<double, std::milli>(built - gridBuilt).count();
+    lastTimings.steeringMs = std::chrono::duration<double, std::milli>(stepped - built).count();
+    if (lodActive)
+    {
+        const int refreshed = lodStats.refreshed[0] + lodStats.refreshed[1] + lodStats.refreshed[2];
+        lodStats.savedMs = lastTimings.steeringMs * lodStats.skipped / std::max(refreshed, 1);
+    }
+
+    if (listsInUse)
+    {
+        neighborListSteps++;
+        neighborListBuildMsTotal += lastTimings.gridBuildMs + lastTimings.neighborListMs;
+    }
+
+    steeringStep++;
+    steeringCached = !fixedPoint; // 固定小数点の更新は操舵の目標を書かない
+
+    flock.swap();
+    reorderIfDue();
+}
+
+void Simulation::buildNeighborSearch(bool perSpecies)
+{
+    const FlockState &currentState = flock.current();
+    // 固定小数点の更新は、選んだ探索方法によらずグリッドを使う
+    if (topologicalNeighbors > 0 && !fixedPoint)
+    {
+        if (!perSpecies)
+        {
+            sharedKdTree.build(currentState);
+            return;
+        }
+        for (int species = 0; species < currentState.speciesCount(); ++species)
+        {
+            const SpeciesRange range = currentState.speciesRanges[species];
+            speciesKdTrees[species].build(currentState, range.begin, range.end);
+        }
+        return;
+    }
+    if (neighborBackend == NeighborBackend::Octree && !fixedPoint)
+    {
+        if (!perSpecies)
+        {
+            sharedOctree.build(currentState);
+            return;
+        }
+        for (int species = 0; species < currentState.speciesCount(); ++species)
+        {
+            const SpeciesRange range = currentState.speciesRanges[species];
+            speciesOctrees[species].build(currentState, range.begin, range.end);
+        }
+        return;
+    }
+    if (neighborBackend != NeighborBackend::Grid && !fixedPoint)
+        return;
+
+    // 近傍リストを作るときは、半径 + skin までの候補が周囲 27 セルに収まるようセルを大きくする
+    const float cellSize = listsInUse ? FLOCK_RADIUS + neighborSkin : FLOCK_RADIUS;
+    if (!perSpecies)
+    {
+        if (sharedGrid.getCellSize() != cellSize)
+            sharedGrid.setCellSize(cellSize);
+        sharedGrid.build(currentState);
+        return;
+    }
+    // 各グリッドの構築自体が並列化されているので、種族は順に組む
+    for (int species = 0; species < currentState.speciesCount(); ++species)
+    {
+        const SpeciesRange range = currentState.speciesRanges[species];
+        if (speciesGrids[species].getCellSize() != cellSize)
+            speciesGrids[species].setCellSize(cellSize);
+        speciesGrids[species].build(currentState, range.begin, range.end);
+    }
+}
+
+NeighborSource Simulation::neighborSource(bool perSpecies, int species) const
+{
+    NeighborSource source;
+    if (topologicalNeighbors > 0)
+    {
+        source.kdTree = perSpecies ? &speciesKdTrees[species] : &sharedKdTree;
+        source.nearestCount = topologicalNeighbors;
+    }
+    else if (listsInUse)
+    {
+        source.lists = &neighborList;
+    }
+    else if (neighborBackend == NeighborBackend::Grid)
+    {
+        source.grid = perSpecies ? &speciesGrids[species] : &sharedGrid;
+    }
+    else if (neighborBackend == NeighborBackend::Octree)
+    {
+        source.octree = perSpecies ? &speciesOctrees[species] : &sharedOctree;
+    }
+    return source;
+}
+
+void Simulation::buildNeighborList(bool perSpecies)
+{
+    neighborList.build(
+        flock.current(), [&](int species) -> const SpatialGrid &
+        { return perSpecies ? speciesGrids[species] : sharedGrid; },
+        FLOCK_RADIUS, neighborSkin);
+}
+
+bool Simulation::steeringDueEvery(std::size_t i, int interval, bool staggered) const
+{
+    if (interval <= 1)
+        return true;
+    // ID でずらすと、空間的に偏らずに毎ステップ 1/N ずつの個体が求め直す
+    const long phase = staggered ? flock.current().boidID[i] : 0;
+    return (steeringStep + phase) % interval == 0;
+}
+
+bool Simulation::steeringDue(std::size_t i) const
+{
+    if (!lodActive)
+        return steeringDueEvery(i, activeSteeringInterval, staggeredSteering);
+    // 遠い個体がまとめて求め直すステップが重くならないよう、LOD で間引くときは常に ID でずらす
+    return steeringDueEvery(i, std::max(activeSteeringInterval, lod.interval(lodTiers[i])), true);
+}
+
+// LOD の段階分けを並列に行うときの1区間の個体数
+static const std::size_t LOD_GRAIN = 4096;
+
+void Simulation::classifyLod()
+{
+    const FlockState &currentState = flock.current();
+    const std::size_t n = currentState.size();
+    lodTiers.resize(n);
+    std::vector<LodStats> partial((n + LOD_GRAIN - 1) / LOD_GRAIN);
+    parallel::forRange(n, LOD_GRAIN, [&](std::size_t begin, std::size_t end)
+                       {
+                           LodStats &stats = partial[begin / LOD_GRAIN];
+                           for (std::size_t i = begin; i < end; ++i)
+                           {
+                               lodTiers[i] = lod.classify(currentState.position(i));
+                               const int tier = static_cast<int>(lodTiers[i]);
+                               stats.count[tier]++;
+                               if (steeringDue(i))
+                                   stats.refreshed[tier]++;
+                               else if (steeringDueEvery(i, activeSteeringInterval, staggeredSteering))
+                                   stats.skipped++;
+                           } });
+    for (const LodStats &stats : partial)
+    {
+        for (int t = 0; t < LOD_TIER_COUNT; ++t)
+        {
+            lodStats.count[t] += stats.count[t];
+            lodStats.refreshed[t] += stats.refreshed[t];
+        }
+        lodStats.skipped += stats.skipped;
+    }
+}
+
+void Simulation::reorderIfDue()
+{
+    if (reorderInterval <= 0 || ++stepsSinceReorder < reorderInterval)
+        return;
+    stepsSinceReorder = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    flock.current().sortBySpatialOrder(cubeSize);
+    flock.syncNext(); // next の速度や種族、ID も同じ並びにそろえる
+    neighborList.invalidate(); // インデックスが変わったので作り直す
+    lastReorderMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    reorderCount++;
+}
+
+void Simulation::stepRange(std::size_t begin, std::size_t end, const NeighborSource &source,
+                           const std::vector<SphereCollider> &colliders, const FlockKernelSet &k)
+{
+    const FlockState &currentState = flock.current();
+    FlockState &nextState = flock.next();
+    NeighborSource cappedSource = source;
+    cappedSource.neighborCap = lod.minimalNeighborCap;
+    static const std::vector<SphereCollider> noColliders;
+    for (std::size_t i = begin; i < end; ++i)
+    {
+        Creature(currentState, i).update(nextState, collidersIndexed ? noColliders : colliders,
+                                         neighborCapped(i) ? cappedSource : source,
+                                         fastMath ? k.accumulateNeighborsFast : k.accumulateNeighbors, steeringDue(i));
+    }
+    if (collidersIndexed)
+        colliderGrid.collide(nextState.boidArrays(), begin, end);
+    if (obstacleField)
+        obstacleField->collide(nextState.boidArrays(), begin, end, obstacleMargin);
+    if (meshObstacles)
+        meshObstacles->avoid(nextState.boidArrays(), begin, end, lookAheadDistance);
+    if (movingObstacles)
+        movingObstacles->getBvh().avoid(nextState.boidArrays(), begin, end, lookAheadDistance);
+    integrateKernel(k, boundary)(nextState.boidArrays(), begin, end, cubeSize);
+}
+
+template <class Policy>
+void Simulation::stepRangeWith(std::size_t begin, std::size_t end, const NeighborSource &source,
+                               const std::vector<SphereCollider> &colliders, const FlockKernelSet &k)
+{
+    const FlockState &currentState = flock.current();
+    FlockState &nextState = flock.next();
+    const SphereCollider *colliderData = colliders.data();
+    const int colliderCount = static_cast<int>(colliders.size());
+    if constexpr (Policy::Math::batchedSteering)
+    {
+        steerBatched<typename Policy::Gains>(begin, end, source, k);
+    }
+    else
+    {
+        const NeighborKernel kernel = Policy::Math::neighbors(k);
+        NeighborSource cappedSource = source;
+        cappedSource.neighborCap = lod.minimalNeighborCap;
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            Creature(currentState, i)
+                .updateWith<typename Policy::Colliders, typename Policy::Gains>(
+                    nextState, colliderData, colliderCount, neighborCapped(i) ? cappedSource : source, kernel,
+                    steeringDue(i));
+        }
+    }
+    const BoidArrays boids = nextState.boidArrays();
+    Policy::Colliders::collideRange(k, boids, begin, end, colliderData, colliderCount);
+    if (collidersIndexed)
+        colliderGrid.collide(boids, begin, end);
+    if (obstacleField)
+        obstacleField->collide(boids, begin, end, obstacleMargin);
+    if (meshObstacles)
+        meshObstacles->avoid(boids, begin, end, lookAheadDistance);
+    if (movingObstacles)
+        movingObstacles->getBvh().avoid(boids, begin, end, lookAheadDistance);
+    Policy::Boundary::integrate(k)(boids, begin, end, cubeSize);
+}
+
+namespace
+{
+    // steerBatched で集める、区間の近傍の合計と重み (SteeringArrays の元)
+    struct SteeringBatch
+    {
+        AlignedArray<float> sepX, sepY, sepZ;
+        AlignedArray<float> alnX, alnY, alnZ;
+        AlignedArray<float> cohX, cohY, cohZ;
+        AlignedArray<int> count;
+        AlignedArray<float> gainSeparation, gainAlignment, gainCohesion;
+
+        void resize(std::size_t n)
+        {
+            for (AlignedArray<float> *v : {&sepX, &sepY, &sepZ, &alnX, &alnY, &alnZ, &cohX, &cohY, &cohZ,
+                                          &gainSeparation, &gainAlignment, &gainCohesion})
+            {
+                v->resize(n);
+            }
+            count.resize(n);
+        }
+    };
+}
+
+template <class Gains>
+void Simulation::steerBatched(std::size_t begin, std::size_t end, const NeighborSource &source, const FlockKernelSet &k)
+{
+    const FlockState &currentState = flock.current();
+    FlockState &nextState = flock.next();
+
+    // 区間はスレッドごとに1つずつ処理するので、作業用の配列もスレッドごとに持って使い回す
+    static thread_local SteeringBatch batch;
+    const std::size_t n = end - begin;
+    batch.resize(n);
+    NeighborSource cappedSource = source;
+    cappedSource.neighborCap = lod.minimalNeighborCap;
+    bool anyCached = false; // 区間に今回は操舵を求め直さない個体がいるか
+    for (std::size_t j = 0; j < n; ++j)
+    {
+        const std::size_t i = begin + j;
+        // 求め直さない個体は近傍がいないものとして steerFast に渡し (向きはそのまま)、後で前回の目標へ曲げる
+        const bool due = steeringDue(i);
+        anyCached = anyCached || !due;
+        const NeighborSums sums = due ? Creature(currentState, i)
+                                            .sumNeighbors(currentState.position(i),
+                                                          neighborCapped(i) ? cappedSource : source,
+                                                          k.accumulateNeighborsFast)
+                                      : NeighborSums();
+        batch.sepX[j] = sums.separation.x;
+        batch.sepY[j] = sums.separation.y;
+        batch.sepZ[j] = sums.separation.z;
+        batch.alnX[j] = sums.alignment.x;
+        batch.alnY[j] = sums.alignment.y;
+        batch.alnZ[j] = sums.alignment.z;
+        batch.cohX[j] = sums.cohesion.x;
+        batch.cohY[j] = sums.cohesion.y;
+        batch.cohZ[j] = sums.cohesion.z;
+        batch.count[j] = sums.count;
+        const SpeciesFlockGains gains = Gains::get(currentState.speciesID[i]);
+        batch.gainSeparation[j] = gains.separation;
+        batch.gainAlignment[j] = gains.alignment;
+        batch.gainCohesion[j] = gains.cohesion;
+        nextState.setPosition(i, currentState.position(i));
+    }
+
+    const SteeringArrays arrays = {batch.sepX.data(), batch.sepY.data(), batch.sepZ.data(),
+                                   batch.alnX.data(), batch.alnY.data(), batch.alnZ.data(),
+                                   batch.cohX.data(), batch.cohY.data(), batch.cohZ.data(),
+                                   batch.count.data(),
+                                   batch.gainSeparation.data(), batch.gainAlignment.data(), batch.gainCohesion.data(),
+                                   currentState.posX.data() + begin, currentState.posY.data() + begin,
+                                   currentState.posZ.data() + begin,
+                                   currentState.dirX.data() + begin, currentState.dirY.data() + begin,
+                                   currentState.dirZ.data() + begin,
+                                   currentState.maxTurn.data() + begin,
+                                   nextState.dirX.data() + begin, nextState.dirY.data() + begin,
+                                   nextState.dirZ.data() + begin,
+                                   nextState.steerX.data() + begin, nextState.steerY.data() + begin,
+                                   nextState.steerZ.data() + begin};
+    k.steerFast(arrays, n);
+
+    if (!anyCached)
+        return;
+    for (std::size_t i = begin; i < end; ++i)
+    {
+        if (steeringDue(i))
+            continue;
+        const glm::vec3 target = currentState.steering(i);
+        glm::vec3 direction = currentState.direction(i);
+        Creature(currentState, i).turnToward(target, direction);
+        nextState.setDirection(i, direction);
+        nextState.setSteering(i, target);
+    }
+}
+
+template <class Boundary>
+Simulation::RangeStepper Simulation::rangeStepperFor(int colliderCount, bool fastMath)
+{
+    if (fastMath)
+    {
+        if (colliderCount == 0)
+            return &Simulation::stepRangeWith<UpdatePolicy<Boundary, NoColliders, ConstexprGains, FastMath>>;
+        return &Simulation::stepRangeWith<UpdatePolicy<Boundary, SphereColliders, ConstexprGains, FastMath>>;
+    }
+    if (colliderCount == 0)
+        return &Simulation::stepRangeWith<UpdatePolicy<Boundary, NoColliders, ConstexprGains>>;
+    return &Simulation::stepRangeWith<UpdatePolicy<Boundary, SphereColliders, ConstexprGains>>;
+}
+
+Simulation::RangeStepper Simulation::selectRangeStepper(int colliderCount) const
+{
+    if (!specializedUpdate)
+        return &Simulation::stepRange;
+    switch (boundary)
+    {
+    case BoundaryMode::Wrap:
+        return rangeStepperFor<WrapBoundary>(colliderCount, fastMath);
+    case BoundaryMode::Open:
+        return rangeStepperFor<OpenBoundary>(colliderCount, fastMath);
+    default:
+        return rangeStepperFor<ReflectBoundary>(colliderCount, fastMath);
+    }
+}
+
+void Simulation::stepSharedGrid(const std::vector<SphereCollider> &colliders, const FlockKernelSet &k)
+{
+    const FlockState &currentState = flock.current();
+    const NeighborSource source = neighborSource(false, 0);
+
+    // current は読み取りのみ、next は各スレッドが自分の担当区間にだけ書くので競合しない
+    parallel::forRange(currentState.size(), CHUNK_SIZE, [&](std::size_t begin, std::size_t end)
+                       { (this->*rangeStepper)(begin, end, source, colliders, k); });
+}
+
+void Simulation::stepPerSpecies(const std::vector<SphereCollider> &colliders, const FlockKernelSet &k)
+{
+    const FlockState &currentState = flock.current();
+    const int speciesCount = currentState.speciesCount();
+
+    // 種族どうしは影響し合わないので、全種族の区間を1つの並列ループにまとめて更新する
+    // (グリッドや八分木は buildNeighborSearch() で種族ごとに組んである)。
+    // 区間は種族の境目で切るので、1つの区間の中の個体は同じ探索構造を使う。
+    std::vector<NeighborSource> sources(speciesCount);
+    std::vector<std::size_t> firstChunk(speciesCount + 1, 0);
+    for (int species = 0; species < speciesCount; ++species)
+    {
+        sources[species] = neighborSource(true, species);
+        const std::size_t count = currentState.speciesRanges[species].count();
+        firstChunk[species + 1] = firstChunk[species] + (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    }
+
+    parallel::forEach(firstChunk[speciesCount], [&](std::size_t chunk)
+                      {
+                          const int species = static_cast<int>(std::upper_bound(firstChunk.begin(), firstChunk.end(), chunk) - firstChunk.begin()) - 1;
+                          const SpeciesRange range = currentState.speciesRanges[species];
+                          const std::size_t begin = range.begin + (chunk - firstChunk[species]) * CHUNK_SIZE;
+                          const std::size_t end = std::min(begin + CHUNK_SIZE, range.end);
+                          (this->*rangeStepper)(begin, end, sources[species], colliders, k); });
+}
+
+void Simulation::stepFixedPoint(bool perSpecies, const std::vector<SphereCollider> &colliders, const FlockKernelSet &k)
+{
+    const FlockState &currentState = flock.current();
+    if (!perSpecies)
+    {
+        fixedStepper.step(currentState, flock.next(), sharedGrid, 0, currentState.size(), colliders, cubeSize,
+                          k.accumulateNeighborsFixed);
+        return;
+    }
+    // 各種族の更新自体が並列化されているので、種族は順に進める
+    for (int species = 0; species < currentState.speciesCount(); ++species)
+    {
+        const SpeciesRange range = currentState.speciesRanges[species];
+        fixedStepper.step(currentState, flock.next(), speciesGrids[species], range.begin, range.end, colliders, cubeSize,
+                          k.accumulateNeighborsFixed);
+    }
+}
@@ -0,0 +1,219 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <functional>
+#include <vector>
+
+#include "Collider.h"
+#include "ColliderGrid.h"
+#include "DistanceField.h"
+#include "DynamicObstacles.h"
+#include "Creature.h"
+#include "FixedPoint.h"
+#include "FlockKernel.h"
+#include "FlockState.h"
+#include "KdTree.h"
+#include "MeshBvh.h"
+#include "NeighborList.h"
+#include "Octree.h"
+#include "SpatialGrid.h"
+#include "SteeringLod.h"
+
+// 1ステップにかかった時間の内訳
+struct StepTimings
+{
+    double gridBuildMs = 0.0;    // 近傍探索用のグリッド (または八分木) の構築
+    double neighborListMs = 0.0; // 近傍リストの構築 (作り直さなかったステップでは 0)
+    double steeringMs = 0.0;     // 操舵・衝突処理と移動・反射
+    ObstacleUpdateTimings obstacles; // 動く障害物の BVH の合わせ直し・作り直し (movingObstacles がなければすべて 0)
+};
+
+// 近傍探索の方法
+enum class NeighborBackend
+{
+    BruteForce, // 総当たり (比較用)
+    Grid,       // 一様グリッド
+    Octree,     // 八分木 (群れが少数の塊に集まっているとき向け)
+};
+
+const char *neighborBackendName(NeighborBackend backend);
+const char *boundaryModeName(BoundaryMode boundary);
+
+// 群れ全体の1ステップ分の更新をまとめたもの
+class Simulation
+{
+public:
+    explicit Simulation(float cubeSize);
+
+    // 個体の追加先 (追加し終えたら finalizePopulation() を呼ぶ)
+    FlockState &population() { return flock.current(); }
+    // 描画などで読む現在の状態
+    const FlockState &state() const { return flock.current(); }
+
+    // 種族ごとに並べ替え、next バッファと種族ごとの近傍探索の構造を用意する
+    void finalizePopulation();
+
+    void step(const std::vector<SphereCollider> &colliders);
+
+    // 1ステップで進める時間の、60 ステップ/秒のときを 1 とした倍率 (30 ステップ/秒なら 2)。
+    // 個体の速さ (1ステップに進む距離) と曲がる割合 (1ステップに目標の向きへ寄せる割合) は 60 ステップ/秒で
+    // 調整してあるので、刻みを変えるときは速さに倍率を掛け、曲がる割合も同じ時間で同じだけ曲がる値にして、
+    // 実時間での群れの動きを刻みによらずそろえる。
+    // 今いる個体の値を前の倍率との比で書き換えるので、finalizePopulation() の後に呼ぶ
+    void setTimeScale(float scale);
+    float getTimeScale() const { return timeScale; }
+
+    NeighborBackend neighborBackend = NeighborBackend::Grid;
+    bool partitionBySpecies = true; // false: 全種族で1つのグリッド (八分木) を共有する (比較用)
+    const FlockKernelSet *kernels = nullptr; // 使うカーネルの組。nullptr なら activeKernels()
+
+    // 箱の壁での扱い (固定小数点の更新は常に反射)
+    BoundaryMode boundary = BoundaryMode::Reflect;
+    // 壁の扱い・コライダーの有無・重みをコンパイル時に固定して実体化した更新を使う (UpdatePolicy.h)。
+    // false なら個体ごとに実行時に分岐する汎用の更新を使う (比較用、--bench policy)
+    bool specializedUpdate = true;
+    // 近傍の合計と操舵の正規化に、近似の逆数平方根・逆数 (推定値 + Newton 法) を使う。
+    // 誤差の上限は FlockKernel.h の FAST_MATH_*_REL_ERROR。操舵の正規化をまとめて行うのは specializedUpdate のときだけで、
+    // 汎用の更新では近傍の合計だけが近似になる
+    bool fastMath = false;
+
+    // 0 なら半径 FLOCK_RADIUS 内の同じ種族の個体すべてと相互作用する。
+    // k > 0 なら、距離によらず近い順に k 体 (KdTree::MAX_K まで) の同じ種族の個体とだけ相互作用する (トポロジカルな近傍)。
+    // k-d 木で探すので、群れがどれだけ密集しても1個体あたりの手間は変わらない。neighborBackend より優先される
+    int topologicalNeighbors = 0;
+
+    // 位置・向きを固定小数点の整数で更新する (fixed_point を参照)。
+    // 同じ初期状態からは、コンパイラ・CPU・スレッド数によらずビット単位で同じ結果になる。
+    // 近傍は半径で探し、他の近傍探索の設定 (neighborBackend など) より優先される
+    bool fixedPoint = false;
+
+    // Verlet 近傍リストを使い、どの個体も skin/2 以上動くまでグリッドと近傍リストを使い回す
+    // (NeighborBackend::Grid のときだけ有効)。skin を大きくすると作り直しは減るが、毎ステップ調べる候補が増える
+    // 候補を集める手間が SIMD での 27 セル走査と同程度かかるので、既定では使わない (--bench verlet で比較)
+    bool useNeighborLists = false;
+    float neighborSkin = 1.0f;
+    const NeighborList &getNeighborList() const { return neighborList; }
+    int getNeighborListRebuilds() const { return neighborListRebuilds; }
+    // 近傍リストを使ったステップ1回あたりの、グリッドと近傍リストの構築時間の平均 (ms)
+    double getNeighborListAmortizedMs() const
+    {
+        return neighborListSteps > 0 ? neighborListBuildMsTotal / neighborListSteps : 0.0;
+    }
+
+    // 近傍から操舵を求め直す間隔 (ステップ数)。1 なら毎ステップ求める。
+    // 間のステップは近傍を探さず、前回求めた操舵の目標 (FlockState::steering) へ曲がる。移動と衝突処理は毎ステップ行う。
+    // staggeredSteering なら個体の ID でずらして毎ステップ 1/N ずつ求め直し (手間がステップ間でならされる)、
+    // false なら N ステップごとに全個体を求め直す (間のステップはグリッドの構築も省く)
+    int steeringInterval = 1;
+    bool staggeredSteering = true;
+
+    // カメラから遠い個体や視野の外の個体の操舵を間引く (SteeringLod.h)。固定小数点の更新では使わない
+    SteeringLod lod;
+    // 直前のステップの段階ごとの個体数と、省けた時間の見積もり (lod.enabled でなければすべて 0)
+    const LodStats &getLodStats() const { return lodStats; }
+
+    // コライダーが colliderGridMinCount 個以上あるとき、衝突判定を ColliderGrid で近くのコライダーだけに絞る。
+    // グリッドはコライダーが前回作ったときと変わったステップでだけ作り直す (その時間は gridBuildMs に入る)。
+    // 少数なら全コライダーを SIMD で調べる方が速い (--bench colliders)。固定小数点の更新では使わない
+    bool useColliderGrid = true;
+    int colliderGridMinCount = 32;
+    const ColliderGrid &getColliderGrid() const { return colliderGrid; }
+
+    // 球・箱・メッシュの障害物を焼き込んだ距離場 (所有しない。nullptr なら使わない)。
+    // コライダーの後に、個体ごとに1回の三線形補間で表面から obstacleMargin 以内に入ったかを調べて押し出す。
+    // 固定小数点の更新では使わない
+    const DistanceField *obstacleField = nullptr;
+    float obstacleMargin = COLLIDER_MARGIN;
+
+    // 三角形メッシュの障害物の BVH (所有しない。nullptr なら使わない)。
+    // 各個体が向きに沿って lookAheadDistance 先まで光線を飛ばし、面に当たるなら手前で曲がって避ける (MeshBvh::avoid)。
+    // 光線は区間の個体を RayPacket::SIZE 本ずつまとめてたどる。固定小数点の更新では使わない
+    const MeshBvh *meshObstacles = nullptr;
+    float lookAheadDistance = 3.0f;
+
+    // 毎ステップ動く三角形メッシュの障害物 (所有しない。nullptr なら使わない)。
+    // ステップの初めに moveObstacles で動かしてから DynamicObstacles::update() で BVH を合わせ、
+    // meshObstacles と同じく先読みの光線で避ける。固定小数点の更新では障害物を動かすだけで避けない
+    DynamicObstacles *movingObstacles = nullptr;
+    std::function<void(DynamicObstacles &)> moveObstacles;
+
+    // 何ステップごとに個体を空間順 (Morton コード順) に並べ直すか (0 で無効)
+    // 近くにいる個体がメモリ上でも近くに並び、グリッド構築時の読み出しがキャッシュに乗りやすくなる
+    int reorderInterval = 64;
+    const StepTimings &getLastTimings() const { return lastTimings; }
+    int getReorderCount() const { return reorderCount; }
+    double getLastReorderMs() const { return lastReorderMs; }
+
+private:
+    float timeScale = 1.0f;
+
+    // 今回のステップで使うグリッドまたは八分木を組み直す (種族ごと、または全体で1つ)
+    void buildNeighborSearch(bool perSpecies);
+    // 種族 species の個体の近傍探索に使う構造
+    NeighborSource neighborSource(bool perSpecies, int species) const;
+    void stepSharedGrid(const std::vector<SphereCollider> &colliders, const FlockKernelSet &k);
+    void stepPerSpecies(const std::vector<SphereCollider> &colliders, const FlockKernelSet &k);
+    void stepFixedPoint(bool perSpecies, const std::vector<SphereCollider> &colliders, const FlockKernelSet &k);
+    // [begin, end) の個体の操舵・衝突処理を行い、その区間をまとめて移動・反射させる
+    using RangeStepper = void (Simulation::*)(std::size_t begin, std::size_t end, const NeighborSource &source,
+                                              const std::vector<SphereCollider> &colliders, const FlockKernelSet &k);
+    // 汎用の版 (コライダーの数・重み・壁の扱いを実行時に調べる)
+    void stepRange(std::size_t begin, std::size_t end, const NeighborSource &source,
+                   const std::vector<SphereCollider> &colliders, const FlockKernelSet &k);
+    // Policy (UpdatePolicy) で実体化した版
+    template <class Policy>
+    void stepRangeWith(std::size_t begin, std::size_t end, const NeighborSource &source,
+                       const std::vector<SphereCollider> &colliders, const FlockKernelSet &k);
+    // 今回のステップの設定に合った版を選ぶ
+    RangeStepper selectRangeStepper(int colliderCount) const;
+    template <class Boundary>
+    static RangeStepper rangeStepperFor(int colliderCount, bool fastMath);
+    // [begin, end) の個体の近傍の合計を集め、k.steerFast でまとめて操舵した向きを next に書く
+    template <class Gains>
+    void steerBatched(std::size_t begin, std::size_t end, const NeighborSource &source, const FlockKernelSet &k);
+    // 個体 i の操舵を今回のステップで近傍から求め直すか
+    bool steeringDue(std::size_t i) const;
+    // interval ステップおきに求め直すとき、今回のステップが個体 i の番か (staggered なら ID でずらす)
+    bool steeringDueEvery(std::size_t i, int interval, bool staggered) const;
+    // 個体 i が近傍を打ち切って探すか (LOD の Minimal の段階)
+    bool neighborCapped(std::size_t i) const
+    {
+        return lodActive && lod.minimalNeighborCap > 0 && lodTiers[i] == LodTier::Minimal;
+    }
+    // 今回のステップの各個体の LOD の段階を決め、段階ごとの個体数を数える
+    void classifyLod();
+    // 近傍リストを作り直す。グリッドは buildNeighborSearch() で組んである前提
+    void buildNeighborList(bool perSpecies);
+
+    void reorderIfDue();
+
+    float cubeSize;
+    FlockBuffers flock;
+    int stepsSinceReorder = 0;
+    int reorderCount = 0;
+    double lastReorderMs = 0.0;
+    StepTimings lastTimings;
+    RangeStepper rangeStepper = &Simulation::stepRange; // 今回のステップで使う版
+    long steeringStep = 0;           // 操舵を求め直す個体を選ぶためのステップの通し番号
+    int activeSteeringInterval = 1;  // 今回のステップで使う steeringInterval
+    bool steeringCached = false;     // FlockState::steering が前のステップの操舵の目標を持っているか
+    bool lodActive = false;          // 今回のステップで LOD を使うか
+    std::vector<LodTier> lodTiers;   // 今回のステップの各個体の段階 (current のインデックス)
+    LodStats lodStats;
+    ColliderGrid colliderGrid;
+    bool collidersIndexed = false; // 今回のステップで colliderGrid を使うか
+    FixedPointStepper fixedStepper;
+    NeighborList neighborList;
+    bool listsInUse = false; // 今回のステップで近傍リストを使うか
+    int neighborListRebuilds = 0;
+    long neighborListSteps = 0;
+    double neighborListBuildMsTotal = 0.0;
+    SpatialGrid sharedGrid;
+    std::vector<SpatialGrid> speciesGrids; // 種族ごとのグリッド (speciesID でひく)
+    Octree sharedOctree;
+    std::vector<Octree> speciesOctrees;    // 種族ごとの八分木 (speciesID でひく)
+    KdTree sharedKdTree;
+    std::vector<KdTree> speciesKdTrees;    // 種族ごとの k-d 木 (speciesID でひく)
+};
+
+#endif
@@ -0,0 +1,238 @@
+#include "SimulationThread.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+void FlockSnapshot::interpolate(std::size_t i, float blend, glm::vec3 &position, glm::vec3 &direction) const
+{
+    position = this->position(i);
+    direction = this->direction(i);
+    const glm::vec3 previous = previousPosition(i);
+    const glm::vec3 moved = position - previous;
+    if (glm::dot(moved, moved) >= INTERPOLATION_MAX_JUMP * INTERPOLATION_MAX_JUMP)
+        return;
+    position = glm::mix(previous, position, blend);
+    // 壁でほぼ真後ろに反射した個体は、補間の途中で向きが 0 に近くなるので今の向きのままにする
+    const glm::vec3 turned = glm::mix(previousDirection(i), direction, blend);
+    if (glm::dot(turned, turned) > 1e-6f)
+        direction = glm::normalize(turned);
+}
+
+void SimulationThread::start(const std::vector<SphereCollider> &initialColliders)
+{
+    stop();
+    colliders = initialColliders;
+    stopping = false;
+    stepsAllowed = 0;
+    accumulator = 0.0;
+    stepsDue = 0;
+    droppedSteps = 0;
+    lastPosX.clear(); // 初期状態の「1つ前」は初期状態自身にする (publish を参照)
+    // 描画側が最初の latest() で初期状態を受け取れるよう、ワーカーを起動する前に公開しておく
+    publish(0, 0.0);
+    worker = std::thread(&SimulationThread::run, this);
+}
+
+void SimulationThread::stop()
+{
+    if (!worker.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    worker.join();
+}
+
+void SimulationThread::setStepRate(double stepsPerSecond)
+{
+    stepSeconds = 1.0 / std::max(stepsPerSecond, 1.0);
+    // 群れの速さと曲がる割合は 60 ステップ/秒を基準にしているので、刻みに合わせてワーカーで直す
+    const float timeScale = static_cast<float>(stepSeconds * 60.0);
+    post([timeScale](Simulation &sim)
+         { sim.setTimeScale(timeScale); });
+}
+
+RenderFrame SimulationThread::advance(double elapsedSeconds)
+{
+    snapshots.acquire();
+    const FlockSnapshot &snapshot = snapshots.front();
+
+    accumulator += std::max(elapsedSeconds, 0.0);
+    long due = static_cast<long>(std::floor(accumulator / stepSeconds));
+    accumulator -= due * stepSeconds;
+    // ワーカーが描いているステップより maxStepsPerFrame 以上遅れそうなら、その先の分は捨てる
+    const long limit = snapshot.step + maxStepsPerFrame;
+    if (stepsDue + due > limit)
+    {
+        const long allowed = std::max(limit - stepsDue, 0L);
+        droppedSteps += due - allowed;
+        due = allowed;
+    }
+    stepsDue += due;
+
+    bool allowedMore = false;
+    {
+        // 描く時刻は stepsDue + 端数で、stepsDue と stepsDue + 1 の間を補間する。
+        // stepsDue + 1 まで許しておき、描く時刻が来る前にワーカーが計算を済ませられるようにする
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stepsDue + 1 > stepsAllowed)
+        {
+            stepsAllowed = stepsDue + 1;
+            allowedMore = true;
+        }
+    }
+    if (allowedMore)
+        wake.notify_one();
+
+    RenderFrame frame;
+    frame.snapshot = &snapshot;
+    // ワーカーが遅れていて描く時刻のステップがまだなければ、最新のステップをそのまま描く (blend = 1)
+    const double renderStep = static_cast<double>(stepsDue) + accumulator / stepSeconds;
+    frame.blend = static_cast<float>(std::min(std::max(renderStep - static_cast<double>(snapshot.step - 1), 0.0), 1.0));
+    frame.stepsDue = static_cast<int>(due);
+    frame.droppedSteps = droppedSteps;
+    return frame;
+}
+
+const FlockSnapshot &SimulationThread::latest()
+{
+    snapshots.acquire();
+    const FlockSnapshot &snapshot = snapshots.front();
+    bool allowedMore = false;
+    {
+        // 1フレームにつき1ステップ許す。ただし描画しているステップより MAX_STEPS_AHEAD 先までに抑え、
+        // シミュレーションが遅いときに許可だけが溜まっていかないようにする
+        std::lock_guard<std::mutex> lock(mutex);
+        const long allowed = std::min(stepsAllowed + 1, snapshot.step + MAX_STEPS_AHEAD);
+        if (allowed > stepsAllowed)
+        {
+            stepsAllowed = allowed;
+            allowedMore = true;
+        }
+    }
+    if (allowedMore)
+        wake.notify_one();
+    return snapshot;
+}
+
+void SimulationThread::post(std::function<void(Simulation &)> command)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        commands.push_back(std::move(command));
+    }
+    wake.notify_one();
+}
+
+void SimulationThread::run()
+{
+    long stepsDone = 0;
+    std::vector<std::function<void(Simulation &)>> pending;
+    while (true)
+    {
+        bool stepDue;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&]
+                      { return stopping || stepsAllowed > stepsDone || !commands.empty(); });
+            if (stopping)
+                return;
+            pending.swap(commands);
+            stepDue = stepsAllowed > stepsDone;
+        }
+
+        // コマンドはステップの合間にだけ実行するので、ステップの途中で設定が変わることはない
+        for (const std::function<void(Simulation &)> &command : pending)
+        {
+            command(simulation);
+        }
+        pending.clear();
+
+        if (stepDue)
+        {
+            auto start = std::chrono::steady_clock::now();
+            simulation.step(colliders);
+            const double stepMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            publish(++stepsDone, stepMs);
+        }
+    }
+}
+
+void SimulationThread::publish(long step, double stepMs)
+{
+    const FlockState &state = simulation.state();
+    FlockSnapshot &snapshot = snapshots.back();
+    snapshot.posX.assign(state.posX.begin(), state.posX.end());
+    snapshot.posY.assign(state.posY.begin(), state.posY.end());
+    snapshot.posZ.assign(state.posZ.begin(), state.posZ.end());
+    snapshot.dirX.assign(state.dirX.begin(), state.dirX.end());
+    snapshot.dirY.assign(state.dirY.begin(), state.dirY.end());
+    snapshot.dirZ.assign(state.dirZ.begin(), state.dirZ.end());
+    snapshot.speciesID.assign(state.speciesID.begin(), state.speciesID.end());
+
+    // 1つ前のステップの値は ID ごとに持っておき、今のインデックスの並びに直して渡す
+    const std::size_t n = state.size();
+    if (lastPosX.size() != n)
+    {
+        for (AlignedArray<float> *v : {&lastPosX, &lastPosY, &lastPosZ, &lastDirX, &lastDirY, &lastDirZ})
+        {
+            v->resize(n);
+        }
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            const int id = state.boidID[i];
+            lastPosX[id] = state.posX[i];
+            lastPosY[id] = state.posY[i];
+            lastPosZ[id] = state.posZ[i];
+            lastDirX[id] = state.dirX[i];
+            lastDirY[id] = state.dirY[i];
+            lastDirZ[id] = state.dirZ[i];
+        }
+    }
+    for (AlignedArray<float> *v : {&snapshot.prevPosX, &snapshot.prevPosY, &snapshot.prevPosZ,
+                                   &snapshot.prevDirX, &snapshot.prevDirY, &snapshot.prevDirZ})
+    {
+        v->resize(n);
+    }
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        const int id = state.boidID[i];
+        snapshot.prevPosX[i] = lastPosX[id];
+        snapshot.prevPosY[i] = lastPosY[id];
+        snapshot.prevPosZ[i] = lastPosZ[id];
+        snapshot.prevDirX[i] = lastDirX[id];
+        snapshot.prevDirY[i] = lastDirY[id];
+        snapshot.prevDirZ[i] = lastDirZ[id];
+        lastPosX[id] = state.posX[i];
+        lastPosY[id] = state.posY[i];
+        lastPosZ[id] = state.posZ[i];
+        lastDirX[id] = state.dirX[i];
+        lastDirY[id] = state.dirY[i];
+        lastDirZ[id] = state.dirZ[i];
+    }
+
+    snapshot.step = step;
+    snapshot.stepMs = stepMs;
+    snapshot.timings = simulation.getLastTimings();
+    snapshot.reorderCount = simulation.getReorderCount();
+    snapshot.lastReorderMs = simulation.getLastReorderMs();
+    snapshot.useNeighborLists = simulation.useNeighborLists;
+    snapshot.neighborListRebuilds = simulation.getNeighborListRebuilds();
+    snapshot.neighborListAmortizedMs = simulation.getNeighborListAmortizedMs();
+    snapshot.lodEnabled = simulation.lod.enabled;
+    snapshot.lod = simulation.getLodStats();
+    snapshot.obstacleTransforms.clear();
+    snapshot.obstacleRebuilds = 0;
+    if (const DynamicObstacles *moving = simulation.movingObstacles)
+    {
+        for (std::size_t o = 0; o < moving->size(); ++o)
+        {
+            snapshot.obstacleTransforms.push_back(moving->getTransform(static_cast<int>(o)));
+        }
+        snapshot.obstacleRebuilds = moving->getRebuildCount();
+    }
+    snapshots.publish();
+}
@@ -0,0 +1,137 @@
+#ifndef SIMULATION_THREAD_H
+#define SIMULATION_THREAD_H
+
+#include <glm/glm.hpp>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Collider.h"
+#include "FlockState.h"
+#include "Simulation.h"
+#include "TripleBuffer.h"
+
+// 描画用に公開する、あるステップの群れの状態 (公開した後は書き換えない)
+struct FlockSnapshot
+{
+    AlignedArray<float> posX, posY, posZ;
+    AlignedArray<float> dirX, dirY, dirZ;
+    AlignedArray<int> speciesID;
+    // 1つ前のステップでの同じ個体の位置と向き (空間順の並べ替えをまたいでも i 番目の個体のもの。補間用)
+    AlignedArray<float> prevPosX, prevPosY, prevPosZ;
+    AlignedArray<float> prevDirX, prevDirY, prevDirZ;
+
+    long step = 0; // 何ステップ目の状態か (0 は初期状態)
+
+    // このステップの計測値 (main.cpp の定期的なログ用)
+    double stepMs = 0.0;
+    StepTimings timings;
+    int reorderCount = 0;
+    double lastReorderMs = 0.0;
+    bool useNeighborLists = false;
+    int neighborListRebuilds = 0;
+    double neighborListAmortizedMs = 0.0;
+    bool lodEnabled = false;
+    LodStats lod;
+    // 動く障害物のこのステップでの変換行列 (Simulation::movingObstacles の番号順。描画用) と作り直した回数 (累計)
+    std::vector<glm::mat4> obstacleTransforms;
+    int obstacleRebuilds = 0;
+
+    std::size_t size() const { return posX.size(); }
+    glm::vec3 position(std::size_t i) const { return glm::vec3(posX[i], posY[i], posZ[i]); }
+    glm::vec3 direction(std::size_t i) const { return glm::vec3(dirX[i], dirY[i], dirZ[i]); }
+    glm::vec3 previousPosition(std::size_t i) const { return glm::vec3(prevPosX[i], prevPosY[i], prevPosZ[i]); }
+    glm::vec3 previousDirection(std::size_t i) const { return glm::vec3(prevDirX[i], prevDirY[i], prevDirZ[i]); }
+
+    // 1つ前のステップ (blend = 0) からこのステップ (blend = 1) までを補間した位置と向き
+    // 壁での回り込みやコライダーの押し戻しで INTERPOLATION_MAX_JUMP 以上跳んだ個体は補間せず、このステップの値を返す
+    void interpolate(std::size_t i, float blend, glm::vec3 &position, glm::vec3 &direction) const;
+    static constexpr float INTERPOLATION_MAX_JUMP = 1.0f;
+};
+
+// SimulationThread::advance() の結果
+struct RenderFrame
+{
+    const FlockSnapshot *snapshot = nullptr; // 描くスナップショット (次に advance() を呼ぶまで有効)
+    float blend = 1.0f;                      // FlockSnapshot::interpolate に渡す補間の割合
+    int stepsDue = 0;                        // このフレームで新たに進めることにしたステップ数
+    long droppedSteps = 0;                   // 上限を超えたために捨てたステップ数 (累計)
+};
+
+// Simulation を専用のスレッドで進め、各ステップの結果を FlockSnapshot として TripleBuffer で描画側に渡す
+// 描画側が step N を描いている間にワーカーが step N+1 を計算するので、1フレームの時間は
+// シミュレーションと描画の和ではなく、遅い方の時間になる (ステップの中の並列化は Parallel.h の並列ループ)。
+//
+// 描画側の進め方は2通りあり、どちらか一方だけを使う。
+// - advance(): 固定の刻み (1 / stepRate 秒) で進める。描画の経過時間を溜め、刻みの分溜まるごとに1ステップ進めるので、
+//   群れの進む速さは描画のフレームレートによらない。描画は直前の2ステップの間を補間して描く。
+// - latest(): 描画1フレームにつき1ステップ進める (ベンチマークで処理能力を測るとき用)。
+//   描画しているステップより MAX_STEPS_AHEAD 先までは先行できる。描画の方が遅ければ描画1フレームにつき1ステップになり、
+//   シミュレーションの方が遅ければ、描画は同じスナップショットを描き直し、ワーカーは休まず進める。
+//   2ステップ先まで許すのは、公開したスナップショットが描画に拾われるのを待つ間もワーカーが止まらないようにするため
+// start() の後は Simulation を直接触らず、設定の変更は post() でワーカーに頼む。
+class SimulationThread
+{
+public:
+    explicit SimulationThread(Simulation &simulation) : simulation(simulation) {}
+    ~SimulationThread() { stop(); }
+    SimulationThread(const SimulationThread &) = delete;
+    SimulationThread &operator=(const SimulationThread &) = delete;
+
+    // 初期状態を公開してからワーカーを起動する (colliders はワーカーが持つ複製を使う)
+    void start(const std::vector<SphereCollider> &colliders);
+    // 計算中のステップが終わるのを待ってワーカーを止める
+    void stop();
+
+    // ---- 描画側 ----
+    // 前回から elapsedSeconds 秒経ったとして、その分のステップをワーカーに許し、描くスナップショットと補間の割合を返す
+    // (1フレームに1回呼ぶ)。描く時刻のステップまでワーカーが進んでいれば、そのステップと1つ前の間を補間する。
+    // ワーカーが追いつかないときは描いているステップより maxStepsPerFrame 先までしか許さず、それを超えた時間は捨てる
+    // (遅いフレームが続いても、溜まったステップを消化しきれずにさらに遅れていくことがない)
+    RenderFrame advance(double elapsedSeconds);
+    // 1秒あたりのステップ数 (advance() の刻み)。Simulation::setTimeScale も合わせて変えるので、
+    // 刻みを変えても実時間での群れの動く速さは変わらない
+    void setStepRate(double stepsPerSecond);
+    double getStepRate() const { return 1.0 / stepSeconds; }
+    int maxStepsPerFrame = 4;
+
+    // 最後に公開された完全なスナップショットを返し、ワーカーに次の1ステップを許す (1フレームに1回呼ぶ)
+    // 返した参照は次に latest() を呼ぶまで有効
+    const FlockSnapshot &latest();
+    // ステップの合間にワーカーのスレッドで command(simulation) を実行する (キー入力による設定の変更など)
+    void post(std::function<void(Simulation &)> command);
+
+    static const long MAX_STEPS_AHEAD = 2;
+
+private:
+    void run();
+    // simulation の現在の状態を back() に写して公開する
+    void publish(long step, double stepMs);
+
+    Simulation &simulation;
+    std::vector<SphereCollider> colliders;
+    TripleBuffer<FlockSnapshot> snapshots;
+    std::thread worker;
+
+    // 以下は publish() だけが触る (start() の後はワーカーのスレッド)。1つ前に公開した位置と向きを、個体の ID ごとに持つ
+    AlignedArray<float> lastPosX, lastPosY, lastPosZ;
+    AlignedArray<float> lastDirX, lastDirY, lastDirZ;
+
+    // 以下は描画側だけが触る (advance() の時間の管理)
+    double stepSeconds = 1.0 / 60.0;
+    double accumulator = 0.0; // まだステップにしていない経過時間 (秒)
+    long stepsDue = 0;        // 描く時刻までに進めるべきステップ数
+    long droppedSteps = 0;
+
+    // 以下は mutex で守る (ステップの進め方とコマンドの受け渡しだけで、スナップショットの受け渡しには使わない)
+    std::mutex mutex;
+    std::condition_variable wake;
+    long stepsAllowed = 0; // ワーカーが進めてよいステップ数
+    bool stopping = false;
+    std::vector<std::function<void(Simulation &)>> commands;
+};
+
+#endif
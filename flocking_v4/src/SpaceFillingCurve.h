@@ -0,0 +1,29 @@
+#ifndef SPACE_FILLING_CURVE_H
+#define SPACE_FILLING_CURVE_H
+
+#include <glm/glm.hpp>
+#include <cstdint>
+
+// 10ビットの整数の各ビットの間に2ビットずつ隙間を空ける (0b1011 -> 0b001000001001)
+inline std::uint32_t spreadBits10(std::uint32_t v)
+{
+    v &= 0x3ff;
+    v = (v | (v << 16)) & 0x030000ff;
+    v = (v | (v << 8)) & 0x0300f00f;
+    v = (v | (v << 4)) & 0x030c30c3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+
+// [-cubeSize, cubeSize]^3 内の位置の Morton (Z-order) コード (各軸 10 ビット、計 30 ビット)
+// 空間的に近い位置ほどコードも近くなりやすいので、このコード順に並べると近傍がメモリ上でも近くに集まる
+inline std::uint32_t mortonCode(const glm::vec3 &p, float cubeSize)
+{
+    const float scale = 1023.0f / (2.0f * cubeSize);
+    glm::vec3 q = glm::clamp((p + glm::vec3(cubeSize)) * scale, glm::vec3(0.0f), glm::vec3(1023.0f));
+    return (spreadBits10(static_cast<std::uint32_t>(q.x)) << 2) |
+           (spreadBits10(static_cast<std::uint32_t>(q.y)) << 1) |
+           spreadBits10(static_cast<std::uint32_t>(q.z));
+}
+
+#endif
@@ -0,0 +1,142 @@
+#include "SpatialGrid.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+
+SpatialGrid::SpatialGrid(float cubeSize, float cellSize)
+    : cubeSize(cubeSize)
+{
+    setCellSize(cellSize);
+}
+
+void SpatialGrid::setCellSize(float newCellSize)
+{
+    cellSize = newCellSize;
+    invCellSize = 1.0f / newCellSize;
+    // 箱の一辺 (2 * cubeSize) をセルで覆うのに必要な数
+    cellsPerAxis = std::max(1, static_cast<int>(std::ceil(2.0f * cubeSize / cellSize)));
+    cellStart.assign(cellsPerAxis * cellsPerAxis * cellsPerAxis + 1, 0);
+}
+
+void SpatialGrid::build(const FlockState &state)
+{
+    build(state, 0, state.size());
+}
+
+// これより個体数が少ないときは、スレッドを起こすより1スレッドで組むほうが速い
+static const int PARALLEL_BUILD_MIN = 4096;
+// 位置などをセル順にコピーするループの区間の大きさ
+static const std::size_t COPY_GRAIN = 4096;
+
+void SpatialGrid::build(const FlockState &state, std::size_t begin, std::size_t end)
+{
+    const int first = static_cast<int>(begin);
+    const int n = static_cast<int>(end - begin);
+    const int cellCount = static_cast<int>(cellStart.size()) - 1;
+    cellOfCreature.resize(n);
+    sortedIndices.resize(n);
+    sortedPosX.resize(n);
+    sortedPosY.resize(n);
+    sortedPosZ.resize(n);
+    sortedDirX.resize(n);
+    sortedDirY.resize(n);
+    sortedDirZ.resize(n);
+    sortedSpecies.resize(n);
+
+    // 個体を連続したブロックに分け、ブロックごとのヒストグラムに数える。
+    // セル順 → ブロック順に開始位置を割り当てるので、同じセル内の並びは個体番号順のままになり、
+    // 結果はブロックの数 (スレッド数) やバックエンドによらず1ブロックで組んだときと同じになる。
+    // 各段階は前の段階の結果をすべて使うので、段階ごとに別の並列ループにする。
+    const int blockCount = n >= PARALLEL_BUILD_MIN ? std::max(1, parallel::threadCount()) : 1;
+    blockCellCounts.assign(static_cast<std::size_t>(blockCount) * cellCount, 0);
+    blockOffset.assign(blockCount + 1, 0);
+    auto creatureBlock = [&](int block, int &i0, int &i1)
+    {
+        i0 = static_cast<int>(static_cast<long long>(n) * block / blockCount);
+        i1 = static_cast<int>(static_cast<long long>(n) * (block + 1) / blockCount);
+    };
+    auto cellBlock = [&](int block, int &c0, int &c1)
+    {
+        c0 = static_cast<int>(static_cast<long long>(cellCount) * block / blockCount);
+        c1 = static_cast<int>(static_cast<long long>(cellCount) * (block + 1) / blockCount);
+    };
+
+    // 1. ブロックごとに、各セルに入る個体数を数える
+    parallel::forEach(blockCount, [&](std::size_t block)
+                      {
+                          int i0, i1;
+                          creatureBlock(static_cast<int>(block), i0, i1);
+                          int *counts = &blockCellCounts[block * cellCount];
+                          for (int i = i0; i < i1; ++i)
+                          {
+                              const int k = first + i;
+                              int cell = cellIndex(cellCoord(state.posX[k]), cellCoord(state.posY[k]), cellCoord(state.posZ[k]));
+                              cellOfCreature[i] = cell;
+                              counts[cell]++;
+                          } });
+
+    // 2. 累積和で、セル×ブロックごとの書き込み開始位置を求める
+    //    セルもブロックに分け、セルのブロック内の合計 → ブロック間の累積和 → ブロック内の累積和の順に行う
+    parallel::forEach(blockCount, [&](std::size_t block)
+                      {
+                          int c0, c1;
+                          cellBlock(static_cast<int>(block), c0, c1);
+                          int blockTotal = 0;
+                          for (int c = c0; c < c1; ++c)
+                          {
+                              for (int b = 0; b < blockCount; ++b)
+                              {
+                                  blockTotal += blockCellCounts[static_cast<std::size_t>(b) * cellCount + c];
+                              }
+                          }
+                          blockOffset[block + 1] = blockTotal; });
+    for (int b = 0; b < blockCount; ++b)
+    {
+        blockOffset[b + 1] += blockOffset[b];
+    }
+    parallel::forEach(blockCount, [&](std::size_t block)
+                      {
+                          int c0, c1;
+                          cellBlock(static_cast<int>(block), c0, c1);
+                          int offset = blockOffset[block];
+                          for (int c = c0; c < c1; ++c)
+                          {
+                              cellStart[c] = offset;
+                              for (int b = 0; b < blockCount; ++b)
+                              {
+                                  int &slot = blockCellCounts[static_cast<std::size_t>(b) * cellCount + c];
+                                  const int count = slot;
+                                  slot = offset;
+                                  offset += count;
+                              }
+                          } });
+    cellStart[cellCount] = n;
+
+    // 3. 個体のインデックスをセル順に並べる (counts は書き込み位置になっている)
+    parallel::forEach(blockCount, [&](std::size_t block)
+                      {
+                          int i0, i1;
+                          creatureBlock(static_cast<int>(block), i0, i1);
+                          int *counts = &blockCellCounts[block * cellCount];
+                          for (int i = i0; i < i1; ++i)
+                          {
+                              sortedIndices[counts[cellOfCreature[i]]++] = first + i;
+                          } });
+
+    // 4. 近傍ループで連続アクセスできるよう、位置・向き・種族もセル順にコピーする
+    const std::size_t copyGrain = n >= PARALLEL_BUILD_MIN ? COPY_GRAIN : static_cast<std::size_t>(n);
+    parallel::forRange(n, copyGrain, [&](std::size_t k0, std::size_t k1)
+                       {
+                           for (std::size_t k = k0; k < k1; ++k)
+                           {
+                               const int src = sortedIndices[k];
+                               sortedPosX[k] = state.posX[src];
+                               sortedPosY[k] = state.posY[src];
+                               sortedPosZ[k] = state.posZ[src];
+                               sortedDirX[k] = state.dirX[src];
+                               sortedDirY[k] = state.dirY[src];
+                               sortedDirZ[k] = state.dirZ[src];
+                               sortedSpecies[k] = state.speciesID[src];
+                           } });
+}
@@ -0,0 +1,112 @@
+#ifndef SPATIAL_GRID_H
+#define SPATIAL_GRID_H
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <vector>
+
+#include "FlockKernel.h"
+#include "FlockState.h"
+
+
+// 一様グリッドによる近傍探索
+// [-cubeSize, cubeSize]^3 の空間を cellSize の立方体セルに分割し、
+// 各セルに入っている個体のインデックスを毎フレーム詰め直す。
+// cellSize を相互作用半径以上にしておけば、近傍は自セルを含む 27 セルだけを見ればよい。
+// 位置・向き・種族もセル順に並べたコピーを持つので、近傍候補は連続した配列として読める。
+class SpatialGrid
+{
+public:
+    SpatialGrid(float cubeSize, float cellSize);
+
+    // state の位置からセルリストを作り直す (カウンティングソート)
+    // 個体数が多いときは、ヒストグラム・累積和・振り分けをそれぞれ並列ループ (Parallel.h) で行う
+    void build(const FlockState &state);
+    // インデックス [begin, end) の個体だけでセルリストを作る (種族ごとのグリッド用)
+    void build(const FlockState &state, std::size_t begin, std::size_t end);
+
+    // pos を含むセルと、その周囲 26 セルに入っている個体のインデックスを visit に渡す
+    template <typename Visitor>
+    void forEachNeighbor(const glm::vec3 &pos, Visitor &&visit) const
+    {
+        forEachNeighborRange(pos, [&](int begin, int end)
+                             {
+                                 for (int k = begin; k < end; ++k)
+                                 {
+                                     visit(sortedIndices[k]);
+                                 }
+                             });
+    }
+
+    // 周囲 27 セルを、セル順に並べた配列 (sortedArrays()) 上の区間 [begin, end) として visit に渡す
+    // x方向に隣り合う3セルは連続しているので、呼び出しは最大 9 回
+    template <typename RangeVisitor>
+    void forEachNeighborRange(const glm::vec3 &pos, RangeVisitor &&visit) const
+    {
+        int cx = cellCoord(pos.x);
+        int cy = cellCoord(pos.y);
+        int cz = cellCoord(pos.z);
+
+        for (int z = glm::max(cz - 1, 0); z <= glm::min(cz + 1, cellsPerAxis - 1); ++z)
+        {
+            for (int y = glm::max(cy - 1, 0); y <= glm::min(cy + 1, cellsPerAxis - 1); ++y)
+            {
+                // x方向に並んだセルは cellStart 上で連続しているので、まとめて走査する
+                int x0 = glm::max(cx - 1, 0);
+                int x1 = glm::min(cx + 1, cellsPerAxis - 1);
+                int begin = cellStart[cellIndex(x0, y, z)];
+                int end = cellStart[cellIndex(x1, y, z) + 1];
+                if (begin < end)
+                {
+                    visit(begin, end);
+                }
+            }
+        }
+    }
+
+    // セル順に並べた位置・向き・種族 (forEachNeighborRange の区間はこの配列上の位置)
+    NeighborArrays sortedArrays() const
+    {
+        return NeighborArrays{sortedPosX.data(), sortedPosY.data(), sortedPosZ.data(),
+                              sortedDirX.data(), sortedDirY.data(), sortedDirZ.data(),
+                              sortedSpecies.data()};
+    }
+
+    // セル順に並べた個体のインデックス
+    const std::vector<int> &getSortedIndices() const { return sortedIndices; }
+
+    // セルの大きさを変える (次の build() から有効)。探す距離をセルの大きさ以下にしておくこと
+    void setCellSize(float cellSize);
+
+    int getCellsPerAxis() const { return cellsPerAxis; }
+    float getCellSize() const { return cellSize; }
+
+private:
+    int cellCoord(float v) const
+    {
+        // 境界上や、コライダーの押し戻しで箱の外に出た個体は端のセルに入れる
+        int c = static_cast<int>((v + cubeSize) * invCellSize);
+        return glm::clamp(c, 0, cellsPerAxis - 1);
+    }
+    int cellIndex(int x, int y, int z) const
+    {
+        return (z * cellsPerAxis + y) * cellsPerAxis + x;
+    }
+
+    float cubeSize;
+    float cellSize;
+    float invCellSize;
+    int cellsPerAxis;
+
+    std::vector<int> cellStart;     // セルごとの開始位置 (要素数 = セル数 + 1)
+    std::vector<int> sortedIndices; // セル順に並べた個体のインデックス
+    std::vector<int> cellOfCreature; // build 時に計算した各個体のセル番号
+    std::vector<int> blockCellCounts; // ブロック×セルごとの個体数 (のちに書き込み位置)
+    std::vector<int> blockOffset;     // 各ブロックが受け持つセルの範囲の開始位置
+
+    AlignedArray<float> sortedPosX, sortedPosY, sortedPosZ;
+    AlignedArray<float> sortedDirX, sortedDirY, sortedDirZ;
+    AlignedArray<int> sortedSpecies;
+};
+
+#endif
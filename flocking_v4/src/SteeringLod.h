@@ -0,0 +1,79 @@
+#ifndef STEERING_LOD_H
+#define STEERING_LOD_H
+
+#include <glm/glm.hpp>
+#include <cmath>
+
+// カメラに合わせた操舵の詳しさ (level of detail) の段階
+enum class LodTier : unsigned char
+{
+    Full,    // 視野内でカメラに近い: 毎ステップ、半径内の全近傍で操舵する
+    Reduced, // 視野内で遠い: reducedInterval ステップごとに操舵し直す
+    Minimal, // 視野外、またはさらに遠い: minimalInterval ステップごとに、近傍を minimalNeighborCap 体ほどで打ち切って操舵する
+};
+constexpr int LOD_TIER_COUNT = 3;
+
+const char *lodTierName(LodTier tier);
+
+// カメラの位置と視錐台から、個体ごとの操舵の詳しさを決める設定 (Simulation::lod)
+// 間引いたステップは Simulation::steeringInterval と同じく前回の操舵の目標へ曲がるだけになる。
+// 間隔は steeringInterval と大きい方が使われ、個体の ID でずらして求め直す (staggeredSteering によらない)
+struct SteeringLod
+{
+    bool enabled = false;
+
+    // 描画側のカメラ (main.cpp が毎フレーム post() で渡す)
+    glm::vec3 cameraPos = glm::vec3(0.0f);
+    glm::mat4 viewProjection = glm::mat4(1.0f);
+
+    float fullDistance = 60.0f;     // 視野内でこれより近ければ Full
+    float reducedDistance = 90.0f;  // 視野内でこれより近ければ Reduced (これより遠ければ Minimal)
+    float frustumMargin = 0.2f;     // 視野の判定を正規化座標でこれだけ広げる (画面の端のすぐ外から入ってくる個体のため)
+    int reducedInterval = 2;
+    int minimalInterval = 8;
+    int minimalNeighborCap = 8;     // 0 なら打ち切らない
+
+    LodTier classify(const glm::vec3 &position) const
+    {
+        const glm::vec4 clip = viewProjection * glm::vec4(position, 1.0f);
+        const float limit = clip.w * (1.0f + frustumMargin);
+        const bool visible = clip.w > 0.0f && std::abs(clip.x) <= limit && std::abs(clip.y) <= limit &&
+                             std::abs(clip.z) <= limit;
+        if (!visible)
+            return LodTier::Minimal;
+        const glm::vec3 d = position - cameraPos;
+        const float distanceSq = glm::dot(d, d);
+        if (distanceSq < fullDistance * fullDistance)
+            return LodTier::Full;
+        if (distanceSq < reducedDistance * reducedDistance)
+            return LodTier::Reduced;
+        return LodTier::Minimal;
+    }
+
+    // その段階の個体が操舵し直す間隔
+    int interval(LodTier tier) const
+    {
+        switch (tier)
+        {
+        case LodTier::Reduced:
+            return reducedInterval;
+        case LodTier::Minimal:
+            return minimalInterval;
+        default:
+            return 1;
+        }
+    }
+};
+
+// 1ステップの段階ごとの個体数と、間引いたことで省けた時間の見積もり
+struct LodStats
+{
+    int count[LOD_TIER_COUNT] = {};
+    int refreshed[LOD_TIER_COUNT] = {}; // そのステップで近傍から操舵し直した個体
+    // LOD なしなら操舵し直していた個体のうち、間引いた数と、その分の操舵の時間の見積もり
+    // (操舵し直した個体1体あたりの操舵の時間 × 間引いた数。近傍の打ち切りで軽くなった分は含まない)
+    int skipped = 0;
+    double savedMs = 0.0;
+};
+
+#endif
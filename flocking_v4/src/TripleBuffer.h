@@ -0,0 +1,51 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+
+// 書き込み側1スレッドと読み出し側1スレッドの間で、最新の値だけを受け渡すトリプルバッファ (ロックなし)
+// 3つの枠を「書き込み中 (back)」「公開済み (middle)」「読み出し中 (front)」として持ち、
+// 公開と取得は middle の番号とのアトミックな交換だけで行う。どちらの側も相手を待たず、
+// 読み出し側は常に最後に公開された完全な値を読む (書き込み途中の値が見えることはない)。
+// 読み出しが追いつかなかった値は読まれずに上書きされる。
+// 枠は使い回すので、T が std::vector などを持つ場合も容量が育った後は確保が起きない。
+template <class T>
+class TripleBuffer
+{
+public:
+    // ---- 書き込み側 ----
+    // 次に公開する値を書く枠 (前に公開した値とは別の枠で、中身は2回前などの古い値)
+    T &back() { return slots[backIndex]; }
+    // back() に書いた値を公開し、空いている枠を新しい back() にする
+    void publish()
+    {
+        // release: back() への書き込みを、この交換より前に見えるようにする
+        const int previous = middle.exchange(backIndex | FRESH, std::memory_order_acq_rel);
+        backIndex = previous & INDEX_MASK;
+    }
+
+    // ---- 読み出し側 ----
+    // 前回の acquire() 以降に公開された値があれば front() をそれに入れ替えて true を返す
+    bool acquire()
+    {
+        if ((middle.load(std::memory_order_relaxed) & FRESH) == 0)
+            return false;
+        // acquire: 公開した側の書き込みが、入れ替えた front() の読み出しより前に見えるようにする
+        const int previous = middle.exchange(frontIndex, std::memory_order_acq_rel);
+        frontIndex = previous & INDEX_MASK;
+        return true;
+    }
+    // 最後に acquire() した値。次の acquire() までは書き込み側に触られない
+    const T &front() const { return slots[frontIndex]; }
+
+private:
+    static const int INDEX_MASK = 3;
+    static const int FRESH = 4; // middle が読み出し側にまだ渡していない値を持っている
+
+    T slots[3];
+    int backIndex = 0;           // 書き込み側だけが触る
+    int frontIndex = 1;          // 読み出し側だけが触る
+    std::atomic<int> middle{2};  // 枠の番号 | FRESH
+};
+
+#endif
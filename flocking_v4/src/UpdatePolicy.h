@@ -0,0 +1,167 @@
+#ifndef UPDATE_POLICY_H
+#define UPDATE_POLICY_H
+
+#include <glm/glm.hpp>
+
+#include "Collider.h"
+#include "Creature.h"
+#include "FlockKernel.h"
+
+// 1ステップの更新を組み立てる方針 (コンパイル時に選ぶ)
+// 壁の扱い・コライダーの処理・重みの引き方の組ごとに別の関数が実体化されるので、
+// 汎用の版が個体ごとに行っている分岐や表引きがなくなる (Simulation::specializedUpdate を参照)
+
+// ---- 箱の壁 ----
+// 移動のカーネルを選ぶだけで、どれも分岐のないカーネル (FlockKernelVariant.inl) になる
+
+struct ReflectBoundary
+{
+    static IntegrateKernel integrate(const FlockKernelSet &k) { return k.integrate; }
+};
+
+struct WrapBoundary
+{
+    static IntegrateKernel integrate(const FlockKernelSet &k) { return k.integrateWrap; }
+};
+
+struct OpenBoundary
+{
+    static IntegrateKernel integrate(const FlockKernelSet &k) { return k.integrateOpen; }
+};
+
+// ---- コライダー ----
+// collide は操舵の直後に1個体ずつ、collideRange は区間の全個体の操舵が済んでから next の配列に対して呼ばれる
+
+// コライダーなし
+struct NoColliders
+{
+    static void collide(glm::vec3 &, glm::vec3 &, const SphereCollider *, int) {}
+    static void collideRange(const FlockKernelSet &, const BoidArrays &, std::size_t, std::size_t,
+                             const SphereCollider *, int) {}
+};
+
+// 区間をまとめて、分岐のないカーネル (FlockKernelSet::collide) で個体方向にベクトル化して処理する
+// コライダーを外側のループにするので、コライダーの数は外側の回数になるだけで個体ごとの分岐は生まれない
+struct SphereColliders
+{
+    static void collide(glm::vec3 &, glm::vec3 &, const SphereCollider *, int) {}
+    static void collideRange(const FlockKernelSet &k, const BoidArrays &boids, std::size_t begin, std::size_t end,
+                             const SphereCollider *colliders, int count)
+    {
+        k.collide(boids, begin, end, colliders, count);
+    }
+};
+
+// 1個体ずつ、当たったコライダーだけ分岐して処理する (汎用の版)
+struct DynamicColliders
+{
+    static void collide(glm::vec3 &position, glm::vec3 &direction, const SphereCollider *colliders, int count)
+    {
+        for (int c = 0; c < count; ++c)
+        {
+            Creature::collide(position, direction, colliders[c]);
+        }
+    }
+    static void collideRange(const FlockKernelSet &, const BoidArrays &, std::size_t, std::size_t,
+                             const SphereCollider *, int) {}
+};
+
+// ---- 重み ----
+
+// speciesParams から引く (汎用の版。実行中に書き換えた値も反映される)
+struct TableGains
+{
+    static const SpeciesFlockGains &get(int species) { return Creature::flockGains(species); }
+};
+
+// DEFAULT_FLOCK_GAINS を定数として使う
+struct ConstexprGains
+{
+    static constexpr SpeciesFlockGains get(int species)
+    {
+        return DEFAULT_FLOCK_GAINS[species % DEFAULT_FLOCK_GAIN_COUNT];
+    }
+};
+
+// ---- 計算の精度 ----
+
+// 正確な版: 個体ごとに glm::normalize で操舵する
+struct ExactMath
+{
+    static constexpr bool batchedSteering = false;
+    static NeighborKernel neighbors(const FlockKernelSet &k) { return k.accumulateNeighbors; }
+};
+
+// 近似の逆数を使う版 (Simulation::fastMath)。近傍の合計を区間の全個体分集めてから、
+// 正規化を FlockKernelSet::steerFast でまとめて行う (個体ごとの Colliders::collide は呼ばれない)
+struct FastMath
+{
+    static constexpr bool batchedSteering = true;
+    static NeighborKernel neighbors(const FlockKernelSet &k) { return k.accumulateNeighborsFast; }
+};
+
+// 方針の組
+template <class BoundaryPolicy, class CollidersPolicy, class GainsPolicy, class MathPolicy = ExactMath>
+struct UpdatePolicy
+{
+    using Boundary = BoundaryPolicy;
+    using Colliders = CollidersPolicy;
+    using Gains = GainsPolicy;
+    using Math = MathPolicy;
+};
+
+// ---- Creature の更新 ----
+
+template <class Colliders, class Gains>
+void Creature::updateWith(FlockState &next, const SphereCollider *colliders, int colliderCount,
+                          const NeighborSource &source, NeighborKernel kernel, bool refreshSteering) const
+{
+    // 現在の状態から作業用の変数に読み出し、最後に next へまとめて書き込む
+    glm::vec3 position = state->position(index);
+    glm::vec3 direction = state->direction(index);
+    const glm::vec3 target = refreshSteering ? steeringTarget<Gains>(sumNeighbors(position, source, kernel), position)
+                                             : state->steering(index);
+    turnToward(target, direction);
+
+    // コライダーによる衝突と反射の処理 (区間でまとめて処理する方針では何もしない)
+    Colliders::collide(position, direction, colliders, colliderCount);
+
+    next.setPosition(index, position);
+    next.setDirection(index, direction);
+    next.setSteering(index, target);
+}
+
+template <class Gains>
+glm::vec3 Creature::steeringTarget(const NeighborSums &sums, const glm::vec3 &position) const
+{
+    glm::vec3 separation = sums.separation;
+    glm::vec3 alignment = sums.alignment;
+    glm::vec3 cohesion = sums.cohesion;
+    const int count = sums.count;
+
+    if (count == 0)
+        return glm::vec3(0.0f);
+
+    separation /= static_cast<float>(count);
+    alignment = glm::normalize(alignment / static_cast<float>(count));
+    cohesion = glm::normalize(cohesion / static_cast<float>(count) - position);
+
+    glm::vec3 steer = glm::vec3(0.0f);
+
+    const SpeciesFlockGains &params = Gains::get(state->speciesID[index]);
+
+    steer += separation * params.separation;
+    steer += alignment * params.alignment;
+    steer += cohesion * params.cohesion;
+    return glm::normalize(steer);
+}
+
+inline void Creature::turnToward(const glm::vec3 &target, glm::vec3 &direction) const
+{
+    if (target == glm::vec3(0.0f))
+        return;
+    // lerp (線形補間) を使用し、結果を正規化
+    direction = glm::normalize(glm::mix(direction, target, state->maxTurn[index]));
+}
+
+#endif
@@ -3,6 +3,14 @@
 #include <iostream>
 #include <vector>
 #include <memory>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <algorithm>
+#include <cmath>
 
 // OpenGL and GLFW
 #include <glad/glad.h>
@@ -15,14 +23,19 @@
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtx/quaternion.hpp> // This is the header that triggered the error
 
-// openMP for parallel
-#include <omp.h> // OpenMPのヘッダーを追加
-
 // Custom headers
 #include "Creature.h"
+#include "DistanceField.h"
+#include "DynamicObstacles.h"
+#include "MeshBvh.h"
+#include "Parallel.h"
+#include "Population.h"
 #include "Shader.h"
+#include "Simulation.h"
+#include "SimulationThread.h"
 
 #include "Collider.h"
+#include "Benchmark.h"
 
 // --- グローバル変数 ---
 // ウィンドウサイズ
@@ -43,12 +56,48 @@ bool firstMouse = true;
 float cameraSpeed = 0.1f; // カメラの移動速度
 float orbitRadius = glm::distance(cameraPos, cameraTarget);
 
-// 生物のリスト
-std::vector<std::unique_ptr<Creature>> creatures;
 const float CUBE_SIZE = 20.0f;
 
+// 生物の状態と更新処理
+// Gキー: 近傍探索をグリッド / 総当たりで切り替え
+// Pキー: 種族ごとのグリッド / 全種族共有のグリッドで切り替え
+// Vキー: 命令セット別のカーネル / スカラー版で切り替え
+Simulation simulation(CUBE_SIZE);
+// simulation は起動後は専用のスレッドで進め、描画は公開されたスナップショットを読む
+// (キー入力による設定の変更も post() でそのスレッドに頼む)
+SimulationThread simulationThread(simulation);
+bool gridKeyPressed = false;
+bool partitionKeyPressed = false;
+bool simdKeyPressed = false;
+bool neighborListKeyPressed = false;
+bool topologicalKeyPressed = false;
+bool fixedPointKeyPressed = false;
+bool boundaryKeyPressed = false;
+bool fastMathKeyPressed = false;
+bool parallelBackendKeyPressed = false;
+bool steeringIntervalKeyPressed = false;
+bool lodKeyPressed = false;
+bool stepRateKeyPressed = false;
+// Hキーで切り替える、1秒あたりのシミュレーションのステップ数
+const double STEP_RATES[] = {60.0, 30.0, 120.0};
+int stepRateIndex = 0;
+
+// 描画する各個体のモデル行列 (prepareCreatureModels で並列に計算する)
+std::vector<glm::mat4> creatureModels;
+
 // 球形コライダーのリスト
 std::vector<SphereCollider> colliders;
+DistanceField obstacleField; // --sdf のときに使う
+const int DISTANCE_FIELD_RESOLUTION = 96;
+// --mesh で読み込む三角形メッシュの障害物 (水槽の底に置く飾り)
+TriangleMesh obstacleMesh;
+MeshBvh obstacleBvh;
+const float OBSTACLE_MESH_SIZE = 12.0f; // 読み込んだメッシュの一番長い辺をこの長さにそろえる
+// --moving で水槽の中を周回させる球の障害物 (形は共通で、変換行列だけが違う)
+DynamicObstacles movingObstacles;
+TriangleMesh movingShape;
+const float MOVING_OBSTACLE_RADIUS = 2.5f;
+const float MOVING_ORBIT_SPEED = 0.002f; // 60 ステップ/秒の1ステップに回る角度 (ラジアン。外側の周回で個体と同じくらいの速さ)
 
 // VAO/VBO/EBO for Creature (円錐) - speciesIDごとに配列で管理
 unsigned int creatureVAOs[3];
@@ -68,6 +117,10 @@ unsigned int sphereVAO, sphereVBO, sphereEBO;
 int sphereIndexCount = 0;
 Shader *sphereShader = nullptr;
 
+// 三角形メッシュの障害物の VAO/VBO/EBO (球と同じシェーダーで描く)
+unsigned int meshVAO = 0, meshVBO = 0, meshEBO = 0;
+unsigned int movingVAO = 0, movingVBO = 0, movingEBO = 0; // 動く障害物 (movingShape を変換行列ごとに描く)
+
 unsigned int planeVAO = 0, planeVBO = 0;
 
 // シェーダープログラム
@@ -80,18 +133,59 @@ void framebuffer_size_callback(GLFWwindow *window, int width, int height);
 void mouse_callback(GLFWwindow *window, double xpos, double ypos);
 void scroll_callback(GLFWwindow *window, double xoffset, double yoffset);
 void processInput(GLFWwindow *window);
+bool keyPressedOnce(GLFWwindow *window, int key, bool &wasPressed);
 void updateCameraPosition(); // ★ New function prototype
 void setupCreatureMesh(float radius, float height, int speciesID);
 void setupBoxMesh();
-void renderCreature(const Creature &creature);
+glm::mat4 creatureModel(const glm::vec3 &position, const glm::vec3 &direction);
+void prepareCreatureModels(const FlockSnapshot &snapshot, float blend, std::vector<glm::mat4> &models);
+void renderCreature(const glm::mat4 &model, int speciesID);
 void renderBox(float size);
 void setupSphereMesh(float radius, int sectorCount, int stackCount);
 void generateSphereMesh(std::vector<float> &vertices, std::vector<unsigned int> &indices, float radius, int sectorCount, int stackCount);
 void setupPlane();
+void setupObstacleMesh(const TriangleMesh &mesh, unsigned int &vao, unsigned int &vbo, unsigned int &ebo);
+glm::mat4 movingObstacleTransform(int obstacle, int count, double time);
 void drawPlane(Shader &shader, const glm::mat4 &view, const glm::mat4 &projection);
 
-int main()
+int main(int argc, char **argv)
 {
+    // --bench: ウィンドウを開かずにシミュレーションのベンチマークだけを実行する
+    if (argc > 1 && std::string(argv[1]) == "--bench")
+    {
+        return runBenchmarks(argc - 2, argv + 2);
+    }
+
+    // --seed <n>: 群れの初期配置の乱数の種。指定しなければ起動ごとに変え、同じ群れを再現できるようログに出す
+    // --boids <n>: 全体の個体数。種族の比率 (450 : 30 : 50) はそのままにする
+    // --sdf: 球のコライダーを距離場 (DistanceField) に焼き込んで衝突判定に使う (bin/obstacles.sdf にキャッシュする)
+    // --mesh <file.obj>: 三角形メッシュを水槽の底に置き、個体は BVH への先読みの光線で手前から避ける
+    // --moving <n>: 水槽の中を周回する球の障害物を n 個置く。毎ステップ BVH を合わせ直し、崩れたら作り直す
+    std::uint64_t seed = std::random_device()();
+    long boids = 0;
+    bool useDistanceField = false;
+    std::string meshPath;
+    int movingCount = 0;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::string(argv[i]) == "--sdf")
+            useDistanceField = true;
+        if (i + 1 >= argc)
+            continue;
+        if (std::string(argv[i]) == "--seed")
+            seed = std::strtoull(argv[i + 1], nullptr, 10);
+        if (std::string(argv[i]) == "--boids")
+            boids = std::strtol(argv[i + 1], nullptr, 10);
+        if (std::string(argv[i]) == "--mesh")
+            meshPath = argv[i + 1];
+        if (std::string(argv[i]) == "--moving")
+            movingCount = std::max(0, static_cast<int>(std::strtol(argv[i + 1], nullptr, 10)));
+    }
+    auto scaledCount = [boids](int defaultCount)
+    {
+        return boids > 0 ? static_cast<int>(static_cast<double>(boids) * defaultCount / (450 + 30 + 50)) : defaultCount;
+    };
+
     // GLFW初期化
     if (!glfwInit())
     {
@@ -153,30 +247,123 @@ int main()
     setupCreatureMesh(0.3f, 1.2f, 2);
     setupBoxMesh();
 
-    // Creaturesの生成
-    for (int i = 0; i < 450; ++i)
+    // Creaturesの生成 (種族ごとの数と配置をまとめて渡し、並列に埋める)
+    const std::vector<SpawnGroup> spawnGroups = {
+        {0, scaledCount(450), SpawnDistribution::Uniform},
+        {1, scaledCount(30), SpawnDistribution::Uniform},
+        {2, scaledCount(50), SpawnDistribution::Uniform},
+    };
+    auto populationStart = std::chrono::steady_clock::now();
+    FlockState &flockState = simulation.population();
+    const PopulationTimings populationTimings = spawnPopulation(flockState, CUBE_SIZE, spawnGroups, seed);
+    auto finalizeStart = std::chrono::steady_clock::now();
+    simulation.finalizePopulation();
+    auto populationEnd = std::chrono::steady_clock::now();
+    std::cout << "Creatures: " << flockState.size()
+              << " (" << FlockState::bytesPerBoid() << " bytes/boid, seed " << seed << ")" << std::endl;
+    std::printf("Startup: %.2f ms (allocate %.2f ms, fill %.2f ms, finalize %.2f ms)\n",
+                std::chrono::duration<double, std::milli>(populationEnd - populationStart).count(),
+                populationTimings.allocateMs, populationTimings.fillMs,
+                std::chrono::duration<double, std::milli>(populationEnd - finalizeStart).count());
+    activeKernels(); // 使う命令セットをここで選んでログに出す
+    std::cout << "Parallel backend: " << parallelBackendName(parallel::backend())
+              << " (" << parallel::threadCount() << " threads)" << std::endl;
+
+    // シミュレーション時間の計測用 (新しいスナップショットを受け取ったときに足す)
+    double simTimeAccum = 0.0;
+    double gridBuildAccum = 0.0;
+    double steeringAccum = 0.0;
+    double lodSavedAccum = 0.0;
+    double obstacleRefitAccum = 0.0;   // 動く障害物の頂点の変換と BVH の合わせ直し
+    double obstacleRebuildAccum = 0.0; // 動く障害物の BVH の作り直し
+    int simFrameCount = 0;
+    int renderFrameCount = 0; // 前回のログから描いたフレーム数
+    long stepsDueAccum = 0;   // 前回のログから進めたステップ数
+    long lastSnapshotStep = 0;
+    bool lodTitleShown = false; // ウィンドウのタイトルに LOD の統計を出しているか
+
+    // Coliderの生成
+    colliders.push_back(SphereCollider(glm::vec3(5.0f, -15.0f, 0.0f), 3.0f));
+    colliders.push_back(SphereCollider(glm::vec3(-10.0f, -18.0f, 3.0f), 3.0f));
+
+    // 距離場を使うときは、コライダーは描画にだけ使い、シミュレーションには焼き込んだ距離場を渡す
+    std::vector<SphereCollider> simulationColliders = colliders;
+    if (useDistanceField)
     {
-        creatures.push_back(std::make_unique<Creature>(CUBE_SIZE, 0));
+        ObstacleSet obstacles;
+        for (const SphereCollider &collider : colliders)
+        {
+            obstacles.spheres.push_back(SphereObstacle{collider.center, collider.radius});
+        }
+        const bool cached = obstacleField.bakeOrLoad(obstacles, CUBE_SIZE, DISTANCE_FIELD_RESOLUTION, "bin/obstacles.sdf");
+        std::printf("Distance field: %d^3 nodes, %s in %.2f ms\n", obstacleField.getResolution(),
+                    cached ? "loaded from bin/obstacles.sdf" : "baked", obstacleField.getBakeMs());
+        simulation.obstacleField = &obstacleField;
+        simulationColliders.clear();
     }
-    for (int i = 0; i < 30; ++i)
+
+    if (!meshPath.empty())
     {
-        creatures.push_back(std::make_unique<Creature>(CUBE_SIZE, 1));
+        if (obstacleMesh.loadObj(meshPath))
+        {
+            // 一番長い辺を OBSTACLE_MESH_SIZE にして、底の中央に置く
+            glm::vec3 lo(obstacleMesh.vertices[0]), hi(obstacleMesh.vertices[0]);
+            for (const glm::vec3 &v : obstacleMesh.vertices)
+            {
+                lo = glm::min(lo, v);
+                hi = glm::max(hi, v);
+            }
+            const glm::vec3 extent = hi - lo;
+            const float scale = OBSTACLE_MESH_SIZE / std::max(extent.x, std::max(extent.y, std::max(extent.z, 1e-6f)));
+            const glm::vec3 bottomCenter(0.5f * (lo.x + hi.x), lo.y, 0.5f * (lo.z + hi.z));
+            obstacleMesh.transform(scale, glm::vec3(0.0f, -CUBE_SIZE, 0.0f) - bottomCenter * scale);
+            obstacleBvh.build({obstacleMesh});
+            std::printf("Mesh obstacle: %zu triangles from %s, BVH of %d nodes built in %.2f ms (SAH cost %.1f)\n",
+                        obstacleBvh.triangleCount(), meshPath.c_str(), obstacleBvh.nodeCount(), obstacleBvh.getBuildMs(),
+                        obstacleBvh.sahCost());
+            simulation.meshObstacles = &obstacleBvh;
+            setupObstacleMesh(obstacleMesh, meshVAO, meshVBO, meshEBO);
+        }
+        else
+        {
+            std::cerr << "Failed to load mesh: " << meshPath << std::endl;
+        }
     }
 
-    for (int i = 0; i < 50; ++i)
+    if (movingCount > 0)
     {
-        creatures.push_back(std::make_unique<Creature>(CUBE_SIZE, 2));
+        movingShape = TriangleMesh::sphere(glm::vec3(0.0f), MOVING_OBSTACLE_RADIUS, 24, 16);
+        for (int o = 0; o < movingCount; ++o)
+        {
+            movingObstacles.add(movingShape, movingObstacleTransform(o, movingCount, 0));
+        }
+        movingObstacles.update();
+        std::printf("Moving obstacles: %d spheres, %zu triangles, BVH built in %.2f ms\n", movingCount,
+                    movingObstacles.getBvh().triangleCount(), movingObstacles.getBvh().getBuildMs());
+        simulation.movingObstacles = &movingObstacles;
+        // 個体と同じく、刻みを変えても実時間での周回の速さが変わらないよう Simulation::getTimeScale() ずつ進める
+        simulation.moveObstacles = [movingCount, time = 0.0](DynamicObstacles &moving) mutable
+        {
+            time += simulation.getTimeScale();
+            for (int o = 0; o < movingCount; ++o)
+            {
+                moving.setTransform(o, movingObstacleTransform(o, movingCount, time));
+            }
+        };
+        setupObstacleMesh(movingShape, movingVAO, movingVBO, movingEBO);
     }
 
-    // Coliderの生成
-    colliders.push_back(SphereCollider(glm::vec3(5.0f, -15.0f, 0.0f), 3.0f));
-    colliders.push_back(SphereCollider(glm::vec3(-10.0f, -18.0f, 3.0f), 3.0f));
-
     setupSphereMesh(2.0f, 16, 16);
 
     Shader planeShader("bin/shaders/plane.vert", "bin/shaders/plane.frag");
     setupPlane();
 
+    // ここから先、シミュレーションは描画と並行して進む
+    // シミュレーションは描画のフレームレートによらず 1秒に 60 ステップ (Hキーで切り替え) の固定の刻みで進み、
+    // 描画は直前の2ステップの間を補間して描く
+    simulationThread.start(simulationColliders);
+    auto lastFrameTime = std::chrono::steady_clock::now();
+
     // メインループ
     while (!glfwWindowShouldClose(window))
     {
@@ -191,17 +378,88 @@ int main()
         glm::mat4 projection = glm::perspective(glm::radians(75.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 1000.0f);
         glm::mat4 view = glm::lookAt(cameraPos, cameraTarget, cameraUp);
 
-        // Creatureの更新
-        std::vector<Creature *> creaturePointers;
-        for (const auto &c_ptr : creatures)
+        // LOD の段階分けに使うカメラを、次のステップの前にシミュレーションのスレッドへ渡す
+        simulationThread.post([eye = cameraPos, viewProjection = projection * view](Simulation &sim)
+                              {
+            sim.lod.cameraPos = eye;
+            sim.lod.viewProjection = viewProjection; });
+
+        // 前のフレームからの経過時間の分だけシミュレーションを進め、描くスナップショットを受け取る
+        // (ワーカーはこの間に次のステップを計算する)
+        const auto frameTime = std::chrono::steady_clock::now();
+        const double frameSeconds = std::chrono::duration<double>(frameTime - lastFrameTime).count();
+        lastFrameTime = frameTime;
+        const RenderFrame frame = simulationThread.advance(frameSeconds);
+        const FlockSnapshot &renderState = *frame.snapshot;
+        renderFrameCount++;
+        stepsDueAccum += frame.stepsDue;
+
+        // 途中のスナップショットを読み飛ばした場合も、受け取ったステップの値で平均する
+        if (renderState.step != lastSnapshotStep)
         {
-            creaturePointers.push_back(c_ptr.get());
+            lastSnapshotStep = renderState.step;
+            simTimeAccum += renderState.stepMs;
+            gridBuildAccum += renderState.timings.gridBuildMs;
+            steeringAccum += renderState.timings.steeringMs;
+            lodSavedAccum += renderState.lod.savedMs;
+            obstacleRefitAccum += renderState.timings.obstacles.transformMs + renderState.timings.obstacles.refitMs;
+            obstacleRebuildAccum += renderState.timings.obstacles.rebuildMs;
+            simFrameCount++;
         }
 
-#pragma omp parallel for // 並列化
-        for (int i = 0; i < creatures.size(); ++i)
+        // LOD を使っている間は、段階ごとの個体数と省けた時間を毎フレームタイトルに出す
+        if (renderState.lodEnabled)
         {
-            creatures[i]->update(creaturePointers, CUBE_SIZE, colliders);
+            char title[160];
+            std::snprintf(title, sizeof(title),
+                          "Flocking Creatures C++ | LOD full %d, reduced %d, minimal %d | saved %.2f ms",
+                          renderState.lod.count[0], renderState.lod.count[1], renderState.lod.count[2],
+                          renderState.lod.savedMs);
+            glfwSetWindowTitle(window, title);
+            lodTitleShown = true;
+        }
+        else if (lodTitleShown)
+        {
+            glfwSetWindowTitle(window, "Flocking Creatures C++");
+            lodTitleShown = false;
+        }
+        if (simFrameCount == 120)
+        {
+            std::cout << "Sim step: " << simTimeAccum / simFrameCount << " ms"
+                      << " (search build " << gridBuildAccum / simFrameCount << " ms"
+                      << ", steering " << steeringAccum / simFrameCount << " ms)"
+                      << " (reorders: " << renderState.reorderCount
+                      << ", last " << renderState.lastReorderMs << " ms)" << std::endl;
+            std::cout << "  Fixed timestep: " << simulationThread.getStepRate() << " steps/s, "
+                      << static_cast<double>(stepsDueAccum) / renderFrameCount << " steps per rendered frame, "
+                      << frame.droppedSteps << " steps dropped in total" << std::endl;
+            if (renderState.useNeighborLists)
+            {
+                std::cout << "  Neighbor lists: " << renderState.neighborListRebuilds << " rebuilds, "
+                          << renderState.neighborListAmortizedMs << " ms/step amortized" << std::endl;
+            }
+            if (renderState.lodEnabled)
+            {
+                std::cout << "  LOD: full " << renderState.lod.count[0] << ", reduced " << renderState.lod.count[1]
+                          << ", minimal " << renderState.lod.count[2] << " boids, about "
+                          << lodSavedAccum / simFrameCount << " ms/step of steering saved" << std::endl;
+            }
+            if (!renderState.obstacleTransforms.empty())
+            {
+                std::cout << "  Moving obstacles: transform + refit " << obstacleRefitAccum / simFrameCount
+                          << " ms/step, rebuild " << obstacleRebuildAccum / simFrameCount << " ms/step amortized ("
+                          << renderState.obstacleRebuilds << " rebuilds, SAH ratio "
+                          << renderState.timings.obstacles.sahRatio << ")" << std::endl;
+            }
+            simTimeAccum = 0.0;
+            gridBuildAccum = 0.0;
+            steeringAccum = 0.0;
+            lodSavedAccum = 0.0;
+            obstacleRefitAccum = 0.0;
+            obstacleRebuildAccum = 0.0;
+            simFrameCount = 0;
+            renderFrameCount = 0;
+            stepsDueAccum = 0;
         }
 
         // --- レンダリング ---
@@ -209,9 +467,10 @@ int main()
         creatureShader->setMat4("projection", projection);
         creatureShader->setMat4("view", view);
 
-        for (const auto &c : creatures)
+        prepareCreatureModels(renderState, frame.blend, creatureModels);
+        for (std::size_t i = 0; i < renderState.size(); ++i)
         {
-            renderCreature(*c);
+            renderCreature(creatureModels[i], renderState.speciesID[i]);
         }
 
         // 球形コライダーの描画
@@ -231,6 +490,23 @@ int main()
             glBindVertexArray(sphereVAO);
             glDrawElements(GL_TRIANGLES, sphereIndexCount, GL_UNSIGNED_INT, 0);
         }
+        if (meshVAO != 0)
+        {
+            sphereShader->setMat4("model", glm::mat4(1.0f));
+            sphereShader->setVec3("color", glm::vec3(0.35f, 0.3f, 0.25f));
+            sphereShader->setFloat("alpha", 1.0f);
+            glBindVertexArray(meshVAO);
+            glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(obstacleMesh.indices.size()), GL_UNSIGNED_INT, 0);
+        }
+        // 動く障害物はそのステップの変換行列で描く (個体のようには補間しない)
+        for (const glm::mat4 &model : renderState.obstacleTransforms)
+        {
+            sphereShader->setMat4("model", model);
+            sphereShader->setVec3("color", glm::vec3(0.55f, 0.15f, 0.1f));
+            sphereShader->setFloat("alpha", 1.0f);
+            glBindVertexArray(movingVAO);
+            glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(movingShape.indices.size()), GL_UNSIGNED_INT, 0);
+        }
         glBindVertexArray(0);
 
         drawPlane(planeShader, view, projection);
@@ -244,6 +520,8 @@ int main()
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
+    simulationThread.stop();
+
     // リソースの解放
     glDeleteVertexArrays(2, creatureVAOs); // 配列で一括削除
     glDeleteBuffers(2, creatureVBOs);
@@ -256,6 +534,18 @@ int main()
     glDeleteVertexArrays(1, &sphereVAO);
     glDeleteBuffers(1, &sphereVBO);
     glDeleteBuffers(1, &sphereEBO);
+    if (meshVAO != 0)
+    {
+        glDeleteVertexArrays(1, &meshVAO);
+        glDeleteBuffers(1, &meshVBO);
+        glDeleteBuffers(1, &meshEBO);
+    }
+    if (movingVAO != 0)
+    {
+        glDeleteVertexArrays(1, &movingVAO);
+        glDeleteBuffers(1, &movingVBO);
+        glDeleteBuffers(1, &movingEBO);
+    }
 
     delete creatureShader;
     delete transparentBoxShader;
@@ -337,6 +627,165 @@ void processInput(GLFWwindow *window)
 {
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
+
+    // 以下の設定の変更は、シミュレーションのスレッドでステップの合間に行う
+
+    // Gキー: 近傍探索をグリッド → 八分木 → 総当たりの順に切り替える
+    if (keyPressedOnce(window, GLFW_KEY_G, gridKeyPressed))
+    {
+        simulationThread.post([](Simulation &sim)
+                              {
+            switch (sim.neighborBackend)
+            {
+            case NeighborBackend::Grid:
+                sim.neighborBackend = NeighborBackend::Octree;
+                break;
+            case NeighborBackend::Octree:
+                sim.neighborBackend = NeighborBackend::BruteForce;
+                break;
+            default:
+                sim.neighborBackend = NeighborBackend::Grid;
+                break;
+            }
+            std::cout << "Neighbor search: " << neighborBackendName(sim.neighborBackend) << std::endl; });
+    }
+
+    // Pキー: 種族ごとに分けて探索するかを切り替える
+    if (keyPressedOnce(window, GLFW_KEY_P, partitionKeyPressed))
+    {
+        simulationThread.post([](Simulation &sim)
+                              {
+            sim.partitionBySpecies = !sim.partitionBySpecies;
+            std::cout << "Species partitioning: " << (sim.partitionBySpecies ? "on" : "off") << std::endl; });
+    }
+
+    // Vキー: 命令セット別のカーネルとスカラー版を切り替える
+    if (keyPressedOnce(window, GLFW_KEY_V, simdKeyPressed))
+    {
+        simulationThread.post([](Simulation &sim)
+                              {
+            sim.kernels = sim.kernels ? nullptr : &scalarKernels();
+            std::cout << "Flock kernels: " << (sim.kernels ? sim.kernels->name : activeKernels().name) << std::endl; });
+    }
+
+    // Lキー: Verlet 近傍リストの使い回しを切り替える
+    if (keyPressedOnce(window, GLFW_KEY_L, neighborListKeyPressed))
+    {
+        simulationThread.post([](Simulation &sim)
+                              {
+            sim.useNeighborLists = !sim.useNeighborLists;
+            std::cout << "Neighbor lists: " << (sim.useNeighborLists ? "on" : "off") << std::endl; });
+    }
+
+    // Kキー: 半径内の全個体 / 近い順に 7 体だけ (トポロジカル) の相互作用を切り替える
+    if (keyPressedOnce(window, GLFW_KEY_K, topologicalKeyPressed))
+    {
+        simulationThread.post([](Simulation &sim)
+                              {
+            sim.topologicalNeighbors = sim.topologicalNeighbors > 0 ? 0 : 7;
+            if (sim.topologicalNeighbors > 0)
+                std::cout << "Neighbors: " << sim.topologicalNeighbors << " nearest (k-d tree)" << std::endl;
+            else
+                std::cout << "Neighbors: within radius " << FLOCK_RADIUS << std::endl; });
+    }
+
+    // Fキー: 浮動小数点 / 固定小数点 (ビット単位で再現できる) の更新を切り替える
+    if (keyPressedOnce(window, GLFW_KEY_F, fixedPointKeyPressed))
+    {
+        simulationThread.post([](Simulation &sim)
+                              {
+            sim.fixedPoint = !sim.fixedPoint;
+            std::cout << "Arithmetic: " << (sim.fixedPoint ? "fixed point" : "floating point") << std::endl; });
+    }
+
+    // Bキー: 箱の壁を反射 → 回り込み → なしの順に切り替える
+    if (keyPressedOnce(window, GLFW_KEY_B, boundaryKeyPressed))
+    {
+        simulationThread.post([](Simulation &sim)
+                              {
+            switch (sim.boundary)
+            {
+            case BoundaryMode::Reflect:
+                sim.boundary = BoundaryMode::Wrap;
+                break;
+            case BoundaryMode::Wrap:
+                sim.boundary = BoundaryMode::Open;
+                break;
+            default:
+                sim.boundary = BoundaryMode::Reflect;
+                break;
+            }
+            std::cout << "Boundary: " << boundaryModeName(sim.boundary) << std::endl; });
+    }
+
+    // Mキー: 正規化を正確に行う / 近似の逆数平方根で行う (fastMath) を切り替える
+    if (keyPressedOnce(window, GLFW_KEY_M, fastMathKeyPressed))
+    {
+        simulationThread.post([](Simulation &sim)
+                              {
+            sim.fastMath = !sim.fastMath;
+            std::cout << "Math: " << (sim.fastMath ? "fast (approximate rsqrt)" : "exact") << std::endl; });
+    }
+
+    // Nキー: 操舵を求め直す間隔を 1 → 2 → 4 → 8 ステップの順に切り替える (個体ごとにずらして求め直す)
+    if (keyPressedOnce(window, GLFW_KEY_N, steeringIntervalKeyPressed))
+    {
+        simulationThread.post([](Simulation &sim)
+                              {
+            sim.steeringInterval = sim.steeringInterval >= 8 ? 1 : sim.steeringInterval * 2;
+            std::cout << "Steering interval: every " << sim.steeringInterval << " steps"
+                      << (sim.steeringInterval > 1 && sim.staggeredSteering ? " (staggered)" : "") << std::endl; });
+    }
+
+    // Oキー: カメラに合わせた操舵の LOD (遠い個体・視野外の個体を間引く) を切り替える
+    if (keyPressedOnce(window, GLFW_KEY_O, lodKeyPressed))
+    {
+        simulationThread.post([](Simulation &sim)
+                              {
+            sim.lod.enabled = !sim.lod.enabled;
+            std::cout << "Steering LOD: " << (sim.lod.enabled ? "on" : "off") << std::endl; });
+    }
+
+    // Hキー: シミュレーションの刻みを 1秒に 60 → 30 → 120 ステップの順に切り替える
+    // 1ステップに進む距離と曲がる割合も刻みに合わせて変わるので、実時間での群れの動く速さは変わらない
+    if (keyPressedOnce(window, GLFW_KEY_H, stepRateKeyPressed))
+    {
+        stepRateIndex = (stepRateIndex + 1) % 3;
+        simulationThread.setStepRate(STEP_RATES[stepRateIndex]);
+        std::cout << "Simulation rate: " << simulationThread.getStepRate() << " steps/s" << std::endl;
+    }
+
+    // Tキー: 並列ループのバックエンドを、このビルドで使えるものの中で順に切り替える
+    if (keyPressedOnce(window, GLFW_KEY_T, parallelBackendKeyPressed))
+    {
+        simulationThread.post([](Simulation &)
+                              {
+            const ParallelBackend order[] = {ParallelBackend::OpenMP, ParallelBackend::StdExecution,
+                                             ParallelBackend::WorkStealing};
+            int current = 0;
+            while (order[current] != parallel::backend())
+                current++;
+            for (int k = 1; k <= 3; ++k)
+            {
+                const ParallelBackend next = order[(current + k) % 3];
+                if (parallel::available(next))
+                {
+                    parallel::setBackend(next);
+                    break;
+                }
+            }
+            std::cout << "Parallel backend: " << parallelBackendName(parallel::backend())
+                      << " (" << parallel::threadCount() << " threads)" << std::endl; });
+    }
+}
+
+// キーが押された瞬間だけ true を返す (押しっぱなしで毎フレーム反応しないように)
+bool keyPressedOnce(GLFWwindow *window, int key, bool &wasPressed)
+{
+    bool pressed = glfwGetKey(window, key) == GLFW_PRESS;
+    bool result = pressed && !wasPressed;
+    wasPressed = pressed;
+    return result;
 }
 
 // --- メッシュのセットアップとレンダリング関数 ---
@@ -415,7 +864,7 @@ void setupCreatureMesh(float radius, float height, int speciesID)
     creatureNumIndices[speciesID] = indices.size(); // 各種別のインデックス数を保存
 }
 
-void renderCreature(const Creature &creature)
+glm::mat4 creatureModel(const glm::vec3 &position, const glm::vec3 &direction)
 {
     // Model行列の計算
     // Three.jsの quat.setFromUnitVectors(new THREE.Vector3(0, -1, 0), this.direction);
@@ -425,16 +874,34 @@ void renderCreature(const Creature &creature)
     // Creatureの `direction` へ回転させるクォータニオンを計算します。
     // Creatureの速度が負の値だったので、その向きを反転させて (-direction) を使うことで、
     // 円錐の底面が進む方向に向くようにします。
-    glm::quat orientation = glm::rotation(glm::vec3(0.0f, 1.0f, 0.0f), glm::normalize(-creature.direction));
+    glm::quat orientation = glm::rotation(glm::vec3(0.0f, 1.0f, 0.0f), glm::normalize(-direction));
 
     glm::mat4 model = glm::mat4(1.0f);
-    model = glm::translate(model, creature.position);
+    model = glm::translate(model, position);
     model = model * glm::toMat4(orientation); // クォータニオンから行列に変換
+    return model;
+}
 
+// 描画の準備: 個体ごとのモデル行列を並列に計算しておく (GL の呼び出しはメインスレッドで順に行う)
+void prepareCreatureModels(const FlockSnapshot &snapshot, float blend, std::vector<glm::mat4> &models)
+{
+    models.resize(snapshot.size());
+    parallel::forRange(snapshot.size(), 1024, [&](std::size_t begin, std::size_t end)
+                       {
+                           for (std::size_t i = begin; i < end; ++i)
+                           {
+                               glm::vec3 position, direction;
+                               snapshot.interpolate(i, blend, position, direction);
+                               models[i] = creatureModel(position, direction);
+                           } });
+}
+
+void renderCreature(const glm::mat4 &model, int speciesID)
+{
     creatureShader->setMat4("model", model);
 
     glm::vec3 color;
-    switch (creature.speciesID)
+    switch (speciesID)
     {
     case 0:
         color = glm::vec3(0.8f, 0.8f, 1.0f);
@@ -452,8 +919,8 @@ void renderCreature(const Creature &creature)
     creatureShader->setVec3("creatureColor", color);
 
     // CreatureのspeciesIDに応じて適切なVAOとインデックス数をバインド
-    glBindVertexArray(creatureVAOs[creature.speciesID]);
-    glDrawElements(GL_TRIANGLES, creatureNumIndices[creature.speciesID], GL_UNSIGNED_INT, 0);
+    glBindVertexArray(creatureVAOs[speciesID]);
+    glDrawElements(GL_TRIANGLES, creatureNumIndices[speciesID], GL_UNSIGNED_INT, 0);
     glBindVertexArray(0);
 }
 void setupBoxMesh()
@@ -623,6 +1090,38 @@ void generateSphereMesh(std::vector<float> &vertices, std::vector<unsigned int>
     }
 }
 
+void setupObstacleMesh(const TriangleMesh &mesh, unsigned int &vao, unsigned int &vbo, unsigned int &ebo)
+{
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vbo);
+    glGenBuffers(1, &ebo);
+
+    glBindVertexArray(vao);
+
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, mesh.vertices.size() * sizeof(glm::vec3), mesh.vertices.data(), GL_STATIC_DRAW);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size() * sizeof(unsigned int), mesh.indices.data(), GL_STATIC_DRAW);
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void *)0);
+    glEnableVertexAttribArray(0);
+
+    glBindVertexArray(0);
+}
+
+// 動く障害物 obstacle の時刻 time (60 ステップ/秒のステップ数で数えた経過時間) での置き方。
+// count 個を周回の半径と高さをずらして回し、内側の方を速く回すので、周回ごとに互いを追い越して並びが入れ替わる
+glm::mat4 movingObstacleTransform(int obstacle, int count, double time)
+{
+    const float share = (obstacle + 0.5f) / count;
+    const float angle = MOVING_ORBIT_SPEED * static_cast<float>(time) * (1.5f - share) + 6.2831853f * share;
+    const float orbit = (0.25f + 0.5f * share) * CUBE_SIZE;
+    const glm::vec3 center(orbit * std::cos(angle), 0.5f * CUBE_SIZE * std::sin(1.7f * angle + obstacle),
+                           orbit * std::sin(angle));
+    return glm::rotate(glm::translate(glm::mat4(1.0f), center), 2.0f * angle, glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
 void setupPlane()
 {
     float planeVertices[] = {